@@ -0,0 +1,162 @@
+// shared asset cache: first load against repeated loads and copies, material libraries shared between
+// models, reloads after a file changes, lru eviction under a budget and concurrent loads of one file
+// usage: bench_assets [triangles] [--tmp DIR]
+#include "asset_manager.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+// a synthetic mesh whose groups all use one material of a shared library
+static bool writeMesh(const synthetic_mesh &mesh, const std::string &path) {
+    if (generateSyntheticMesh(mesh, path) == 0) return false;
+    std::stringstream contents;
+    {
+        std::ifstream in(path);
+        contents << in.rdbuf();
+    }
+    std::ofstream out(path);
+    out << "mtllib bench_assets.mtl\nusemtl red\n" << contents.rdbuf();
+    return (bool)out;
+}
+
+static void indexed(objLoader &model) {
+    model.setIndexed(true);
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 200000;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_assets [triangles] [--tmp DIR]", {&triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    {
+        std::ofstream library(tmp_dir + "/bench_assets.mtl");
+        library << "newmtl red\nKa 0.1 0 0\nKd 0.8 0 0\nKs 0.5 0.5 0.5\nNs 16\n";
+    }
+    const size_t file_count = 4;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < file_count; i++) {
+        // different sizes, so every file has its own contents
+        synthetic_mesh mesh = {triangles + i * 1000, true, true, false, 8};
+        paths.push_back(tmp_dir + "/bench_assets_" + std::to_string(i) + ".obj");
+        if (!writeMesh(mesh, paths.back())) return 1;
+    }
+    asset_manager assets;
+
+    // first load parses, later loads of the same file and options share it
+    // only a load that parses hands out the asset being parsed
+    mesh_handle parsed_first, parsed_again;
+    auto start = std::chrono::steady_clock::now();
+    mesh_handle first = assets.load(paths[0], indexed, [&](const mesh_handle &asset) { parsed_first = asset; });
+    double miss_ms = elapsedMs(start);
+    if (!first) return 1;
+    start = std::chrono::steady_clock::now();
+    mesh_handle again = assets.load(paths[0], indexed, [&](const mesh_handle &asset) { parsed_again = asset; });
+    double hit_ms = elapsedMs(start);
+    objLoader copy;
+    start = std::chrono::steady_clock::now();
+    copy.copyFrom(first -> model);
+    double copy_ms = elapsedMs(start);
+    printf("%zu triangles: load %.2f ms, cached %.3f ms, copy %.2f ms, %.1f MB\n",
+        copy.getIndexCount() / 3, miss_ms, hit_ms, copy_ms, first -> cpu_bytes / 1e6);
+    check(again == first, "a second load shares the first");
+    check(parsed_first == first && !parsed_again && first -> model.getLoadProgress() == 1.0f, "the parsed asset reports the progress");
+    check(assets.load(tmp_dir + "/./bench_assets_0.obj", indexed) == first, "paths are compared canonically");
+    check(assets.load(paths[0], nullptr) != first, "other options load another mesh");
+    check(copy.getVertexCount() > 0 && copy.getPackedVBOSize() == copy.getVertexCount() * copy.getVertexFormat().stride(), "the copy holds the buffers");
+    if (copy.getGroupIndices().size() > 0) {
+        const material &red = std::get<2>(copy.getGroupIndices()[0]);
+        check(red.diffuse.x == 0.8f && red.shininess == 16.0f, "materials come from the library");
+    }
+    copy.applyTransform(0, glm::mat4(2.0f));
+    check(first -> model.getVBOSize() == copy.getVBOSize(), "editing the copy leaves the cached mesh alone");
+
+    // the library is parsed once for every model
+    for (size_t i = 1; i < file_count; i++) check(assets.load(paths[i], indexed) != nullptr, "load " + paths[i]);
+    asset_stats stats = assets.getStats();
+    printf("meshes %zu  hits %zu  misses %zu  materials %zu  material hits %zu  misses %zu  %.1f MB\n", stats.meshes,
+        stats.mesh_hits, stats.mesh_misses, stats.materials, stats.material_hits, stats.material_misses, stats.cpu_bytes / 1e6);
+    check(stats.material_misses == 1 && stats.material_hits == file_count, "one material library parse");
+
+    // a changed file is loaded again, the old handle stays valid and so do the buffers it is drawn with
+    assets.setGPUMesh(first, gpu_mesh{21, 22, 23, 0});
+    {
+        std::ofstream out(paths[0], std::ios::app);
+        out << "# changed\n";
+    }
+    mesh_handle changed = assets.load(paths[0], indexed);
+    check(changed && changed != first && changed -> hash != first -> hash, "a changed file is loaded again");
+    check(first -> model.getVBOSize() > 0, "the old handle keeps its model");
+    std::vector<gpu_mesh> returned;
+    assets.takeEvicted(returned);
+    check(returned.empty(), "the buffers of a held old mesh are kept");
+    first.reset();
+    again.reset();
+    parsed_first.reset();
+    changed.reset();
+    assets.takeEvicted(returned);
+    check(returned.size() == 1 && returned[0].vao == 21, "they go back to the renderer once it is let go");
+
+    // room for two meshes: unused ones go oldest first, held ones never
+    size_t mesh_bytes = assets.getStats().cpu_bytes / assets.getStats().meshes;
+    mesh_handle held = assets.load(paths[1], indexed);
+    assets.load(paths[2], indexed);
+    assets.load(paths[3], indexed);
+    gpu_mesh gpu = {11, 12, 13, mesh_bytes / 4};
+    assets.setGPUMesh(assets.load(paths[3], indexed), gpu);
+    assets.setBudget(mesh_bytes * 5 / 2);
+    stats = assets.getStats();
+    printf("budget %.1f MB: meshes %zu  evictions %zu  gpu %zu  %.1f MB\n", assets.getBudget() / 1e6, stats.meshes,
+        stats.evictions, stats.gpu_evictions, (stats.cpu_bytes + stats.gpu_bytes) / 1e6);
+    check(stats.cpu_bytes + stats.gpu_bytes <= assets.getBudget(), "the cache fits the budget");
+    size_t misses = stats.mesh_misses;
+    check(assets.load(paths[3], indexed) != nullptr && assets.getStats().mesh_misses == misses, "the most recent mesh stays");
+    check(assets.getGPUMesh(assets.load(paths[3], indexed)).vao == 11, "its gpu buffers stay");
+    check(assets.load(paths[1], indexed) == held, "a held mesh stays");
+    assets.setBudget(0);
+    std::vector<gpu_mesh> evicted;
+    assets.takeEvicted(evicted);
+    check(evicted.size() == 1 && evicted[0].vbo == 12, "evicted gpu buffers go back to the renderer");
+    check(assets.getStats().meshes == 1, "only the held mesh is left");
+    held.reset();
+    assets.clearUnused();
+    check(assets.getStats().meshes == 0 && assets.getStats().cpu_bytes == 0, "nothing left once unused");
+
+    // threads loading the same file end up with one mesh
+    assets.setBudget((size_t)1 << 30);
+    std::vector<mesh_handle> results(4);
+    std::vector<std::thread> threads;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < results.size(); i++) threads.emplace_back([&, i]() { results[i] = assets.load(paths[2], indexed); });
+    for (auto &thread : threads) thread.join();
+    printf("%zu threads loading one file: %.2f ms\n", results.size(), elapsedMs(start));
+    for (auto &result : results) check(result && result == results[0], "concurrent loads share one mesh");
+
+    // an edited library makes cached meshes and mesh cache files stale although the .obj is the same
+    objLoader cached_model;
+    cached_model.setIndexed(true);
+    cached_model.setCacheEnabled(true);
+    if (!cached_model.load(paths[2]) || !cached_model.load(paths[2])) return 1;
+    check(cached_model.loadedFromCache(), "the mesh cache is used while nothing changed");
+    {
+        std::ofstream library(tmp_dir + "/bench_assets.mtl");
+        library << "newmtl red\nKa 0.1 0 0\nKd 0.4 0 0\nKs 0.5 0.5 0.5\nNs 16\n";
+    }
+    mesh_handle recolored = assets.load(paths[2], indexed);
+    check(recolored && recolored != results[0] && std::get<2>(recolored -> model.getGroupIndices()[0]).diffuse.x == 0.4f,
+        "a changed library reloads the mesh");
+    if (!cached_model.load(paths[2])) return 1;
+    check(!cached_model.loadedFromCache() && std::get<2>(cached_model.getGroupIndices()[0]).diffuse.x == 0.4f,
+        "a changed library bypasses the mesh cache");
+    std::remove((paths[2] + ".meshcache").c_str());
+
+    for (auto &path : paths) std::remove(path.c_str());
+    std::remove((tmp_dir + "/bench_assets.mtl").c_str());
+    return benchResult();
+}
@@ -0,0 +1,131 @@
+// background loading without a window: how often a 60 fps render loop gets to poll while a model loads,
+// with checks that a failed load leaves the current model alone, progress reaches 1 and a loader
+// can be started again once its result was taken, directly, through the asset cache and for openGroups
+// usage: bench_async [triangles] [--tmp DIR]
+#include "async_loader.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+static void configure(objLoader &model) {
+    model.setIndexed(true);
+    model.setCacheEnabled(false);
+}
+
+// poll like the viewer's render loop until the load is over, progress must never go back
+struct poll_result {
+    bool finished;
+    size_t frames;
+    bool monotonic;
+    float progress;
+    double ms;
+};
+
+static poll_result poll(async_loader &loader) {
+    const size_t max_frames = 60 * 60;
+    poll_result result = {false, 0, true, 0.0f, 0.0};
+    auto start = std::chrono::steady_clock::now();
+    float last = 0.0f;
+    while (result.frames < max_frames) {
+        async_load_state state = loader.getState();
+        float progress = loader.getProgress();
+        result.monotonic = result.monotonic && progress >= last && progress <= 1.0f;
+        last = progress;
+        if (state == ASYNC_DONE || state == ASYNC_FAILED) {
+            result.finished = true;
+            break;
+        }
+        result.frames++;
+        std::this_thread::sleep_for(std::chrono::microseconds(16667));
+    }
+    result.progress = loader.getProgress();
+    result.ms = elapsedMs(start);
+    return result;
+}
+
+static bool sameBuffers(const objLoader &a, const objLoader &b) {
+    return a.getVBOSize() == b.getVBOSize() && memcmp(a.getVBO(), b.getVBO(), a.getVBOSize()) == 0 &&
+        a.getIBOSize() == b.getIBOSize() && memcmp(a.getIBO(), b.getIBO(), a.getIBOSize()) == 0;
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 2000000;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_async [triangles] [--tmp DIR]", {&triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    synthetic_mesh mesh = {triangles, true, true, false, 16};
+    std::string path = tmp_dir + "/bench_async.obj";
+    std::string missing = tmp_dir + "/bench_async_missing.obj";
+    if (generateSyntheticMesh(mesh, path) == 0) return 1;
+    std::remove(missing.c_str());
+    std::remove((path + ".objindex").c_str());
+
+    objLoader reference;
+    configure(reference);
+    if (!reference.load(path)) return 1;
+
+    // the model on screen, loads only replace it through take
+    std::unique_ptr<objLoader> current(new objLoader());
+    configure(*current);
+    if (!current -> load(path)) return 1;
+    const objLoader *shown = current.get();
+
+    async_loader loader;
+    std::unique_ptr<objLoader> model;
+    mesh_handle asset;
+    check(loader.getState() == ASYNC_IDLE && loader.getProgress() == 0.0f, "idle before a load");
+    check(!loader.take(model, asset) && !model && !asset, "nothing to take before a load");
+
+    // a direct load, a second one is refused until the first is taken
+    check(loader.start(path, configure), "start");
+    check(!loader.start(path, configure) && !loader.startOpen(path, configure), "no second load while busy");
+    poll_result direct = poll(loader);
+    check(direct.finished && loader.getState() == ASYNC_DONE, "direct load finishes");
+    check(direct.monotonic && direct.progress == 1.0f, "direct load progress reaches 1");
+    check(!loader.start(path, configure), "no new load before take");
+    check(loader.take(model, asset) && model && !asset && loader.getState() == ASYNC_IDLE, "direct load is taken");
+    check(model && sameBuffers(*model, reference) && model -> getPackedVBOSize() > 0, "direct load matches a load and is packed");
+    if (model) current.swap(model);
+    shown = current.get();
+    check(!loader.take(model, asset) && !model && !asset, "a result is taken once");
+
+    // a file that does not exist fails without touching the model on screen
+    check(loader.start(missing, configure), "start a missing file");
+    poll_result failed = poll(loader);
+    check(failed.finished && loader.getState() == ASYNC_FAILED, "missing file fails");
+    check(failed.monotonic && failed.progress == 1.0f, "failed load progress reaches 1");
+    check(!loader.take(model, asset) && !model && !asset && loader.getState() == ASYNC_IDLE, "a failed load gives nothing");
+    check(current.get() == shown && sameBuffers(*current, reference), "a failed load keeps the current model");
+
+    // started again after a failure, the same file through the asset cache: parsed once, then shared
+    asset_manager assets;
+    loader.setAssetManager(&assets);
+    mesh_handle first;
+    check(loader.start(path, configure), "start again after a failure");
+    poll_result cached = poll(loader);
+    check(cached.finished && cached.monotonic && cached.progress == 1.0f, "cached load progress reaches 1");
+    check(loader.take(model, first) && !model && first && sameBuffers(first -> model, reference), "cached load hands out the shared model");
+    check(loader.start(path, configure), "start again after a take");
+    poll_result hit = poll(loader);
+    check(hit.finished && hit.monotonic && hit.progress == 1.0f, "cache hit progress reaches 1");
+    check(loader.take(model, asset) && asset == first, "a second load shares the cached model");
+    loader.setAssetManager(nullptr);
+
+    // opening the group index, the groups stay placeholders
+    check(loader.startOpen(path, configure), "start open");
+    poll_result open = poll(loader);
+    check(open.finished && open.monotonic && open.progress == 1.0f, "open progress reaches 1");
+    check(loader.take(model, asset) && model && !asset && model -> getGroupIndices().size() == reference.getGroupIndices().size() &&
+        !model -> isGroupLoaded(0), "open hands out the placeholders");
+
+    printf("%zu triangles: direct load %.1f ms over %zu frames, cached %.1f ms over %zu frames, hit %.1f ms, open %.1f ms\n",
+        reference.getIndexCount() / 3, direct.ms, direct.frames, cached.ms, cached.frames, hit.ms, open.ms);
+    std::remove(path.c_str());
+    std::remove((path + ".objindex").c_str());
+    return benchResult();
+}
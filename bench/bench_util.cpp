@@ -0,0 +1,48 @@
+#include "bench_util.h"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+static size_t failures = 0;
+
+// a whole positive decimal number, "--help" or "12k" are not
+static bool parseCount(const char *text, size_t &count) {
+    char *end = NULL;
+    count = std::strtoull(text, &end, 10);
+    return end != text && *end == '\0' && count > 0 && text[0] != '-';
+}
+
+bool parseBenchArgs(int argc, char **argv, const char *usage, const std::vector<size_t*> &counts, const std::vector<bench_option> &options) {
+    size_t positional = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const bench_option *matched = NULL;
+        for (const bench_option &option : options) {
+            if (arg == option.name) matched = &option;
+        }
+        bool ok;
+        if (matched) {
+            ok = i + 1 < argc;
+            if (ok && matched -> count) ok = parseCount(argv[++i], *matched -> count);
+            else if (ok) *matched -> text = argv[++i];
+        } else {
+            ok = positional < counts.size() && parseCount(argv[i], *counts[positional++]);
+        }
+        if (!ok) {
+            std::cerr << "usage: " << usage << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void check(bool ok, const std::string &what) {
+    if (ok) return;
+    failures++;
+    printf("FAILED: %s\n", what.c_str());
+}
+
+int benchResult() {
+    printf("%zu failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
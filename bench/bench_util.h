@@ -0,0 +1,23 @@
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// a --name VALUE option of a benchmark, either a positive number into count or any text into text
+struct bench_option {
+    const char *name;
+    size_t *count;
+    std::string *text;
+};
+
+// positional arguments fill counts in order and options their targets; anything else, a count that is
+// not a positive number or more positionals than counts prints usage and returns false
+bool parseBenchArgs(int argc, char **argv, const char *usage, const std::vector<size_t*> &counts, const std::vector<bench_option> &options);
+// a failed check is printed and counted
+void check(bool ok, const std::string &what);
+// print the number of failed checks, the exit status for main: 0 if every check passed
+int benchResult();
+
+#endif
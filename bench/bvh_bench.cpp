@@ -0,0 +1,194 @@
+// mesh_bvh build, refit and query throughput on a synthetic height field,
+// a sample of every query is checked against a brute force scan
+// usage: bench_bvh [triangles] [queries] [--tmp DIR]
+#include "mesh_bvh.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// triangles in element order, read the same way mesh_bvh does
+struct triangle_soup {
+    std::vector<glm::vec3> corners;
+    void read(objLoader &model) {
+        const float *vbo = model.getVBO();
+        size_t count = model.isIndexed() ? model.getIndexCount() : model.getVertexCount();
+        this -> corners.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            size_t vertex = i;
+            if (model.isIndexed()) {
+                vertex = model.getIndexSize() == sizeof(uint32_t) ? ((const uint32_t*)model.getIBO())[i] : ((const uint16_t*)model.getIBO())[i];
+            }
+            const float *p = vbo + vertex * VBO_FLOATS_PER_VERTEX;
+            this -> corners[i] = glm::vec3(p[0], p[1], p[2]);
+        }
+    }
+    size_t size() const { return this -> corners.size() / 3; }
+};
+
+// closest hit distance by testing every triangle, infinity on a miss
+static float bruteRaycast(const triangle_soup &soup, const glm::vec3 &origin, const glm::vec3 &dir) {
+    float best = INFINITY;
+    for (size_t t = 0; t < soup.size(); t++) {
+        const glm::vec3 &a = soup.corners[t * 3], &b = soup.corners[t * 3 + 1], &c = soup.corners[t * 3 + 2];
+        glm::vec3 e1 = b - a, e2 = c - a, p = glm::cross(dir, e2);
+        float det = glm::dot(e1, p);
+        if (std::fabs(det) < 1e-12f) continue;
+        glm::vec3 s = origin - a;
+        float u = glm::dot(s, p) / det;
+        if (u < 0.0f || u > 1.0f) continue;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(dir, q) / det;
+        if (v < 0.0f || u + v > 1.0f) continue;
+        float d = glm::dot(e2, q) / det;
+        if (d >= 0.0f && d < best) best = d;
+    }
+    return best;
+}
+
+// distance to the closest vertex is an upper bound, the bvh answer must not exceed the
+// true minimum, which is checked by sampling points on every triangle
+static float bruteNearestBound(const triangle_soup &soup, const glm::vec3 &point) {
+    float best = INFINITY;
+    const float w[7][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {0.5f, 0.5f, 0}, {0, 0.5f, 0.5f}, {0.5f, 0, 0.5f}, {1 / 3.0f, 1 / 3.0f, 1 / 3.0f}};
+    for (size_t t = 0; t < soup.size(); t++) {
+        for (int k = 0; k < 7; k++) {
+            glm::vec3 q = soup.corners[t * 3] * w[k][0] + soup.corners[t * 3 + 1] * w[k][1] + soup.corners[t * 3 + 2] * w[k][2];
+            best = std::min(best, glm::length(q - point));
+        }
+    }
+    return best;
+}
+
+static size_t bruteOverlap(const triangle_soup &soup, const glm::vec3 &lo, const glm::vec3 &hi) {
+    size_t count = 0;
+    for (size_t t = 0; t < soup.size(); t++) {
+        const glm::vec3 &a = soup.corners[t * 3], &b = soup.corners[t * 3 + 1], &c = soup.corners[t * 3 + 2];
+        glm::vec3 tlo = glm::min(a, glm::min(b, c)), thi = glm::max(a, glm::max(b, c));
+        if (tlo.x <= hi.x && thi.x >= lo.x && tlo.y <= hi.y && thi.y >= lo.y && tlo.z <= hi.z && thi.z >= lo.z) count++;
+    }
+    return count;
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 1000000;
+    size_t queries = 100000;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_bvh [triangles] [queries] [--tmp DIR]", {&triangles, &queries}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    // brute force checks scan every triangle, so only a few queries are checked
+    const size_t checked = 64;
+
+    synthetic_mesh mesh = {triangles, false, false, false, 64};
+    std::string path = tmp_dir + "/bench_bvh.obj";
+    if (generateSyntheticMesh(mesh, path) == 0) return 1;
+    objLoader model;
+    model.setIndexed(true);
+    bool loaded = model.load(path);
+    std::remove(path.c_str());
+    if (!loaded) return 1;
+
+    thread_pool pool;
+    mesh_bvh bvh;
+    auto start = std::chrono::steady_clock::now();
+    bvh.build(model);
+    double serial_ms = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    bvh.build(model, &pool);
+    double parallel_ms = elapsedMs(start);
+    std::cout << bvh.getTriangleCount() << " triangles, " << bvh.getNodeCount() << " nodes, " << queries << " queries" << std::endl;
+    std::cout << "build             " << serial_ms << " ms" << std::endl;
+    std::cout << "build x " << pool.size() + 1 << " threads  " << parallel_ms << " ms" << std::endl;
+
+    triangle_soup soup;
+    soup.read(model);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    // rays from above the height field, tilted a little, and rays from anywhere around it
+    std::vector<glm::vec3> origins(queries), directions(queries);
+    for (size_t i = 0; i < queries; i++) {
+        if (i % 2 == 0) {
+            origins[i] = glm::vec3(unit(rng), 1.0f, unit(rng));
+            directions[i] = glm::vec3(unit(rng) * 0.4f - 0.2f, -1.0f, unit(rng) * 0.4f - 0.2f);
+        } else {
+            origins[i] = glm::vec3(unit(rng) * 2.0f - 0.5f, unit(rng) * 2.0f - 1.0f, unit(rng) * 2.0f - 0.5f);
+            directions[i] = glm::vec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f);
+        }
+    }
+    size_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++) hits += bvh.raycast(origins[i], directions[i]).hit;
+    double ray_ms = elapsedMs(start);
+    size_t ray_errors = 0;
+    for (size_t i = 0; i < std::min(queries, checked); i++) {
+        bvh_hit hit = bvh.raycast(origins[i], directions[i]);
+        float expected = bruteRaycast(soup, origins[i], directions[i]);
+        if (hit.hit != std::isfinite(expected) || (hit.hit && std::fabs(hit.distance - expected) > 1e-4f * std::max(1.0f, expected))) ray_errors++;
+    }
+    std::cout << "raycast           " << ray_ms << " ms  " << queries / ray_ms * 1e3 << " rays/s  " << hits << " hits  " << ray_errors << " errors" << std::endl;
+
+    std::vector<glm::vec3> points(queries);
+    for (size_t i = 0; i < queries; i++) points[i] = glm::vec3(unit(rng) * 1.4f - 0.2f, unit(rng) * 0.4f - 0.2f, unit(rng) * 1.4f - 0.2f);
+    start = std::chrono::steady_clock::now();
+    double distance_sum = 0.0;
+    for (size_t i = 0; i < queries; i++) distance_sum += bvh.nearest(points[i]).distance;
+    double nearest_ms = elapsedMs(start);
+    size_t nearest_errors = 0;
+    for (size_t i = 0; i < std::min(queries, checked); i++) {
+        bvh_nearest found = bvh.nearest(points[i]);
+        // the true distance is at most the sampled bound, and the answer lies on the mesh
+        if (!found.found || found.distance > bruteNearestBound(soup, points[i]) + 1e-5f ||
+            bruteRaycast(soup, points[i], found.point - points[i]) < 1.0f - 1e-3f) nearest_errors++;
+    }
+    std::cout << "nearest           " << nearest_ms << " ms  " << queries / nearest_ms * 1e3 << " queries/s  mean distance " << distance_sum / queries << "  " << nearest_errors << " errors" << std::endl;
+
+    size_t overlapped = 0, overlap_errors = 0;
+    std::vector<size_t> found;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++) {
+        found.clear();
+        glm::vec3 size(0.01f);
+        bvh.overlap(points[i] - size, points[i] + size, found);
+        overlapped += found.size();
+    }
+    double overlap_ms = elapsedMs(start);
+    for (size_t i = 0; i < std::min(queries, checked); i++) {
+        found.clear();
+        glm::vec3 size(0.01f);
+        bvh.overlap(points[i] - size, points[i] + size, found);
+        if (found.size() != bruteOverlap(soup, points[i] - size, points[i] + size)) overlap_errors++;
+    }
+    std::cout << "overlap           " << overlap_ms << " ms  " << queries / overlap_ms * 1e3 << " queries/s  " << overlapped << " triangles  " << overlap_errors << " errors" << std::endl;
+
+    // move one group, refit only its leaves and compare with a rebuild and brute force
+    model.clearDirtyRanges();
+    model.applyTransform(0, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.3f, 0.0f)));
+    start = std::chrono::steady_clock::now();
+    bvh.refit(model, model.getDirtyRanges());
+    double refit_ms = elapsedMs(start);
+    soup.read(model);
+    size_t refit_errors = 0;
+    for (size_t i = 0; i < std::min(queries, checked); i++) {
+        bvh_hit hit = bvh.raycast(origins[i], directions[i]);
+        float expected = bruteRaycast(soup, origins[i], directions[i]);
+        if (hit.hit != std::isfinite(expected) || (hit.hit && std::fabs(hit.distance - expected) > 1e-4f * std::max(1.0f, expected))) refit_errors++;
+    }
+    start = std::chrono::steady_clock::now();
+    bvh.refit(model);
+    double full_refit_ms = elapsedMs(start);
+    std::cout << "refit one group   " << refit_ms << " ms  " << refit_errors << " errors" << std::endl;
+    std::cout << "refit all         " << full_refit_ms << " ms" << std::endl;
+    check(ray_errors == 0, "raycasts match a brute force scan");
+    check(nearest_errors == 0, "nearest points match a brute force scan");
+    check(overlap_errors == 0, "overlaps match a brute force scan");
+    check(refit_errors == 0, "raycasts after a refit match a brute force scan");
+    return benchResult();
+}
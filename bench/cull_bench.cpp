@@ -0,0 +1,191 @@
+// cluster building and frustum / normal cone culling on a synthetic height field,
+// the simd kernel is compared with the scalar one and every culled cluster is checked
+// against its triangles: all vertices outside one plane, or every triangle facing away
+// usage: bench_cull [triangles] [cluster triangles] [--tmp DIR]
+#include "frustum_culler.h"
+#include "obj_loader.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+static uint32_t elementAt(objLoader &model, size_t i) {
+    return model.getIndexSize() == sizeof(uint32_t) ? ((const uint32_t*)model.getIBO())[i] : ((const uint16_t*)model.getIBO())[i];
+}
+
+static glm::vec3 positionAt(objLoader &model, uint32_t vertex) {
+    const float *p = model.getVBO() + (size_t)vertex * VBO_FLOATS_PER_VERTEX;
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+// true when culling the triangles first .. first + count is safe for view
+static bool cullIsSafe(objLoader &model, size_t first, size_t count, const cull_view &view) {
+    const float epsilon = 1e-4f;
+    for (const glm::vec4 &plane : view.planes) {
+        bool outside = true;
+        for (size_t i = first; i < first + count && outside; i++) {
+            glm::vec3 p = positionAt(model, elementAt(model, i));
+            outside = glm::dot(glm::vec3(plane), p) + plane.w < epsilon;
+        }
+        if (outside) return true;
+    }
+    if (!view.backface) return false;
+    for (size_t i = first; i < first + count; i += 3) {
+        glm::vec3 a = positionAt(model, elementAt(model, i));
+        glm::vec3 n = glm::cross(positionAt(model, elementAt(model, i + 1)) - a, positionAt(model, elementAt(model, i + 2)) - a);
+        glm::vec3 to_camera = view.camera - a;
+        if (glm::dot(n, to_camera) > -epsilon * glm::length(n) * glm::length(to_camera)) return false;
+    }
+    return true;
+}
+
+// bounds have to contain every vertex they were built from
+static size_t boundsErrors(objLoader &model) {
+    size_t errors = 0;
+    const float epsilon = 1e-4f;
+    for (size_t g = 0; g < model.getGroupIndices().size(); g++) {
+        const mesh_bounds &bounds = model.getGroupBounds(g);
+        auto range = model.getGroupVertexRange(g);
+        for (size_t v = range.first; v < range.first + range.second; v++) {
+            glm::vec3 p = positionAt(model, v);
+            bool in_box = true;
+            for (int k = 0; k < 3; k++) in_box = in_box && p[k] >= bounds.min[k] && p[k] <= bounds.max[k];
+            if (!in_box || glm::length(p - glm::vec3(bounds.sphere)) > bounds.sphere.w + epsilon) errors++;
+        }
+    }
+    for (const group_cluster &cluster : model.getClusters()) {
+        for (size_t i = cluster.first; i < cluster.first + cluster.count; i++) {
+            glm::vec3 p = positionAt(model, elementAt(model, i));
+            if (glm::length(p - glm::vec3(cluster.bounds.sphere)) > cluster.bounds.sphere.w + epsilon) errors++;
+        }
+    }
+    return errors;
+}
+
+// clusters have to tile every group's index range in order
+static size_t coverageErrors(objLoader &model) {
+    size_t errors = 0;
+    const std::vector<group_cluster> &clusters = model.getClusters();
+    for (size_t g = 0; g < model.getGroupIndices().size(); g++) {
+        auto range = model.getGroupRange(g);
+        auto cluster_range = model.getGroupClusters(g);
+        size_t next = range.first;
+        for (size_t c = cluster_range.first; c < cluster_range.first + cluster_range.second; c++) {
+            if (clusters[c].group != g || clusters[c].first != next || clusters[c].count % 3 != 0) errors++;
+            next = clusters[c].first + clusters[c].count;
+        }
+        if (next != range.first + range.second) errors++;
+    }
+    return errors;
+}
+
+static void fillCuller(objLoader &model, frustum_culler &culler) {
+    culler.clear();
+    for (const group_cluster &cluster : model.getClusters()) culler.add(cluster.bounds.sphere, cluster.cone);
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 1000000;
+    size_t cluster_triangles = 64;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_cull [triangles] [cluster triangles] [--tmp DIR]", {&triangles, &cluster_triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    const size_t views = 64;
+    const size_t repeats = 100;
+
+    synthetic_mesh mesh = {triangles, false, false, false, 16};
+    std::string path = tmp_dir + "/bench_cull.obj";
+    if (generateSyntheticMesh(mesh, path) == 0) return 1;
+    objLoader model;
+    model.setIndexed(true);
+    bool loaded = model.load(path);
+    std::remove(path.c_str());
+    if (!loaded) return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    model.buildClusters(cluster_triangles);
+    double cluster_ms = elapsedMs(start);
+    size_t coverage_errors = coverageErrors(model);
+    size_t bounds_errors = boundsErrors(model);
+    frustum_culler culler;
+    fillCuller(model, culler);
+    std::cout << model.getIndexCount() / 3 << " triangles, " << culler.size() << " clusters of " << cluster_triangles << ", "
+        << frustum_culler::kernelName() << " kernel" << std::endl;
+    std::cout << "build clusters    " << cluster_ms << " ms  " << coverage_errors << " coverage errors  " << bounds_errors << " bounds errors" << std::endl;
+
+    // cameras around and below the height field, looking somewhere near it
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f, 100.0f);
+    std::vector<cull_view> cull_views;
+    for (size_t i = 0; i < views; i++) {
+        glm::vec3 eye(unit(rng) * 3.0f - 1.0f, unit(rng) * 2.0f - 1.0f, unit(rng) * 3.0f - 1.0f);
+        glm::vec3 target(unit(rng), 0.0f, unit(rng));
+        glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 model_matrix = glm::rotate(glm::mat4(1.0f), unit(rng) * 0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+        cull_views.push_back(makeCullView(projection, view, model_matrix, i % 2 == 1));
+    }
+
+    std::vector<uint32_t> visible, reference;
+    size_t kernel_errors = 0, unsafe_culls = 0, visible_total = 0;
+    for (const cull_view &view : cull_views) {
+        culler.cull(view, visible);
+        culler.cullScalar(view, reference);
+        if (visible != reference) kernel_errors++;
+        visible_total += visible.size();
+        // every cluster missing from the visible list was culled
+        size_t next = 0;
+        for (size_t c = 0; c < culler.size(); c++) {
+            if (next < visible.size() && visible[next] == c) {
+                next++;
+                continue;
+            }
+            const group_cluster &cluster = model.getClusters()[c];
+            if (!cullIsSafe(model, cluster.first, cluster.count, view)) unsafe_culls++;
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; r++) {
+        for (const cull_view &view : cull_views) culler.cull(view, visible);
+    }
+    double cull_us = elapsedMs(start) * 1e3 / (repeats * views);
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; r++) {
+        for (const cull_view &view : cull_views) culler.cullScalar(view, visible);
+    }
+    double scalar_us = elapsedMs(start) * 1e3 / (repeats * views);
+    std::cout << "cull              " << cull_us << " us per view  " << (double)visible_total / views << " of " << culler.size() << " visible  "
+        << kernel_errors << " kernel mismatches  " << unsafe_culls << " unsafe culls" << std::endl;
+    std::cout << "cull scalar       " << scalar_us << " us per view" << std::endl;
+
+    // bounds and cones follow a transform of one group
+    model.applyTransform(0, glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.3f, 0.0f)), 1.0f, glm::vec3(1.0f, 0.0f, 0.0f)));
+    size_t transform_errors = boundsErrors(model);
+    fillCuller(model, culler);
+    for (const cull_view &view : cull_views) {
+        culler.cull(view, visible);
+        size_t next = 0;
+        for (size_t c = 0; c < culler.size(); c++) {
+            if (next < visible.size() && visible[next] == c) {
+                next++;
+                continue;
+            }
+            const group_cluster &cluster = model.getClusters()[c];
+            if (!cullIsSafe(model, cluster.first, cluster.count, view)) transform_errors++;
+        }
+    }
+    std::cout << "after transform   " << transform_errors << " errors" << std::endl;
+    check(coverage_errors == 0, "clusters tile every group in order");
+    check(bounds_errors == 0, "group and cluster bounds hold their vertices");
+    check(kernel_errors == 0, "the simd kernel matches the scalar one");
+    check(unsafe_culls == 0, "culled clusters are not visible");
+    check(transform_errors == 0, "bounds and cones follow a group transform");
+    return benchResult();
+}
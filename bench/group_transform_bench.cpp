@@ -0,0 +1,160 @@
+// group transforms kept next to the vertices against transforms baked into them: the cost of one edit
+// for growing meshes, save baking the transforms like applyTransform, drift of repeated baked edits,
+// and bounds and picking through the transforms
+// usage: bench_group_transform [triangles] [--tmp DIR]
+#include "obj_loader.h"
+#include "mesh_bvh.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+static std::string readFile(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+static glm::mat4 editMatrix(size_t step) {
+    return glm::translate(glm::mat4(1.0f), glm::vec3(0.01f * step, 0.5f, 0.0f)) *
+        glm::rotate(glm::mat4(1.0f), glm::radians(0.5f * step), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 2000000;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_group_transform [triangles] [--tmp DIR]", {&triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    const size_t groups = 16;
+    std::string path = tmp_dir + "/bench_group_transform.obj";
+
+    // an edit of the largest group, the baked edit also counts the bytes to upload again
+    for (size_t size = std::max<size_t>(triangles / 64, 1000); ; size *= 4) {
+        size = std::min(size, triangles);
+        synthetic_mesh mesh = {size, true, false, false, groups};
+        if (generateSyntheticMesh(mesh, path) == 0) return 1;
+        objLoader model;
+        model.setIndexed(true);
+        if (!model.load(path)) return 1;
+        const size_t edits = 1000;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < edits; i++) model.setGroupTransform(0, editMatrix(i));
+        double set_us = elapsedMs(start) * 1000.0 / edits;
+        start = std::chrono::steady_clock::now();
+        model.applyTransform(0, editMatrix(1));
+        double bake_ms = elapsedMs(start);
+        size_t dirty = 0;
+        for (const auto &range : model.getDirtyRanges()) dirty += range.second * model.getVertexFormat().stride();
+        printf("%9zu triangles: set transform %.3f us, applyTransform %.3f ms and %.2f MB to upload\n",
+            model.getIndexCount() / 3, set_us, bake_ms, dirty / 1e6);
+        if (size == triangles) break;
+    }
+
+    synthetic_mesh mesh = {std::min<size_t>(triangles, 200000), true, true, false, groups};
+    if (generateSyntheticMesh(mesh, path) == 0) return 1;
+    objLoader model, baked;
+    model.setIndexed(true);
+    baked.setIndexed(true);
+    if (!model.load(path) || !baked.load(path)) return 1;
+    std::vector<float> original(model.getVBO(), model.getVBO() + model.getVBOSize() / sizeof(float));
+
+    // save bakes the group transforms the way applyTransform does, the model keeps its vertices
+    std::vector<std::pair<size_t, glm::mat4>> transforms;
+    for (size_t g = 0; g < model.getGroupIndices().size(); g += 3) {
+        glm::mat4 transform = glm::scale(editMatrix(g * 7), glm::vec3(1.0f + 0.1f * g));
+        model.setGroupTransform(g, transform);
+        transforms.push_back(std::make_pair(g, transform));
+    }
+    baked.applyTransforms(transforms);
+    std::string model_path = tmp_dir + "/bench_group_transform_model.obj";
+    std::string baked_path = tmp_dir + "/bench_group_transform_baked.obj";
+    auto start = std::chrono::steady_clock::now();
+    if (!model.save(model_path)) return 1;
+    double save_ms = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    if (!baked.save(baked_path)) return 1;
+    double plain_save_ms = elapsedMs(start);
+    printf("save %.1f ms with %zu group transforms, %.1f ms baked before\n", save_ms, transforms.size(), plain_save_ms);
+    // past the mtllib line, which names the file
+    std::string saved = readFile(model_path), expected = readFile(baked_path);
+    check(saved.substr(saved.find('\n')) == expected.substr(expected.find('\n')), "saving bakes the group transforms");
+    check(memcmp(original.data(), model.getVBO(), model.getVBOSize()) == 0, "saving leaves the vertices as they were");
+    check(model.hasGroupTransforms() && !baked.hasGroupTransforms(), "only set transforms count");
+    for (const std::string &file : {model_path, baked_path}) {
+        std::remove(file.c_str());
+        std::remove((file.substr(0, file.size() - 4) + ".mtl").c_str());
+    }
+
+    // many small baked edits pile up rounding, the kept transform is set exactly
+    {
+        objLoader drifting;
+        drifting.setIndexed(true);
+        if (!drifting.load(path)) return 1;
+        glm::mat4 step = glm::rotate(glm::mat4(1.0f), glm::radians(1.0f), glm::vec3(0.3f, 1.0f, 0.2f));
+        for (int i = 0; i < 360; i++) drifting.applyTransform(1, step);
+        auto range = drifting.getGroupVertexRange(1);
+        float drift = 0.0f;
+        for (size_t v = range.first; v < range.first + range.second; v++) {
+            for (int k = 0; k < 3; k++) drift = std::max(drift, std::fabs(drifting.getVBO()[v * VBO_FLOATS_PER_VERTEX + k] - original[v * VBO_FLOATS_PER_VERTEX + k]));
+        }
+        printf("360 baked edits of 1 degree move vertices by up to %.2e\n", drift);
+    }
+
+    // a group named twice in one call gets both transforms in order, as with two calls
+    {
+        objLoader once, twice;
+        once.setIndexed(true);
+        twice.setIndexed(true);
+        if (!once.load(path) || !twice.load(path)) return 1;
+        glm::mat4 turn = editMatrix(3), shift = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f));
+        once.applyTransforms({{1, turn}, {2, shift}, {1, shift}});
+        twice.applyTransform(1, turn);
+        twice.applyTransform(2, shift);
+        twice.applyTransform(1, shift);
+        float difference = 0.0f;
+        for (size_t i = 0; i < once.getVertexCount() * VBO_FLOATS_PER_VERTEX; i++) {
+            difference = std::max(difference, std::fabs(once.getVBO()[i] - twice.getVBO()[i]) / (1.0f + std::fabs(twice.getVBO()[i])));
+        }
+        check(difference < 1e-5f, "a repeated group gets its transforms in order");
+    }
+
+    // bounds and picking follow the transforms
+    size_t outside = 0;
+    for (size_t g = 0; g < model.getGroupIndices().size(); g++) {
+        const glm::mat4 &transform = model.getGroupTransform(g);
+        mesh_bounds bounds = transformBounds(model.getGroupBounds(g), transform);
+        auto range = model.getGroupVertexRange(g);
+        for (size_t v = range.first; v < range.first + range.second; v++) {
+            const float *p = model.getVBO() + v * VBO_FLOATS_PER_VERTEX;
+            glm::vec3 moved = glm::vec3(transform * glm::vec4(p[0], p[1], p[2], 1.0f));
+            float slack = 1e-4f * (1.0f + glm::length(moved));
+            bool in_box = true;
+            for (int k = 0; k < 3; k++) in_box = in_box && moved[k] >= bounds.min[k] - slack && moved[k] <= bounds.max[k] + slack;
+            if (!in_box || glm::length(moved - glm::vec3(bounds.sphere)) > bounds.sphere.w + slack) outside++;
+        }
+    }
+    check(outside == 0, "transformed bounds hold the transformed vertices");
+    model.setGroupTransform(5, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 10.0f, 0.0f)));
+    mesh_bvh bvh;
+    bvh.build(model);
+    glm::vec3 center = glm::vec3(transformBounds(model.getGroupBounds(5), model.getGroupTransform(5)).sphere);
+    bvh_hit hit = bvh.raycast(center + glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), 10.0f);
+    check(hit.hit && hit.group == 5, "picking finds the moved group");
+    model.setGroupTransform(5, glm::mat4(1.0f));
+    bvh.refit(model);
+    hit = bvh.raycast(center + glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), 10.0f);
+    check(!hit.hit, "picking misses where the group was after a refit");
+    std::remove(path.c_str());
+
+    return benchResult();
+}
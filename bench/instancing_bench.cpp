@@ -0,0 +1,389 @@
+// many copies of one model drawn headless through EGL (Mesa llvmpipe works): one draw list per copy
+// with a model uniform against instanced draws reading the transforms from an instance_buffer,
+// both frames are compared pixel by pixel, and the dirty span of the buffer upload is checked;
+// a group transform drawn by both paths is compared with the same transform baked into the vertices,
+// and a white diffuse map is compared with no map and a black one
+// usage: bench_instancing [copies] [--model FILE] [--frames N]
+// run headless with EGL_PLATFORM=surfaceless, LIBGL_ALWAYS_SOFTWARE=1 forces llvmpipe
+#include "draw_list.h"
+#include "instance_buffer.h"
+#include "gpu_textures.h"
+#include "load_stats.h"
+#include "bench_util.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static const int width = 640;
+static const int height = 480;
+// a GL 3.3 core context without any surface, frames go to a framebuffer object
+static bool createContext() {
+    EGLDisplay display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+    if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) return false;
+    // the default surface type is window, which a surfaceless display has none of
+    const EGLint config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) return false;
+    if (!eglBindAPI(EGL_OPENGL_API)) return false;
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE,
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT) return false;
+    return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+static std::string readFile(const std::string &path) {
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+static GLuint compileShader(GLenum type, const std::string &path) {
+    std::string source = readFile(path);
+    const char *text = source.c_str();
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Shader compilation failed: " << path << ": " << log << std::endl;
+    }
+    return shader;
+}
+
+static GLuint createProgram(const std::string &vertex, const std::string &fragment) {
+    GLuint program = glCreateProgram();
+    GLuint vertex_shader = compileShader(GL_VERTEX_SHADER, vertex);
+    GLuint fragment_shader = compileShader(GL_FRAGMENT_SHADER, fragment);
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success ? program : 0;
+}
+
+static GLenum componentType(vertex_component_type type) {
+    switch (type) {
+        case COMPONENT_HALF: return GL_HALF_FLOAT;
+        case COMPONENT_SHORT: return GL_SHORT;
+        case COMPONENT_BYTE: return GL_BYTE;
+        default: return GL_FLOAT;
+    }
+}
+
+static GLuint createVAO(objLoader &model, GLuint buffers[2]) {
+    GLuint VAO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(2, buffers);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, model.getPackedVBOSize(), model.getPackedVBO(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.getIBOSize(), model.getIBO(), GL_STATIC_DRAW);
+    const vertex_format &format = model.getVertexFormat();
+    for (const vertex_attribute &attr : format.attributes()) {
+        glVertexAttribPointer(attr.location, attr.components, componentType(attr.type), GL_FALSE, format.stride(), (void*)attr.offset);
+        glEnableVertexAttribArray(attr.location);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return VAO;
+}
+
+static void setCommonUniforms(const model_uniforms &uniforms, objLoader &model, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye) {
+    glUniformMatrix4fv(uniforms.view, 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(uniforms.projection, 1, GL_FALSE, &projection[0][0]);
+    glUniform3f(uniforms.light_pos, 0.0f, 50.0f, 50.0f);
+    glUniform3f(uniforms.light_color, 1.0f, 1.0f, 1.0f);
+    glUniform3f(uniforms.view_pos, eye.x, eye.y, eye.z);
+    glUniform1f(uniforms.normal_oct_scale, model.getVertexFormat().normalScale());
+}
+
+// a square binary ppm of one color
+static bool writeImage(const std::string &path, unsigned char value) {
+    std::vector<unsigned char> pixels(4 * 4 * 3, value);
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n4 4\n255\n";
+    out.write((const char *)pixels.data(), pixels.size());
+    return (bool)out;
+}
+
+static std::vector<unsigned char> readFrame() {
+    std::vector<unsigned char> pixels(width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    return pixels;
+}
+
+// pixels with a channel more than tolerance apart
+static size_t differentPixels(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b, int tolerance) {
+    size_t different = 0;
+    for (size_t i = 0; i < a.size(); i += 4) {
+        for (size_t c = 0; c < 3; c++) {
+            if (std::abs((int)a[i + c] - (int)b[i + c]) > tolerance) {
+                different++;
+                break;
+            }
+        }
+    }
+    return different;
+}
+
+int main(int argc, char **argv) {
+    size_t copies = 1000;
+    size_t frames = 10;
+    std::string path = "res/model/shuttle/shuttle.obj";
+    if (!parseBenchArgs(argc, argv, "bench_instancing [copies] [--model FILE] [--frames N]", {&copies},
+        {{"--model", NULL, &path}, {"--frames", &frames, NULL}})) return 1;
+    if (!createContext()) {
+        std::cerr << "Cannot create an EGL context" << std::endl;
+        return 1;
+    }
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // glew built for GLX finds no X display under EGL, the core entry points are loaded all the same
+    if (status == GLEW_ERROR_NO_GLX_DISPLAY) status = GLEW_OK;
+#endif
+    if (status != GLEW_OK) {
+        std::cerr << "Failed to initialize GLEW" << std::endl;
+        return 1;
+    }
+    printf("%s\n", (const char*)glGetString(GL_RENDERER));
+
+    GLuint framebuffer, renderbuffers[2];
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) return 1;
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+
+    objLoader model;
+    model.setIndexed(true);
+    if (!model.load(path) || model.getGroupIndices().empty()) return 1;
+    GLuint buffers[2];
+    GLuint VAO = createVAO(model, buffers);
+    GLuint program = createProgram("res/shader/model.vs", "res/shader/model.fs");
+    GLuint instanced_program = createProgram("res/shader/model_instanced.vs", "res/shader/model.fs");
+    check(program != 0 && instanced_program != 0, "the shaders link");
+    if (program == 0 || instanced_program == 0) return 1;
+    draw_list loop_list, instanced_list;
+    loop_list.setProgram(program);
+    instanced_list.setProgram(instanced_program);
+    loop_list.update(model);
+    instanced_list.update(model);
+
+    // copies on a square grid seen from above, each scaled to a unit sphere
+    mesh_bounds bounds = model.getGroupBounds(0);
+    for (size_t i = 1; i < model.getGroupIndices().size(); i++) {
+        bounds.min = glm::min(bounds.min, model.getGroupBounds(i).min);
+        bounds.max = glm::max(bounds.max, model.getGroupBounds(i).max);
+    }
+    glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float unit = 2.0f / std::max(glm::length(bounds.max - bounds.min), 1e-6f);
+    size_t side = (size_t)std::ceil(std::sqrt((double)copies));
+    float extent = side * 1.2f;
+    glm::vec3 eye(0.0f, extent * 0.9f, extent * 0.9f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, extent * 4.0f);
+    std::vector<glm::mat4> transforms(copies);
+    auto place = [&](size_t frame) {
+        for (size_t i = 0; i < copies; i++) {
+            glm::vec3 cell(((i % side) - (side - 1) * 0.5f) * 1.2f, 0.0f, ((i / side) - (side - 1) * 0.5f) * 1.2f);
+            glm::mat4 spin = glm::rotate(glm::mat4(1.0f), glm::radians((float)(frame * 7 + i * 13)), glm::vec3(0.0f, 1.0f, 0.0f));
+            transforms[i] = glm::translate(glm::mat4(1.0f), cell) * spin * glm::scale(glm::mat4(1.0f), glm::vec3(unit)) * glm::translate(glm::mat4(1.0f), -center);
+        }
+    };
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    std::vector<unsigned char> empty_frame = readFrame();
+
+    // one model uniform and one draw list per copy
+    const model_uniforms &uniforms = loop_list.getUniforms();
+    glUseProgram(program);
+    setCommonUniforms(uniforms, model, view, projection, eye);
+    double loop_ms = 0.0;
+    for (size_t frame = 0; frame < frames; frame++) {
+        place(frame);
+        auto start = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        for (size_t i = 0; i < copies; i++) loop_list.draw(VAO, transforms[i]);
+        glFinish();
+        loop_ms += elapsedMs(start);
+    }
+    std::vector<unsigned char> loop_frame = readFrame();
+
+    // all copies in one call per range, transforms written each frame and uploaded at once
+    instance_buffer instances;
+    instances.resize(copies);
+    instances.attach(VAO);
+    glUseProgram(instanced_program);
+    setCommonUniforms(instanced_list.getUniforms(), model, view, projection, eye);
+    double instanced_ms = 0.0, upload_ms = 0.0;
+    for (size_t frame = 0; frame < frames; frame++) {
+        place(frame);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < copies; i++) instances.setTransform(i, transforms[i]);
+        instances.upload();
+        upload_ms += elapsedMs(start);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        instanced_list.drawInstanced(VAO, copies);
+        glFinish();
+        instanced_ms += elapsedMs(start);
+    }
+    std::vector<unsigned char> instanced_frame = readFrame();
+    check(glGetError() == GL_NO_ERROR, "no GL errors");
+
+    size_t ranges = instanced_list.getRangeCount();
+    printf("%zu copies of %s, %zu triangles each, %zu frames of %dx%d\n", copies, path.c_str(),
+        instanced_list.getTriangleCount(), frames, width, height);
+    printf("per copy draws:  %8.2f ms/frame  %zu draw calls\n", loop_ms / frames, copies * ranges);
+    printf("instanced draws: %8.2f ms/frame  %zu draw calls, upload %.3f ms %.2f MB\n", instanced_ms / frames, ranges,
+        upload_ms / frames, instances.getUploadedBytes() / 1e6);
+    printf("speedup %.2fx\n", loop_ms / instanced_ms);
+
+    // the normal matrix and the product order differ slightly, edges may land on other pixels
+    size_t lit = differentPixels(loop_frame, empty_frame, 0);
+    size_t different = differentPixels(loop_frame, instanced_frame, 2);
+    printf("%zu of %zu pixels covered, %zu differ\n", lit, (size_t)width * height, different);
+    check(lit > 0, "the copies are visible");
+    check(different <= (size_t)width * height / 200, "instanced frame matches the per copy frame");
+
+    // a diffuse override changes the picture, transparent overrides keep the material
+    for (size_t i = 0; i < copies; i++) instances.setColor(i, glm::vec4(1.0f, 0.0f, 1.0f, 1.0f));
+    instances.upload();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    instanced_list.drawInstanced(VAO, copies);
+    check(differentPixels(readFrame(), instanced_frame, 2) > lit / 4, "diffuse overrides show");
+
+    // only the span of changed instances is sent
+    instances.upload();
+    check(instances.getUploadedBytes() == 0, "nothing changed, nothing uploaded");
+    if (copies > 10) {
+        instances.setColor(3, glm::vec4(0.0f));
+        instances.setTransform(8, transforms[8]);
+        instances.upload();
+        check(instances.getUploadedBytes() == 6 * sizeof(instance_data), "one upload of the changed span");
+    }
+    instances.resize(copies * 2);
+    instances.upload();
+    check(instances.getUploadedBytes() == copies * 2 * sizeof(instance_data), "growing uploads everything");
+    check(instances.get(copies * 2 - 1).model == glm::mat4(1.0f), "new instances start at the identity");
+    check(glGetError() == GL_NO_ERROR, "no GL errors");
+
+    // a group transform applied per batch on the GPU draws what the same transform baked into the vertices does
+    {
+        objLoader baked;
+        baked.setIndexed(true);
+        if (!baked.load(path)) return 1;
+        glm::mat4 lift = glm::translate(glm::mat4(1.0f), (bounds.max - bounds.min) * glm::vec3(0.0f, 0.5f, 0.0f)) *
+            glm::rotate(glm::mat4(1.0f), glm::radians(40.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        model.setGroupTransform(0, lift);
+        baked.applyTransform(0, lift);
+        GLuint baked_buffers[2];
+        GLuint baked_VAO = createVAO(baked, baked_buffers);
+        draw_list baked_list;
+        baked_list.setProgram(program);
+        baked_list.update(baked);
+        loop_list.update(model);
+        glUseProgram(program);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        for (size_t i = 0; i < copies; i++) loop_list.draw(VAO, transforms[i]);
+        std::vector<unsigned char> group_frame = readFrame();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        for (size_t i = 0; i < copies; i++) baked_list.draw(baked_VAO, transforms[i]);
+        std::vector<unsigned char> baked_frame = readFrame();
+        size_t moved = differentPixels(group_frame, loop_frame, 2), different = differentPixels(group_frame, baked_frame, 2);
+        printf("group transform: %zu pixels moved, %zu differ from baked vertices\n", moved, different);
+        check(moved > 0, "the group transform shows");
+        check(different <= (size_t)width * height / 200, "group transforms match baked vertices");
+        // instanced draws apply the group transform before the instance's
+        glUseProgram(instanced_program);
+        instanced_list.update(model);
+        for (size_t i = 0; i < copies; i++) {
+            instances.setTransform(i, transforms[i]);
+            instances.setColor(i, glm::vec4(0.0f));
+        }
+        instances.resize(copies);
+        instances.upload();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        instanced_list.drawInstanced(VAO, copies);
+        check(differentPixels(readFrame(), baked_frame, 2) <= (size_t)width * height / 200, "instanced group transforms match baked vertices");
+        check(glGetError() == GL_NO_ERROR, "no GL errors");
+        glDeleteVertexArrays(1, &baked_VAO);
+        glDeleteBuffers(2, baked_buffers);
+    }
+
+    // a white diffuse map multiplies by one, a black one leaves only the ambient and specular terms
+    {
+        std::string white = "/tmp/bench_instancing_white.ppm", black = "/tmp/bench_instancing_black.ppm";
+        if (!writeImage(white, 255) || !writeImage(black, 0)) return 1;
+        texture_cache textures;
+        gpu_textures gpu(&textures);
+        loop_list.setTextures(&gpu);
+        model.setGroupTransform(0, glm::mat4(1.0f));
+        auto drawWithMap = [&](const std::string &map) {
+            for (size_t i = 0; i < model.getGroupIndices().size(); i++) {
+                material mat = std::get<2>(model.getGroupIndices()[i]);
+                mat.diffuse_map = map;
+                model.applyMaterial(i, mat);
+            }
+            loop_list.update(model);
+            glUseProgram(program);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            for (size_t i = 0; i < copies; i++) loop_list.draw(VAO, transforms[i]);
+            return readFrame();
+        };
+        size_t white_different = differentPixels(drawWithMap(white), loop_frame, 2);
+        size_t black_different = differentPixels(drawWithMap(black), loop_frame, 2);
+        printf("diffuse maps: white differs in %zu pixels, black in %zu\n", white_different, black_different);
+        check(gpu.size() == 2 && textures.getStats().misses == 2, "each map is decoded and uploaded once");
+        check(white_different <= (size_t)width * height / 200, "a white diffuse map keeps the material color");
+        check(black_different > lit / 4, "a black diffuse map shows");
+        check(glGetError() == GL_NO_ERROR, "no GL errors");
+        drawWithMap("");
+        loop_list.setTextures(nullptr);
+        gpu.clear();
+        std::remove(white.c_str());
+        std::remove(black.c_str());
+    }
+
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(2, buffers);
+    glDeleteProgram(program);
+    glDeleteProgram(instanced_program);
+    glDeleteRenderbuffers(2, renderbuffers);
+    glDeleteFramebuffers(1, &framebuffer);
+    return benchResult();
+}
@@ -0,0 +1,149 @@
+// lazy loading through the group index: a full load against opening the index cold and from its sidecar,
+// loading a few groups, and every group loaded lazily against a full load of the same file
+// usage: bench_lazy [triangles] [--tmp DIR]
+#include "obj_loader.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void configure(objLoader &model, bool smooth) {
+    model.setIndexed(true);
+    model.setSmoothNormals(smooth);
+    model.setCacheEnabled(false);
+}
+
+// buffers, group ranges and materials must match byte for byte
+static void compareModels(const std::string &name, objLoader &full, objLoader &lazy) {
+    check(full.getVBOSize() == lazy.getVBOSize() && memcmp(full.getVBO(), lazy.getVBO(), full.getVBOSize()) == 0, name + ": vbo");
+    check(full.getIBOSize() == lazy.getIBOSize() && memcmp(full.getIBO(), lazy.getIBO(), full.getIBOSize()) == 0, name + ": ibo");
+    const auto &full_groups = full.getGroupIndices(), &lazy_groups = lazy.getGroupIndices();
+    check(full_groups.size() == lazy_groups.size(), name + ": group count");
+    for (size_t i = 0; i < full_groups.size() && i < lazy_groups.size(); i++) {
+        check(full.getGroupRange(i) == lazy.getGroupRange(i) && std::get<1>(full_groups[i]) == std::get<1>(lazy_groups[i]) &&
+            std::get<2>(full_groups[i]).diffuse == std::get<2>(lazy_groups[i]).diffuse && lazy.isGroupLoaded(i), name + ": group " + std::to_string(i));
+    }
+}
+
+static std::vector<size_t> allGroups(objLoader &model) {
+    std::vector<size_t> groups(model.getGroupIndices().size());
+    for (size_t i = 0; i < groups.size(); i++) groups[i] = i;
+    return groups;
+}
+
+// groups of records followed by faces counting back from them, with materials switching inside a group
+static bool writeRelative(const std::string &path, const std::string &library) {
+    std::ofstream mtl(library);
+    mtl << "newmtl red\nKd 0.8 0 0\nnewmtl blue\nKd 0 0 0.8\n";
+    std::ofstream out(path);
+    out << "mtllib " << library.substr(library.find_last_of('/') + 1) << "\n";
+    for (int g = 0; g < 6; g++) {
+        out << "g part" << g << "\n";
+        if (g % 2 == 0) out << "usemtl " << (g % 4 == 0 ? "red" : "blue") << "\n";
+        for (int row = 0; row < 4; row++) {
+            for (int x = 0; x < 3; x++) out << "v " << x << " " << row << " " << g << "\nvt " << x / 2.0 << " " << row / 3.0 << "\nvn 0 0 1\n";
+            if (row == 0) continue;
+            out << "f -6/-6/-6 -5/-5/-5 -2/-2/-2 -3/-3/-3\nf -5/-5/-5 -4/-4/-4 -1/-1/-1 -2/-2/-2\n";
+        }
+        // a face reaching back into the previous group
+        if (g > 0) out << "f -1 -13 -14\n";
+    }
+    return (bool)mtl && (bool)out;
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 2000000;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_lazy [triangles] [--tmp DIR]", {&triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    synthetic_mesh mesh = {triangles, true, true, false, 64};
+    std::string path = tmp_dir + "/bench_lazy.obj";
+    std::string index_path = path + ".objindex";
+    if (generateSyntheticMesh(mesh, path) == 0) return 1;
+    std::remove(index_path.c_str());
+
+    objLoader full;
+    configure(full, false);
+    auto start = std::chrono::steady_clock::now();
+    if (!full.load(path)) return 1;
+    double full_ms = elapsedMs(start);
+
+    objLoader lazy;
+    configure(lazy, false);
+    start = std::chrono::steady_clock::now();
+    if (!lazy.openGroups(path)) return 1;
+    double cold_ms = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    if (!lazy.openGroups(path)) return 1;
+    double warm_ms = elapsedMs(start);
+    check(lazy.getGroupIndices().size() == full.getGroupIndices().size(), "the index has every group");
+    size_t placeholders = 0;
+    for (size_t i = 0; i < lazy.getGroupIndices().size(); i++) {
+        if (!lazy.isGroupLoaded(i) && lazy.getGroupRange(i).second == 0) placeholders++;
+    }
+    check(placeholders == lazy.getGroupIndices().size() && lazy.getVertexCount() == 0, "opened groups are empty placeholders");
+
+    // a few groups spread over the file, group 0 stays a placeholder
+    size_t group_count = full.getGroupIndices().size();
+    if (group_count < 2) {
+        std::cerr << "too few groups in " << triangles << " triangles" << std::endl;
+        return 1;
+    }
+    std::vector<size_t> some = {1, group_count * 17 / 64, group_count * 40 / 64, group_count - 1};
+    some.erase(std::remove(some.begin(), some.end(), (size_t)0), some.end());
+    std::sort(some.begin(), some.end());
+    some.erase(std::unique(some.begin(), some.end()), some.end());
+    start = std::chrono::steady_clock::now();
+    if (!lazy.loadGroups(some)) return 1;
+    double some_ms = elapsedMs(start);
+    for (size_t group : some) {
+        check(lazy.isGroupLoaded(group) && lazy.getGroupRange(group).second == full.getGroupRange(group).second,
+            "group " + std::to_string(group) + " is loaded whole");
+    }
+    check(!lazy.isGroupLoaded(0) && lazy.getGroupRange(0).second == 0, "other groups stay placeholders");
+    // placeholders have no faces to write, save refuses them without creating the file
+    std::string saved_path = tmp_dir + "/bench_lazy_saved.obj";
+    std::remove(saved_path.c_str());
+    check(!lazy.save(saved_path) && !std::ifstream(saved_path), "a partly loaded model is not saved");
+    size_t some_bytes = lazy.getMemoryUsage();
+    start = std::chrono::steady_clock::now();
+    if (!lazy.loadGroups(allGroups(lazy))) return 1;
+    double rest_ms = elapsedMs(start);
+    printf("%zu triangles in %zu groups: load %.1f ms, index scan %.1f ms, sidecar %.2f ms\n",
+        full.getIndexCount() / 3, full.getGroupIndices().size(), full_ms, cold_ms, warm_ms);
+    printf("%zu groups %.1f ms (%.1f MB), the other %zu groups %.1f ms (%.1f MB)\n", some.size(), some_ms, some_bytes / 1e6,
+        full.getGroupIndices().size() - some.size(), rest_ms, lazy.getMemoryUsage() / 1e6);
+
+    // loaded in another order and in pieces, the buffers still match a full load
+    objLoader full_smooth, lazy_smooth;
+    configure(full_smooth, true);
+    configure(lazy_smooth, true);
+    if (!full_smooth.load(path) || !lazy_smooth.openGroups(path)) return 1;
+    if (!lazy_smooth.loadGroups(allGroups(lazy_smooth))) return 1;
+    compareModels("all groups", full, lazy);
+    compareModels("smooth normals", full_smooth, lazy_smooth);
+    std::remove(path.c_str());
+    std::remove(index_path.c_str());
+
+    std::string relative_path = tmp_dir + "/bench_lazy_relative.obj";
+    std::string library_path = tmp_dir + "/bench_lazy_relative.mtl";
+    if (!writeRelative(relative_path, library_path)) return 1;
+    std::remove((relative_path + ".objindex").c_str());
+    objLoader full_relative, lazy_relative;
+    configure(full_relative, false);
+    configure(lazy_relative, false);
+    if (!full_relative.load(relative_path) || !lazy_relative.openGroups(relative_path)) return 1;
+    if (!lazy_relative.loadGroups({5, 2}) || !lazy_relative.loadGroups({0, 1, 3, 4})) return 1;
+    compareModels("relative indices", full_relative, lazy_relative);
+    std::remove(relative_path.c_str());
+    std::remove(library_path.c_str());
+    std::remove((relative_path + ".objindex").c_str());
+
+    return benchResult();
+}
@@ -0,0 +1,260 @@
+// headless loader benchmark, writes a json report to stdout or --output
+// usage: bench_loader [--max-triangles N] [--repeat N] [--tmp DIR] [--output FILE] [--no-bundled] [file.obj ...]
+#include "obj_loader.h"
+#include "mesh_generator.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// every heap allocation of the process goes through these
+static std::atomic<size_t> allocation_count(0);
+static std::atomic<size_t> allocation_bytes(0);
+
+void *operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    std::free(p);
+}
+
+struct phase_result {
+    std::string name;
+    // best of the repeats
+    double ms;
+    size_t allocations;
+    size_t allocated_bytes;
+};
+
+struct case_result {
+    std::string name;
+    std::string path;
+    size_t file_bytes;
+    size_t triangles;
+    size_t vertices;
+    size_t groups;
+    std::vector<phase_result> phases;
+    size_t peak_rss_kb;
+};
+
+static phase_result runPhase(const std::string &name, size_t repeat, const std::function<void()> &fn) {
+    phase_result result;
+    result.name = name;
+    result.ms = 1e30;
+    for (size_t r = 0; r < repeat; r++) {
+        size_t count = allocation_count.load(), bytes = allocation_bytes.load();
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        result.ms = std::min(result.ms, elapsed);
+        result.allocations = allocation_count.load() - count;
+        result.allocated_bytes = allocation_bytes.load() - bytes;
+    }
+    return result;
+}
+
+// reset the high water mark so every case reports its own peak, linux only
+static void resetPeakRSS() {
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (!file) return;
+    fputs("5", file);
+    fclose(file);
+}
+
+static size_t peakRSS() {
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file) {
+        char line[256];
+        size_t kb = 0;
+        while (fgets(line, sizeof(line), file))
+            if (sscanf(line, "VmHWM: %zu kB", &kb) == 1) break;
+        fclose(file);
+        if (kb) return kb;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss;
+}
+
+static size_t fileSize(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file.is_open() ? (size_t)file.tellg() : 0;
+}
+
+static case_result runCase(const std::string &name, const std::string &path, const std::string &tmp_dir, size_t repeat) {
+    case_result result;
+    result.name = name;
+    result.path = path;
+    result.file_bytes = fileSize(path);
+    resetPeakRSS();
+    objLoader loader;
+    bool loaded = false;
+    result.phases.push_back(runPhase("load", repeat, [&] { loaded = loader.load(path); }));
+    result.triangles = loaded ? loader.getVertexCount() / 3 : 0;
+    result.vertices = loaded ? loader.getVertexCount() : 0;
+    result.groups = loaded ? loader.getGroupIndices().size() : 0;
+    if (!loaded) {
+        result.peak_rss_kb = peakRSS();
+        return result;
+    }
+    vertex_format format;
+    format.position = VERTEX_QUANT16;
+    format.normal = VERTEX_OCT16;
+    format.texcoord = VERTEX_HALF;
+    result.phases.push_back(runPhase("pack_vbo", repeat, [&] {
+        loader.setVertexFormat(format);
+        loader.getPackedVBO();
+    }));
+    std::vector<std::pair<size_t, glm::mat4>> transforms;
+    glm::mat4 transform = glm::rotate(glm::mat4(1.0f), glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    for (size_t i = 0; i < result.groups; i++) transforms.push_back(std::make_pair(i, transform));
+    result.phases.push_back(runPhase("transform", repeat, [&] { loader.applyTransforms(transforms); }));
+    // the mtl file is saved next to the obj under its name
+    std::string save_path = tmp_dir + "/bench_save.obj";
+    result.phases.push_back(runPhase("save", repeat, [&] { loader.save(save_path); }));
+    std::remove(save_path.c_str());
+    std::remove((save_path.substr(0, save_path.size() - 4) + ".mtl").c_str());
+    objLoader indexed_loader;
+    indexed_loader.setIndexed(true);
+    result.phases.push_back(runPhase("load_indexed", repeat, [&] { indexed_loader.load(path); }));
+    result.peak_rss_kb = peakRSS();
+    return result;
+}
+
+static void writeJSON(std::ostream &out, const std::vector<case_result> &cases) {
+    out << "{\n  \"threads\": " << thread_pool::hardwareThreads() << ",\n";
+    out << "  \"transform_kernel\": \"" << transformKernelName() << "\",\n";
+    out << "  \"cases\": [\n";
+    for (size_t i = 0; i < cases.size(); i++) {
+        const case_result &c = cases[i];
+        out << "    {\n";
+        out << "      \"name\": \"" << c.name << "\",\n";
+        out << "      \"file_bytes\": " << c.file_bytes << ",\n";
+        out << "      \"triangles\": " << c.triangles << ",\n";
+        out << "      \"vertices\": " << c.vertices << ",\n";
+        out << "      \"groups\": " << c.groups << ",\n";
+        out << "      \"peak_rss_kb\": " << c.peak_rss_kb << ",\n";
+        out << "      \"phases\": {\n";
+        for (size_t j = 0; j < c.phases.size(); j++) {
+            const phase_result &p = c.phases[j];
+            double seconds = p.ms / 1000.0;
+            out << "        \"" << p.name << "\": {\"ms\": " << p.ms
+                << ", \"mb_per_s\": " << (seconds > 0 ? c.file_bytes / 1e6 / seconds : 0.0)
+                << ", \"triangles_per_s\": " << (seconds > 0 ? c.triangles / seconds : 0.0)
+                << ", \"allocations\": " << p.allocations
+                << ", \"allocated_bytes\": " << p.allocated_bytes << "}"
+                << (j + 1 < c.phases.size() ? "," : "") << "\n";
+        }
+        out << "      }\n";
+        out << "    }" << (i + 1 < cases.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static std::vector<std::string> bundledModels(const std::string &dir) {
+    std::vector<std::string> models;
+    DIR *root = opendir(dir.c_str());
+    if (!root) return models;
+    while (struct dirent *entry = readdir(root)) {
+        std::string name = entry -> d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = dir + "/" + name + "/" + name + ".obj";
+        if (fileSize(path) > 0) models.push_back(path);
+    }
+    closedir(root);
+    std::sort(models.begin(), models.end());
+    return models;
+}
+
+int main(int argc, char **argv) {
+    size_t max_triangles = 1000000;
+    size_t repeat = 3;
+    std::string tmp_dir = "/tmp";
+    std::string output;
+    bool bundled = true;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--max-triangles" && i + 1 < argc) max_triangles = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--repeat" && i + 1 < argc) repeat = std::max<size_t>(1, std::strtoull(argv[++i], NULL, 10));
+        else if (arg == "--tmp" && i + 1 < argc) tmp_dir = argv[++i];
+        else if (arg == "--output" && i + 1 < argc) output = argv[++i];
+        else if (arg == "--no-bundled") bundled = false;
+        else files.push_back(arg);
+    }
+    // the loader reports to std::cout, keep stdout for the report
+    std::ostream report(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    std::vector<case_result> cases;
+    if (bundled) {
+        std::vector<std::string> models = bundledModels("res/model");
+        files.insert(files.begin(), models.begin(), models.end());
+    }
+    for (const std::string &path : files) {
+        std::cerr << "bench " << path << std::endl;
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        cases.push_back(runCase(name, path, tmp_dir, repeat));
+    }
+    const size_t sizes[] = {10000, 100000, 1000000, 10000000, 50000000};
+    for (size_t size : sizes) {
+        if (size > max_triangles) break;
+        synthetic_mesh variants[4] = {
+            {size, false, false, false, 1},
+            {size, true, true, false, 1},
+            {size, true, true, true, 1},
+            {size, true, true, false, 1000},
+        };
+        for (const synthetic_mesh &mesh : variants) {
+            std::string name = syntheticMeshName(mesh);
+            std::string path = tmp_dir + "/bench_" + name + ".obj";
+            std::cerr << "bench " << name << std::endl;
+            if (generateSyntheticMesh(mesh, path) == 0) continue;
+            cases.push_back(runCase(name, path, tmp_dir, repeat));
+            std::remove(path.c_str());
+        }
+    }
+
+    if (output.empty()) {
+        writeJSON(report, cases);
+    } else {
+        std::ofstream file(output);
+        if (!file.is_open()) {
+            std::cerr << "Cannot open file: " << output << std::endl;
+            return 1;
+        }
+        writeJSON(file, cases);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+// level of detail generation time and quality on the bundled models and a synthetic height field,
+// every level is checked for indices outside its group, degenerate triangles and lost group borders
+// usage: bench_lod [triangles] [--tmp DIR] [file.obj ...]
+#include "obj_loader.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const std::vector<float> lod_ratios = {0.5f, 0.25f, 0.1f, 0.02f};
+
+static uint32_t elementAt(objLoader &model, size_t i) {
+    return model.getIndexSize() == sizeof(uint32_t) ? ((const uint32_t*)model.getIBO())[i] : ((const uint16_t*)model.getIBO())[i];
+}
+
+static bool samePosition(const float *vbo, uint32_t a, uint32_t b) {
+    return memcmp(vbo + (size_t)a * VBO_FLOATS_PER_VERTEX, vbo + (size_t)b * VBO_FLOATS_PER_VERTEX, 3 * sizeof(float)) == 0;
+}
+
+// vertices whose position also belongs to another group, these have to survive every level
+static std::vector<unsigned char> groupBorders(objLoader &model) {
+    const float *vbo = model.getVBO();
+    size_t vertex_count = model.getVertexCount();
+    std::vector<uint32_t> group(vertex_count), order(vertex_count);
+    for (size_t i = 0; i < model.getGroupIndices().size(); i++) {
+        auto range = model.getGroupVertexRange(i);
+        for (size_t v = range.first; v < range.first + range.second; v++) group[v] = i;
+    }
+    for (size_t v = 0; v < vertex_count; v++) order[v] = v;
+    std::sort(order.begin(), order.end(), [vbo](uint32_t a, uint32_t b) {
+        return memcmp(vbo + (size_t)a * VBO_FLOATS_PER_VERTEX, vbo + (size_t)b * VBO_FLOATS_PER_VERTEX, 3 * sizeof(float)) < 0;
+    });
+    std::vector<unsigned char> border(vertex_count, 0);
+    for (size_t i = 0; i < vertex_count;) {
+        size_t j = i + 1;
+        bool shared = false;
+        for (; j < vertex_count && samePosition(vbo, order[i], order[j]); j++) {
+            if (group[order[j]] != group[order[i]]) shared = true;
+        }
+        if (shared) for (size_t k = i; k < j; k++) border[order[k]] = 1;
+        i = j;
+    }
+    return border;
+}
+
+static void runCase(const std::string &name, const std::string &path) {
+    objLoader model;
+    model.setIndexed(true);
+    if (!model.load(path)) {
+        check(false, "load " + name);
+        return;
+    }
+    size_t base_triangles = model.getIndexCount() / 3;
+    auto start = std::chrono::steady_clock::now();
+    model.generateLODs(lod_ratios);
+    double lod_ms = elapsedMs(start);
+
+    const float *vbo = model.getVBO();
+    std::vector<unsigned char> border = groupBorders(model);
+    size_t levels = lod_ratios.size() + 1;
+    std::vector<size_t> level_triangles(levels, 0);
+    std::vector<float> level_error(levels, 0.0f);
+    size_t out_of_range = 0, degenerate = 0, lost_borders = 0, order_errors = 0;
+    std::vector<unsigned char> used(model.getVertexCount());
+    for (size_t g = 0; g < model.getGroupIndices().size(); g++) {
+        const std::vector<group_lod> &lods = model.getGroupLODs(g);
+        auto vertex_range = model.getGroupVertexRange(g);
+        for (size_t level = 0; level < levels; level++) {
+            // groups that stopped early are drawn with their coarsest level
+            const group_lod &lod = lods[std::min(level, lods.size() - 1)];
+            level_triangles[level] += lod.count / 3;
+            level_error[level] = std::max(level_error[level], lod.error);
+            if (level > 0 && level < lods.size() && (lod.count > lods[level - 1].count || lod.error < lods[level - 1].error)) order_errors++;
+            std::fill(used.begin() + vertex_range.first, used.begin() + vertex_range.first + vertex_range.second, 0);
+            for (size_t i = lod.first; i < lod.first + lod.count; i += 3) {
+                uint32_t a = elementAt(model, i), b = elementAt(model, i + 1), c = elementAt(model, i + 2);
+                for (uint32_t v : {a, b, c}) {
+                    if (v < vertex_range.first || v >= vertex_range.first + vertex_range.second) out_of_range++;
+                    else used[v] = 1;
+                }
+                if (samePosition(vbo, a, b) || samePosition(vbo, b, c) || samePosition(vbo, a, c)) degenerate++;
+            }
+            if (level == 0) continue;
+            // positions on the border of the full group must still be used, possibly by another
+            // vertex with the same position but other attributes
+            std::vector<uint32_t> used_positions;
+            for (size_t v = vertex_range.first; v < vertex_range.first + vertex_range.second; v++)
+                if (used[v]) used_positions.push_back(v);
+            auto less = [vbo](uint32_t a, uint32_t b) {
+                return memcmp(vbo + (size_t)a * VBO_FLOATS_PER_VERTEX, vbo + (size_t)b * VBO_FLOATS_PER_VERTEX, 3 * sizeof(float)) < 0;
+            };
+            std::sort(used_positions.begin(), used_positions.end(), less);
+            for (size_t i = lods[0].first; i < lods[0].first + lods[0].count; i++) {
+                uint32_t v = elementAt(model, i);
+                if (!border[v] || used[v]) continue;
+                if (!std::binary_search(used_positions.begin(), used_positions.end(), v, less)) lost_borders++;
+                used[v] = 1;
+            }
+        }
+    }
+
+    printf("%-28s %10zu triangles  %9.2f ms", name.c_str(), base_triangles, lod_ms);
+    for (size_t level = 1; level < levels; level++) printf("  %.0f%%: %zu (%.3g)", lod_ratios[level - 1] * 100.0f, level_triangles[level], level_error[level]);
+    printf("\n");
+    check(out_of_range == 0, name + ": " + std::to_string(out_of_range) + " indices outside their group");
+    check(degenerate == 0, name + ": " + std::to_string(degenerate) + " degenerate triangles");
+    check(lost_borders == 0, name + ": " + std::to_string(lost_borders) + " lost border vertices");
+    check(order_errors == 0, name + ": " + std::to_string(order_errors) + " badly ordered levels");
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 200000;
+    std::string tmp_dir = "/tmp";
+    std::vector<std::string> files;
+    // .obj files are taken out before the rest is parsed
+    std::vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i > 0 && arg.size() > 4 && arg.compare(arg.size() - 4, 4, ".obj") == 0) files.push_back(arg);
+        else args.push_back(argv[i]);
+    }
+    if (!parseBenchArgs((int)args.size(), args.data(), "bench_lod [triangles] [--tmp DIR] [file.obj ...]", {&triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    if (files.empty()) {
+        for (const char *model : {"cow", "teddy", "pumpkin", "shuttle"}) files.push_back(std::string("res/model/") + model + "/" + model + ".obj");
+    }
+
+    printf("level: triangles (largest error in model units)\n");
+    for (const std::string &file : files) runCase(file, file);
+    synthetic_mesh mesh = {triangles, true, true, false, 16};
+    std::string path = tmp_dir + "/" + syntheticMeshName(mesh) + ".obj";
+    if (generateSyntheticMesh(mesh, path) > 0) {
+        runCase(syntheticMeshName(mesh), path);
+        std::remove(path.c_str());
+    }
+    return benchResult();
+}
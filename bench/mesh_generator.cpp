@@ -0,0 +1,117 @@
+#include "mesh_generator.h"
+#include "format_util.h"
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+std::string syntheticMeshName(const synthetic_mesh &mesh) {
+    std::string name = "grid_" + std::to_string(mesh.triangles);
+    if (mesh.normals) name += "_vn";
+    if (mesh.texcoords) name += "_vt";
+    if (mesh.quads) name += "_quads";
+    if (mesh.groups > 1) name += "_g" + std::to_string(mesh.groups);
+    if (mesh.relative) name += "_rel";
+    return name;
+}
+
+// flush the text buffer once it is this large
+static const size_t flush_size = 1 << 20;
+
+static bool flush(FILE *file, std::string &out) {
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    out.clear();
+    return ok;
+}
+
+size_t generateSyntheticMesh(const synthetic_mesh &mesh, const std::string &filename) {
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return 0;
+    }
+    // columns x rows cells, two triangles each
+    size_t columns = std::max<size_t>(1, (size_t)std::sqrt(mesh.triangles / 2.0));
+    size_t rows = std::max<size_t>(1, (mesh.triangles / 2 + columns - 1) / columns);
+    size_t groups = std::max<size_t>(1, std::min(mesh.groups, rows));
+    std::string out;
+    out.reserve(flush_size + 4096);
+    bool ok = true;
+    append_str(out, "# synthetic mesh ");
+    out += syntheticMeshName(mesh);
+    out.push_back('\n');
+    for (size_t y = 0; y <= rows && ok; y++) {
+        for (size_t x = 0; x <= columns; x++) {
+            float u = (float)x / columns, v = (float)y / rows;
+            // height field h = 0.05 sin(6u) cos(6v)
+            float position[3] = {u, 0.05f * std::sin(6.0f * u) * std::cos(6.0f * v), v};
+            append_floats_line(out, "v", position, 3);
+            if (mesh.texcoords) {
+                float texcoord[2] = {u, v};
+                append_floats_line(out, "vt", texcoord, 2);
+            }
+            if (mesh.normals) {
+                float dx = 0.3f * std::cos(6.0f * u) * std::cos(6.0f * v);
+                float dz = -0.3f * std::sin(6.0f * u) * std::sin(6.0f * v);
+                float inv = 1.0f / std::sqrt(dx * dx + 1.0f + dz * dz);
+                float normal[3] = {-dx * inv, inv, -dz * inv};
+                append_floats_line(out, "vn", normal, 3);
+            }
+        }
+        if (out.size() > flush_size) ok = flush(file, out);
+    }
+    // every vertex is written before the faces, so -1 is the last one
+    size_t vertex_count = (rows + 1) * (columns + 1);
+    auto append_index = [&](size_t index) {
+        if (mesh.relative) {
+            out.push_back('-');
+            append_uint(out, vertex_count + 1 - index);
+        } else {
+            append_uint(out, index);
+        }
+    };
+    auto corner = [&](size_t x, size_t y) {
+        size_t index = y * (columns + 1) + x + 1;
+        out.push_back(' ');
+        append_index(index);
+        if (mesh.texcoords || mesh.normals) {
+            out.push_back('/');
+            if (mesh.texcoords) append_index(index);
+        }
+        if (mesh.normals) {
+            out.push_back('/');
+            append_index(index);
+        }
+    };
+    size_t rows_per_group = (rows + groups - 1) / groups;
+    for (size_t y = 0; y < rows && ok; y++) {
+        if (y % rows_per_group == 0) {
+            size_t group = y / rows_per_group;
+            append_str(out, "g group");
+            append_uint(out, group);
+            out.push_back('\n');
+        }
+        for (size_t x = 0; x < columns; x++) {
+            // counter clockwise seen from above, like the normals
+            if (mesh.quads) {
+                out.push_back('f');
+                corner(x, y); corner(x, y + 1); corner(x + 1, y + 1); corner(x + 1, y);
+                out.push_back('\n');
+            } else {
+                out.push_back('f');
+                corner(x, y); corner(x + 1, y + 1); corner(x + 1, y);
+                append_str(out, "\nf");
+                corner(x, y); corner(x, y + 1); corner(x + 1, y + 1);
+                out.push_back('\n');
+            }
+        }
+        if (out.size() > flush_size) ok = flush(file, out);
+    }
+    ok = ok && flush(file, out);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        std::cerr << "Cannot write file: " << filename << std::endl;
+        return 0;
+    }
+    return rows * columns * 2;
+}
@@ -0,0 +1,25 @@
+#ifndef __MESH_GENERATOR_H__
+#define __MESH_GENERATOR_H__
+
+#include <string>
+#include <cstddef>
+
+// synthetic obj files for the benchmarks: a wavy height field split into groups
+struct synthetic_mesh {
+    // approximate, rounded up to whole grid rows
+    size_t triangles;
+    bool normals;
+    bool texcoords;
+    // write each grid cell as one quad instead of two triangles
+    bool quads;
+    size_t groups;
+    // faces count back from the last vertex with negative indices
+    bool relative;
+};
+
+// name describing the options, used for the file name and in reports
+std::string syntheticMeshName(const synthetic_mesh &mesh);
+// write the mesh to filename, returns the number of triangles after triangulation, 0 on failure
+size_t generateSyntheticMesh(const synthetic_mesh &mesh, const std::string &filename);
+
+#endif
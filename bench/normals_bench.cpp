@@ -0,0 +1,176 @@
+// smooth normal and tangent generation on a synthetic height field with known normals,
+// a copy with the normals of every other face removed, and a cube for the crease angle
+// usage: bench_normals [triangles] [--tmp DIR]
+#include "obj_loader.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+// the normal of the generator's height field h = 0.05 sin(6x) cos(6z)
+static glm::vec3 fieldNormal(const glm::vec3 &p) {
+    float dx = 0.3f * std::cos(6.0f * p.x) * std::cos(6.0f * p.z);
+    float dz = -0.3f * std::sin(6.0f * p.x) * std::sin(6.0f * p.z);
+    return glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+}
+
+static glm::vec3 attributeAt(objLoader &model, size_t vertex, size_t offset) {
+    const float *p = model.getVBO() + vertex * VBO_FLOATS_PER_VERTEX + offset;
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+static float angleDegrees(const glm::vec3 &a, const glm::vec3 &b) {
+    return std::acos(std::max(-1.0f, std::min(1.0f, glm::dot(a, b)))) * 180.0f / 3.14159265f;
+}
+
+// largest and mean angle to the field normals, every normal must be unit length
+static void compareNormals(const std::string &name, objLoader &model, float max_allowed) {
+    double sum = 0.0;
+    float largest = 0.0f;
+    size_t bad = 0;
+    for (size_t v = 0; v < model.getVertexCount(); v++) {
+        glm::vec3 normal = attributeAt(model, v, 3);
+        if (!(std::fabs(glm::length(normal) - 1.0f) < 1e-3f)) {
+            bad++;
+            continue;
+        }
+        float angle = angleDegrees(normal, fieldNormal(attributeAt(model, v, 0)));
+        sum += angle;
+        largest = std::max(largest, angle);
+    }
+    printf("%-28s %9zu vertices  mean %.3f deg  max %.3f deg  %zu not unit\n", name.c_str(), model.getVertexCount(), sum / model.getVertexCount(), largest, bad);
+    check(bad == 0, name + ": every normal is unit length");
+    check(largest <= max_allowed, name + ": normals follow the field");
+}
+
+// drop the normal index of every other face line
+static bool stripNormals(const std::string &input, const std::string &output) {
+    std::ifstream in(input);
+    std::ofstream out(output);
+    if (!in || !out) return false;
+    std::string line;
+    size_t faces = 0;
+    while (std::getline(in, line)) {
+        if (line.size() > 2 && line[0] == 'f' && line[1] == ' ' && faces++ % 2 == 1) {
+            std::istringstream corners(line.substr(2));
+            std::string corner;
+            line = "f";
+            while (corners >> corner) line += " " + corner.substr(0, corner.find_last_of('/'));
+        }
+        out << line << '\n';
+    }
+    return true;
+}
+
+static void crease(const std::string &path, float angle, size_t expected_vertices) {
+    objLoader model;
+    model.setIndexed(true);
+    model.setSmoothNormals(true);
+    model.setCreaseAngle(angle);
+    if (!model.load(path)) {
+        check(false, "load " + path);
+        return;
+    }
+    check(model.getVertexCount() == expected_vertices, "cube crease " + std::to_string((int)angle) + ": " + std::to_string(expected_vertices) + " vertices");
+    size_t errors = 0;
+    for (size_t v = 0; v < model.getVertexCount(); v++) {
+        glm::vec3 p = attributeAt(model, v, 0), n = attributeAt(model, v, 3);
+        // hard edges keep the axis normals, smoothed corners point away from the center
+        bool ok = expected_vertices == 8 ? angleDegrees(n, glm::normalize(p - glm::vec3(0.5f))) < 0.1f :
+            std::fabs(std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z) - 1.0f) < 1e-5f;
+        if (!ok) errors++;
+    }
+    printf("cube crease %-16.0f %9zu vertices  %zu errors\n", angle, model.getVertexCount(), errors);
+    check(errors == 0, "cube crease " + std::to_string((int)angle) + ": normals are smoothed or kept");
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 1000000;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_normals [triangles] [--tmp DIR]", {&triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+    thread_pool pool;
+
+    synthetic_mesh with_normals = {triangles, true, true, false, 16};
+    synthetic_mesh without_normals = {triangles, false, true, false, 16};
+    std::string normals_path = tmp_dir + "/bench_normals_vn.obj";
+    std::string plain_path = tmp_dir + "/bench_normals.obj";
+    std::string mixed_path = tmp_dir + "/bench_normals_mixed.obj";
+    if (generateSyntheticMesh(with_normals, normals_path) == 0 || generateSyntheticMesh(without_normals, plain_path) == 0 ||
+        !stripNormals(normals_path, mixed_path)) return 1;
+
+    // the generation alone, on the grid's shared positions
+    {
+        objLoader model;
+        model.setIndexed(true);
+        if (!model.load(normals_path)) return 1;
+        std::vector<glm::vec3> positions(model.getVertexCount());
+        for (size_t v = 0; v < positions.size(); v++) positions[v] = attributeAt(model, v, 0);
+        std::vector<uint32_t> corners(model.getIndexCount());
+        for (size_t i = 0; i < corners.size(); i++)
+            corners[i] = model.getIndexSize() == sizeof(uint32_t) ? ((const uint32_t*)model.getIBO())[i] : ((const uint16_t*)model.getIBO())[i];
+        std::vector<glm::vec3> normals(corners.size());
+        auto start = std::chrono::steady_clock::now();
+        generateSmoothNormals(positions.data(), positions.size(), corners.data(), corners.size(), NULL, glm::radians(60.0f), normals.data(), NULL);
+        double serial_ms = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        generateSmoothNormals(positions.data(), positions.size(), corners.data(), corners.size(), NULL, glm::radians(60.0f), normals.data(), &pool);
+        double parallel_ms = elapsedMs(start);
+        printf("%zu triangles: smooth normals %.2f ms, %.2f ms on %zu threads\n", corners.size() / 3, serial_ms, parallel_ms, pool.size() + 1);
+
+        compareNormals("file normals", model, 0.1f);
+        start = std::chrono::steady_clock::now();
+        const std::vector<glm::vec4> &tangents = model.getTangents();
+        double tangent_ms = elapsedMs(start);
+        // u runs along +x and v along +z, so with the normal up every bitangent sign is -1
+        size_t tangent_errors = 0;
+        for (size_t v = 0; v < tangents.size(); v++) {
+            glm::vec3 t(tangents[v]);
+            if (std::fabs(glm::length(t) - 1.0f) > 1e-3f || std::fabs(glm::dot(t, attributeAt(model, v, 3))) > 1e-3f ||
+                t.x < 0.9f || tangents[v].w != -1.0f) tangent_errors++;
+        }
+        printf("tangents %.2f ms  %zu errors\n", tangent_ms, tangent_errors);
+        check(tangent_errors == 0, "tangents are unit, orthogonal to the normal and follow u");
+    }
+
+    // generated normals follow the field closely, the mixed file keeps the file normals where present
+    for (int mixed = 0; mixed < 2; mixed++) {
+        objLoader model;
+        model.setIndexed(true);
+        model.setSmoothNormals(true);
+        auto start = std::chrono::steady_clock::now();
+        if (!model.load(mixed ? mixed_path : plain_path)) return 1;
+        double load_ms = elapsedMs(start);
+        char name[64];
+        snprintf(name, sizeof(name), "%s %.0f ms", mixed ? "mixed, smooth" : "no normals, smooth", load_ms);
+        compareNormals(name, model, 1.0f);
+    }
+    {
+        objLoader model;
+        model.setIndexed(true);
+        if (!model.load(mixed_path)) return 1;
+        // face normals of a tessellated smooth field are off by about the tessellation angle
+        compareNormals("mixed, face normals", model, 5.0f);
+    }
+    std::remove(normals_path.c_str());
+    std::remove(plain_path.c_str());
+    std::remove(mixed_path.c_str());
+
+    std::string cube_path = tmp_dir + "/bench_normals_cube.obj";
+    {
+        std::ofstream cube(cube_path);
+        cube << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 0 1\nv 1 0 1\nv 1 1 1\nv 0 1 1\n"
+            << "f 1 4 3 2\nf 5 6 7 8\nf 1 2 6 5\nf 4 8 7 3\nf 1 5 8 4\nf 2 3 7 6\n";
+    }
+    crease(cube_path, 60.0f, 24);
+    crease(cube_path, 100.0f, 8);
+    std::remove(cube_path.c_str());
+    return benchResult();
+}
@@ -0,0 +1,133 @@
+// optimizeMesh on the bundled models and synthetic height fields, with and without overdraw ordering:
+// every group keeps its triangles, the cache miss ratio never gets worse and vertices end up in order of first use
+// usage: bench_optimize [triangles] [--tmp DIR]
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <dirent.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+static std::vector<std::string> bundledModels(const std::string &dir) {
+    std::vector<std::string> models;
+    DIR *root = opendir(dir.c_str());
+    if (!root) return models;
+    while (struct dirent *entry = readdir(root)) {
+        std::string name = entry -> d_name;
+        if (name == "." || name == "..") continue;
+        models.push_back(dir + "/" + name + "/" + name + ".obj");
+    }
+    closedir(root);
+    std::sort(models.begin(), models.end());
+    return models;
+}
+
+static uint32_t elementAt(const objLoader &model, size_t i) {
+    return model.getIndexSize() == sizeof(uint32_t) ? ((const uint32_t*)model.getIBO())[i] : ((const uint16_t*)model.getIBO())[i];
+}
+
+// a group's triangles by vertex contents, each rotated to start at its smallest vertex so the winding is
+// kept, sorted; the same before and after whatever the triangle and vertex order
+static std::vector<std::string> groupTriangles(const objLoader &model, size_t group) {
+    const size_t vertex_bytes = VBO_FLOATS_PER_VERTEX * sizeof(float);
+    auto range = model.getGroupRange(group);
+    std::vector<std::string> triangles;
+    triangles.reserve(range.second / 3);
+    for (size_t i = range.first; i + 2 < range.first + range.second; i += 3) {
+        std::string corners[3];
+        for (int k = 0; k < 3; k++) {
+            corners[k].assign((const char*)(model.getVBO() + (size_t)elementAt(model, i + k) * VBO_FLOATS_PER_VERTEX), vertex_bytes);
+        }
+        int first = (int)(std::min_element(corners, corners + 3) - corners);
+        triangles.push_back(corners[first] + corners[(first + 1) % 3] + corners[(first + 2) % 3]);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+static void runCase(const std::string &name, const std::string &path, bool reduce_overdraw) {
+    std::string label = name + (reduce_overdraw ? " overdraw" : "");
+    objLoader model;
+    model.setIndexed(true);
+    // models without normals share their vertices once they are smoothed
+    model.setSmoothNormals(true);
+    model.setCacheEnabled(false);
+    if (!model.load(path)) {
+        check(false, "load " + label);
+        return;
+    }
+    size_t group_count = model.getGroupIndices().size();
+    size_t vertex_count = model.getVertexCount();
+    std::vector<std::pair<size_t, size_t>> ranges(group_count), vertex_ranges(group_count);
+    std::vector<std::vector<std::string>> triangles(group_count);
+    for (size_t g = 0; g < group_count; g++) {
+        ranges[g] = model.getGroupRange(g);
+        vertex_ranges[g] = model.getGroupVertexRange(g);
+        triangles[g] = groupTriangles(model, g);
+    }
+
+    vertex_cache_stats before, after;
+    auto start = std::chrono::steady_clock::now();
+    if (!model.optimizeMesh(reduce_overdraw, before, after)) {
+        check(false, "optimize " + label);
+        return;
+    }
+    double optimize_ms = elapsedMs(start);
+    check(after.triangles == before.triangles && after.triangles == model.getIndexCount() / 3, label + ": triangle count");
+    check(after.acmr <= before.acmr, label + ": acmr does not get worse");
+    check(model.getVertexCount() == vertex_count, label + ": vertex count");
+    for (size_t g = 0; g < group_count; g++) {
+        check(model.getGroupRange(g) == ranges[g] && model.getGroupVertexRange(g) == vertex_ranges[g], label + ": group " + std::to_string(g) + " range");
+        check(groupTriangles(model, g) == triangles[g], label + ": group " + std::to_string(g) + " triangles");
+        // the group's vertices are numbered in order of first use
+        size_t next = vertex_ranges[g].first;
+        bool ordered = true;
+        for (size_t i = ranges[g].first; i < ranges[g].first + ranges[g].second; i++) {
+            uint32_t vertex = elementAt(model, i);
+            if (vertex == next) next++;
+            else if (vertex > next || vertex < vertex_ranges[g].first) ordered = false;
+        }
+        check(ordered && next <= vertex_ranges[g].first + vertex_ranges[g].second, label + ": group " + std::to_string(g) + " fetch order");
+    }
+    printf("%s: %zu triangles in %zu groups, %.1f ms, acmr %.3f -> %.3f, atvr %.3f -> %.3f\n", label.c_str(),
+        after.triangles, group_count, optimize_ms, before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 1000000;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_optimize [triangles] [--tmp DIR]", {&triangles}, {{"--tmp", NULL, &tmp_dir}})) return 1;
+
+    std::vector<std::pair<std::string, std::string>> cases;
+    for (const std::string &path : bundledModels("res/model")) cases.push_back({path.substr(path.find_last_of('/') + 1), path});
+    synthetic_mesh variants[2] = {
+        {triangles, true, true, false, 16},
+        {triangles, false, true, true, 1},
+    };
+    std::vector<std::string> generated;
+    for (const synthetic_mesh &mesh : variants) {
+        std::string path = tmp_dir + "/bench_optimize_" + syntheticMeshName(mesh) + ".obj";
+        if (generateSyntheticMesh(mesh, path) == 0) return 1;
+        cases.push_back({syntheticMeshName(mesh), path});
+        generated.push_back(path);
+    }
+    for (const auto &c : cases) {
+        runCase(c.first, c.second, false);
+        runCase(c.first, c.second, true);
+    }
+
+    // the optimizer needs the index buffer
+    objLoader flat;
+    flat.setIndexed(false);
+    flat.setCacheEnabled(false);
+    vertex_cache_stats before, after;
+    check(flat.load(cases.back().second) && !flat.optimizeMesh(false, before, after), "a non-indexed model is refused");
+    for (const std::string &path : generated) std::remove(path.c_str());
+    return benchResult();
+}
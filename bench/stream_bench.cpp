@@ -0,0 +1,114 @@
+// streaming reader: objStream against a full load of the same file, with blocks small enough to split groups;
+// the streamed triangles and groups must match the loader's vbo and group table byte for byte
+// usage: bench_stream [triangles] [--block TRIANGLES] [--tmp DIR]
+#include "obj_loader.h"
+#include "obj_stream.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <dirent.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+static std::vector<std::string> bundledModels(const std::string &dir) {
+    std::vector<std::string> models;
+    DIR *root = opendir(dir.c_str());
+    if (!root) return models;
+    while (struct dirent *entry = readdir(root)) {
+        std::string name = entry -> d_name;
+        if (name == "." || name == "..") continue;
+        models.push_back(dir + "/" + name + "/" + name + ".obj");
+    }
+    closedir(root);
+    std::sort(models.begin(), models.end());
+    return models;
+}
+
+static void compareStream(const std::string &name, const std::string &path, size_t block_triangles) {
+    objLoader model;
+    model.setIndexed(false);
+    model.setSmoothNormals(false);
+    model.setCacheEnabled(false);
+    auto start = std::chrono::steady_clock::now();
+    if (!model.load(path)) {
+        check(false, "load " + name);
+        return;
+    }
+    double load_ms = elapsedMs(start);
+
+    objStream stream(block_triangles);
+    std::vector<float> streamed;
+    size_t blocks = 0;
+    bool blocks_ok = true;
+    size_t last_group = 0;
+    start = std::chrono::steady_clock::now();
+    bool ran = stream.run(path, [&](const obj_stream_block &block) {
+        // whole triangles, at most one block's worth, groups in file order starting where the group does
+        size_t first = streamed.size() / VBO_FLOATS_PER_VERTEX;
+        const auto &groups = stream.getGroupIndices();
+        blocks_ok = blocks_ok && block.vertex_count % 3 == 0 && block.vertex_count <= block_triangles * 3 &&
+            block.group < groups.size() && block.group >= last_group && first >= std::get<0>(groups[block.group]);
+        last_group = block.group;
+        streamed.insert(streamed.end(), block.vertices, block.vertices + block.vertex_count * VBO_FLOATS_PER_VERTEX);
+        blocks++;
+        return true;
+    });
+    double stream_ms = elapsedMs(start);
+    check(ran, name + ": stream");
+    check(blocks_ok, name + ": blocks");
+    check(stream.getSkippedFaces() == 0, name + ": no skipped faces");
+    check(streamed.size() * sizeof(float) == model.getVBOSize() &&
+        memcmp(streamed.data(), model.getVBO(), model.getVBOSize()) == 0, name + ": vertices");
+
+    const auto &loaded_groups = model.getGroupIndices();
+    const auto &streamed_groups = stream.getGroupIndices();
+    check(loaded_groups.size() == streamed_groups.size(), name + ": group count");
+    for (size_t i = 0; i < loaded_groups.size() && i < streamed_groups.size(); i++) {
+        check((size_t)std::get<0>(loaded_groups[i]) == std::get<0>(streamed_groups[i]) &&
+            std::get<1>(loaded_groups[i]) == std::get<1>(streamed_groups[i]) &&
+            std::get<2>(loaded_groups[i]).diffuse == std::get<2>(streamed_groups[i]).diffuse &&
+            std::get<2>(loaded_groups[i]).specular == std::get<2>(streamed_groups[i]).specular &&
+            std::get<2>(loaded_groups[i]).diffuse_map == std::get<2>(streamed_groups[i]).diffuse_map, name + ": group " + std::to_string(i));
+    }
+    // a group larger than a block is handed out in several
+    size_t largest = 0;
+    for (size_t i = 0; i < loaded_groups.size(); i++) largest = std::max(largest, model.getGroupRange(i).second);
+    if (largest > block_triangles * 3) check(blocks > loaded_groups.size(), name + ": groups split into blocks");
+
+    // stopping after the first block
+    size_t stopped_blocks = 0;
+    check(stream.run(path, [&](const obj_stream_block &) { return ++stopped_blocks < 1; }) && stopped_blocks == std::min<size_t>(blocks, 1),
+        name + ": stop early");
+    printf("%s: %zu triangles in %zu groups, %zu blocks: load %.1f ms, stream %.1f ms\n", name.c_str(),
+        model.getVertexCount() / 3, loaded_groups.size(), blocks, load_ms, stream_ms);
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 1000000;
+    size_t block_triangles = 4096;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_stream [triangles] [--block TRIANGLES] [--tmp DIR]", {&triangles},
+        {{"--block", &block_triangles, NULL}, {"--tmp", NULL, &tmp_dir}})) return 1;
+
+    for (const std::string &path : bundledModels("res/model")) {
+        compareStream(path.substr(path.find_last_of('/') + 1), path, block_triangles);
+    }
+    // negative indices, with and without normals and texcoords, and quads split into triangles
+    synthetic_mesh variants[3] = {
+        {triangles, true, true, false, 16, true},
+        {triangles, false, false, true, 16, true},
+        {triangles, true, false, false, 1, false},
+    };
+    for (const synthetic_mesh &mesh : variants) {
+        std::string name = syntheticMeshName(mesh);
+        std::string path = tmp_dir + "/bench_stream_" + name + ".obj";
+        if (generateSyntheticMesh(mesh, path) == 0) return 1;
+        compareStream(name, path, block_triangles);
+        std::remove(path.c_str());
+    }
+    return benchResult();
+}
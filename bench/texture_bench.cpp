@@ -0,0 +1,199 @@
+// texture maps: geometry parse and image decode alone against a load decoding the maps while the
+// geometry parses, maps shared between materials decoded once, the SSE2 mip filter against the
+// scalar one, and map paths kept through save, the mesh cache and a missing file
+// usage: bench_texture [triangles] [--images N] [--size PIXELS] [--tmp DIR]
+#include "obj_loader.h"
+#include "texture_cache.h"
+#include "mesh_generator.h"
+#include "bench_util.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// binary ppm, which stb_image reads, with a pattern that differs per image
+static bool writeImage(const std::string &path, int size, int seed) {
+    std::vector<unsigned char> pixels((size_t)size * size * 3);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            unsigned char *p = &pixels[((size_t)y * size + x) * 3];
+            p[0] = (unsigned char)(x * 7 + seed * 31);
+            p[1] = (unsigned char)(y * 5 + seed * 17);
+            p[2] = (unsigned char)((x ^ y) + seed);
+        }
+    }
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n" << size << " " << size << "\n255\n";
+    out.write((const char *)pixels.data(), pixels.size());
+    return (bool)out;
+}
+
+// a synthetic mesh whose groups cycle through materials, two materials per image and every
+// image named once through another spelling of its path
+static bool writeModel(const synthetic_mesh &mesh, const std::string &path, const std::string &library_path, size_t images) {
+    if (generateSyntheticMesh(mesh, path) == 0) return false;
+    std::ofstream library(library_path);
+    for (size_t i = 0; i < images * 2; i++) {
+        size_t image = i % images;
+        library << "newmtl mat" << i << "\nKd 1 1 1\nmap_Kd " << (i < images ? "" : "./") << "bench_texture_" << image << ".ppm\n";
+        if (i % 3 == 0) library << "map_Bump -bm 0.5 bench_texture_" << (image + 1) % images << ".ppm\n";
+    }
+    std::stringstream contents;
+    {
+        std::ifstream in(path);
+        contents << in.rdbuf();
+    }
+    std::string text = contents.str(), out;
+    size_t library_slash = library_path.find_last_of('/');
+    out = "mtllib " + library_path.substr(library_slash + 1) + "\n";
+    size_t group = 0;
+    for (size_t line = 0; line < text.size(); ) {
+        size_t end = text.find('\n', line);
+        end = end == std::string::npos ? text.size() : end + 1;
+        out.append(text, line, end - line);
+        if (text.compare(line, 2, "g ") == 0) out += "usemtl mat" + std::to_string(group++ % (images * 2)) + "\n";
+        line = end;
+    }
+    std::ofstream file(path);
+    file << out;
+    return (bool)library && (bool)file;
+}
+
+static std::vector<std::string> mapPaths(const objLoader &model) {
+    std::vector<std::string> paths;
+    for (const auto &group : model.getGroupIndices()) {
+        const material &mat = std::get<2>(group);
+        paths.push_back(mat.diffuse_map + "|" + mat.specular_map + "|" + mat.bump_map);
+    }
+    return paths;
+}
+
+int main(int argc, char **argv) {
+    size_t triangles = 2000000, images = 8, pixels = 1024;
+    std::string tmp_dir = "/tmp";
+    if (!parseBenchArgs(argc, argv, "bench_texture [triangles] [--images N] [--size PIXELS] [--tmp DIR]", {&triangles},
+        {{"--images", &images, NULL}, {"--size", &pixels, NULL}, {"--tmp", NULL, &tmp_dir}})) return 1;
+    // the dedupe checks need images shared between materials
+    images = std::max<size_t>(2, images);
+    int size = (int)pixels;
+    std::string path = tmp_dir + "/bench_texture.obj";
+    std::string library_path = tmp_dir + "/bench_texture.mtl";
+    std::vector<std::string> image_paths;
+    for (size_t i = 0; i < images; i++) {
+        image_paths.push_back(tmp_dir + "/bench_texture_" + std::to_string(i) + ".ppm");
+        if (!writeImage(image_paths.back(), size, (int)i)) return 1;
+    }
+    synthetic_mesh mesh = {triangles, true, true, false, images * 4};
+    if (!writeModel(mesh, path, library_path, images)) return 1;
+
+    // each part alone, then both with the decodes started before the geometry parses
+    objLoader geometry;
+    geometry.setIndexed(true);
+    auto start = std::chrono::steady_clock::now();
+    if (!geometry.load(path)) return 1;
+    double parse_ms = elapsedMs(start);
+    double decode_ms;
+    {
+        texture_cache textures;
+        start = std::chrono::steady_clock::now();
+        for (const std::string &image : image_paths) textures.request(image);
+        textures.wait();
+        decode_ms = elapsedMs(start);
+    }
+    texture_cache textures;
+    objLoader model;
+    model.setIndexed(true);
+    model.setTextureCache(&textures);
+    start = std::chrono::steady_clock::now();
+    if (!model.load(path)) return 1;
+    double geometry_ready_ms = elapsedMs(start);
+    textures.wait();
+    double overlapped_ms = elapsedMs(start);
+    texture_stats stats = textures.getStats();
+    printf("%zu triangles, %zu images of %dx%d: parse %.1f ms, decode %.1f ms, sum %.1f ms\n",
+        model.getIndexCount() / 3, images, size, size, parse_ms, decode_ms, parse_ms + decode_ms);
+    printf("decoding while parsing: geometry %.1f ms, every map %.1f ms (%.2fx of the larger part)\n",
+        geometry_ready_ms, overlapped_ms, overlapped_ms / std::max(parse_ms, decode_ms));
+    check(stats.misses == images && stats.failures == 0 && stats.images == images, "every image is decoded once");
+
+    // materials naming one image through different paths share the decoded image
+    const auto &groups = model.getGroupIndices();
+    size_t textured = 0;
+    for (size_t i = 0; i < groups.size(); i++) {
+        const material &mat = std::get<2>(groups[i]);
+        if (mat.diffuse_map.empty()) continue;
+        textured++;
+        check(mat.diffuse_map[0] == '/', "map paths are absolute");
+        texture_handle image = textures.get(mat.diffuse_map);
+        check(image && textures.get(mat.diffuse_map) == image, "a map is shared");
+    }
+    check(textured == groups.size(), "every group has its diffuse map");
+    check(textures.get(tmp_dir + "/./bench_texture_0.ppm") == textures.get(image_paths[0]), "paths are compared canonically");
+    texture_handle first = textures.get(image_paths[0]);
+    check(first && first -> levels.size() == 1 + (size_t)std::log2(size) && first -> levels.back().width == 1 &&
+        first -> levels.back().height == 1, "the mip chain goes down to 1x1");
+    check(textures.getStats().misses == images, "gets of decoded images are hits");
+
+    // the simd filter matches the scalar one on odd, thin and even sizes
+    const int sizes[][2] = {{1, 1}, {1, 7}, {9, 1}, {2, 2}, {7, 5}, {8, 8}, {17, 3}, {33, 31}, {64, 48}, {129, 130}};
+    for (const auto &s : sizes) {
+        std::vector<unsigned char> source((size_t)s[0] * s[1] * 4);
+        for (size_t i = 0; i < source.size(); i++) source[i] = (unsigned char)(i * 2654435761u >> 13);
+        size_t target_size = (size_t)std::max(1, s[0] / 2) * std::max(1, s[1] / 2) * 4;
+        std::vector<unsigned char> simd(target_size), scalar(target_size);
+        downsampleRGBA8(source.data(), s[0], s[1], simd.data());
+        downsampleRGBA8Scalar(source.data(), s[0], s[1], scalar.data());
+        check(simd == scalar, "simd and scalar filters agree on " + std::to_string(s[0]) + "x" + std::to_string(s[1]));
+    }
+    {
+        // 2x2 blocks of 0 and 255 average to 128 with rounding
+        std::vector<unsigned char> checker(8 * 8 * 4), half(4 * 4 * 4);
+        for (size_t i = 0; i < checker.size(); i++) checker[i] = ((i / 4 + i / 32) % 2) ? 255 : 0;
+        downsampleRGBA8(checker.data(), 8, 8, half.data());
+        check(std::all_of(half.begin(), half.end(), [](unsigned char c) { return c == 128; }), "the box filter averages");
+    }
+    texture_image chain = *first;
+    const int repeats = 20;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++) generateMipmaps(chain);
+    double simd_ms = elapsedMs(start) / repeats;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        for (size_t l = 1; l < chain.levels.size(); l++) {
+            const texture_level &previous = chain.levels[l - 1];
+            downsampleRGBA8Scalar(chain.pixels.data() + previous.offset, previous.width, previous.height, chain.pixels.data() + chain.levels[l].offset);
+        }
+    }
+    double scalar_ms = elapsedMs(start) / repeats;
+    check(chain.pixels == first -> pixels, "mipmaps are the same every time");
+    printf("mip chain of %dx%d: %.2f ms, scalar %.2f ms\n", size, size, simd_ms, scalar_ms);
+
+    // map paths survive save, which writes them relative to the new .mtl, and the mesh cache
+    std::string saved_path = tmp_dir + "/bench_texture_saved.obj";
+    if (!model.save(saved_path)) return 1;
+    objLoader saved, cached;
+    saved.setIndexed(true);
+    cached.setIndexed(true);
+    cached.setCacheEnabled(true);
+    if (!saved.load(saved_path) || !cached.load(path) || !cached.load(path)) return 1;
+    check(mapPaths(saved) == mapPaths(model), "saving keeps the maps");
+    check(cached.loadedFromCache() && mapPaths(cached) == mapPaths(model), "the mesh cache keeps the maps");
+    check(std::get<2>(cached.getGroupIndices()[0]).bump_multiplier == 0.5f, "the bump multiplier is kept");
+
+    // a missing image fails once and is not decoded again
+    std::remove(image_paths[images - 1].c_str());
+    texture_cache fresh;
+    check(!fresh.get(image_paths[images - 1]) && !fresh.get(image_paths[images - 1]) && fresh.getStats().failures == 1, "a missing image fails once");
+
+    for (const std::string &file : image_paths) std::remove(file.c_str());
+    for (const std::string &file : {path, library_path, saved_path, saved_path.substr(0, saved_path.size() - 4) + ".mtl", path + ".meshcache"}) std::remove(file.c_str());
+
+    return benchResult();
+}
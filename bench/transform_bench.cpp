@@ -0,0 +1,90 @@
+// applyTransform kernels against the original per-vertex implementation
+// usage: bench_transform [vertex count] [repeats]
+#include "transform_kernel.h"
+#include "thread_pool.h"
+#include "vertex_format.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+
+// applyTransform before the kernels were introduced
+static void transformLegacy(float *vbo, size_t count, const glm::mat4 &transform) {
+    for (size_t i = 0; i < count * VBO_FLOATS_PER_VERTEX; i += VBO_FLOATS_PER_VERTEX) {
+        glm::vec3 vertex(vbo[i], vbo[i+1], vbo[i+2]);
+        glm::vec3 normal(vbo[i+3], vbo[i+4], vbo[i+5]);
+        vertex = transform * glm::vec4(vertex, 1.0f);
+        normal = glm::normalize(glm::transpose(glm::inverse(glm::mat3(transform))) * normal);
+        vbo[i] = vertex.x;
+        vbo[i+1] = vertex.y;
+        vbo[i+2] = vertex.z;
+        vbo[i+3] = normal.x;
+        vbo[i+4] = normal.y;
+        vbo[i+5] = normal.z;
+    }
+}
+
+// best of repeats, in milliseconds, every run starts from the same input
+static double measure(const std::vector<float> &input, std::vector<float> &output, size_t repeats, const std::function<void(float*)> &fn) {
+    double best = 1e30;
+    for (size_t r = 0; r < repeats; r++) {
+        output = input;
+        auto start = std::chrono::steady_clock::now();
+        fn(output.data());
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, elapsed);
+    }
+    return best;
+}
+
+static float maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+    float result = 0.0f;
+    for (size_t i = 0; i < a.size(); i++) result = std::max(result, std::fabs(a[i] - b[i]));
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], NULL, 10) : 4000000;
+    size_t repeats = argc > 2 ? std::strtoull(argv[2], NULL, 10) : 5;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<float> input(count * VBO_FLOATS_PER_VERTEX);
+    for (size_t i = 0; i < count; i++) {
+        float *v = input.data() + i * VBO_FLOATS_PER_VERTEX;
+        for (int k = 0; k < 8; k++) v[k] = dist(rng);
+        glm::vec3 n = glm::normalize(glm::vec3(v[3], v[4], v[5]));
+        v[3] = n.x; v[4] = n.y; v[5] = n.z;
+    }
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, -2.0f, 0.5f)) *
+        glm::rotate(glm::mat4(1.0f), glm::radians(30.0f), glm::vec3(0.3f, 1.0f, 0.2f)) *
+        glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 0.5f, 1.5f));
+    vertex_transform prepared = makeVertexTransform(transform);
+    thread_pool pool;
+    const size_t slice_size = 16384;
+
+    std::vector<float> reference, output;
+    double legacy = measure(input, reference, repeats, [&](float *v) { transformLegacy(v, count, transform); });
+    double scalar = measure(input, output, repeats, [&](float *v) { transformVerticesScalar(v, count, VBO_FLOATS_PER_VERTEX, prepared); });
+    float scalar_error = maxDifference(reference, output);
+    double simd = measure(input, output, repeats, [&](float *v) { transformVertices(v, count, VBO_FLOATS_PER_VERTEX, prepared); });
+    float simd_error = maxDifference(reference, output);
+    double parallel = measure(input, output, repeats, [&](float *v) {
+        pool.parallel_for((count + slice_size - 1) / slice_size, [&](size_t i) {
+            size_t begin = i * slice_size;
+            transformVertices(v + begin * VBO_FLOATS_PER_VERTEX, std::min(slice_size, count - begin), VBO_FLOATS_PER_VERTEX, prepared);
+        });
+    });
+    float parallel_error = maxDifference(reference, output);
+
+    std::cout << count << " vertices, best of " << repeats << std::endl;
+    std::cout << "legacy            " << legacy << " ms" << std::endl;
+    std::cout << "scalar            " << scalar << " ms  x" << legacy / scalar << "  max error " << scalar_error << std::endl;
+    std::cout << transformKernelName() << "              " << simd << " ms  x" << legacy / simd << "  max error " << simd_error << std::endl;
+    std::cout << transformKernelName() << " x " << pool.size() << " threads  " << parallel << " ms  x" << legacy / parallel << "  max error " << parallel_error << std::endl;
+    return 0;
+}
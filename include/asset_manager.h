@@ -0,0 +1,123 @@
+#ifndef __ASSET_MANAGER_H__
+#define __ASSET_MANAGER_H__
+
+#include "obj_loader.h"
+#include <map>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <memory>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// a model shared by every load of the same file contents with the same options, never changed
+// once loaded: draw from it, or copy it into an own objLoader (objLoader::copyFrom) to edit it
+struct mesh_asset {
+    // canonical path of the .obj
+    std::string path;
+    uint64_t hash;
+    // objLoader::cacheOptions and the requested vertex format of the loader that built it
+    uint64_t options;
+    vertex_format format;
+    // built and packed with the options given to asset_manager::load
+    objLoader model;
+    size_t cpu_bytes;
+};
+typedef std::shared_ptr<const mesh_asset> mesh_handle;
+
+// buffers the renderer created for an asset, GL names are plain unsigned ints so the manager
+// needs no GL headers
+struct gpu_mesh {
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int ebo;
+    size_t bytes;
+};
+
+struct asset_stats {
+    size_t mesh_hits;
+    size_t mesh_misses;
+    size_t material_hits;
+    size_t material_misses;
+    // unused meshes dropped to stay within the budget, and how many of them had gpu buffers
+    size_t evictions;
+    size_t gpu_evictions;
+    size_t meshes;
+    size_t materials;
+    size_t cpu_bytes;
+    size_t gpu_bytes;
+};
+
+// cache of loaded models and material libraries keyed by canonical path and content hash; meshes
+// nobody holds a handle to any more are kept until the budget is exceeded, then dropped least
+// recently used first; every member is safe to call from several threads
+class asset_manager {
+public:
+    // budget for the cpu and gpu bytes of all cached meshes, thread_count as for thread_pool
+    explicit asset_manager(size_t budget = (size_t)1 << 30, size_t thread_count = 0);
+    asset_manager(const asset_manager&) = delete;
+    asset_manager& operator=(const asset_manager&) = delete;
+    // the model at filename built with the options setup (may be empty) sets, nullptr if it cannot be
+    // loaded; the file is hashed again only when its size or modification time changed, a changed
+    // file is loaded anew while holders of the old handle keep the old model; parsing (may be empty)
+    // is given the asset before its model is loaded, e.g. to show the progress of the load
+    mesh_handle load(const std::string &filename, const std::function<void(objLoader&)> &setup,
+        const std::function<void(const mesh_handle&)> &parsing = nullptr);
+    // the parsed material library at filename, shared by every model loaded here, nullptr if missing;
+    // libraries are small and not counted against the budget
+    std::shared_ptr<const mtl_file> loadMaterials(const std::string &filename);
+    // record the buffers uploaded for a cached mesh, they count against the budget from now on and
+    // belong to the manager, the renderer deletes them once takeEvicted hands them back
+    void setGPUMesh(const mesh_handle &mesh, const gpu_mesh &gpu);
+    // the buffers of a cached mesh, all zero if none were recorded; counts as a use for the lru order
+    gpu_mesh getGPUMesh(const mesh_handle &mesh);
+    // buffers of evicted meshes, to be deleted on the thread owning the GL context; buffers of a mesh
+    // dropped while somebody still holds it, e.g. after its file changed, come once the last handle is gone
+    void takeEvicted(std::vector<gpu_mesh> &out);
+    void setBudget(size_t bytes);
+    size_t getBudget();
+    // drop meshes and libraries nobody holds, whatever the budget
+    void clearUnused();
+    asset_stats getStats();
+private:
+    struct mesh_entry {
+        mesh_handle mesh;
+        mesh_cache_source source;
+        // the material libraries the model was built with, a changed one makes the mesh stale too
+        std::vector<std::pair<std::string, mesh_cache_source>> libraries;
+        gpu_mesh gpu;
+        // position in lru, front is the most recent
+        std::list<std::string>::iterator use;
+    };
+    struct material_entry {
+        std::shared_ptr<const mtl_file> library;
+        mesh_cache_source source;
+    };
+    std::mutex mutex;
+    // keyed by canonical path, options and vertex format
+    std::map<std::string, mesh_entry> meshes;
+    // keys of meshes being loaded, loaded is notified when one finishes
+    std::set<std::string> loading;
+    std::condition_variable loaded;
+    std::list<std::string> lru;
+    std::map<std::string, material_entry> materials;
+    std::vector<gpu_mesh> evicted;
+    // buffers of meshes dropped while still held, possibly still drawn
+    std::vector<std::pair<std::weak_ptr<const mesh_asset>, gpu_mesh>> retired;
+    size_t budget;
+    asset_stats stats;
+    thread_pool pool;
+    // size, time and hash of the file at path, which is hashed only if its size or time differ from
+    // cached; false if it cannot be read; called without the mutex, hashing a large file takes long
+    bool currentSource(const std::string &path, const mesh_cache_source &cached, mesh_cache_source &current);
+    // true while every library still has the recorded contents, a missing one has a zero source
+    bool librariesMatch(const std::vector<std::pair<std::string, mesh_cache_source>> &libraries);
+    void dropMesh(std::map<std::string, mesh_entry>::iterator entry);
+    // evict unused meshes until the budget holds, mutex held
+    void trim();
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __ASYNC_LOADER_H__
+#define __ASYNC_LOADER_H__
+
+#include "obj_loader.h"
+#include "asset_manager.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include <string>
+
+enum async_load_state {
+    ASYNC_IDLE,
+    ASYNC_LOADING,
+    // the result is waiting to be taken
+    ASYNC_DONE,
+    ASYNC_FAILED,
+};
+
+// loads a model into a fresh objLoader on a worker thread, so a slow or failed load
+// never touches the model currently in use
+class async_loader {
+public:
+    async_loader(): state(ASYNC_IDLE), assets(nullptr) {}
+    async_loader(const async_loader&) = delete;
+    async_loader& operator=(const async_loader&) = delete;
+    ~async_loader();
+    // setup configures the new loader before load is called, returns false while a load is running;
+    // with an asset manager setup runs again on the worker, so it must only read values it captured
+    bool start(const std::string &filename, const std::function<void(objLoader&)> &setup);
+    // as start, but open the groups of filename with objLoader::openGroups instead of loading it whole;
+    // the asset manager is not used
+    bool startOpen(const std::string &filename, const std::function<void(objLoader&)> &setup);
+    // load through a shared asset cache and hand out the cached model itself, nullptr loads directly;
+    // the cache must outlive the loads
+    void setAssetManager(asset_manager *assets);
+    async_load_state getState() const { return this -> state.load(); }
+    // [0, 1] while loading, 1 once done or failed
+    float getProgress();
+    // the result once done, false if the load failed: the loaded model with its packed vbo already built
+    // in model, or for a load through the asset manager the shared cached model in asset, to be drawn
+    // as it is and copied to be edited (objLoader::copyFrom); the loader is idle again afterwards
+    bool take(std::unique_ptr<objLoader> &model, mesh_handle &asset);
+private:
+    std::atomic<async_load_state> state;
+    std::unique_ptr<objLoader> loader;
+    asset_manager *assets;
+    // the cached model being parsed for this load, its progress is the progress of the load
+    std::mutex parsing_mutex;
+    mesh_handle parsing;
+    // the cached model of a finished load through the asset manager
+    mesh_handle loaded;
+    std::thread worker;
+    bool launch(const std::string &filename, const std::function<void(objLoader&)> &setup, bool open_groups);
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef __DRAW_LIST_H__
+#define __DRAW_LIST_H__
+
+#include <GL/glew.h>
+#include "obj_loader.h"
+#include "gpu_textures.h"
+#include <vector>
+
+// uniform locations of the model shader, looked up once per program
+struct model_uniforms {
+    GLint model;
+    GLint view;
+    GLint projection;
+    GLint view_pos;
+    GLint light_pos;
+    GLint light_color;
+    GLint position_scale;
+    GLint position_offset;
+    GLint normal_oct_scale;
+    // inverse transpose of model, set per batch by draw
+    GLint normal_matrix;
+    // group transform and its normal matrix, set per batch by drawInstanced
+    GLint group_model;
+    GLint group_normal;
+};
+
+// groups sharing a material, position dequantization and group transform, drawn with one multi draw call
+struct draw_batch {
+    // byte offset of the material in the material buffer
+    GLintptr material_offset;
+    // diffuse, specular and bump map bound to texture units 0, 1 and 2, 0 where the material has none
+    GLuint textures[3];
+    position_dequant dequant;
+    glm::mat4 transform;
+    glm::mat3 normal;
+    // element ranges, contiguous groups are merged into one range
+    std::vector<GLsizei> counts;
+    std::vector<GLint> firsts;
+    std::vector<const void*> offsets;
+};
+
+// part of a group drawn with its material, a range of the index buffer or of the vertices
+struct draw_range {
+    size_t group;
+    size_t first;
+    size_t count;
+};
+
+// the draw calls of a model sorted by material, materials live in a uniform buffer
+// so a batch only rebinds a buffer range, everything is GL 3.3 core
+class draw_list {
+public:
+    draw_list(): program(0), textures(NULL), material_buffer(0), material_stride(0), indexed(false), index_type(GL_UNSIGNED_SHORT), group_count(0), range_count(0), triangle_count(0) {}
+    draw_list(const draw_list&) = delete;
+    draw_list& operator=(const draw_list&) = delete;
+    ~draw_list();
+    // cache the uniform locations of program, bind its Material block and point its samplers at the
+    // texture units of the maps
+    void setProgram(GLuint program);
+    // draw the maps of the materials with the textures of textures, NULL draws plain colors;
+    // textures must outlive the draw list
+    void setTextures(gpu_textures *textures);
+    const model_uniforms &getUniforms();
+    // rebuild the batches and the material buffer if the groups, their ranges or materials changed;
+    // the model is read as last packed, i.e. as uploaded, so a shared asset can be drawn
+    void update(const objLoader &model);
+    // same, drawing level levels[i] of the levels of detail of group i, clamped to the coarsest
+    // one, groups past the end of levels draw the full group
+    void update(const objLoader &model, const std::vector<size_t> &levels);
+    // draw exactly ranges, e.g. the visible clusters, touching ranges are merged into one draw
+    void update(const objLoader &model, const std::vector<draw_range> &ranges);
+    // VAO must hold the buffers of the model passed to update, model is the matrix of the whole model,
+    // the model and normal matrix uniforms are set per batch with the group transform applied
+    void draw(GLuint VAO, const glm::mat4 &model);
+    // draw instances copies in one call per merged range, VAO also holds the per instance
+    // attributes (instance_buffer::attach) and the program reads the model matrix from them,
+    // the group transform comes from the groupModel and groupNormal uniforms
+    void drawInstanced(GLuint VAO, GLsizei instances);
+    size_t getGroupCount();
+    size_t getBatchCount();
+    // merged element ranges over all batches
+    size_t getRangeCount();
+    // triangles drawn by draw
+    size_t getTriangleCount();
+private:
+    // what a range contributes to the draw list, compared bytewise between frames
+    struct group_record {
+        // ambient, diffuse, specular, shininess, the bump multiplier and the bits of the three texture
+        // names, the dequant scale and offset, then the group transform
+        float key[36];
+        // normal matrix of the group transform, follows from the key
+        float normal[9];
+        size_t first;
+        size_t count;
+    };
+    GLuint program;
+    model_uniforms uniforms;
+    gpu_textures *textures;
+    GLuint material_buffer;
+    size_t material_stride;
+    bool indexed;
+    GLenum index_type;
+    size_t group_count;
+    std::vector<group_record> records;
+    std::vector<draw_batch> batches;
+    size_t range_count;
+    size_t triangle_count;
+    void build();
+    // bind the material and maps and set the dequantization of batch, the material and maps only if
+    // they are not bound yet
+    void bindBatch(const draw_batch &batch, GLintptr &bound_material, GLuint *bound_textures);
+    // whether batch has another group transform than the one before it
+    bool transformChanged(size_t batch);
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef __FORMAT_UTIL_H__
+#define __FORMAT_UTIL_H__
+
+#include <charconv>
+#include <string>
+#include <cstring>
+#include <cstddef>
+
+// allocation-light, locale-independent counterparts of parse_util for writing text
+
+// shortest representation that parses back to the same float
+inline void append_float(std::string &out, float value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+inline void append_uint(std::string &out, size_t value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+inline void append_str(std::string &out, const char *text) {
+    out.append(text, strlen(text));
+}
+
+// keyword followed by n space separated floats and a newline
+inline void append_floats_line(std::string &out, const char *keyword, const float *values, int n) {
+    append_str(out, keyword);
+    for (int i = 0; i < n; i++) {
+        out.push_back(' ');
+        append_float(out, values[i]);
+    }
+    out.push_back('\n');
+}
+
+#endif
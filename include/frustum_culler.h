@@ -0,0 +1,46 @@
+#ifndef __FRUSTUM_CULLER_H__
+#define __FRUSTUM_CULLER_H__
+
+#include "mesh_cluster.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// frustum and camera in the space of the bounds being culled
+struct cull_view {
+    // normalized planes, p is inside when dot(plane.xyz, p) + plane.w >= 0
+    glm::vec4 planes[6];
+    glm::vec3 camera;
+    // test the normal cones as well
+    bool backface;
+};
+
+// the view of bounds drawn with projection * view * model, the cone test assumes model
+// keeps angles (rotation, translation, uniform scale)
+cull_view makeCullView(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &model, bool backface);
+
+// spheres with normal cones kept in structure of arrays layout, culled 4 or 8 at a time
+class frustum_culler {
+public:
+    frustum_culler(): count(0) {}
+    void clear();
+    // a cone with cutoff 1 is never backface culled
+    void add(const glm::vec4 &sphere, const normal_cone &cone);
+    // replace item index, e.g. after the group it bounds moved
+    void set(size_t index, const glm::vec4 &sphere, const normal_cone &cone);
+    size_t size();
+    // indices of the items inside or crossing the frustum and not facing away, ascending
+    void cull(const cull_view &view, std::vector<uint32_t> &visible);
+    // the reference kernel, cull picks the widest one the cpu supports
+    void cullScalar(const cull_view &view, std::vector<uint32_t> &visible);
+    // "avx2", "sse" or "scalar"
+    static const char *kernelName();
+private:
+    size_t count;
+    // padded to a multiple of 8 with spheres that are always outside
+    std::vector<float> center_x, center_y, center_z, radius;
+    std::vector<float> axis_x, axis_y, axis_z, cutoff;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __GPU_TEXTURES_H__
+#define __GPU_TEXTURES_H__
+
+#include <GL/glew.h>
+#include "texture_cache.h"
+#include <map>
+#include <string>
+#include <cstddef>
+
+// GL textures of the images in a texture_cache keyed by path, uploaded once with their whole mip chain
+// and shared by every draw list of the context; the decoded image is not kept after the upload
+class gpu_textures {
+public:
+    explicit gpu_textures(texture_cache *cache): cache(cache), bytes(0) {}
+    gpu_textures(const gpu_textures&) = delete;
+    gpu_textures& operator=(const gpu_textures&) = delete;
+    ~gpu_textures();
+    // the texture of the image at path, waiting for it if it is still decoding; 0 for an empty path
+    // or an image that cannot be decoded
+    GLuint get(const std::string &path);
+    // delete every texture
+    void clear();
+    size_t size();
+    size_t getMemoryUsage();
+private:
+    texture_cache *cache;
+    std::map<std::string, GLuint> textures;
+    size_t bytes;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __INSTANCE_BUFFER_H__
+#define __INSTANCE_BUFFER_H__
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+// one copy of a model in an instanced draw, laid out as the per instance attributes of model_instanced.vs
+struct instance_data {
+    glm::mat4 model;
+    // inverse transpose of the model matrix, computed once per instance instead of per vertex
+    glm::mat3 normal;
+    // replaces the material's diffuse color by rgb where a is 1, a = 0 keeps the material
+    glm::vec4 color;
+};
+
+// transforms and material overrides of the copies of a model, edited on the CPU and sent to the GPU
+// in one upload per frame; the attributes start at location 3, after position, normal and texcoord
+class instance_buffer {
+public:
+    instance_buffer(): buffer(0), capacity(0), dirty_first(0), dirty_end(0), uploaded_bytes(0) {}
+    instance_buffer(const instance_buffer&) = delete;
+    instance_buffer& operator=(const instance_buffer&) = delete;
+    ~instance_buffer();
+    // new instances get the identity transform and keep their material
+    void resize(size_t count);
+    size_t size();
+    void setTransform(size_t index, const glm::mat4 &model);
+    void setColor(size_t index, const glm::vec4 &color);
+    const instance_data &get(size_t index);
+    // one buffer update covering every instance changed since the last upload, call before drawing
+    void upload();
+    // point the per instance attributes of VAO at the buffer, the VAO keeps them until it is deleted
+    void attach(GLuint VAO);
+    // bytes copied by the last upload
+    size_t getUploadedBytes();
+private:
+    std::vector<instance_data> instances;
+    GLuint buffer;
+    // instances the buffer storage holds
+    size_t capacity;
+    // instances dirty_first .. dirty_end - 1 changed since the last upload
+    size_t dirty_first;
+    size_t dirty_end;
+    size_t uploaded_bytes;
+    void markDirty(size_t index);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __LOAD_STATS_H__
+#define __LOAD_STATS_H__
+
+#include <chrono>
+#include <cstddef>
+
+// numbers of the last objLoader::load, only collected when built with -DOBJ_LOADER_STATS,
+// otherwise LOAD_STATS() statements compile to nothing and the struct stays zero
+struct load_stats {
+    // wall time per phase in milliseconds
+    double open_ms;
+    double cache_ms;
+    double parse_ms;
+    // chunk merge and group replay, without material libraries
+    double merge_ms;
+    double material_ms;
+    // smooth normal generation
+    double normals_ms;
+    double triangulate_ms;
+    // tmp_vbo to vbo copy and index packing
+    double copy_ms;
+    double total_ms;
+    size_t bytes_read;
+    // lines per record type
+    size_t vertex_lines;
+    size_t normal_lines;
+    size_t texcoord_lines;
+    size_t face_lines;
+    size_t group_lines;
+    size_t usemtl_lines;
+    size_t mtllib_lines;
+    size_t comment_lines;
+    size_t empty_lines;
+    // unsupported keywords (o, s, l, ...) and lines starting with a space
+    size_t skipped_lines;
+    size_t triangles;
+    size_t vertices;
+    size_t indices;
+    // bytes allocated per container, tmp_vbo at its largest
+    size_t positions_bytes;
+    size_t normals_bytes;
+    size_t texcoords_bytes;
+    size_t faces_bytes;
+    size_t tmp_vbo_bytes;
+    size_t vbo_bytes;
+    size_t ibo_bytes;
+};
+
+#ifdef OBJ_LOADER_STATS
+#define LOAD_STATS(statement) statement
+#else
+#define LOAD_STATS(statement)
+#endif
+
+inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
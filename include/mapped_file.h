@@ -0,0 +1,35 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <string>
+#include <cstddef>
+#include <utility>
+
+// memory mapping of a whole file, either read-only or a private copy-on-write view
+class mapped_file {
+public:
+    mapped_file(): map_data(nullptr), map_size(0), opened(false) {}
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    ~mapped_file();
+    bool open(const std::string &filename, bool copy_on_write = false);
+    void close();
+    bool isOpen() const { return this -> opened; }
+    const char *data() const { return this -> map_data; }
+    // only writable when opened copy-on-write, writes never reach the file
+    char *mutableData() { return this -> map_data; }
+    // drop the pages of [0, offset) from the resident set, they are read back from the file if touched again
+    void releaseBefore(size_t offset);
+    size_t size() const { return this -> map_size; }
+    void swap(mapped_file &other) {
+        std::swap(this -> map_data, other.map_data);
+        std::swap(this -> map_size, other.map_size);
+        std::swap(this -> opened, other.opened);
+    }
+private:
+    char *map_data;
+    size_t map_size;
+    bool opened;
+};
+
+#endif
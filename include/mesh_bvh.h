@@ -0,0 +1,80 @@
+#ifndef __MESH_BVH_H__
+#define __MESH_BVH_H__
+
+#include "obj_loader.h"
+#include "thread_pool.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+// 32 bytes, two nodes share a cache line, the children of a node are stored next to each other
+struct bvh_node {
+    float bounds_min[3];
+    // first child when count is 0, otherwise the first triangle of the leaf
+    uint32_t first;
+    float bounds_max[3];
+    uint32_t count;
+};
+
+// triangles are numbered in element order: triangle t uses the elements 3t .. 3t + 2
+struct bvh_hit {
+    bool hit;
+    float distance;
+    size_t group;
+    size_t triangle;
+    // barycentric coordinates of the hit point
+    float u, v;
+};
+
+struct bvh_nearest {
+    bool found;
+    glm::vec3 point;
+    float distance;
+    size_t group;
+    size_t triangle;
+};
+
+// bounding volume hierarchy over the triangles of a model, in model space after the group transforms,
+// it reads positions straight from the model's vbo while every group is at the identity and from a
+// transformed copy otherwise, so rebuild after the model is reloaded and refit after transforms change
+class mesh_bvh {
+public:
+    mesh_bvh(): vbo(NULL), stride(VBO_FLOATS_PER_VERTEX) {}
+    // binned SAH build, subtrees are built in parallel when a pool is given
+    void build(const objLoader &model, thread_pool *pool = nullptr);
+    // recompute the bounds after vertices moved, the tree shape is kept
+    void refit(const objLoader &model);
+    // only refit the leaves using vertices in (first vertex, vertex count) ranges, sorted as from getDirtyRanges(),
+    // a model with group transforms is refit as a whole
+    void refit(const objLoader &model, const std::vector<std::pair<size_t, size_t>> &vertex_ranges);
+    bool empty();
+    size_t getNodeCount();
+    size_t getTriangleCount();
+    size_t getGroup(size_t triangle);
+    // closest hit along the ray, direction does not need to be normalized,
+    // distances are then in multiples of its length
+    bvh_hit raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_distance = INFINITY);
+    // triangles whose bounds overlap the box
+    void overlap(const glm::vec3 &box_min, const glm::vec3 &box_max, std::vector<size_t> &triangles);
+    // closest point on the surface within max_distance
+    bvh_nearest nearest(const glm::vec3 &point, float max_distance = INFINITY);
+private:
+    std::vector<bvh_node> nodes;
+    // vertex indices of the triangles in leaf order
+    std::vector<uint32_t> corners;
+    // element order number of each triangle in leaf order
+    std::vector<uint32_t> triangle_ids;
+    // first triangle of every group
+    std::vector<size_t> group_first;
+    const float *vbo;
+    size_t stride;
+    // positions after the group transforms, 3 floats per vertex
+    std::vector<float> transformed;
+    // point vbo at the model's positions, transforming them first if needed
+    void usePositions(const objLoader &model);
+    glm::vec3 vertex(uint32_t index) const;
+    void leafBounds(bvh_node &node) const;
+};
+
+#endif
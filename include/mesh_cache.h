@@ -0,0 +1,87 @@
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "thread_pool.h"
+
+// bump whenever the layout below or the loader output changes
+#define MESH_CACHE_VERSION 4
+#define MESH_CACHE_ENDIAN_TAG 0x01020304u
+
+// identity of a source file a cache was built from, the .obj or a material library
+struct mesh_cache_source {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+};
+
+// fixed size file header, all offsets are from the start of the file and 16 byte aligned
+struct mesh_cache_header {
+    char magic[8];
+    uint32_t endian_tag;
+    uint32_t version;
+    mesh_cache_source source;
+    // loader options that change the output, see objLoader::cacheOptions
+    uint64_t options;
+    uint64_t vbo_offset;
+    uint64_t vbo_size;
+    uint64_t ibo_offset;
+    uint64_t index_count;
+    uint64_t index_size;
+    uint64_t group_offset;
+    uint64_t group_count;
+    uint64_t material_offset;
+    uint64_t material_count;
+    uint64_t string_offset;
+    uint64_t string_size;
+    uint64_t flags;
+    uint64_t library_offset;
+    uint64_t library_count;
+};
+
+struct mesh_cache_material {
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+    float bump_multiplier;
+    uint32_t reserved;
+    // diffuse, specular and bump map paths in the string section, empty if unset
+    uint64_t map_offset[3];
+    uint64_t map_size[3];
+};
+
+// one entry of group_index
+struct mesh_cache_group {
+    uint64_t start;
+    uint64_t vertex_offset;
+    uint64_t name_offset;
+    uint64_t name_size;
+    mesh_cache_material mat;
+};
+
+// one entry of the material library
+struct mesh_cache_named_material {
+    uint64_t name_offset;
+    uint64_t name_size;
+    mesh_cache_material mat;
+};
+
+// a material library the cached materials were read from, the cache is stale once it changes
+struct mesh_cache_library {
+    uint64_t path_offset;
+    uint64_t path_size;
+    // all zero if the library could not be read
+    mesh_cache_source source;
+};
+
+// size and modification time only, the hash is filled by hashBytes
+bool statMeshSource(const std::string &filename, mesh_cache_source &source);
+// size, time and hash of a small file such as a material library, all zero if it cannot be read
+mesh_cache_source readMeshSource(const std::string &filename);
+// fast non-cryptographic 64 bit hash, blocks are hashed in parallel when a pool is given
+uint64_t hashBytes(const char *data, size_t size, thread_pool *pool = nullptr);
+
+#endif
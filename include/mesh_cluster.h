@@ -0,0 +1,41 @@
+#ifndef __MESH_CLUSTER_H__
+#define __MESH_CLUSTER_H__
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstddef>
+
+// vertices are stride floats each, the position being the first three
+
+// axis aligned box and bounding sphere in model space
+struct mesh_bounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    // center and radius
+    glm::vec4 sphere;
+};
+
+// the face normals of a set of triangles all lie within cone_cutoff of cone_axis, seen from a point p
+// every triangle faces away when dot(center - p, cone_axis) >= cone_cutoff * |center - p| + radius,
+// a cutoff of 1 never passes so cones over half a sphere are stored that way
+struct normal_cone {
+    glm::vec3 axis;
+    float cutoff;
+};
+
+// bounds of count vertices, the sphere is centered on the box
+mesh_bounds computeVertexBounds(const float *vertices, size_t count, size_t stride);
+// bounds of the vertices used by a triangle list, indices are absolute
+mesh_bounds computeTriangleBounds(const uint32_t *indices, size_t index_count, const float *vertices, size_t stride);
+// normal cone of the counter clockwise face normals of a triangle list, degenerate triangles are ignored
+normal_cone computeNormalCone(const uint32_t *indices, size_t index_count, const float *vertices, size_t stride);
+// bounds of the transformed box, the sphere keeps its center moved and its radius grown by the largest axis scale
+mesh_bounds transformBounds(const mesh_bounds &bounds, const glm::mat4 &transform);
+// the cone of the transformed normals, normal_matrix being the inverse transpose of the transform; cones
+// only stay valid under angle preserving transforms, others get cutoff 1 so they are never culled
+normal_cone transformCone(const normal_cone &cone, const glm::mat4 &transform, const glm::mat3 &normal_matrix);
+// reorder triangles so every run of max_triangles is compact in space, runs follow the morton order
+// of the triangle centroids and keep the previous order inside, so a cache optimized order mostly survives
+void sortClusters(uint32_t *indices, size_t index_count, const float *vertices, size_t stride, size_t max_triangles);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __MESH_NORMALS_H__
+#define __MESH_NORMALS_H__
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstddef>
+#include "thread_pool.h"
+
+// corners hold the position index of every triangle corner, three per triangle,
+// pool may be NULL to run on the calling thread
+
+// smooth normal of every corner of the triangles flagged in needed (NULL = all): the face normals
+// around the corner's position weighted by triangle area and corner angle, counting only faces
+// within crease_angle (radians) of the corner's own face, so edges sharper than that stay hard;
+// normals of unflagged triangles are left untouched
+void generateSmoothNormals(const glm::vec3 *positions, size_t position_count, const uint32_t *corners, size_t corner_count,
+    const unsigned char *needed, float crease_angle, glm::vec3 *normals, thread_pool *pool);
+
+// tangent of every vertex from the uv gradients of its triangles (Lengyel 2001), made orthogonal
+// to the vertex normal, w is the sign of the bitangent; vertices are stride floats of position,
+// normal and uv, indices NULL means a plain triangle list
+void generateTangents(const float *vertices, size_t stride, size_t vertex_count, const uint32_t *indices, size_t index_count,
+    glm::vec4 *tangents, thread_pool *pool);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __MESH_OPTIMIZER_H__
+#define __MESH_OPTIMIZER_H__
+
+#include <cstdint>
+#include <cstddef>
+
+// post-transform cache efficiency of an index sequence, simulated with a FIFO cache
+struct vertex_cache_stats {
+    size_t triangles;
+    // vertices actually used by the triangles
+    size_t vertices;
+    // cache misses, i.e. vertex shader invocations
+    size_t transformed;
+    // average cache miss ratio, transformed / triangles (0.5 best, 3 worst)
+    double acmr;
+    // average transform to vertex ratio, transformed / vertices (1 best)
+    double atvr;
+};
+
+// indices are relative to a vertex range of vertex_count vertices
+
+// totals over several index ranges with disjoint vertices
+vertex_cache_stats sumVertexCacheStats(const vertex_cache_stats *stats, size_t count);
+vertex_cache_stats analyzeVertexCache(const uint32_t *indices, size_t index_count, size_t vertex_count, unsigned cache_size = 16);
+// reorder triangles for cache reuse with Tipsify (Sander et al. 2007)
+void optimizeVertexCache(uint32_t *indices, size_t index_count, size_t vertex_count, unsigned cache_size = 16);
+// reorder clusters of an already cache optimized sequence so outward facing ones come first,
+// a cluster is only split where its running miss ratio stays within threshold of the whole cluster
+void optimizeOverdraw(uint32_t *indices, size_t index_count, const float *vertices, size_t stride, size_t vertex_count, unsigned cache_size = 16, float threshold = 1.05f);
+// reorder vertices (stride floats each) in order of first use and remap the indices
+void optimizeVertexFetch(uint32_t *indices, size_t index_count, float *vertices, size_t stride, size_t vertex_count);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef __MESH_SIMPLIFIER_H__
+#define __MESH_SIMPLIFIER_H__
+
+#include <cstdint>
+#include <cstddef>
+
+// indices are relative to a vertex range of vertex_count vertices with stride floats each,
+// the position being the first three
+
+// reduce a triangle list to at most target_index_count indices by quadric error edge collapse
+// (Garland and Heckbert 1997), every collapse moves a vertex onto a neighbour so the result
+// indexes the same vertices, open borders only collapse along themselves, vertices with
+// several attribute sets (uv or normal seams) only along the seam, and vertices flagged
+// in locked (may be NULL) never move; returns the new index count and stores the largest
+// collapse error, a distance in model units, in result_error
+size_t simplifyMesh(uint32_t *destination, const uint32_t *indices, size_t index_count, const float *vertices, size_t stride, size_t vertex_count,
+    size_t target_index_count, const unsigned char *locked, float *result_error);
+
+#endif
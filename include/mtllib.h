@@ -8,16 +8,25 @@
 #include <iostream>
 #include <sstream>
 
-class material { // map unimplemented
+class material {
 public:
     glm::vec3 ambient;
     glm::vec3 diffuse;
     glm::vec3 specular;
     float shininess;
+    // map_Kd, map_Ks and map_Bump resolved against the .mtl, absolute when the file exists, empty if unset
+    std::string diffuse_map;
+    std::string specular_map;
+    std::string bump_map;
+    // -bm of map_Bump, the bump map is a height map scaled by it
+    float bump_multiplier;
     material(glm::vec3 a = glm::vec3(0.0), glm::vec3 d = glm::vec3(1.0), glm::vec3 s = glm::vec3(0.0), float sh = 32.0)
-        : ambient(a), diffuse(d), specular(s), shininess(sh) {}
+        : ambient(a), diffuse(d), specular(s), shininess(sh), bump_multiplier(1.0f) {}
     material(const material& m)
-        : ambient(m.ambient), diffuse(m.diffuse), specular(m.specular), shininess(m.shininess) {}
+        : ambient(m.ambient), diffuse(m.diffuse), specular(m.specular), shininess(m.shininess),
+          diffuse_map(m.diffuse_map), specular_map(m.specular_map), bump_map(m.bump_map), bump_multiplier(m.bump_multiplier) {}
+    material& operator=(const material&) = default;
+    bool hasMaps() const { return !diffuse_map.empty() || !specular_map.empty() || !bump_map.empty(); }
 };
 
 class mtl_file {
@@ -28,6 +37,7 @@ public:
         : name(filename) {}
     bool load(const std::string& filename, bool append = false);
     void append(const std::string& matname, const material &mat);
+    // map paths are written relative to the directory of filename
     bool save(const std::string& filename);
 };
 
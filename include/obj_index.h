@@ -0,0 +1,68 @@
+#ifndef __OBJ_INDEX_H__
+#define __OBJ_INDEX_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "mesh_cache.h"
+#include "thread_pool.h"
+
+// bump whenever the layout of the sidecar or the meaning of its fields changes
+#define OBJ_INDEX_VERSION 1
+
+// the lines of a group as objLoader::load splits them: from its first face to the first face of
+// the next group, with the records before it for resolving relative indices
+struct obj_group_span {
+    std::string name;
+    // usemtl name in effect at the first face, empty if none, and the mtllib in effect when it was
+    // set (index into obj_index::libraries, -1 for none)
+    std::string material;
+    int64_t library;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t faces;
+    // v, vt and vn records before begin
+    uint64_t vertices;
+    uint64_t texcoords;
+    uint64_t normals;
+};
+
+// a line start and the records before it, one about every obj_index_checkpoint_step bytes
+struct obj_index_checkpoint {
+    uint64_t offset;
+    uint64_t vertices;
+    uint64_t texcoords;
+    uint64_t normals;
+};
+
+enum obj_record_kind {
+    OBJ_RECORD_VERTEX,
+    OBJ_RECORD_TEXCOORD,
+    OBJ_RECORD_NORMAL,
+};
+
+// where every group and every record of an .obj is, found by looking at the first token of each line only
+struct obj_index {
+    // size and modification time of the indexed file, the hash is not checked
+    mesh_cache_source source;
+    uint64_t vertices;
+    uint64_t texcoords;
+    uint64_t normals;
+    uint64_t faces;
+    std::vector<obj_group_span> groups;
+    std::vector<obj_index_checkpoint> checkpoints;
+    // mtllib names in file order, relative to the .obj
+    std::vector<std::string> libraries;
+};
+
+// scan size bytes of an .obj, newline aligned slices in parallel when a pool is given
+void scanObjIndex(const char *data, size_t size, obj_index &index, thread_pool *pool = nullptr);
+// false if the sidecar is missing, damaged or was built from another size or modification time
+bool readObjIndex(const std::string &path, const mesh_cache_source &source, obj_index &index);
+bool writeObjIndex(const std::string &path, const obj_index &index);
+// the records of kind with the given sorted file indices (0 based), parsed by seeking to the checkpoint
+// before each run of them; 3 floats per vertex or normal and 2 per texcoord, records past the end read as 0
+void readObjRecords(const char *data, size_t size, const obj_index &index, obj_record_kind kind, const std::vector<uint32_t> &ids, float *out);
+
+#endif
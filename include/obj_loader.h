@@ -8,31 +8,315 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <atomic>
+#include <functional>
 #include "mtllib.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "obj_index.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "mesh_cluster.h"
+#include "mesh_normals.h"
+#include "vertex_format.h"
+#include "transform_kernel.h"
+#include "load_stats.h"
+
+struct obj_chunk;
+
+// faces in compressed rows: the corners of face i are first[i] .. first[i+1] - 1,
+// with one index array per attribute, -1 marks a missing index
+struct face_list {
+    std::vector<uint32_t> first;
+    std::vector<int> v;
+    std::vector<int> vt;
+    std::vector<int> vn;
+    face_list(): first(1, 0) {}
+    size_t size() const { return this -> first.size() - 1; }
+    bool empty() const { return this -> first.size() == 1; }
+    // keeps the capacity for the next load
+    void clear() {
+        this -> first.assign(1, 0);
+        this -> v.clear();
+        this -> vt.clear();
+        this -> vn.clear();
+    }
+    void swap(face_list &other) {
+        this -> first.swap(other.first);
+        this -> v.swap(other.v);
+        this -> vt.swap(other.vt);
+        this -> vn.swap(other.vn);
+    }
+};
+
+// a level of detail of a group, a range of the index buffer
+struct group_lod {
+    size_t first;
+    size_t count;
+    // geometric error of the simplification in model units, 0 for the full group
+    float error;
+};
+
+// a run of a group's triangles culled on its own, a range of the index buffer
+struct group_cluster {
+    size_t group;
+    size_t first;
+    size_t count;
+    mesh_bounds bounds;
+    normal_cone cone;
+};
 
 class objLoader {
 public:
-    objLoader(): vbo(NULL), vertices(0), normals(0), texcoord(0), material_lib("default") {}
+    objLoader(): vbo(NULL), vbo_size(0), vertices(0), normals(0), texcoord(0), material_lib("default"), textures(NULL), lod_first(0), indexed(false), index_size(sizeof(uint16_t)), has_normal(false), has_texcoord(false),
+        flat_normals(false), smooth_normals(false), crease_angle(60.0f), tangents_dirty(true), packed_dirty(true), release_source(false), cache_enabled(false), from_cache(false), known_source(), stats(), thread_count(0), shared_pool(NULL),
+        progress_bytes(0), progress_bytes_total(0), progress_faces(0), progress_faces_total(0) {}
     ~objLoader();
     bool load(const std::string &filename);
-    bool hasNormal();
-    bool hasTexcoord();
-    const float *getVBO();
-    size_t getVBOSize();
-    const std::vector<std::tuple<int, std::string, material>> &getGroupIndices();
+    // open a large file without parsing its geometry: the group index is read from a sidecar next to the
+    // .obj (or in the cache dir), or built by scanning the first token of every line if it is missing or
+    // the file changed; every group is an unloaded placeholder in getGroupIndices with an empty range;
+    // a file that cannot be opened leaves the model as it was
+    bool openGroups(const std::string &filename);
+    // parse only the lines of the given groups and the records they use, then rebuild the buffers of
+    // every loaded group; loaded groups are skipped, levels of detail and clusters are dropped, and the
+    // parsed source is kept whatever setReleaseSource says
+    bool loadGroups(const std::vector<size_t> &groups);
+    // false for the placeholders of openGroups
+    bool isGroupLoaded(size_t index) const;
+    // progress of a running load in [0, 1], safe to call from another thread
+    float getLoadProgress() const;
+    // exchange every buffer and setting with other, e.g. to publish a model loaded on another thread
+    void swap(objLoader &other);
+    // copy every buffer and output setting of other, e.g. to edit a model shared through asset_manager;
+    // the thread and material source settings stay with this loader
+    void copyFrom(const objLoader &other);
+    bool hasNormal() const;
+    bool hasTexcoord() const;
+    const float *getVBO() const;
+    size_t getVBOSize() const;
+    // getVBO() always holds VBO_FLOATS_PER_VERTEX floats per vertex, the packed vbo
+    // uses the vertex format, texcoords are dropped when the model has none
+    void setVertexFormat(const vertex_format &format);
+    vertex_format getVertexFormat() const;
+    // the format given to setVertexFormat, before attributes the model lacks are dropped
+    vertex_format getRequestedFormat() const;
+    const unsigned char *getPackedVBO();
+    size_t getPackedVBOSize();
+    // maps a group's packed positions back to model space
+    const position_dequant &getGroupDequant(size_t index);
+    // a const model is not repacked, these return the buffers as last packed, e.g. for a shared
+    // asset packed when it was loaded
+    const unsigned char *getPackedVBO() const;
+    size_t getPackedVBOSize() const;
+    const position_dequant &getGroupDequant(size_t index) const;
+    // indexed mode deduplicates vertices per group and fills an index buffer,
+    // group offsets then count indices instead of vertices
+    void setIndexed(bool enable);
+    bool isIndexed() const;
+    const void *getIBO() const;
+    size_t getIBOSize() const;
+    // 2 or 4 bytes, chosen from the vertex count
+    size_t getIndexSize() const;
+    size_t getIndexCount() const;
+    size_t getVertexCount() const;
+    // first element and element count of a group, in indices when indexed and vertices otherwise
+    std::pair<size_t, size_t> getGroupRange(size_t index) const;
+    // first vertex and vertex count of a group
+    std::pair<size_t, size_t> getGroupVertexRange(size_t index) const;
+    const std::vector<std::tuple<int, std::string, material>> &getGroupIndices() const;
+    // levels of detail of a group from finest to coarsest, the first is the group itself
+    const std::vector<group_lod> &getGroupLODs(size_t index) const;
+    // box and sphere of a group's vertices before its group transform, computed at load and kept up
+    // to date by applyTransform
+    const mesh_bounds &getGroupBounds(size_t index) const;
+    // clusters of every group in group order, empty until buildClusters
+    const std::vector<group_cluster> &getClusters() const;
+    // first cluster and cluster count of a group
+    std::pair<size_t, size_t> getGroupClusters(size_t index) const;
     void applyMaterial(size_t index, const material &mat);
+    // group transforms are baked into the saved vertices, the model itself is left as it is; false
+    // without writing anything while a group of openGroups is not loaded
     bool save(const std::string &filename);
+    // group transforms are kept next to the vertices and applied by the renderer, setting one only
+    // stores the matrix and its normal matrix; every group starts at the identity
+    void setGroupTransform(size_t index, const glm::mat4 &transform);
+    const glm::mat4 &getGroupTransform(size_t index) const;
+    // inverse transpose of the upper 3x3 part of the group transform
+    const glm::mat3 &getGroupNormalMatrix(size_t index) const;
+    // false while every group is at the identity
+    bool hasGroupTransforms() const;
+    // transform the vertices of a group in place, e.g. to edit the mesh itself
     void applyTransform(size_t index, const glm::mat4 &transform);
+    // transform several groups in one pass, large groups are split across the pool; a group given more
+    // than once gets its transforms applied in order
+    void applyTransforms(const std::vector<std::pair<size_t, glm::mat4>> &transforms);
+    // vertex spans (first vertex, vertex count) changed since the last clearDirtyRanges(),
+    // sorted and merged, a span starts at first * stride in the packed vbo
+    const std::vector<std::pair<size_t, size_t>> &getDirtyRanges();
+    void clearDirtyRanges();
+    // reorder each group's triangles for the post-transform cache (and optionally overdraw),
+    // then its vertices for fetch locality, indexed mode only
+    bool optimizeMesh(bool reduce_overdraw, vertex_cache_stats &before, vertex_cache_stats &after);
+    // simplify every group to each ratio of its triangles, descending (e.g. 0.5, 0.25, 0.1, 0.02),
+    // each level from the one before, and append the levels to the index buffer after the groups,
+    // groups run in parallel, indexed mode only
+    bool generateLODs(const std::vector<float> &ratios);
+    // drop the appended levels, every group is left with only itself; optimizeMesh does this since it
+    // renumbers the vertices
+    void clearLODs();
+    // reorder each group's triangles into spatially compact runs of at most max_triangles and keep
+    // the bounds and normal cone of every run, for culling below group granularity, indexed mode only;
+    // optimizeMesh drops the clusters
+    bool buildClusters(size_t max_triangles);
+    // binary cache of the built buffers, written next to the .obj unless a cache dir is set
+    void setCacheEnabled(bool enable);
+    void setCacheDir(const std::string &dir);
+    bool loadedFromCache() const;
+    // size, time and hash of the file the next load reads when the caller hashed it already; the cache
+    // uses the hash instead of hashing again if the file still has that size and time
+    void setKnownSource(const mesh_cache_source &source);
+    // paths of the material libraries the model was built with, whether they could be read or not
+    const std::vector<std::string> &getMaterialLibraries() const;
+    // loader options that change the built buffers, part of the cache key
+    uint64_t cacheOptions() const;
+    // bytes held by the model's buffers, including a vbo mapped from the cache
+    size_t getMemoryUsage() const;
+    // libraries named by mtllib come from source instead of being parsed by this loader, e.g. to share
+    // them between models; nullptr from source counts as a missing library, an empty function parses them
+    void setMaterialSource(const std::function<std::shared_ptr<const mtl_file>(const std::string&)> &source);
+    // request the maps of every material library read from now on from cache, which decodes them on its
+    // own pool; load reads the libraries named near the start of the file before parsing, so the images
+    // decode while the geometry parses; the cache must outlive its use here, nullptr stops the requests
+    void setTextureCache(texture_cache *cache);
+    // phase timings and counts of the last load, zero unless built with OBJ_LOADER_STATS
+    const load_stats &getLoadStats() const;
+    // free the parsed vertices, normals, texcoords and faces once the vbo is built,
+    // otherwise their memory is reused by the next load
+    void setReleaseSource(bool enable);
+    // ignore the file's normals and give every triangle its face normal, written by save
+    void setFlatNormals(bool enable);
+    // give faces without normals smooth vertex normals instead of their face normal, averaged over
+    // the faces around a position that meet within the crease angle; faces with normals keep them
+    void setSmoothNormals(bool enable);
+    // in degrees, 60 unless set
+    void setCreaseAngle(float degrees);
+    // tangent and bitangent sign (w) of every vertex from its uv, computed on first use after the vertices change
+    const std::vector<glm::vec4> &getTangents();
+    // threads used for loading, 0 = all hardware threads
+    void setThreadCount(size_t count);
+    size_t getThreadCount() const;
+    // run parallel work on a pool shared with other loaders instead of an own one,
+    // nullptr goes back to the own pool, the pool must outlive its use here
+    void setThreadPool(thread_pool *pool);
 private:
     float *vbo;
     size_t vbo_size;
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec2> texcoord;
-    std::vector<std::vector<std::tuple<int, int, int>>> faces;
+    face_list faces;
     mtl_file material_lib;
+    // path of the library in material_lib, read again only when another one was read in between
+    std::string material_lib_path;
+    // every library named by mtllib, in the order first named; cached meshes depend on them
+    std::vector<std::string> material_lib_paths;
+    std::function<std::shared_ptr<const mtl_file>(const std::string&)> material_source;
+    texture_cache *textures;
+    void requestTextures(const material &mat);
+    // read the libraries named by mtllib lines near the start of a file being loaded
+    void prefetchMaterials(const std::string &filename, const char *data, size_t size);
     // face index, group name, material
     std::vector<std::tuple<int, std::string, material>> group_index;
+    std::vector<size_t> group_vertex_offset;
+    std::vector<std::vector<group_lod>> group_lods;
+    // first index of the appended levels, 0 while the index buffer only holds the groups
+    size_t lod_first;
+    std::vector<mesh_bounds> group_bounds;
+    std::vector<group_cluster> clusters;
+    // clusters of group i are group_cluster_first[i] .. group_cluster_first[i + 1] - 1
+    std::vector<size_t> group_cluster_first;
+    // per group, empty while every group is at the identity
+    std::vector<glm::mat4> group_transforms;
+    std::vector<glm::mat3> group_normal_matrices;
+    // transform the vertices of the given groups in target, a vbo laid out like this one, in parallel slices;
+    // every group at most once, slices of one group would race
+    void transformGroups(float *target, const std::vector<std::pair<size_t, glm::mat4>> &transforms);
+    // bounds of every group after the groups were built, clusters and levels of detail are dropped
+    void computeBounds();
+    // bounds of the given groups and their clusters after their vertices moved
+    void updateBounds(const std::vector<size_t> &groups);
+    void clearClusters();
+    bool indexed;
+    size_t index_size;
+    std::vector<uint16_t> ibo16;
+    std::vector<uint32_t> ibo32;
+    void packIndices(const std::vector<uint32_t> &indices);
+    std::vector<uint32_t> unpackIndices();
+    bool has_normal;
+    bool has_texcoord;
+    bool flat_normals;
+    bool smooth_normals;
+    float crease_angle;
+    std::vector<glm::vec4> tangents;
+    bool tangents_dirty;
+    vertex_format requested_format;
+    std::vector<unsigned char> packed_vbo;
+    std::vector<position_dequant> group_dequant;
+    // packed_dirty repacks everything, stale groups are repacked alone
+    bool packed_dirty;
+    std::vector<size_t> stale_groups;
+    void packVBO();
+    std::vector<std::pair<size_t, size_t>> dirty_ranges;
+    void addDirtyRange(size_t first, size_t count);
+    // set when the vbo lives in a mapped cache file instead of the heap
+    mapped_file vbo_mapping;
+    void releaseVBO();
+    bool release_source;
+    bool cache_enabled;
+    bool from_cache;
+    // set by setKnownSource, size 0 when unset, used by one load
+    mesh_cache_source known_source;
+    std::string cache_dir;
+    std::string cachePath(const std::string &filename, const char *extension = ".meshcache");
+    bool readCache(const std::string &cache_path, const mesh_cache_source &source);
+    bool writeCache(const std::string &cache_path, const mesh_cache_source &source);
+    load_stats stats;
+    void collectLoadStats(size_t bytes_read, size_t tmp_vbo_bytes);
+    size_t thread_count;
+    std::unique_ptr<thread_pool> pool;
+    thread_pool *shared_pool;
+    thread_pool &getPool();
+    void mergeChunks(std::vector<obj_chunk> &chunks, const std::string &filename);
+    // read the library name relative to the .obj at filename into material_lib
+    void loadMaterialLibrary(const std::string &filename, const std::string &name);
+    // forget the model before loading another one
+    void resetModel();
+    // triangulate faces into the vbo and ibo, group_index holds face starts before and element offsets
+    // after, returns the bytes of the temporary vbo
+    size_t buildBuffers();
+    // lazy loading, see openGroups: the file and its index, the faces of every group with indices into
+    // vertices, texcoord and normals (empty until loaded), and the sorted file indices of the v, vt and vn
+    // records held with where each one is held
+    std::string lazy_filename;
+    obj_index lazy_index;
+    std::vector<face_list> lazy_faces;
+    std::vector<unsigned char> group_loaded;
+    std::vector<uint32_t> lazy_ids[3];
+    std::vector<uint32_t> lazy_local[3];
+    // rebuild the buffers from the faces of the loaded groups
+    void rebuildLazyGroups();
+    // parsed bytes and triangulated faces of the running load
+    std::atomic<size_t> progress_bytes;
+    std::atomic<size_t> progress_bytes_total;
+    std::atomic<size_t> progress_faces;
+    std::atomic<size_t> progress_faces_total;
+    void finishProgress();
 };
 
 #endif
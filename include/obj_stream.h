@@ -0,0 +1,39 @@
+#ifndef __OBJ_STREAM_H__
+#define __OBJ_STREAM_H__
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <tuple>
+#include <string>
+#include <functional>
+#include "mtllib.h"
+#include "vertex_format.h"
+
+// a block of finished triangles in the canonical vbo layout, all from one group
+struct obj_stream_block {
+    // index into objStream::getGroupIndices
+    size_t group;
+    const float *vertices;
+    // always a multiple of 3
+    size_t vertex_count;
+};
+
+// single pass, bounded memory alternative to objLoader::load for meshes larger than RAM:
+// only v/vn/vt stay resident, triangles are handed out in fixed size blocks and never stored
+class objStream {
+public:
+    objStream(size_t block_triangles = 65536): block_triangles(block_triangles), material_lib("default"), skipped_faces(0) {}
+    // callback returns false to stop early, blocks are only valid during the call
+    bool run(const std::string &filename, const std::function<bool(const obj_stream_block &)> &callback);
+    // first vertex, group name and material of every group seen so far, like objLoader::getGroupIndices
+    const std::vector<std::tuple<size_t, std::string, material>> &getGroupIndices();
+    // faces dropped because they referenced attributes that do not exist
+    size_t getSkippedFaces();
+private:
+    size_t block_triangles;
+    mtl_file material_lib;
+    std::vector<std::tuple<size_t, std::string, material>> group_index;
+    size_t skipped_faces;
+};
+
+#endif
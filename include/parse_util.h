@@ -0,0 +1,87 @@
+#ifndef __PARSE_UTIL_H__
+#define __PARSE_UTIL_H__
+
+#include <charconv>
+#include <cstring>
+#include <cstddef>
+
+// allocation-free, locale-independent tokenizing helpers working on raw bytes
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char *skip_space(const char *p, const char *end) {
+    while (p < end && is_space(*p)) p++;
+    return p;
+}
+
+inline const char *skip_token(const char *p, const char *end) {
+    while (p < end && !is_space(*p)) p++;
+    return p;
+}
+
+inline const char *find_line_end(const char *p, const char *end) {
+    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    return nl ? nl : end;
+}
+
+inline bool token_is(const char *token, const char *token_end, const char *keyword) {
+    size_t len = strlen(keyword);
+    return (size_t)(token_end - token) == len && memcmp(token, keyword, len) == 0;
+}
+
+// parse a float at p and advance p past it, p is left untouched on failure
+inline bool parse_float(const char *&p, const char *end, float &out) {
+    const char *start = p;
+    // from_chars does not accept an explicit plus sign
+    if (start < end && *start == '+') start++;
+    auto result = std::from_chars(start, end, out);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+// parse a decimal integer at p and advance p past it, p is left untouched on failure
+inline bool parse_int(const char *&p, const char *end, int &out) {
+    const char *cur = p;
+    bool negative = false;
+    if (cur < end && (*cur == '-' || *cur == '+')) {
+        negative = (*cur == '-');
+        cur++;
+    }
+    const char *digits = cur;
+    long long value = 0;
+    while (cur < end && *cur >= '0' && *cur <= '9') {
+        if (value < (1LL << 32)) value = value * 10 + (*cur - '0');
+        cur++;
+    }
+    if (cur == digits) return false;
+    out = (int)(negative ? -value : value);
+    p = cur;
+    return true;
+}
+
+// parse up to n whitespace separated floats, returns how many were read
+inline int parse_floats(const char *p, const char *end, float *out, int n) {
+    for (int i = 0; i < n; i++) {
+        p = skip_space(p, end);
+        if (!parse_float(p, end, out[i])) return i;
+    }
+    return n;
+}
+
+// parse one face corner (v, v/vt, v//vn or v/vt/vn) into raw 1-based indices, 0 marks a missing field
+inline void parse_face_corner(const char *corner, const char *corner_end, int raw[3]) {
+    raw[0] = raw[1] = raw[2] = 0;
+    const char *field = corner;
+    for (int k = 0; k < 3; k++) {
+        const char *num = field;
+        parse_int(num, corner_end, raw[k]);
+        const char *slash = static_cast<const char *>(memchr(field, '/', corner_end - field));
+        if (!slash) break;
+        field = slash + 1;
+    }
+}
+
+#endif
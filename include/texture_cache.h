@@ -0,0 +1,89 @@
+#ifndef __TEXTURE_CACHE_H__
+#define __TEXTURE_CACHE_H__
+
+#include "thread_pool.h"
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// one level of a mip chain, a slice of texture_image::pixels
+struct texture_level {
+    int width;
+    int height;
+    size_t offset;
+};
+
+// an image decoded to RGBA8 with its mip chain down to 1x1, level 0 first, rows top to bottom
+// as stored in the file
+struct texture_image {
+    std::string path;
+    std::vector<texture_level> levels;
+    // every level back to back
+    std::vector<unsigned char> pixels;
+    const unsigned char *level(size_t index) const { return this -> pixels.data() + this -> levels[index].offset; }
+};
+typedef std::shared_ptr<const texture_image> texture_handle;
+
+struct texture_stats {
+    size_t hits;
+    size_t misses;
+    // files that could not be read or decoded
+    size_t failures;
+    size_t images;
+    size_t bytes;
+    // summed over every decode, on whatever thread it ran
+    double decode_ms;
+};
+
+// decode the image at path with stb_image and build its mip chain, false if it cannot be read
+bool decodeTexture(const std::string &path, texture_image &image);
+// levels 1.. of image from level 0
+void generateMipmaps(texture_image &image);
+// halve an RGBA8 image with a 2x2 box filter into max(1, width / 2) x max(1, height / 2) pixels,
+// rounding to nearest; the last column or row of an odd size is dropped like GL's floor rule,
+// a side of 1 is kept and averaged along the other side only
+void downsampleRGBA8(const unsigned char *source, int width, int height, unsigned char *target);
+// the reference filter, downsampleRGBA8 uses SSE2 where the cpu has it
+void downsampleRGBA8Scalar(const unsigned char *source, int width, int height, unsigned char *target);
+
+// decoded images keyed by canonical path, so materials and models naming the same file share one
+// image; requested images are decoded on the cache's pool while the caller goes on, e.g. with the
+// geometry of the model using them; every member is safe to call from several threads
+class texture_cache {
+public:
+    // thread_count as for thread_pool
+    explicit texture_cache(size_t thread_count = 0);
+    texture_cache(const texture_cache&) = delete;
+    texture_cache& operator=(const texture_cache&) = delete;
+    // start decoding path on the pool unless it is cached or decoding already
+    void request(const std::string &path);
+    // the image at path, waiting for a running decode and decoding on the calling thread if it was never
+    // requested; nullptr if it cannot be decoded, which is remembered until clear
+    texture_handle get(const std::string &path);
+    // wait until every requested image is decoded
+    void wait();
+    // drop images nobody holds a handle to
+    void clearUnused();
+    void clear();
+    texture_stats getStats();
+private:
+    std::mutex mutex;
+    // keyed by canonical path, nullptr for images that failed
+    std::map<std::string, texture_handle> images;
+    // keys being decoded, decoded is notified when one finishes
+    std::set<std::string> decoding;
+    std::condition_variable decoded;
+    texture_stats stats;
+    // true if key is neither cached nor decoding, it is marked as decoding then; mutex held
+    bool claim(const std::string &key);
+    void decode(const std::string &key);
+    // last so running decodes finish before the rest of the cache goes away
+    thread_pool pool;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+class thread_pool {
+public:
+    // thread_count = 0 uses all hardware threads
+    explicit thread_pool(size_t thread_count = 0);
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+    ~thread_pool();
+    size_t size() const { return this -> workers.size(); }
+    void submit(std::function<void()> task);
+    // run body(0) .. body(count - 1) on the pool, the calling thread helps and returns when all are done
+    void parallel_for(size_t count, const std::function<void(size_t)> &body);
+    static size_t hardwareThreads();
+private:
+    void workerLoop();
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __TRANSFORM_KERNEL_H__
+#define __TRANSFORM_KERNEL_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// a model matrix prepared for transforming vbo records, the normal matrix is computed once
+struct vertex_transform {
+    // rows of the upper 3x4 part of the matrix
+    float position[3][4];
+    // rows of the inverse transpose of the upper 3x3 part
+    float normal[3][3];
+};
+
+vertex_transform makeVertexTransform(const glm::mat4 &transform);
+
+// transform count records of stride floats in place, each starting with position and normal,
+// normals are renormalized and zero normals stay zero
+void transformVertices(float *vertices, size_t count, size_t stride, const vertex_transform &transform);
+
+// the reference kernel, transformVertices picks the widest one the cpu supports
+void transformVerticesScalar(float *vertices, size_t count, size_t stride, const vertex_transform &transform);
+
+// "avx2", "sse" or "scalar"
+const char *transformKernelName();
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __VERTEX_FORMAT_H__
+#define __VERTEX_FORMAT_H__
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// floats per vertex in the canonical vbo: position, normal, texcoord
+#define VBO_FLOATS_PER_VERTEX 8
+
+// how one attribute is stored in a packed vertex buffer
+enum vertex_encoding {
+    // attribute is dropped
+    VERTEX_NONE,
+    VERTEX_FLOAT32,
+    // positions only: 16 bit integers relative to the group bounding box
+    VERTEX_QUANT16,
+    // normals only: octahedral mapping in 2x16 or 2x8 bit integers
+    VERTEX_OCT16,
+    VERTEX_OCT8,
+    // texcoords only
+    VERTEX_HALF,
+};
+
+enum vertex_component_type {
+    COMPONENT_FLOAT,
+    COMPONENT_HALF,
+    COMPONENT_SHORT,
+    COMPONENT_BYTE,
+};
+
+// everything needed for one glVertexAttribPointer call
+struct vertex_attribute {
+    unsigned location;
+    unsigned components;
+    vertex_component_type type;
+    size_t offset;
+};
+
+// integer components are never normalized by the pipeline, the shader applies
+// position_dequant and the octahedral scale itself so the result does not depend
+// on the GL version's snorm conversion rule
+struct vertex_format {
+    vertex_encoding position;
+    vertex_encoding normal;
+    vertex_encoding texcoord;
+    vertex_format(vertex_encoding p = VERTEX_FLOAT32, vertex_encoding n = VERTEX_FLOAT32, vertex_encoding t = VERTEX_FLOAT32)
+        : position(p), normal(n), texcoord(t) {}
+    size_t stride() const;
+    // position at location 0, normal at 1, texcoord at 2, dropped ones are skipped
+    std::vector<vertex_attribute> attributes() const;
+    // factor turning stored octahedral integers into [-1, 1], 0 for float normals
+    float normalScale() const;
+};
+
+// stored position * scale + offset gives the original position
+struct position_dequant {
+    glm::vec3 offset;
+    glm::vec3 scale;
+    position_dequant(): offset(0.0f), scale(1.0f) {}
+};
+
+// identity for float positions, the bounding box mapping for quantized ones
+position_dequant computeDequant(const float *vertices, size_t count, const vertex_format &format);
+// pack count canonical vertices into format.stride() bytes each
+void packVertices(const float *vertices, size_t count, const vertex_format &format, const position_dequant &dequant, unsigned char *out);
+uint16_t floatToHalf(float value);
+
+#endif
@@ -1,27 +1,58 @@
 #version 330 core
 in vec3 FragPos;
 in vec3 Normal;
+in vec2 TexCoord;
+flat in vec4 DiffuseOverride;
 out vec4 FragColor;
 uniform vec3 viewPos;
 uniform vec3 lightPos;
 uniform vec3 lightColor;
-uniform vec3 objectAmbientColor;
-uniform vec3 objectDiffuseColor;
-uniform vec3 objectSpecularColor;
-uniform float objectShininess;
+// material of the current draw batch, shininess is stored in specular.w;
+// maps.xyz is 1 where the diffuse, specular and bump map are bound, maps.w the bump multiplier
+layout (std140) uniform Material {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 maps;
+} object;
+uniform sampler2D diffuseMap;
+uniform sampler2D specularMap;
+uniform sampler2D bumpMap;
+
+// the bump map is a height map, the normal is tilted by its screen space gradient so no tangents
+// are needed (Mikkelsen 2010)
+vec3 bumpNormal(vec3 n) {
+    vec3 dpdx = dFdx(FragPos);
+    vec3 dpdy = dFdy(FragPos);
+    float height = texture(bumpMap, TexCoord).r * object.maps.w;
+    float dhdx = dFdx(height);
+    float dhdy = dFdy(height);
+    vec3 r1 = cross(dpdy, n);
+    vec3 r2 = cross(n, dpdx);
+    float det = dot(dpdx, r1);
+    vec3 gradient = sign(det) * (dhdx * r1 + dhdy * r2);
+    return normalize(abs(det) * n - gradient);
+}
+
 void main() {
     vec3 norm = normalize(Normal);
+    // the maps are the same for the whole batch, so derivatives stay defined inside the branches
+    if (object.maps.z > 0.0) norm = bumpNormal(norm);
     vec3 lightDir = normalize(lightPos - FragPos);
     // ambient
-    vec3 ambient = objectAmbientColor;
+    vec3 ambient = object.ambient.rgb;
     // diffuse
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * objectDiffuseColor;
+    vec3 albedo = mix(object.diffuse.rgb, DiffuseOverride.rgb, DiffuseOverride.a);
+    if (object.maps.x > 0.0) albedo *= texture(diffuseMap, TexCoord).rgb;
+    vec3 diffuse = diff * albedo;
     // specular
     vec3 viewDir = normalize(viewPos-FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), objectShininess);
-    vec3 specular = objectSpecularColor * spec;
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), object.specular.w);
+    vec3 specularColor = object.specular.rgb;
+    if (object.maps.y > 0.0) specularColor *= texture(specularMap, TexCoord).rgb;
+    vec3 specular = specularColor * spec;
     // combine results
     vec3 result = (ambient + diffuse + specular) * lightColor;
     FragColor = vec4(result, 1.0);
@@ -1,14 +1,39 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
 
 out vec3 FragPos;
 out vec3 Normal;
+out vec2 TexCoord;
+// diffuse color replacing the material's where w is 1, instanced draws only
+flat out vec4 DiffuseOverride;
+// model with the group transform, and its inverse transpose computed once per draw on the CPU
 uniform mat4 model;
+uniform mat3 normalMatrix;
 uniform mat4 view;
 uniform mat4 projection;
+// quantized positions: stored * positionScale + positionOffset, (1, 0) for floats
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+// octahedral normals: integer scale to [-1, 1], 0 for float normals
+uniform float normalOctScale;
+
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
+
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 pos = aPos * positionScale + positionOffset;
+    vec3 normal = normalOctScale > 0.0 ? octDecode(aNormal.xy * normalOctScale) : aNormal;
+    FragPos = vec3(model * vec4(pos, 1.0));
+    Normal = normalMatrix * normal;
+    // images are stored top row first, obj texcoords start at the bottom
+    TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);
+    DiffuseOverride = vec4(0.0);
+    gl_Position = projection * view * model * vec4(pos, 1.0);
 }
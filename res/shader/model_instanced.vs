@@ -0,0 +1,43 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+// per instance: model matrix, its normal matrix computed on the CPU and a diffuse override
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in mat3 instanceNormal;
+layout (location = 10) in vec4 instanceColor;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+flat out vec4 DiffuseOverride;
+// transform of the group being drawn and its normal matrix, applied before the instance's
+uniform mat4 groupModel;
+uniform mat3 groupNormal;
+uniform mat4 view;
+uniform mat4 projection;
+// quantized positions: stored * positionScale + positionOffset, (1, 0) for floats
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+// octahedral normals: integer scale to [-1, 1], 0 for float normals
+uniform float normalOctScale;
+
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
+
+void main() {
+    vec3 pos = aPos * positionScale + positionOffset;
+    vec3 normal = normalOctScale > 0.0 ? octDecode(aNormal.xy * normalOctScale) : aNormal;
+    vec4 world = instanceModel * (groupModel * vec4(pos, 1.0));
+    FragPos = vec3(world);
+    Normal = instanceNormal * (groupNormal * normal);
+    // images are stored top row first, obj texcoords start at the bottom
+    TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);
+    DiffuseOverride = instanceColor;
+    gl_Position = projection * view * world;
+}
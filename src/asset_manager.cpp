@@ -0,0 +1,272 @@
+#include "asset_manager.h"
+#include "mapped_file.h"
+#include <iterator>
+#include <cstdio>
+#include <climits>
+#include <cstdlib>
+
+static bool canonicalPath(const std::string &filename, std::string &path) {
+    char resolved[PATH_MAX];
+    if (!realpath(filename.c_str(), resolved)) return false;
+    path = resolved;
+    return true;
+}
+
+static std::string meshKey(const std::string &path, uint64_t options, const vertex_format &format) {
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), "|%016llx|%d%d%d", (unsigned long long)options, (int)format.position, (int)format.normal, (int)format.texcoord);
+    return path + suffix;
+}
+
+asset_manager::asset_manager(size_t budget, size_t thread_count): budget(budget), stats(), pool(thread_count) {}
+
+bool asset_manager::currentSource(const std::string &path, const mesh_cache_source &cached, mesh_cache_source &current) {
+    if (!statMeshSource(path, current)) return false;
+    if (current.size == cached.size && current.mtime_ns == cached.mtime_ns) {
+        current.hash = cached.hash;
+        return true;
+    }
+    mapped_file file;
+    if (!file.open(path)) return false;
+    current.hash = hashBytes(file.data(), file.size(), &this -> pool);
+    return true;
+}
+
+bool asset_manager::librariesMatch(const std::vector<std::pair<std::string, mesh_cache_source>> &libraries) {
+    for (auto &library : libraries) {
+        mesh_cache_source current;
+        if (!this -> currentSource(library.first, library.second, current)) current = mesh_cache_source();
+        if (current.size != library.second.size || current.hash != library.second.hash) return false;
+    }
+    return true;
+}
+
+mesh_handle asset_manager::load(const std::string &filename, const std::function<void(objLoader&)> &setup,
+    const std::function<void(const mesh_handle&)> &parsing) {
+    std::string path;
+    if (!canonicalPath(filename, path)) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return nullptr;
+    }
+    // a mesh is only shared with loads that would have built the same buffers
+    std::shared_ptr<mesh_asset> asset = std::make_shared<mesh_asset>();
+    objLoader &model = asset -> model;
+    model.setThreadPool(&this -> pool);
+    if (setup) setup(model);
+    model.setMaterialSource([this](const std::string &library) { return this -> loadMaterials(library); });
+    std::string key = meshKey(path, model.cacheOptions(), model.getRequestedFormat());
+    // the file is checked without the mutex, other threads keep using the manager meanwhile
+    mesh_cache_source source;
+    bool readable;
+    for (;;) {
+        mesh_handle cached;
+        mesh_cache_source cached_source = mesh_cache_source();
+        std::vector<std::pair<std::string, mesh_cache_source>> cached_libraries;
+        {
+            std::unique_lock<std::mutex> lock(this -> mutex);
+            // the same mesh loading on another thread is waited for instead of parsed twice
+            this -> loaded.wait(lock, [&] { return this -> loading.count(key) == 0; });
+            auto found = this -> meshes.find(key);
+            if (found != this -> meshes.end()) {
+                cached = found -> second.mesh;
+                cached_source = found -> second.source;
+                cached_libraries = found -> second.libraries;
+            }
+        }
+        readable = this -> currentSource(path, cached_source, source);
+        bool libraries_match = this -> librariesMatch(cached_libraries);
+        std::lock_guard<std::mutex> lock(this -> mutex);
+        auto found = this -> meshes.find(key);
+        // loaded, replaced or dropped by another thread meanwhile, look again
+        if (this -> loading.count(key) || (found != this -> meshes.end() ? found -> second.mesh : nullptr) != cached) continue;
+        if (cached && readable && source.hash == cached_source.hash && libraries_match) {
+            // touched but not changed, the next check is cheap again
+            found -> second.source = source;
+            this -> stats.mesh_hits++;
+            this -> lru.splice(this -> lru.begin(), this -> lru, found -> second.use);
+            return cached;
+        }
+        // the file or a library changed, holders of the old handle keep the old model
+        if (cached) this -> dropMesh(found);
+        this -> stats.mesh_misses++;
+        this -> loading.insert(key);
+        break;
+    }
+    if (parsing) parsing(asset);
+    // the loader's mesh cache takes the hash instead of reading the file twice
+    if (readable) model.setKnownSource(source);
+    bool ok = readable && model.load(filename);
+    std::vector<std::pair<std::string, mesh_cache_source>> libraries;
+    if (ok) {
+        for (const std::string &library : model.getMaterialLibraries()) {
+            mesh_cache_source library_source = mesh_cache_source();
+            if (!this -> currentSource(library, mesh_cache_source(), library_source)) library_source = mesh_cache_source();
+            libraries.push_back(std::make_pair(library, library_source));
+        }
+        // pack now, the model is never changed again
+        model.getPackedVBO();
+        // the handle may outlive the manager and its pool
+        model.setThreadPool(nullptr);
+        model.setMaterialSource(nullptr);
+        model.setTextureCache(nullptr);
+        asset -> path = path;
+        asset -> hash = source.hash;
+        asset -> options = model.cacheOptions();
+        asset -> format = model.getRequestedFormat();
+        asset -> cpu_bytes = model.getMemoryUsage();
+    }
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    this -> loading.erase(key);
+    this -> loaded.notify_all();
+    // waiting loads of a failed mesh try again themselves
+    if (!ok) return nullptr;
+    this -> lru.push_front(key);
+    mesh_entry &entry = this -> meshes[key];
+    entry.mesh = asset;
+    entry.source = source;
+    entry.libraries = libraries;
+    entry.gpu = gpu_mesh();
+    entry.use = this -> lru.begin();
+    this -> stats.cpu_bytes += asset -> cpu_bytes;
+    this -> trim();
+    return asset;
+}
+
+std::shared_ptr<const mtl_file> asset_manager::loadMaterials(const std::string &filename) {
+    std::string path;
+    if (!canonicalPath(filename, path)) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return nullptr;
+    }
+    std::shared_ptr<const mtl_file> cached;
+    mesh_cache_source cached_source = mesh_cache_source(), source;
+    {
+        std::lock_guard<std::mutex> lock(this -> mutex);
+        auto found = this -> materials.find(path);
+        if (found != this -> materials.end()) {
+            cached = found -> second.library;
+            cached_source = found -> second.source;
+        }
+    }
+    bool readable = this -> currentSource(path, cached_source, source);
+    {
+        std::lock_guard<std::mutex> lock(this -> mutex);
+        auto found = this -> materials.find(path);
+        bool same = found != this -> materials.end() && found -> second.library == cached;
+        if (cached && readable && source.hash == cached_source.hash) {
+            // a library another thread read meanwhile is as good
+            if (same) found -> second.source = source;
+            this -> stats.material_hits++;
+            return cached;
+        }
+        if (same) this -> materials.erase(found);
+        this -> stats.material_misses++;
+    }
+    std::shared_ptr<mtl_file> library = std::make_shared<mtl_file>(path);
+    if (!readable || !library -> load(path)) return nullptr;
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    material_entry &entry = this -> materials[path];
+    entry.library = library;
+    entry.source = source;
+    return library;
+}
+
+void asset_manager::setGPUMesh(const mesh_handle &mesh, const gpu_mesh &gpu) {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    auto found = this -> meshes.find(meshKey(mesh -> path, mesh -> options, mesh -> format));
+    if (found == this -> meshes.end() || found -> second.mesh != mesh) {
+        // no longer cached, the buffers go back to the renderer once the caller lets go of the mesh
+        this -> retired.push_back(std::make_pair(std::weak_ptr<const mesh_asset>(mesh), gpu));
+        return;
+    }
+    gpu_mesh &current = found -> second.gpu;
+    if (current.vao != 0 || current.vbo != 0 || current.ebo != 0) this -> evicted.push_back(current);
+    this -> stats.gpu_bytes = this -> stats.gpu_bytes - current.bytes + gpu.bytes;
+    current = gpu;
+    this -> trim();
+}
+
+gpu_mesh asset_manager::getGPUMesh(const mesh_handle &mesh) {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    auto found = this -> meshes.find(meshKey(mesh -> path, mesh -> options, mesh -> format));
+    if (found == this -> meshes.end() || found -> second.mesh != mesh) return gpu_mesh();
+    this -> lru.splice(this -> lru.begin(), this -> lru, found -> second.use);
+    return found -> second.gpu;
+}
+
+void asset_manager::takeEvicted(std::vector<gpu_mesh> &out) {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    out.insert(out.end(), this -> evicted.begin(), this -> evicted.end());
+    this -> evicted.clear();
+    for (auto entry = this -> retired.begin(); entry != this -> retired.end(); ) {
+        if (!entry -> first.expired()) {
+            ++entry;
+            continue;
+        }
+        out.push_back(entry -> second);
+        entry = this -> retired.erase(entry);
+    }
+}
+
+void asset_manager::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    this -> budget = bytes;
+    this -> trim();
+}
+
+size_t asset_manager::getBudget() {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    return this -> budget;
+}
+
+void asset_manager::clearUnused() {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    for (auto entry = this -> meshes.begin(); entry != this -> meshes.end(); ) {
+        auto next = std::next(entry);
+        // the map holds the only reference, nobody can take a new one without the mutex
+        if (entry -> second.mesh.use_count() == 1) this -> dropMesh(entry);
+        entry = next;
+    }
+    for (auto entry = this -> materials.begin(); entry != this -> materials.end(); ) {
+        if (entry -> second.library.use_count() == 1) entry = this -> materials.erase(entry);
+        else ++entry;
+    }
+}
+
+asset_stats asset_manager::getStats() {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    asset_stats current = this -> stats;
+    current.meshes = this -> meshes.size();
+    current.materials = this -> materials.size();
+    return current;
+}
+
+void asset_manager::dropMesh(std::map<std::string, mesh_entry>::iterator entry) {
+    const gpu_mesh &gpu = entry -> second.gpu;
+    if (gpu.vao != 0 || gpu.vbo != 0 || gpu.ebo != 0) {
+        // a held mesh may still be drawn with them
+        if (entry -> second.mesh.use_count() > 1) this -> retired.push_back(std::make_pair(std::weak_ptr<const mesh_asset>(entry -> second.mesh), gpu));
+        else this -> evicted.push_back(gpu);
+    }
+    this -> stats.gpu_bytes -= gpu.bytes;
+    this -> stats.cpu_bytes -= entry -> second.mesh -> cpu_bytes;
+    this -> lru.erase(entry -> second.use);
+    this -> meshes.erase(entry);
+}
+
+void asset_manager::trim() {
+    // oldest first, meshes somebody still holds stay whatever the budget
+    auto next = this -> lru.end();
+    while (this -> stats.cpu_bytes + this -> stats.gpu_bytes > this -> budget && next != this -> lru.begin()) {
+        auto use = std::prev(next);
+        auto entry = this -> meshes.find(*use);
+        if (entry -> second.mesh.use_count() > 1) {
+            next = use;
+            continue;
+        }
+        this -> stats.evictions++;
+        const gpu_mesh &gpu = entry -> second.gpu;
+        if (gpu.vao != 0 || gpu.vbo != 0 || gpu.ebo != 0) this -> stats.gpu_evictions++;
+        this -> dropMesh(entry);
+    }
+}
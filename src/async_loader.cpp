@@ -0,0 +1,76 @@
+#include "async_loader.h"
+
+async_loader::~async_loader() {
+    if (this -> worker.joinable()) this -> worker.join();
+}
+
+bool async_loader::start(const std::string& filename, const std::function<void(objLoader&)>& setup) {
+    return this -> launch(filename, setup, false);
+}
+
+bool async_loader::startOpen(const std::string& filename, const std::function<void(objLoader&)>& setup) {
+    return this -> launch(filename, setup, true);
+}
+
+bool async_loader::launch(const std::string& filename, const std::function<void(objLoader&)>& setup, bool open_groups) {
+    if (this -> state.load() != ASYNC_IDLE) return false;
+    this -> loader.reset(new objLoader());
+    setup(*this -> loader);
+    this -> state = ASYNC_LOADING;
+    objLoader *target = this -> loader.get();
+    asset_manager *assets = open_groups ? nullptr : this -> assets;
+    this -> worker = std::thread([this, target, filename, setup, assets, open_groups]() {
+        bool ok;
+        if (open_groups) {
+            // scanning a large file for its index takes a while too
+            ok = target -> openGroups(filename);
+        } else if (assets) {
+            // the cached model is shared and never edited, it is already packed
+            this -> loaded = assets -> load(filename, setup, [this](const mesh_handle &asset) {
+                std::lock_guard<std::mutex> lock(this -> parsing_mutex);
+                this -> parsing = asset;
+            });
+            ok = this -> loaded != nullptr;
+        } else {
+            ok = target -> load(filename);
+            // pack here as well, the render thread only uploads
+            if (ok) target -> getPackedVBO();
+        }
+        this -> state = ok ? ASYNC_DONE : ASYNC_FAILED;
+    });
+    return true;
+}
+
+void async_loader::setAssetManager(asset_manager *assets) {
+    this -> assets = assets;
+}
+
+float async_loader::getProgress() {
+    async_load_state current = this -> state.load();
+    if (current == ASYNC_IDLE) return 0.0f;
+    // a cache hit or an index read from its sidecar parses nothing, a failed load stops early
+    if (current != ASYNC_LOADING) return 1.0f;
+    {
+        std::lock_guard<std::mutex> lock(this -> parsing_mutex);
+        if (this -> parsing) return this -> parsing -> model.getLoadProgress();
+    }
+    return this -> loader -> getLoadProgress();
+}
+
+bool async_loader::take(std::unique_ptr<objLoader> &model, mesh_handle &asset) {
+    model.reset();
+    asset.reset();
+    async_load_state current = this -> state.load();
+    if (current != ASYNC_DONE && current != ASYNC_FAILED) return false;
+    this -> worker.join();
+    if (current == ASYNC_DONE && this -> loaded) asset.swap(this -> loaded);
+    else if (current == ASYNC_DONE) model.swap(this -> loader);
+    this -> loader.reset();
+    this -> loaded.reset();
+    {
+        std::lock_guard<std::mutex> lock(this -> parsing_mutex);
+        this -> parsing.reset();
+    }
+    this -> state = ASYNC_IDLE;
+    return current == ASYNC_DONE;
+}
@@ -0,0 +1,273 @@
+#include "draw_list.h"
+#include <algorithm>
+#include <cstring>
+
+// binding point of the Material uniform block
+static const GLuint material_binding = 0;
+// std140 layout of the block: ambient, diffuse and specular as vec4, shininess in specular.w,
+// then which maps are bound and the bump multiplier in w
+static const size_t material_size = 16 * sizeof(float);
+// leading floats of a group_record key that describe the material and its maps
+static const size_t material_floats = 14;
+// samplers of the maps in the order of draw_batch::textures
+static const char *const map_samplers[3] = {"diffuseMap", "specularMap", "bumpMap"};
+
+draw_list::~draw_list() {
+    if (this -> material_buffer != 0) glDeleteBuffers(1, &this -> material_buffer);
+}
+
+void draw_list::setProgram(GLuint program) {
+    this -> program = program;
+    this -> uniforms.model = glGetUniformLocation(program, "model");
+    this -> uniforms.view = glGetUniformLocation(program, "view");
+    this -> uniforms.projection = glGetUniformLocation(program, "projection");
+    this -> uniforms.view_pos = glGetUniformLocation(program, "viewPos");
+    this -> uniforms.light_pos = glGetUniformLocation(program, "lightPos");
+    this -> uniforms.light_color = glGetUniformLocation(program, "lightColor");
+    this -> uniforms.position_scale = glGetUniformLocation(program, "positionScale");
+    this -> uniforms.position_offset = glGetUniformLocation(program, "positionOffset");
+    this -> uniforms.normal_oct_scale = glGetUniformLocation(program, "normalOctScale");
+    this -> uniforms.normal_matrix = glGetUniformLocation(program, "normalMatrix");
+    this -> uniforms.group_model = glGetUniformLocation(program, "groupModel");
+    this -> uniforms.group_normal = glGetUniformLocation(program, "groupNormal");
+    // sampler units are program state, set once here
+    GLint current = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    glUseProgram(program);
+    for (int i = 0; i < 3; i++) glUniform1i(glGetUniformLocation(program, map_samplers[i]), i);
+    glUseProgram(current);
+    GLuint block = glGetUniformBlockIndex(program, "Material");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(program, block, material_binding);
+    // every material starts at a multiple of the offset alignment so it can be bound alone
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    this -> material_stride = (material_size + alignment - 1) / alignment * alignment;
+}
+
+void draw_list::setTextures(gpu_textures *textures) {
+    this -> textures = textures;
+}
+
+const model_uniforms &draw_list::getUniforms() {
+    return this -> uniforms;
+}
+
+void draw_list::update(const objLoader &model) {
+    this -> update(model, std::vector<size_t>());
+}
+
+void draw_list::update(const objLoader &model, const std::vector<size_t> &levels) {
+    std::vector<draw_range> ranges(model.getGroupIndices().size());
+    for (size_t i = 0; i < ranges.size(); i++) {
+        const std::vector<group_lod> &lods = model.getGroupLODs(i);
+        const group_lod &lod = lods[std::min(i < levels.size() ? levels[i] : 0, lods.size() - 1)];
+        ranges[i] = draw_range{i, lod.first, lod.count};
+    }
+    this -> update(model, ranges);
+}
+
+void draw_list::update(const objLoader &model, const std::vector<draw_range> &ranges) {
+    const auto &groups = model.getGroupIndices();
+    bool indexed = model.isIndexed();
+    GLenum index_type = (model.getIndexSize() == sizeof(uint16_t)) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    // maps of every group, looked up once per group instead of per range
+    std::vector<GLuint> maps(groups.size() * 3, 0);
+    if (this -> textures) {
+        for (size_t g = 0; g < groups.size(); g++) {
+            const material &mtl = std::get<2>(groups[g]);
+            if (!mtl.hasMaps()) continue;
+            maps[g * 3] = this -> textures -> get(mtl.diffuse_map);
+            maps[g * 3 + 1] = this -> textures -> get(mtl.specular_map);
+            maps[g * 3 + 2] = this -> textures -> get(mtl.bump_map);
+        }
+    }
+    std::vector<group_record> current(ranges.size());
+    for (size_t i = 0; i < ranges.size(); i++) {
+        const material &mtl = std::get<2>(groups[ranges[i].group]);
+        const position_dequant &dequant = model.getGroupDequant(ranges[i].group);
+        group_record &record = current[i];
+        const float values[11] = {
+            mtl.ambient.x, mtl.ambient.y, mtl.ambient.z,
+            mtl.diffuse.x, mtl.diffuse.y, mtl.diffuse.z,
+            mtl.specular.x, mtl.specular.y, mtl.specular.z, mtl.shininess, mtl.bump_multiplier,
+        };
+        memcpy(record.key, values, sizeof(values));
+        memcpy(record.key + 11, &maps[ranges[i].group * 3], 3 * sizeof(GLuint));
+        const float dequant_values[6] = {
+            dequant.scale.x, dequant.scale.y, dequant.scale.z,
+            dequant.offset.x, dequant.offset.y, dequant.offset.z,
+        };
+        memcpy(record.key + 14, dequant_values, sizeof(dequant_values));
+        // groups at the identity keep sharing batches
+        memcpy(record.key + 20, &model.getGroupTransform(ranges[i].group)[0][0], 16 * sizeof(float));
+        memcpy(record.normal, &model.getGroupNormalMatrix(ranges[i].group)[0][0], sizeof(record.normal));
+        record.first = ranges[i].first;
+        record.count = ranges[i].count;
+    }
+    this -> group_count = groups.size();
+    // materials are edited every frame through the ui, so only rebuild on an actual change
+    if (indexed == this -> indexed && index_type == this -> index_type && current.size() == this -> records.size() &&
+        (current.empty() || memcmp(current.data(), this -> records.data(), current.size() * sizeof(group_record)) == 0)) return;
+    this -> indexed = indexed;
+    this -> index_type = index_type;
+    this -> records.swap(current);
+    this -> build();
+}
+
+void draw_list::build() {
+    this -> batches.clear();
+    this -> range_count = 0;
+    this -> triangle_count = 0;
+    // sort by material, then dequantization, then position in the buffer
+    std::vector<size_t> order;
+    for (size_t i = 0; i < this -> records.size(); i++) {
+        if (this -> records[i].count > 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        int key = memcmp(this -> records[a].key, this -> records[b].key, sizeof(this -> records[a].key));
+        return key != 0 ? key < 0 : this -> records[a].first < this -> records[b].first;
+    });
+
+    std::vector<unsigned char> materials;
+    size_t index_size = this -> index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    const group_record *previous = NULL;
+    // element range of the batch being filled, flushed when the next group is not adjacent
+    size_t range_first = 0, range_count = 0;
+    auto flush = [&]() {
+        if (range_count == 0) return;
+        draw_batch &batch = this -> batches.back();
+        batch.counts.push_back((GLsizei)range_count);
+        if (this -> indexed) batch.offsets.push_back((const void*)(range_first * index_size));
+        else batch.firsts.push_back((GLint)range_first);
+        this -> range_count++;
+        range_count = 0;
+    };
+    for (size_t i : order) {
+        const group_record &record = this -> records[i];
+        bool same_material = previous && memcmp(previous -> key, record.key, material_floats * sizeof(float)) == 0;
+        bool same_batch = same_material && memcmp(previous -> key, record.key, sizeof(record.key)) == 0;
+        if (!same_batch) {
+            flush();
+            if (!same_material) {
+                // ambient, diffuse and specular padded to vec4, shininess in the last component,
+                // then 1 for every bound map and the bump multiplier
+                GLuint names[3];
+                memcpy(names, record.key + 11, sizeof(names));
+                float slot[16] = {
+                    record.key[0], record.key[1], record.key[2], 0.0f,
+                    record.key[3], record.key[4], record.key[5], 0.0f,
+                    record.key[6], record.key[7], record.key[8], record.key[9],
+                    names[0] != 0 ? 1.0f : 0.0f, names[1] != 0 ? 1.0f : 0.0f, names[2] != 0 ? 1.0f : 0.0f, record.key[10],
+                };
+                materials.resize(materials.size() + this -> material_stride);
+                memcpy(materials.data() + materials.size() - this -> material_stride, slot, sizeof(slot));
+            }
+            this -> batches.push_back(draw_batch());
+            draw_batch &batch = this -> batches.back();
+            batch.material_offset = materials.size() - this -> material_stride;
+            memcpy(batch.textures, record.key + 11, sizeof(batch.textures));
+            batch.dequant.scale = glm::vec3(record.key[14], record.key[15], record.key[16]);
+            batch.dequant.offset = glm::vec3(record.key[17], record.key[18], record.key[19]);
+            memcpy(&batch.transform[0][0], record.key + 20, 16 * sizeof(float));
+            memcpy(&batch.normal[0][0], record.normal, sizeof(record.normal));
+        }
+        if (range_count > 0 && range_first + range_count == record.first) {
+            range_count += record.count;
+        } else {
+            flush();
+            range_first = record.first;
+            range_count = record.count;
+        }
+        this -> triangle_count += record.count / 3;
+        previous = &record;
+    }
+    flush();
+
+    if (materials.empty()) return;
+    if (this -> material_buffer == 0) glGenBuffers(1, &this -> material_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, this -> material_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, materials.size(), materials.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void draw_list::bindBatch(const draw_batch &batch, GLintptr &bound_material, GLuint *bound_textures) {
+    // batches are sorted by material, so consecutive ones often share the binding
+    if (batch.material_offset != bound_material) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, material_binding, this -> material_buffer, batch.material_offset, material_size);
+        bound_material = batch.material_offset;
+    }
+    // units of missing maps keep whatever is bound, the shader does not sample them
+    for (int i = 0; i < 3; i++) {
+        if (batch.textures[i] == 0 || batch.textures[i] == bound_textures[i]) continue;
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, batch.textures[i]);
+        bound_textures[i] = batch.textures[i];
+    }
+    glUniform3f(this -> uniforms.position_scale, batch.dequant.scale.x, batch.dequant.scale.y, batch.dequant.scale.z);
+    glUniform3f(this -> uniforms.position_offset, batch.dequant.offset.x, batch.dequant.offset.y, batch.dequant.offset.z);
+}
+
+bool draw_list::transformChanged(size_t batch) {
+    return batch == 0 || this -> batches[batch].transform != this -> batches[batch - 1].transform;
+}
+
+void draw_list::draw(GLuint VAO, const glm::mat4 &model) {
+    glBindVertexArray(VAO);
+    GLintptr bound_material = -1;
+    GLuint bound_textures[3] = {0, 0, 0};
+    // the normal matrix of a product is the product of the normal matrices
+    glm::mat3 model_normal = glm::transpose(glm::inverse(glm::mat3(model)));
+    for (size_t b = 0; b < this -> batches.size(); b++) {
+        const draw_batch &batch = this -> batches[b];
+        this -> bindBatch(batch, bound_material, bound_textures);
+        if (this -> transformChanged(b)) {
+            glm::mat4 group_model = model * batch.transform;
+            glm::mat3 normal = model_normal * batch.normal;
+            glUniformMatrix4fv(this -> uniforms.model, 1, GL_FALSE, &group_model[0][0]);
+            glUniformMatrix3fv(this -> uniforms.normal_matrix, 1, GL_FALSE, &normal[0][0]);
+        }
+        if (this -> indexed) {
+            glMultiDrawElements(GL_TRIANGLES, batch.counts.data(), this -> index_type, batch.offsets.data(), batch.counts.size());
+        } else {
+            glMultiDrawArrays(GL_TRIANGLES, batch.firsts.data(), batch.counts.data(), batch.counts.size());
+        }
+    }
+    glBindVertexArray(0);
+}
+
+void draw_list::drawInstanced(GLuint VAO, GLsizei instances) {
+    if (instances <= 0) return;
+    glBindVertexArray(VAO);
+    GLintptr bound_material = -1;
+    GLuint bound_textures[3] = {0, 0, 0};
+    for (size_t b = 0; b < this -> batches.size(); b++) {
+        const draw_batch &batch = this -> batches[b];
+        this -> bindBatch(batch, bound_material, bound_textures);
+        if (this -> transformChanged(b)) {
+            glUniformMatrix4fv(this -> uniforms.group_model, 1, GL_FALSE, &batch.transform[0][0]);
+            glUniformMatrix3fv(this -> uniforms.group_normal, 1, GL_FALSE, &batch.normal[0][0]);
+        }
+        // GL 3.3 has no instanced multi draw, ranges are few after merging anyway
+        for (size_t r = 0; r < batch.counts.size(); r++) {
+            if (this -> indexed) glDrawElementsInstanced(GL_TRIANGLES, batch.counts[r], this -> index_type, batch.offsets[r], instances);
+            else glDrawArraysInstanced(GL_TRIANGLES, batch.firsts[r], batch.counts[r], instances);
+        }
+    }
+    glBindVertexArray(0);
+}
+
+size_t draw_list::getGroupCount() {
+    return this -> group_count;
+}
+
+size_t draw_list::getBatchCount() {
+    return this -> batches.size();
+}
+
+size_t draw_list::getRangeCount() {
+    return this -> range_count;
+}
+
+size_t draw_list::getTriangleCount() {
+    return this -> triangle_count;
+}
@@ -0,0 +1,211 @@
+#include "frustum_culler.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRUSTUM_CULLER_X86
+#include <immintrin.h>
+#endif
+
+cull_view makeCullView(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &model, bool backface) {
+    cull_view result;
+    // rows of the combined matrix (Gribb and Hartmann), glm is column major, m[column][row]
+    glm::mat4 m = projection * view * model;
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++) rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    for (int i = 0; i < 3; i++) {
+        result.planes[i * 2] = rows[3] + rows[i];
+        result.planes[i * 2 + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4 &plane : result.planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f) plane = plane * (1.0f / length);
+    }
+    result.camera = glm::vec3(glm::inverse(view * model)[3]);
+    result.backface = backface;
+    return result;
+}
+
+void frustum_culler::clear() {
+    this -> count = 0;
+    for (std::vector<float> *column : {&this -> center_x, &this -> center_y, &this -> center_z, &this -> radius,
+        &this -> axis_x, &this -> axis_y, &this -> axis_z, &this -> cutoff}) column -> clear();
+}
+
+void frustum_culler::add(const glm::vec4 &sphere, const normal_cone &cone) {
+    // fill the padding slot, then pad up to the next multiple of 8
+    if (this -> count == this -> radius.size()) {
+        size_t padded = this -> count + 8;
+        this -> center_x.resize(padded, 0.0f);
+        this -> center_y.resize(padded, 0.0f);
+        this -> center_z.resize(padded, 0.0f);
+        this -> radius.resize(padded, -1e30f);
+        this -> axis_x.resize(padded, 0.0f);
+        this -> axis_y.resize(padded, 0.0f);
+        this -> axis_z.resize(padded, 1.0f);
+        this -> cutoff.resize(padded, 1.0f);
+    }
+    this -> set(this -> count++, sphere, cone);
+}
+
+void frustum_culler::set(size_t i, const glm::vec4 &sphere, const normal_cone &cone) {
+    this -> center_x[i] = sphere.x;
+    this -> center_y[i] = sphere.y;
+    this -> center_z[i] = sphere.z;
+    this -> radius[i] = sphere.w;
+    this -> axis_x[i] = cone.axis.x;
+    this -> axis_y[i] = cone.axis.y;
+    this -> axis_z[i] = cone.axis.z;
+    this -> cutoff[i] = cone.cutoff;
+}
+
+size_t frustum_culler::size() {
+    return this -> count;
+}
+
+// the simd kernels below evaluate the same expressions in the same order, so every kernel
+// returns the same items
+void frustum_culler::cullScalar(const cull_view &view, std::vector<uint32_t> &visible) {
+    visible.clear();
+    for (size_t i = 0; i < this -> count; i++) {
+        float x = this -> center_x[i], y = this -> center_y[i], z = this -> center_z[i], r = this -> radius[i];
+        bool culled = false;
+        for (const glm::vec4 &plane : view.planes) {
+            float distance = plane.x * x + plane.y * y + plane.z * z + plane.w;
+            culled = culled || distance < -r;
+        }
+        if (view.backface) {
+            float dx = x - view.camera.x, dy = y - view.camera.y, dz = z - view.camera.z;
+            float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float along = dx * this -> axis_x[i] + dy * this -> axis_y[i] + dz * this -> axis_z[i];
+            culled = culled || along >= this -> cutoff[i] * length + r;
+        }
+        if (!culled) visible.push_back((uint32_t)i);
+    }
+}
+
+#ifdef FRUSTUM_CULLER_X86
+
+static inline void appendVisible(std::vector<uint32_t> &visible, size_t first, unsigned mask) {
+    while (mask != 0) {
+        visible.push_back((uint32_t)(first + __builtin_ctz(mask)));
+        mask &= mask - 1;
+    }
+}
+
+static void cullSSE(const float *const columns[8], size_t count, const cull_view &view, std::vector<uint32_t> &visible) {
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = _mm_set1_ps(view.planes[p].x);
+        py[p] = _mm_set1_ps(view.planes[p].y);
+        pz[p] = _mm_set1_ps(view.planes[p].z);
+        pw[p] = _mm_set1_ps(view.planes[p].w);
+    }
+    const __m128 cx = _mm_set1_ps(view.camera.x), cy = _mm_set1_ps(view.camera.y), cz = _mm_set1_ps(view.camera.z);
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 x = _mm_loadu_ps(columns[0] + i), y = _mm_loadu_ps(columns[1] + i), z = _mm_loadu_ps(columns[2] + i), r = _mm_loadu_ps(columns[3] + i);
+        __m128 negative_r = _mm_sub_ps(zero, r);
+        __m128 culled = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)), _mm_mul_ps(pz[p], z)), pw[p]);
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(distance, negative_r));
+        }
+        if (view.backface) {
+            __m128 dx = _mm_sub_ps(x, cx), dy = _mm_sub_ps(y, cy), dz = _mm_sub_ps(z, cz);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(columns[4] + i)), _mm_mul_ps(dy, _mm_loadu_ps(columns[5] + i))),
+                _mm_mul_ps(dz, _mm_loadu_ps(columns[6] + i)));
+            __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(columns[7] + i), length), r);
+            culled = _mm_or_ps(culled, _mm_cmpge_ps(along, limit));
+        }
+        unsigned mask = ~(unsigned)_mm_movemask_ps(culled) & 0xf;
+        // the padding is always culled, so a block never reports items past count
+        appendVisible(visible, i, mask);
+    }
+}
+
+__attribute__((target("avx2")))
+static void cullAVX2(const float *const columns[8], size_t count, const cull_view &view, std::vector<uint32_t> &visible) {
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = _mm256_set1_ps(view.planes[p].x);
+        py[p] = _mm256_set1_ps(view.planes[p].y);
+        pz[p] = _mm256_set1_ps(view.planes[p].z);
+        pw[p] = _mm256_set1_ps(view.planes[p].w);
+    }
+    const __m256 cx = _mm256_set1_ps(view.camera.x), cy = _mm256_set1_ps(view.camera.y), cz = _mm256_set1_ps(view.camera.z);
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t i = 0; i < count; i += 8) {
+        __m256 x = _mm256_loadu_ps(columns[0] + i), y = _mm256_loadu_ps(columns[1] + i), z = _mm256_loadu_ps(columns[2] + i), r = _mm256_loadu_ps(columns[3] + i);
+        __m256 negative_r = _mm256_sub_ps(zero, r);
+        __m256 culled = _mm256_setzero_ps();
+        // no fma, the results have to match the scalar kernel
+        for (int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)), _mm256_mul_ps(pz[p], z)), pw[p]);
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(distance, negative_r, _CMP_LT_OQ));
+        }
+        if (view.backface) {
+            __m256 dx = _mm256_sub_ps(x, cx), dy = _mm256_sub_ps(y, cy), dz = _mm256_sub_ps(z, cz);
+            __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+            __m256 along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, _mm256_loadu_ps(columns[4] + i)), _mm256_mul_ps(dy, _mm256_loadu_ps(columns[5] + i))),
+                _mm256_mul_ps(dz, _mm256_loadu_ps(columns[6] + i)));
+            __m256 limit = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(columns[7] + i), length), r);
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(along, limit, _CMP_GE_OQ));
+        }
+        unsigned mask = ~(unsigned)_mm256_movemask_ps(culled) & 0xff;
+        appendVisible(visible, i, mask);
+    }
+}
+
+enum cull_kernel_kind { CULL_SCALAR, CULL_SSE, CULL_AVX2 };
+
+static cull_kernel_kind detectKernel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return CULL_AVX2;
+    if (__builtin_cpu_supports("sse2")) return CULL_SSE;
+    return CULL_SCALAR;
+}
+
+static cull_kernel_kind selectedKernel() {
+    static const cull_kernel_kind kind = detectKernel();
+    return kind;
+}
+
+void frustum_culler::cull(const cull_view &view, std::vector<uint32_t> &visible) {
+    const float *const columns[8] = {
+        this -> center_x.data(), this -> center_y.data(), this -> center_z.data(), this -> radius.data(),
+        this -> axis_x.data(), this -> axis_y.data(), this -> axis_z.data(), this -> cutoff.data(),
+    };
+    switch (selectedKernel()) {
+        case CULL_AVX2:
+            visible.clear();
+            cullAVX2(columns, this -> count, view, visible);
+            return;
+        case CULL_SSE:
+            visible.clear();
+            cullSSE(columns, this -> count, view, visible);
+            return;
+        default: break;
+    }
+    this -> cullScalar(view, visible);
+}
+
+const char *frustum_culler::kernelName() {
+    switch (selectedKernel()) {
+        case CULL_AVX2: return "avx2";
+        case CULL_SSE: return "sse";
+        default: return "scalar";
+    }
+}
+
+#else
+
+void frustum_culler::cull(const cull_view &view, std::vector<uint32_t> &visible) {
+    this -> cullScalar(view, visible);
+}
+
+const char *frustum_culler::kernelName() {
+    return "scalar";
+}
+
+#endif
@@ -0,0 +1,48 @@
+#include "gpu_textures.h"
+
+gpu_textures::~gpu_textures() {
+    this -> clear();
+}
+
+GLuint gpu_textures::get(const std::string &path) {
+    if (path.empty()) return 0;
+    auto found = this -> textures.find(path);
+    if (found != this -> textures.end()) return found -> second;
+    // failures are remembered as 0 so they are not decoded again every frame
+    GLuint texture = 0;
+    texture_handle image = this -> cache -> get(path);
+    if (image) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        // rows of RGBA8 are always 4 byte aligned
+        for (size_t i = 0; i < image -> levels.size(); i++) {
+            const texture_level &level = image -> levels[i];
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image -> level(i));
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image -> levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        this -> bytes += image -> pixels.size();
+    }
+    this -> textures[path] = texture;
+    return texture;
+}
+
+void gpu_textures::clear() {
+    for (auto &entry : this -> textures) {
+        if (entry.second != 0) glDeleteTextures(1, &entry.second);
+    }
+    this -> textures.clear();
+    this -> bytes = 0;
+}
+
+size_t gpu_textures::size() {
+    return this -> textures.size();
+}
+
+size_t gpu_textures::getMemoryUsage() {
+    return this -> bytes;
+}
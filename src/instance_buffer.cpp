@@ -0,0 +1,108 @@
+#include "instance_buffer.h"
+#include <algorithm>
+
+// first attribute location of the instance data, and the float offsets of its members
+static const GLuint instance_location = 3;
+static const size_t normal_offset = 16;
+static const size_t color_offset = 25;
+static_assert(sizeof(instance_data) == 29 * sizeof(float), "instance_data must be tightly packed floats");
+
+instance_buffer::~instance_buffer() {
+    if (this -> buffer != 0) glDeleteBuffers(1, &this -> buffer);
+}
+
+void instance_buffer::resize(size_t count) {
+    size_t old_count = this -> instances.size();
+    instance_data identity;
+    identity.model = glm::mat4(1.0f);
+    identity.normal = glm::mat3(1.0f);
+    identity.color = glm::vec4(0.0f);
+    this -> instances.resize(count, identity);
+    if (count > old_count) {
+        this -> markDirty(old_count);
+        this -> markDirty(count - 1);
+    }
+    // instances cut off need no upload
+    this -> dirty_end = std::min(this -> dirty_end, count);
+    this -> dirty_first = std::min(this -> dirty_first, this -> dirty_end);
+}
+
+size_t instance_buffer::size() {
+    return this -> instances.size();
+}
+
+void instance_buffer::setTransform(size_t index, const glm::mat4 &model) {
+    instance_data &instance = this -> instances[index];
+    instance.model = model;
+    instance.normal = glm::mat3(glm::transpose(glm::inverse(model)));
+    this -> markDirty(index);
+}
+
+void instance_buffer::setColor(size_t index, const glm::vec4 &color) {
+    this -> instances[index].color = color;
+    this -> markDirty(index);
+}
+
+const instance_data &instance_buffer::get(size_t index) {
+    return this -> instances[index];
+}
+
+void instance_buffer::markDirty(size_t index) {
+    if (this -> dirty_first == this -> dirty_end) {
+        this -> dirty_first = index;
+        this -> dirty_end = index + 1;
+    } else {
+        this -> dirty_first = std::min(this -> dirty_first, index);
+        this -> dirty_end = std::max(this -> dirty_end, index + 1);
+    }
+}
+
+void instance_buffer::upload() {
+    this -> uploaded_bytes = 0;
+    if (this -> buffer == 0) glGenBuffers(1, &this -> buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, this -> buffer);
+    if (this -> instances.size() > this -> capacity) {
+        // grow with room to spare, the whole buffer is written anyway
+        this -> capacity = std::max(this -> instances.size(), this -> capacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, this -> capacity * sizeof(instance_data), nullptr, GL_DYNAMIC_DRAW);
+        this -> dirty_first = 0;
+        this -> dirty_end = this -> instances.size();
+    }
+    if (this -> dirty_first < this -> dirty_end) {
+        size_t bytes = (this -> dirty_end - this -> dirty_first) * sizeof(instance_data);
+        glBufferSubData(GL_ARRAY_BUFFER, this -> dirty_first * sizeof(instance_data), bytes, this -> instances.data() + this -> dirty_first);
+        this -> uploaded_bytes = bytes;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    this -> dirty_first = this -> dirty_end = 0;
+}
+
+void instance_buffer::attach(GLuint VAO) {
+    if (this -> buffer == 0) glGenBuffers(1, &this -> buffer);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, this -> buffer);
+    GLsizei stride = sizeof(instance_data);
+    // a mat4 takes four vec4 locations and a mat3 three vec3 ones
+    for (GLuint column = 0; column < 4; column++) {
+        GLuint location = instance_location + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(column * 4 * sizeof(float)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    for (GLuint column = 0; column < 3; column++) {
+        GLuint location = instance_location + 4 + column;
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)((normal_offset + column * 3) * sizeof(float)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    GLuint location = instance_location + 7;
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(color_offset * sizeof(float)));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t instance_buffer::getUploadedBytes() {
+    return this -> uploaded_bytes;
+}
@@ -1,18 +1,36 @@
 #include "obj_loader.h"
+#include "asset_manager.h"
+#include "async_loader.h"
+#include "draw_list.h"
+#include "gpu_textures.h"
+#include "instance_buffer.h"
+#include "mesh_bvh.h"
+#include "frustum_culler.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <memory>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "imgui_util.h"
 
+// models and material libraries already loaded, the model on screen is drawn from the cache
+// until it is edited
+asset_manager assets;
+mesh_handle shown;
+// the viewer's own model, a copy of the shared one once edited, or a lazily opened one
 objLoader obj;
+// images of the material maps, decoded on its own pool while the models using them parse
+texture_cache textures;
 const int window_width = 1600;
 const int window_height = 900;
 glm::vec3 light_pos = glm::vec3(0.0f, 0.0f, 5.0f);
 glm::vec3 light_color = glm::vec3(1.0f, 1.0f, 1.0f);
+// fractions of the triangles of every group kept by the levels of detail
+const std::vector<float> lod_ratios = {0.5f, 0.25f, 0.1f, 0.02f};
 
 // shaders
 std::string vertexShaderSource, fragmentShaderSource;
@@ -71,8 +89,37 @@ GLuint createShaderProgram(const std::string &vertexSource, const std::string &f
     return shaderProgram;
 }
 
-// update VAO and VBO
-void updateVAOandVBO(const float *vertices, size_t vertices_size, GLuint &VAO, GLuint &VBO) {
+// GL type of a packed vertex component
+GLenum componentType(vertex_component_type type) {
+    switch (type) {
+        case COMPONENT_HALF: return GL_HALF_FLOAT;
+        case COMPONENT_SHORT: return GL_SHORT;
+        case COMPONENT_BYTE: return GL_BYTE;
+        default: return GL_FLOAT;
+    }
+}
+
+// the model on screen
+const objLoader &shownModel() {
+    return shown ? shown -> model : obj;
+}
+
+void deleteBuffers(GLuint &VAO, GLuint &VBO, GLuint &EBO) {
+    if (VAO != 0) glDeleteVertexArrays(1, &VAO);
+    if (VBO != 0) glDeleteBuffers(1, &VBO);
+    if (EBO != 0) glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+}
+
+// buffers of shared models the asset cache evicted
+void deleteEvicted() {
+    std::vector<gpu_mesh> evicted;
+    assets.takeEvicted(evicted);
+    for (gpu_mesh &gpu : evicted) deleteBuffers(gpu.vao, gpu.vbo, gpu.ebo);
+}
+
+// update VAO, VBO and EBO, EBO is only created for indexed geometry
+void updateVAOandVBO(const void *vertices, size_t vertices_size, const vertex_format &format, const void *indices, size_t indices_size, GLuint &VAO, GLuint &VBO, GLuint &EBO) {
     if (VAO != 0) {
         glDeleteVertexArrays(1, &VAO);
         VAO = 0;
@@ -81,6 +128,10 @@ void updateVAOandVBO(const float *vertices, size_t vertices_size, GLuint &VAO, G
         glDeleteBuffers(1, &VBO);
         VBO = 0;
     }
+    if (EBO != 0) {
+        glDeleteBuffers(1, &EBO);
+        EBO = 0;
+    }
 
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
@@ -88,15 +139,208 @@ void updateVAOandVBO(const float *vertices, size_t vertices_size, GLuint &VAO, G
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
+    // group edits are transforms applied in the shader, the vertices are only replaced as a whole
     glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    if (indices_size > 0) {
+        // the element buffer binding is part of the VAO state
+        glGenBuffers(1, &EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices, GL_STATIC_DRAW);
+    }
+
+    // integer attributes are converted without normalization, the shader rescales them
+    for (const vertex_attribute &attr : format.attributes()) {
+        glVertexAttribPointer(attr.location, attr.components, componentType(attr.type), GL_FALSE, format.stride(), (void*)attr.offset);
+        glEnableVertexAttribArray(attr.location);
+    }
 
+    glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// upload the packed vertex buffer of a model
+void updateVAOandVBO(objLoader &model, GLuint &VAO, GLuint &VBO, GLuint &EBO) {
+    updateVAOandVBO(model.getPackedVBO(), model.getPackedVBOSize(), model.getVertexFormat(), model.getIBO(), model.getIBOSize(), VAO, VBO, EBO);
+    model.clearDirtyRanges();
+}
+
+// the same for a shared asset, packed when it was loaded
+void updateVAOandVBO(const objLoader &model, GLuint &VAO, GLuint &VBO, GLuint &EBO) {
+    updateVAOandVBO(model.getPackedVBO(), model.getPackedVBOSize(), model.getVertexFormat(), model.getIBO(), model.getIBOSize(), VAO, VBO, EBO);
+}
+
+// hand the buffers of a shared asset to the cache, they are kept with it until it is evicted
+void shareBuffers(const mesh_handle &asset, GLuint VAO, GLuint VBO, GLuint EBO) {
+    assets.setGPUMesh(asset, gpu_mesh{VAO, VBO, EBO, asset -> model.getPackedVBOSize() + asset -> model.getIBOSize()});
+}
+
+// a loaded model whose buffers are filled a slice per frame, it replaces the model on screen once complete;
+// either the viewer's own model or a shared asset
+struct pending_upload {
+    std::unique_ptr<objLoader> model;
+    mesh_handle asset;
+    GLuint VAO, VBO, EBO;
+    size_t vertices_uploaded;
+    size_t indices_uploaded;
+};
+
+// bytes copied to the GPU per frame while a model is pending
+const size_t upload_budget = 16 << 20;
+
+const objLoader &uploadedModel(const pending_upload &upload) {
+    return upload.asset ? upload.asset -> model : *upload.model;
+}
+
+// allocate the buffers of a loaded model without filling them, a shared asset drawn before
+// comes with its buffers
+void beginUpload(pending_upload &upload, std::unique_ptr<objLoader> model, const mesh_handle &asset) {
+    upload.model = std::move(model);
+    upload.asset = asset;
+    upload.VAO = upload.VBO = upload.EBO = 0;
+    upload.vertices_uploaded = upload.indices_uploaded = 0;
+    const objLoader &loaded = uploadedModel(upload);
+    if (asset) {
+        gpu_mesh gpu = assets.getGPUMesh(asset);
+        if (gpu.vao != 0) {
+            upload.VAO = gpu.vao;
+            upload.VBO = gpu.vbo;
+            upload.EBO = gpu.ebo;
+            upload.vertices_uploaded = loaded.getPackedVBOSize();
+            upload.indices_uploaded = loaded.getIBOSize();
+            return;
+        }
+    }
+    updateVAOandVBO(nullptr, loaded.getPackedVBOSize(), loaded.getVertexFormat(), nullptr, loaded.getIBOSize(), upload.VAO, upload.VBO, upload.EBO);
+}
+
+// copy up to budget bytes, returns true once every buffer is filled
+bool uploadSlice(pending_upload &upload, size_t budget) {
+    const objLoader &loaded = uploadedModel(upload);
+    size_t vertices_size = loaded.getPackedVBOSize();
+    size_t indices_size = loaded.getIBOSize();
+    glBindVertexArray(upload.VAO);
+    if (upload.vertices_uploaded < vertices_size) {
+        size_t size = std::min(budget, vertices_size - upload.vertices_uploaded);
+        glBindBuffer(GL_ARRAY_BUFFER, upload.VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, upload.vertices_uploaded, size, loaded.getPackedVBO() + upload.vertices_uploaded);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        upload.vertices_uploaded += size;
+        budget -= size;
+    }
+    if (budget > 0 && upload.indices_uploaded < indices_size) {
+        size_t size = std::min(budget, indices_size - upload.indices_uploaded);
+        // the element buffer is part of the bound VAO
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, upload.indices_uploaded, size, (const char*)loaded.getIBO() + upload.indices_uploaded);
+        upload.indices_uploaded += size;
+    }
     glBindVertexArray(0);
+    return upload.vertices_uploaded == vertices_size && upload.indices_uploaded == indices_size;
+}
+
+// put the uploaded model on screen; the buffers of the old one are deleted if they were the viewer's own,
+// those of a shared asset stay with the cache
+void finishUpload(pending_upload &upload, GLuint &VAO, GLuint &VBO, GLuint &EBO) {
+    if (!shown) deleteBuffers(VAO, VBO, EBO);
+    VAO = upload.VAO;
+    VBO = upload.VBO;
+    EBO = upload.EBO;
+    if (upload.asset) {
+        if (assets.getGPUMesh(upload.asset).vao != VAO) shareBuffers(upload.asset, VAO, VBO, EBO);
+        shown = upload.asset;
+        // the edited copy of the previous model is not needed any more
+        objLoader().swap(obj);
+    } else {
+        obj.swap(*upload.model);
+        shown.reset();
+    }
+    upload.model.reset();
+    upload.asset.reset();
+}
+
+// coarsest level of detail of every group whose error, projected at the nearest point of the
+// group's sphere, stays below max_pixel_error; pixels_per_unit is the screen size of one unit at distance 1
+void selectLODs(const objLoader &model, const glm::mat4 &model_matrix, const glm::vec3 &camera,
+    float pixels_per_unit, float near_plane, float max_pixel_error, std::vector<size_t> &levels) {
+    levels.assign(model.getGroupIndices().size(), 0);
+    for (size_t i = 0; i < levels.size(); i++) {
+        const std::vector<group_lod> &lods = model.getGroupLODs(i);
+        const glm::vec4 &sphere = model.getGroupBounds(i).sphere;
+        glm::mat4 group_matrix = model_matrix * model.getGroupTransform(i);
+        // the largest axis scale of the matrix, errors and radii are in the units of the group's vertices
+        float scale = std::max(glm::length(glm::vec3(group_matrix[0])), std::max(glm::length(glm::vec3(group_matrix[1])), glm::length(glm::vec3(group_matrix[2]))));
+        glm::vec3 center = glm::vec3(group_matrix * glm::vec4(glm::vec3(sphere), 1.0f));
+        float distance = std::max(glm::length(center - camera) - sphere.w * scale, near_plane);
+        for (size_t level = lods.size() - 1; level > 0; level--) {
+            if (lods[level].error * scale * pixels_per_unit / distance <= max_pixel_error) {
+                levels[i] = level;
+                break;
+            }
+        }
+    }
+}
+
+// translation, rotation in degrees and scale of a group as edited in the ui
+struct group_pose {
+    glm::vec3 translate;
+    glm::vec3 rotate;
+    glm::vec3 scale;
+    group_pose(): translate(0.0f), rotate(0.0f), scale(1.0f) {}
+    glm::mat4 matrix() const {
+        return glm::translate(glm::mat4(1.0f), translate) *
+            glm::rotate(glm::mat4(1.0f), glm::radians(rotate.x), glm::vec3(1.0f, 0.0f, 0.0f)) *
+            glm::rotate(glm::mat4(1.0f), glm::radians(rotate.y), glm::vec3(0.0f, 1.0f, 0.0f)) *
+            glm::rotate(glm::mat4(1.0f), glm::radians(rotate.z), glm::vec3(0.0f, 0.0f, 1.0f)) *
+            glm::scale(glm::mat4(1.0f), scale);
+    }
+};
+
+// groups are too large for their normal cones to ever cull
+static const normal_cone no_cone = {glm::vec3(0.0f, 0.0f, 1.0f), 1.0f};
+
+// bounds of one group and its clusters through its group transform, e.g. after the transform was edited
+void updateGroupCulling(const objLoader &model, size_t group, frustum_culler &groups, frustum_culler &clusters) {
+    const glm::mat4 &transform = model.getGroupTransform(group);
+    groups.set(group, transformBounds(model.getGroupBounds(group), transform).sphere, no_cone);
+    auto range = model.getGroupClusters(group);
+    for (size_t c = range.first; c < range.first + range.second; c++) {
+        const group_cluster &cluster = model.getClusters()[c];
+        clusters.set(c, transformBounds(cluster.bounds, transform).sphere, transformCone(cluster.cone, transform, model.getGroupNormalMatrix(group)));
+    }
+}
+
+// copy the group and cluster bounds into the cullers, after a load, transform or clustering
+void updateCullers(const objLoader &model, frustum_culler &groups, frustum_culler &clusters) {
+    groups.clear();
+    clusters.clear();
+    for (size_t i = 0; i < model.getGroupIndices().size(); i++) {
+        groups.add(glm::vec4(0.0f), no_cone);
+        for (size_t c = 0; c < model.getGroupClusters(i).second; c++) clusters.add(glm::vec4(0.0f), no_cone);
+    }
+    for (size_t i = 0; i < model.getGroupIndices().size(); i++) updateGroupCulling(model, i, groups, clusters);
+}
+
+// ranges of the visible groups at their level of detail, groups at the full level are drawn
+// cluster by cluster when the model has clusters; both visible lists are ascending
+void buildDrawRanges(const objLoader &model, const std::vector<uint32_t> &visible_groups, const std::vector<uint32_t> &visible_clusters,
+    const std::vector<size_t> &levels, std::vector<draw_range> &ranges) {
+    const std::vector<group_cluster> &clusters = model.getClusters();
+    ranges.clear();
+    size_t next_cluster = 0;
+    for (uint32_t group : visible_groups) {
+        const std::vector<group_lod> &lods = model.getGroupLODs(group);
+        size_t level = std::min(group < levels.size() ? levels[group] : 0, lods.size() - 1);
+        if (level > 0 || clusters.empty()) {
+            ranges.push_back(draw_range{group, lods[level].first, lods[level].count});
+            continue;
+        }
+        while (next_cluster < visible_clusters.size() && clusters[visible_clusters[next_cluster]].group < group) next_cluster++;
+        for (; next_cluster < visible_clusters.size() && clusters[visible_clusters[next_cluster]].group == group; next_cluster++) {
+            const group_cluster &cluster = clusters[visible_clusters[next_cluster]];
+            ranges.push_back(draw_range{group, cluster.first, cluster.count});
+        }
+    }
 }
 
 int main() {
@@ -127,25 +371,72 @@ int main() {
 
     glViewport(0, 0, window_width, window_height);
 
-    obj.load("res/model/cow/cow.obj");
-
-    const float *vertices = obj.getVBO();
-    size_t vertices_size = obj.getVBOSize();
-
-    GLuint VAO, VBO;
-    updateVAOandVBO(vertices, vertices_size, VAO, VBO);
+    shown = assets.load("res/model/cow/cow.obj", [](objLoader &model) {
+        model.setIndexed(true);
+        model.setCacheEnabled(true);
+        model.setReleaseSource(true);
+        model.setSmoothNormals(true);
+        model.setTextureCache(&textures);
+    });
+
+    // the buffers on screen, the cache's while a shared asset is drawn and the viewer's own otherwise
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    updateVAOandVBO(shownModel(), VAO, VBO, EBO);
+    if (shown) shareBuffers(shown, VAO, VBO, EBO);
+    // the first edit copies the shared asset into obj, with buffers of its own
+    auto editableModel = [&]() -> objLoader& {
+        if (shown) {
+            obj.copyFrom(shown -> model);
+            shown.reset();
+            VAO = VBO = EBO = 0;
+            updateVAOandVBO(obj, VAO, VBO, EBO);
+        }
+        return obj;
+    };
+
+    // levels of detail are picked per group from its bounding sphere every frame,
+    // groups and clusters outside the frustum are skipped
+    std::vector<size_t> groupLevels;
+    frustum_culler groupCuller, clusterCuller;
+    std::vector<uint32_t> visibleGroups, visibleClusters;
+    std::vector<draw_range> drawRanges;
+    updateCullers(shownModel(), groupCuller, clusterCuller);
+
+    // triangles of the model for picking groups with the mouse
+    thread_pool pool;
+    mesh_bvh bvh;
+    bvh.build(shownModel(), &pool);
+    // group transforms changed since the tree was last fit
+    bool bvhStale = false;
 
     // create shader program
     vertexShaderSource = loadShaderFromFile("res/shader/model.vs");
     fragmentShaderSource = loadShaderFromFile("res/shader/model.fs");
     GLuint shaderProgram = createShaderProgram(vertexShaderSource, fragmentShaderSource);
 
+    // groups are drawn batched by material, uniform locations are looked up once
+    // maps are uploaded once and shared by both draw lists
+    gpu_textures gpuTextures(&textures);
+    draw_list drawList;
+    drawList.setProgram(shaderProgram);
+    drawList.setTextures(&gpuTextures);
+    const model_uniforms &uniforms = drawList.getUniforms();
+
+    // copies of the model drawn in one instanced call per range, transforms are uploaded once per frame
+    GLuint instancedProgram = createShaderProgram(loadShaderFromFile("res/shader/model_instanced.vs"), fragmentShaderSource);
+    draw_list instancedList;
+    instancedList.setProgram(instancedProgram);
+    instancedList.setTextures(&gpuTextures);
+    const model_uniforms &instancedUniforms = instancedList.getUniforms();
+    instance_buffer instances;
+
     glEnable(GL_DEPTH_TEST);
 
     setupImGUI(window);
 
     while (!glfwWindowShouldClose(window)) {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        deleteEvicted();
 
         // time
         float time = glfwGetTime();
@@ -158,32 +449,66 @@ int main() {
         glm::mat4 initModel = glm::mat4(1.0f);
         glm::mat4 model = glm::rotate(initModel, glm::radians(time * 50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         glm::mat4 view = glm::lookAt(cameraPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)window_width / window_height, 0.1f, 100.0f);
+        const float fov = glm::radians(45.0f), near_plane = 0.1f;
+        glm::mat4 projection = glm::perspective(fov, (float)window_width / window_height, near_plane, 100.0f);
 
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &model[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, &view[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, &projection[0][0]);
+        glUniformMatrix4fv(uniforms.view, 1, GL_FALSE, &view[0][0]);
+        glUniformMatrix4fv(uniforms.projection, 1, GL_FALSE, &projection[0][0]);
 
         // set light and color
-        glUniform3f(glGetUniformLocation(shaderProgram, "lightPos"), light_pos.x, light_pos.y, light_pos.z);
-        glUniform3f(glGetUniformLocation(shaderProgram, "lightColor"), light_color.x, light_color.y, light_color.z);
-        glUniform3f(glGetUniformLocation(shaderProgram, "viewPos"), cameraPos.x, cameraPos.y, cameraPos.z);
-
-        for (size_t i = 0; i < obj.getGroupIndices().size(); i++) {
-            size_t start_index = std::get<0>(obj.getGroupIndices()[i]);
-            size_t end_index = (i == obj.getGroupIndices().size() - 1) ? vertices_size / sizeof(float) / 8 : std::get<0>(obj.getGroupIndices()[i + 1]);
-            size_t count = end_index - start_index;
-            material current_mtl = std::get<2>(obj.getGroupIndices()[i]);
-
-            // set object color
-            glUniform3f(glGetUniformLocation(shaderProgram, "objectAmbientColor"), current_mtl.ambient.x, current_mtl.ambient.y, current_mtl.ambient.z);
-            glUniform3f(glGetUniformLocation(shaderProgram, "objectDiffuseColor"), current_mtl.diffuse.x, current_mtl.diffuse.y, current_mtl.diffuse.z);
-            glUniform3f(glGetUniformLocation(shaderProgram, "objectSpecularColor"), current_mtl.specular.x, current_mtl.specular.y, current_mtl.specular.z);
-            glUniform1f(glGetUniformLocation(shaderProgram, "objectShininess"), current_mtl.shininess);
-
-            // bind VAO and draw
-            glBindVertexArray(VAO);
-            glDrawArrays(GL_TRIANGLES, start_index, count);
+        glUniform3f(uniforms.light_pos, light_pos.x, light_pos.y, light_pos.z);
+        glUniform3f(uniforms.light_color, light_color.x, light_color.y, light_color.z);
+        glUniform3f(uniforms.view_pos, cameraPos.x, cameraPos.y, cameraPos.z);
+        glUniform1f(uniforms.normal_oct_scale, shownModel().getVertexFormat().normalScale());
+
+        // material edits, new formats, reloads, level changes and culling are picked up here
+        static bool useLODs = true;
+        static float maxPixelError = 1.0f;
+        static bool frustumCulling = true;
+        static bool backfaceCulling = false;
+        groupLevels.clear();
+        if (useLODs) selectLODs(shownModel(), model, cameraPos, window_height / (2.0f * std::tan(fov * 0.5f)), near_plane, maxPixelError, groupLevels);
+        if (frustumCulling) {
+            cull_view cullView = makeCullView(projection, view, model, backfaceCulling);
+            groupCuller.cull(cullView, visibleGroups);
+            clusterCuller.cull(cullView, visibleClusters);
+        } else {
+            visibleGroups.resize(groupCuller.size());
+            for (size_t i = 0; i < visibleGroups.size(); i++) visibleGroups[i] = i;
+            visibleClusters.resize(clusterCuller.size());
+            for (size_t i = 0; i < visibleClusters.size(); i++) visibleClusters[i] = i;
+        }
+        static bool drawCopies = false;
+        static int copies = 1000;
+        static float copySpacing = 4.0f;
+        static bool tintCopies = false;
+        if (drawCopies) {
+            // a square grid behind the model, every copy turning with it; copies spread far beyond
+            // the frustum, so only the levels of detail of the model itself are used
+            instances.resize(copies);
+            int side = (int)std::ceil(std::sqrt((float)copies));
+            for (int i = 0; i < copies; i++) {
+                glm::vec3 cell(((i % side) - (side - 1) * 0.5f) * copySpacing, 0.0f, -(i / side) * copySpacing);
+                instances.setTransform(i, glm::translate(initModel, cell) * model);
+                glm::vec4 tint(0.5f + 0.5f * std::sin(i * 0.7f), 0.5f + 0.5f * std::sin(i * 1.3f + 2.0f), 0.5f + 0.5f * std::sin(i * 1.9f + 4.0f), 1.0f);
+                instances.setColor(i, tintCopies ? tint : glm::vec4(0.0f));
+            }
+            instances.upload();
+            // the VAO is created again whenever the model changes
+            instances.attach(VAO);
+            glUseProgram(instancedProgram);
+            glUniformMatrix4fv(instancedUniforms.view, 1, GL_FALSE, &view[0][0]);
+            glUniformMatrix4fv(instancedUniforms.projection, 1, GL_FALSE, &projection[0][0]);
+            glUniform3f(instancedUniforms.light_pos, light_pos.x, light_pos.y, light_pos.z);
+            glUniform3f(instancedUniforms.light_color, light_color.x, light_color.y, light_color.z);
+            glUniform3f(instancedUniforms.view_pos, cameraPos.x, cameraPos.y, cameraPos.z);
+            glUniform1f(instancedUniforms.normal_oct_scale, shownModel().getVertexFormat().normalScale());
+            instancedList.update(shownModel(), groupLevels);
+            instancedList.drawInstanced(VAO, copies);
+        } else {
+            buildDrawRanges(shownModel(), visibleGroups, visibleClusters, groupLevels, drawRanges);
+            drawList.update(shownModel(), drawRanges);
+            drawList.draw(VAO, model);
         }
 
         // imgui
@@ -208,15 +533,69 @@ int main() {
         ImGui::Begin("Model Control Panel", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
         static char modelPath[128] = "";
         static char savePath[128] = "";
+        static bool indexedGeometry = true;
+        static bool smoothNormals = true;
+        static float creaseAngle = 60.0f;
+        // open only the group index and load groups on demand below
+        static bool lazyGroups = false;
+        static vertex_format modelFormat;
+        // models are parsed on a worker and uploaded over several frames,
+        // the current one stays on screen until the new one is complete
+        static async_loader loader;
+        static pending_upload upload;
+        bool modelReplaced = false;
         ImGui::InputText("Model Path", modelPath, 128);
-        if (ImGui::Button("Load Model")) {
-            std::cout << "Loading model: " << modelPath << std::endl;
-            if (!obj.load(modelPath)) {
+        ImGui::Checkbox("Indexed Geometry", &indexedGeometry);
+        // only used for faces without normals in the file
+        ImGui::Checkbox("Smooth Normals", &smoothNormals);
+        ImGui::SliderFloat("Crease Angle", &creaseAngle, 0.0f, 180.0f);
+        ImGui::Checkbox("Lazy Groups", &lazyGroups);
+        if (ImGui::Button("Load Model") && loader.getState() == ASYNC_IDLE && !upload.model && !upload.asset) {
+            if (lazyGroups) {
+                // only the index is read or built, the groups are parsed when they are loaded
+                std::cout << "Opening model: " << modelPath << std::endl;
+                loader.startOpen(modelPath, [indexed = indexedGeometry, smooth = smoothNormals, crease = creaseAngle,
+                    format = modelFormat](objLoader &model) {
+                    model.setIndexed(indexed);
+                    model.setSmoothNormals(smooth);
+                    model.setCreaseAngle(crease);
+                    model.setVertexFormat(format);
+                    model.setTextureCache(&textures);
+                });
+            } else {
+                std::cout << "Loading model: " << modelPath << std::endl;
+                loader.setAssetManager(&assets);
+                // the settings as they are now, setup runs again on the worker while the UI changes them
+                loader.start(modelPath, [indexed = indexedGeometry, smooth = smoothNormals, crease = creaseAngle,
+                    format = modelFormat](objLoader &model) {
+                    model.setIndexed(indexed);
+                    model.setSmoothNormals(smooth);
+                    model.setCreaseAngle(crease);
+                    model.setCacheEnabled(true);
+                    model.setReleaseSource(true);
+                    model.setVertexFormat(format);
+                    model.setTextureCache(&textures);
+                });
+            }
+        }
+        if (loader.getState() == ASYNC_LOADING) {
+            ImGui::ProgressBar(loader.getProgress(), ImVec2(-1.0f, 0.0f), "Loading");
+        } else if (loader.getState() != ASYNC_IDLE) {
+            std::unique_ptr<objLoader> loaded;
+            mesh_handle asset;
+            if (!loader.take(loaded, asset)) {
                 ImGui::OpenPopup("Error");
             } else {
-                vertices = obj.getVBO();
-                vertices_size = obj.getVBOSize();
-                updateVAOandVBO(vertices, vertices_size, VAO, VBO);
+                beginUpload(upload, std::move(loaded), asset);
+            }
+        }
+        if (upload.model || upload.asset) {
+            size_t total = uploadedModel(upload).getPackedVBOSize() + uploadedModel(upload).getIBOSize();
+            if (uploadSlice(upload, upload_budget)) {
+                finishUpload(upload, VAO, VBO, EBO);
+                modelReplaced = true;
+            } else {
+                ImGui::ProgressBar((float)(upload.vertices_uploaded + upload.indices_uploaded) / total, ImVec2(-1.0f, 0.0f), "Uploading");
             }
         }
         if (ImGui::BeginPopupModal("Error", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
@@ -228,67 +607,249 @@ int main() {
         }
         // group selector
         static int selected_group_index = 0;
+        if (modelReplaced) {
+            selected_group_index = 0;
+            bvh.build(shownModel(), &pool);
+            updateCullers(shownModel(), groupCuller, clusterCuller);
+        }
+        // a click on the model selects the group under the cursor
+        if (ImGui::IsMouseClicked(0) && !ImGui::GetIO().WantCaptureMouse && !bvh.empty()) {
+            // transforms are edited without touching the tree, it is refit once before picking
+            if (bvhStale) {
+                bvh.refit(shownModel());
+                bvhStale = false;
+            }
+            double cursor_x, cursor_y;
+            glfwGetCursorPos(window, &cursor_x, &cursor_y);
+            glm::vec2 ndc(cursor_x / window_width * 2.0 - 1.0, 1.0 - cursor_y / window_height * 2.0);
+            // unproject the near and far plane points into model space, the ray spans the depth range
+            glm::mat4 unproject = glm::inverse(projection * view * model);
+            glm::vec4 near_point = unproject * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 far_point = unproject * glm::vec4(ndc, 1.0f, 1.0f);
+            glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+            bvh_hit hit = bvh.raycast(origin, glm::vec3(far_point) / far_point.w - origin, 1.0f);
+            if (hit.hit) {
+                selected_group_index = hit.group;
+                std::cout << "Picked group: " << hit.group << std::endl;
+            }
+        }
         std::vector<const char*> group_names;
-        if (obj.getGroupIndices().size() > 0) {
+        if (shownModel().getGroupIndices().size() > 0) {
             ImGui::Text("Group Selector");
-            for (size_t i = 0; i < obj.getGroupIndices().size(); i++) {
-                const char* group_name = (std::get<1>(obj.getGroupIndices()[i])).c_str();
+            for (size_t i = 0; i < shownModel().getGroupIndices().size(); i++) {
+                const char* group_name = (std::get<1>(shownModel().getGroupIndices()[i])).c_str();
                 group_names.push_back(group_name);
             }
             if (ImGui::Combo("Select Group", &selected_group_index, group_names.data(), group_names.size())) {
                 std::cout << "Selected group: " << selected_group_index << " - " << group_names[selected_group_index] << std::endl;
             }
+            ImGui::Text("%zu groups in %zu batches, %zu draws", drawList.getGroupCount(), drawList.getBatchCount(), drawList.getRangeCount());
+            // groups of a lazily opened model are placeholders until loaded
+            size_t unloaded = 0;
+            for (size_t i = 0; i < shownModel().getGroupIndices().size(); i++) unloaded += shownModel().isGroupLoaded(i) ? 0 : 1;
+            if (unloaded > 0) {
+                std::vector<size_t> groups;
+                ImGui::Text("%zu groups not loaded", unloaded);
+                if (!shownModel().isGroupLoaded(selected_group_index) && ImGui::Button("Load Group")) groups.push_back(selected_group_index);
+                if (ImGui::Button("Load All Groups")) {
+                    for (size_t i = 0; i < shownModel().getGroupIndices().size(); i++) groups.push_back(i);
+                }
+                if (!groups.empty()) {
+                    std::cout << "Loading groups: " << groups.size() << std::endl;
+                    // a lazily opened model is the viewer's own
+                    if (obj.loadGroups(groups)) {
+                        updateVAOandVBO(obj, VAO, VBO, EBO);
+                        bvh.build(obj, &pool);
+                        updateCullers(obj, groupCuller, clusterCuller);
+                    } else {
+                        ImGui::OpenPopup("Error");
+                    }
+                }
+            }
         }
         // button control the material of selected group
-        if (obj.getGroupIndices().size() > 0) {
-            auto *current_group = &obj.getGroupIndices()[selected_group_index];
+        if (shownModel().getGroupIndices().size() > 0) {
+            auto *current_group = &shownModel().getGroupIndices()[selected_group_index];
             material current_mtl = std::get<2>(*current_group);
             ImGui::Text("Material Control Panel");
-            ImGui::ColorEdit3("Ambient", &current_mtl.ambient.x);
-            ImGui::ColorEdit3("Diffuse", &current_mtl.diffuse.x);
-            ImGui::ColorEdit3("Specular", &current_mtl.specular.x);
-            ImGui::SliderFloat("Shininess", &current_mtl.shininess, 0.0f, 100.0f);
-            obj.applyMaterial(selected_group_index, current_mtl);
+            bool edited = ImGui::ColorEdit3("Ambient", &current_mtl.ambient.x);
+            edited |= ImGui::ColorEdit3("Diffuse", &current_mtl.diffuse.x);
+            edited |= ImGui::ColorEdit3("Specular", &current_mtl.specular.x);
+            edited |= ImGui::SliderFloat("Shininess", &current_mtl.shininess, 0.0f, 100.0f);
+            if (edited) editableModel().applyMaterial(selected_group_index, current_mtl);
         }
         // button to transform the model
-        static glm::vec3 translate = glm::vec3(0.0f);
-        static glm::vec3 rotate = glm::vec3(0.0f);
-        static glm::vec3 scale = glm::vec3(1.0f);
-        if (obj.getGroupIndices().size() > 0) {
-            ImGui::Text("Model Transformation");
-            ImGui::SliderFloat3("Translate", &translate.x, -10.0f, 10.0f);
-            ImGui::SliderFloat3("Rotate", &rotate.x, -360.0f, 360.0f);
-            ImGui::SliderFloat3("Scale", &scale.x, 0.1f, 5.0f);
-            glm::mat4 new_transform = glm::translate(glm::mat4(1.0f), translate) * 
-                glm::rotate(glm::mat4(1.0f), glm::radians(rotate.x), glm::vec3(1.0f, 0.0f, 0.0f)) * 
-                glm::rotate(glm::mat4(1.0f), glm::radians(rotate.y), glm::vec3(0.0f, 1.0f, 0.0f)) * 
-                glm::rotate(glm::mat4(1.0f), glm::radians(rotate.z), glm::vec3(0.0f, 0.0f, 1.0f)) * 
-                glm::scale(glm::mat4(1.0f), scale);
+        // slider values of every group, edits only replace the group's transform, so they cost the
+        // same whatever the size of the group and nothing is uploaded
+        static std::vector<group_pose> poses;
+        if (modelReplaced || poses.size() != shownModel().getGroupIndices().size()) poses.assign(shownModel().getGroupIndices().size(), group_pose());
+        if (shownModel().getGroupIndices().size() > 0) {
+            group_pose &pose = poses[selected_group_index];
+            ImGui::Text("Group Transformation");
+            bool edited = ImGui::SliderFloat3("Translate", &pose.translate.x, -10.0f, 10.0f);
+            edited |= ImGui::SliderFloat3("Rotate", &pose.rotate.x, -360.0f, 360.0f);
+            edited |= ImGui::SliderFloat3("Scale", &pose.scale.x, 0.1f, 5.0f);
             if (ImGui::Button("Reset Transform")) {
                 std::cout << "Resetting transform" << std::endl;
-                translate = glm::vec3(0.0f);
-                rotate = glm::vec3(0.0f);
-                scale = glm::vec3(1.0f);
-                new_transform = glm::mat4(1.0f);
+                pose = group_pose();
+                edited = true;
+            }
+            if (edited) {
+                editableModel().setGroupTransform(selected_group_index, pose.matrix());
+                updateGroupCulling(obj, selected_group_index, groupCuller, clusterCuller);
+                bvhStale = true;
+            }
+        }
+        // vertex layout of the uploaded buffer
+        if (shownModel().getGroupIndices().size() > 0) {
+            static int positionEncoding = 0, normalEncoding = 0, texcoordEncoding = 0;
+            const char *positionItems[] = {"Float32", "Quantized 16 bit"};
+            const char *normalItems[] = {"Float32", "Octahedral 2x16", "Octahedral 2x8"};
+            const char *texcoordItems[] = {"Float32", "Half", "None"};
+            ImGui::Text("Vertex Format");
+            ImGui::Combo("Position", &positionEncoding, positionItems, 2);
+            ImGui::Combo("Normal", &normalEncoding, normalItems, 3);
+            ImGui::Combo("Texcoord", &texcoordEncoding, texcoordItems, 3);
+            if (ImGui::Button("Apply Format")) {
+                const vertex_encoding positions[] = {VERTEX_FLOAT32, VERTEX_QUANT16};
+                const vertex_encoding normals[] = {VERTEX_FLOAT32, VERTEX_OCT16, VERTEX_OCT8};
+                const vertex_encoding texcoords[] = {VERTEX_FLOAT32, VERTEX_HALF, VERTEX_NONE};
+                modelFormat = vertex_format(positions[positionEncoding], normals[normalEncoding], texcoords[texcoordEncoding]);
+                editableModel().setVertexFormat(modelFormat);
+                updateVAOandVBO(obj, VAO, VBO, EBO);
             }
-            if (ImGui::Button("Transform Model")) {
-                std::cout << "Transforming model" << std::endl;
-                obj.applyTransform(selected_group_index, new_transform);
-                vertices = obj.getVBO();
-                vertices_size = obj.getVBOSize();
-                updateVAOandVBO(vertices, vertices_size, VAO, VBO);
+            ImGui::Text("Vertex Size: %d bytes", (int)shownModel().getVertexFormat().stride());
+        }
+        // reorder triangles and vertices for the vertex cache, indexed geometry only
+        if (shownModel().isIndexed() && shownModel().getGroupIndices().size() > 0) {
+            static bool reduceOverdraw = false;
+            static bool optimized = false;
+            static vertex_cache_stats cacheBefore, cacheAfter;
+            ImGui::Text("Mesh Optimization");
+            ImGui::Checkbox("Reduce Overdraw", &reduceOverdraw);
+            if (ImGui::Button("Optimize Mesh")) {
+                std::cout << "Optimizing mesh" << std::endl;
+                if (editableModel().optimizeMesh(reduceOverdraw, cacheBefore, cacheAfter)) {
+                    optimized = true;
+                    updateVAOandVBO(obj, VAO, VBO, EBO);
+                    bvh.build(obj, &pool);
+                    updateCullers(obj, groupCuller, clusterCuller);
+                }
+            }
+            if (optimized) {
+                ImGui::Text("ACMR %.3f -> %.3f", cacheBefore.acmr, cacheAfter.acmr);
+                ImGui::Text("ATVR %.3f -> %.3f", cacheBefore.atvr, cacheAfter.atvr);
+            }
+        }
+        // simplified copies of every group drawn in place of the full one when their error
+        // is smaller than a pixel or so, indexed geometry only
+        if (shownModel().isIndexed() && shownModel().getGroupIndices().size() > 0) {
+            ImGui::Text("Level of Detail");
+            ImGui::Checkbox("Use LODs", &useLODs);
+            ImGui::SliderFloat("Max Pixel Error", &maxPixelError, 0.1f, 16.0f);
+            if (ImGui::Button("Generate LODs")) {
+                std::cout << "Generating levels of detail" << std::endl;
+                if (editableModel().generateLODs(lod_ratios)) updateVAOandVBO(obj, VAO, VBO, EBO);
+            }
+            ImGui::Text("%zu triangles drawn", drawList.getTriangleCount());
+        }
+        // culling by group, and by cluster once the groups are split, clusters need indexed geometry
+        if (shownModel().getGroupIndices().size() > 0) {
+            static int clusterTriangles = 128;
+            ImGui::Text("Culling");
+            ImGui::Checkbox("Frustum Culling", &frustumCulling);
+            ImGui::Checkbox("Backface Cones", &backfaceCulling);
+            if (shownModel().isIndexed()) {
+                ImGui::SliderInt("Cluster Triangles", &clusterTriangles, 32, 1024);
+                if (ImGui::Button("Build Clusters") && editableModel().buildClusters(clusterTriangles)) {
+                    std::cout << "Building clusters" << std::endl;
+                    updateVAOandVBO(obj, VAO, VBO, EBO);
+                    updateCullers(obj, groupCuller, clusterCuller);
+                }
             }
+            ImGui::Text("%zu of %zu groups, %zu of %zu clusters visible", visibleGroups.size(), groupCuller.size(), visibleClusters.size(), clusterCuller.size());
+        }
+        // many copies of the model in one draw per range instead of one per copy
+        if (shownModel().getGroupIndices().size() > 0) {
+            ImGui::Text("Instancing");
+            ImGui::Checkbox("Draw Copies", &drawCopies);
+            ImGui::SliderInt("Copies", &copies, 1, 10000);
+            ImGui::SliderFloat("Spacing", &copySpacing, 0.5f, 20.0f);
+            ImGui::Checkbox("Tint Copies", &tintCopies);
+            if (drawCopies) ImGui::Text("%.2f MB uploaded", instances.getUploadedBytes() / 1e6);
         }
         // button to save the model
-        if (obj.getGroupIndices().size() > 0) {
+        if (shownModel().getGroupIndices().size() > 0) {
             ImGui::Text("Save Model");
             ImGui::InputText("Save Path", savePath, 128);
-            if (ImGui::Button("Save")) {
+            bool allLoaded = true;
+            for (size_t i = 0; i < shownModel().getGroupIndices().size(); i++) allLoaded = allLoaded && shownModel().isGroupLoaded(i);
+            // save refuses placeholders, their faces are still in the file
+            if (!allLoaded) {
+                ImGui::Text("Load all groups to save");
+            } else if (ImGui::Button("Save")) {
                 std::cout << "Saving model: " << savePath << std::endl;
-                obj.save(savePath);
+                if (shown) {
+                    // the shared asset is never changed, a copy of it bakes and saves
+                    objLoader copy;
+                    copy.copyFrom(shown -> model);
+                    copy.save(savePath);
+                } else {
+                    obj.save(savePath);
+                }
             }
         }
 
+        ImGui::End();
+
+        // load statistics panel
+        ImGui::SetNextWindowPos(ImVec2(window_width - 300, 0));
+        ImGui::SetNextWindowSize(ImVec2(300, window_height / 2));
+        ImGui::Begin("Load Statistics", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
+#ifdef OBJ_LOADER_STATS
+        const load_stats &stats = shownModel().getLoadStats();
+        ImGui::Text("Total %.2f ms, %.1f MB", stats.total_ms, stats.bytes_read / 1e6);
+        ImGui::Text("Open %.2f ms", stats.open_ms);
+        ImGui::Text("Cache %.2f ms", stats.cache_ms);
+        ImGui::Text("Parse %.2f ms", stats.parse_ms);
+        ImGui::Text("Merge %.2f ms", stats.merge_ms);
+        ImGui::Text("Materials %.2f ms", stats.material_ms);
+        ImGui::Text("Normals %.2f ms", stats.normals_ms);
+        ImGui::Text("Triangulate %.2f ms", stats.triangulate_ms);
+        ImGui::Text("Copy %.2f ms", stats.copy_ms);
+        ImGui::Separator();
+        ImGui::Text("v %zu  vn %zu  vt %zu  f %zu", stats.vertex_lines, stats.normal_lines, stats.texcoord_lines, stats.face_lines);
+        ImGui::Text("g %zu  usemtl %zu  mtllib %zu", stats.group_lines, stats.usemtl_lines, stats.mtllib_lines);
+        ImGui::Text("Comments %zu  Empty %zu  Skipped %zu", stats.comment_lines, stats.empty_lines, stats.skipped_lines);
+        ImGui::Text("Triangles %zu  Vertices %zu  Indices %zu", stats.triangles, stats.vertices, stats.indices);
+        ImGui::Separator();
+        ImGui::Text("Positions %.2f MB", stats.positions_bytes / 1e6);
+        ImGui::Text("Normals %.2f MB", stats.normals_bytes / 1e6);
+        ImGui::Text("Texcoords %.2f MB", stats.texcoords_bytes / 1e6);
+        ImGui::Text("Faces %.2f MB", stats.faces_bytes / 1e6);
+        ImGui::Text("Temporary VBO %.2f MB", stats.tmp_vbo_bytes / 1e6);
+        ImGui::Text("VBO %.2f MB  IBO %.2f MB", stats.vbo_bytes / 1e6, stats.ibo_bytes / 1e6);
+#else
+        ImGui::Text("Built without OBJ_LOADER_STATS,");
+        ImGui::Text("rebuild with make STATS=1");
+#endif
+        // shared model cache, unused models are dropped oldest first once over the budget
+        asset_stats assetStats = assets.getStats();
+        static int assetBudget = (int)(assets.getBudget() >> 20);
+        ImGui::Separator();
+        ImGui::Text("Assets %zu meshes %.1f MB, %zu materials", assetStats.meshes, (assetStats.cpu_bytes + assetStats.gpu_bytes) / 1e6, assetStats.materials);
+        ImGui::Text("Mesh hits %zu  misses %zu", assetStats.mesh_hits, assetStats.mesh_misses);
+        ImGui::Text("Material hits %zu  misses %zu", assetStats.material_hits, assetStats.material_misses);
+        ImGui::Text("Evictions %zu  GPU %zu", assetStats.evictions, assetStats.gpu_evictions);
+        if (ImGui::SliderInt("Budget MB", &assetBudget, 16, 4096)) assets.setBudget((size_t)assetBudget << 20);
+        // decoded images are dropped once uploaded, the textures stay on the GPU
+        texture_stats textureStats = textures.getStats();
+        ImGui::Text("Textures %zu on GPU %.1f MB, decoded %.1f ms", gpuTextures.size(), gpuTextures.getMemoryUsage() / 1e6, textureStats.decode_ms);
+        ImGui::Text("Texture hits %zu  misses %zu  failed %zu", textureStats.hits, textureStats.misses, textureStats.failures);
+        if (ImGui::Button("Clear Unused")) {
+            assets.clearUnused();
+            textures.clearUnused();
+        }
         ImGui::End();
         endImGUIFrame();
 
@@ -296,9 +857,14 @@ int main() {
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    // the cache hands back the buffers of the shared asset on screen once nothing holds it
+    if (!shown) deleteBuffers(VAO, VBO, EBO);
+    shown.reset();
+    assets.clearUnused();
+    deleteEvicted();
     glDeleteProgram(shaderProgram);
+    glDeleteProgram(instancedProgram);
+    gpuTextures.clear();
 
     clearImGUIContext();
     glfwTerminate();
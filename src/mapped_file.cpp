@@ -0,0 +1,52 @@
+#include "mapped_file.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+mapped_file::~mapped_file() {
+    this -> close();
+}
+
+bool mapped_file::open(const std::string& filename, bool copy_on_write) {
+    this -> close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    // mmap refuses zero-length mappings, an empty file is still a valid file
+    if (st.st_size > 0) {
+        int prot = copy_on_write ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void *addr = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        // parsers stream through the file once, copies are usually read whole
+        madvise(addr, st.st_size, copy_on_write ? MADV_WILLNEED : MADV_SEQUENTIAL);
+        this -> map_data = static_cast<char *>(addr);
+        this -> map_size = st.st_size;
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    this -> opened = true;
+    return true;
+}
+
+void mapped_file::close() {
+    if (this -> map_data) munmap(this -> map_data, this -> map_size);
+    this -> map_data = nullptr;
+    this -> map_size = 0;
+    this -> opened = false;
+}
+
+void mapped_file::releaseBefore(size_t offset) {
+    if (!this -> map_data) return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t length = std::min(offset, this -> map_size) / page * page;
+    if (length > 0) madvise(this -> map_data, length, MADV_DONTNEED);
+}
@@ -0,0 +1,489 @@
+#include "mesh_bvh.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+// bins per axis for the SAH sweep
+static const size_t bin_count = 16;
+// nodes with more triangles are always split
+static const size_t max_leaf_size = 4;
+// deeper nodes become leaves, so traversal stacks have a fixed size
+static const size_t max_depth = 60;
+// subtrees with fewer triangles are built on the current thread
+static const size_t parallel_threshold = 1 << 16;
+
+struct bin_bounds {
+    glm::vec3 lo, hi;
+    bin_bounds(): lo(FLT_MAX), hi(-FLT_MAX) {}
+    void grow(const glm::vec3 &l, const glm::vec3 &h) {
+        // component by component, the binning loop calls this for every triangle on every level
+        this -> lo.x = std::min(this -> lo.x, l.x);
+        this -> lo.y = std::min(this -> lo.y, l.y);
+        this -> lo.z = std::min(this -> lo.z, l.z);
+        this -> hi.x = std::max(this -> hi.x, h.x);
+        this -> hi.y = std::max(this -> hi.y, h.y);
+        this -> hi.z = std::max(this -> hi.z, h.z);
+    }
+    float area() const {
+        glm::vec3 d = this -> hi - this -> lo;
+        return d.x < 0.0f ? 0.0f : 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+
+static void setBounds(bvh_node &node, const bin_bounds &bounds) {
+    for (int k = 0; k < 3; k++) {
+        node.bounds_min[k] = bounds.lo[k];
+        node.bounds_max[k] = bounds.hi[k];
+    }
+}
+
+// bounds of one triangle, the builder partitions these in place so every pass reads them in order
+struct build_ref {
+    glm::vec3 lo;
+    uint32_t id;
+    glm::vec3 hi;
+};
+
+// recursive top-down build over the triangle refs
+struct bvh_builder {
+    std::vector<bvh_node> &nodes;
+    std::vector<build_ref> &refs;
+    thread_pool *pool;
+    std::atomic<uint32_t> node_count;
+    bvh_builder(std::vector<bvh_node> &nodes, std::vector<build_ref> &refs, thread_pool *pool)
+        : nodes(nodes), refs(refs), pool(pool), node_count(1) {}
+
+    static glm::vec3 centroid(const build_ref &ref) {
+        return (ref.lo + ref.hi) * 0.5f;
+    }
+
+    void rangeBounds(uint32_t begin, uint32_t end, bin_bounds &bounds, bin_bounds &centroids) const {
+        for (uint32_t i = begin; i < end; i++) {
+            const build_ref &ref = this -> refs[i];
+            bounds.grow(ref.lo, ref.hi);
+            glm::vec3 c = centroid(ref);
+            centroids.grow(c, c);
+        }
+    }
+
+    // the bounds of a node's triangles and of their centroids come from the parent's split
+    void build(uint32_t index, uint32_t begin, uint32_t end, size_t depth, const bin_bounds &node_bounds, const bin_bounds &centroid_bounds) {
+        bvh_node &node = this -> nodes[index];
+        setBounds(node, node_bounds);
+        uint32_t count = end - begin;
+        node.first = begin;
+        node.count = count;
+        if (count <= 1 || depth >= max_depth) return;
+
+        // bin the centroids along all three axes in one pass, small nodes use fewer bins
+        // since the sweep over the bins would cost more than the triangles
+        const size_t bins_used = std::min<size_t>(bin_count, count);
+        size_t bin_size[3][bin_count] = {};
+        bin_bounds bins[3][bin_count];
+        glm::vec3 extent = centroid_bounds.hi - centroid_bounds.lo;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; axis++) scale[axis] = extent[axis] > 0.0f ? bins_used / extent[axis] : 0.0f;
+        auto binOf = [&](const glm::vec3 &c, int axis) {
+            return std::min(bins_used - 1, (size_t)((c[axis] - centroid_bounds.lo[axis]) * scale[axis]));
+        };
+        for (uint32_t i = begin; i < end; i++) {
+            const build_ref &ref = this -> refs[i];
+            glm::vec3 c = centroid(ref);
+            for (int axis = 0; axis < 3; axis++) {
+                size_t bin = binOf(c, axis);
+                bin_size[axis][bin]++;
+                bins[axis][bin].grow(ref.lo, ref.hi);
+            }
+        }
+        // cost of a split after bin k: triangles times area on both sides, a traversal step costs one triangle test
+        float best_cost = FLT_MAX;
+        int best_axis = -1;
+        size_t best_bin = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            if (extent[axis] <= 0.0f) continue;
+            float right_area[bin_count];
+            size_t right_size[bin_count];
+            bin_bounds right;
+            size_t right_count = 0;
+            for (size_t k = bins_used - 1; k > 0; k--) {
+                right.grow(bins[axis][k].lo, bins[axis][k].hi);
+                right_count += bin_size[axis][k];
+                right_area[k] = right.area();
+                right_size[k] = right_count;
+            }
+            bin_bounds left;
+            size_t left_count = 0;
+            for (size_t k = 0; k + 1 < bins_used; k++) {
+                left.grow(bins[axis][k].lo, bins[axis][k].hi);
+                left_count += bin_size[axis][k];
+                if (left_count == 0 || right_size[k + 1] == 0) continue;
+                float cost = left_count * left.area() + right_size[k + 1] * right_area[k + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = k;
+                }
+            }
+        }
+        float node_area = node_bounds.area();
+        if (count <= max_leaf_size && (best_axis < 0 || node_area + best_cost >= count * node_area)) return;
+
+        bin_bounds left_bounds, right_bounds, left_centroids, right_centroids;
+        uint32_t mid = begin;
+        if (best_axis >= 0) {
+            // both sides are non-empty, their triangle bounds are the merged bins
+            for (size_t k = 0; k < bins_used; k++) {
+                bin_bounds &side = k <= best_bin ? left_bounds : right_bounds;
+                side.grow(bins[best_axis][k].lo, bins[best_axis][k].hi);
+            }
+            // partition by the same bin test, collecting the centroid bounds of each side
+            uint32_t last = end;
+            while (mid < last) {
+                glm::vec3 c = centroid(this -> refs[mid]);
+                if (binOf(c, best_axis) <= best_bin) {
+                    left_centroids.grow(c, c);
+                    mid++;
+                } else {
+                    right_centroids.grow(c, c);
+                    std::swap(this -> refs[mid], this -> refs[--last]);
+                }
+            }
+        } else {
+            // identical centroids are split in the middle of the range
+            mid = begin + count / 2;
+            this -> rangeBounds(begin, mid, left_bounds, left_centroids);
+            this -> rangeBounds(mid, end, right_bounds, right_centroids);
+        }
+
+        uint32_t child = this -> node_count.fetch_add(2);
+        node.first = child;
+        node.count = 0;
+        if (this -> pool && count >= parallel_threshold) {
+            this -> pool -> parallel_for(2, [&](size_t k) {
+                if (k == 0) this -> build(child, begin, mid, depth + 1, left_bounds, left_centroids);
+                else this -> build(child + 1, mid, end, depth + 1, right_bounds, right_centroids);
+            });
+        } else {
+            this -> build(child, begin, mid, depth + 1, left_bounds, left_centroids);
+            this -> build(child + 1, mid, end, depth + 1, right_bounds, right_centroids);
+        }
+    }
+};
+
+glm::vec3 mesh_bvh::vertex(uint32_t index) const {
+    const float *p = this -> vbo + (size_t)index * this -> stride;
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+void mesh_bvh::usePositions(const objLoader &model) {
+    if (!model.hasGroupTransforms()) {
+        this -> transformed.clear();
+        this -> vbo = model.getVBO();
+        this -> stride = VBO_FLOATS_PER_VERTEX;
+        return;
+    }
+    this -> transformed.resize(model.getVertexCount() * 3);
+    for (size_t i = 0; i < model.getGroupIndices().size(); i++) {
+        auto range = model.getGroupVertexRange(i);
+        const glm::mat4 &transform = model.getGroupTransform(i);
+        for (size_t v = range.first; v < range.first + range.second; v++) {
+            const float *p = model.getVBO() + v * VBO_FLOATS_PER_VERTEX;
+            glm::vec3 position = glm::vec3(transform * glm::vec4(p[0], p[1], p[2], 1.0f));
+            for (int k = 0; k < 3; k++) this -> transformed[v * 3 + k] = position[k];
+        }
+    }
+    this -> vbo = this -> transformed.data();
+    this -> stride = 3;
+}
+
+void mesh_bvh::build(const objLoader &model, thread_pool *pool) {
+    this -> usePositions(model);
+    // the groups cover the surface, levels of detail appended to the index buffer are left out
+    size_t triangle_count = 0;
+    this -> group_first.clear();
+    for (size_t i = 0; i < model.getGroupIndices().size(); i++) {
+        auto range = model.getGroupRange(i);
+        this -> group_first.push_back(range.first / 3);
+        triangle_count = std::max(triangle_count, (range.first + range.second) / 3);
+    }
+
+    // vertex indices in element order
+    std::vector<uint32_t> elements(triangle_count * 3);
+    const void *ibo = model.getIBO();
+    bool wide = model.getIndexSize() == sizeof(uint32_t);
+    for (size_t i = 0; i < elements.size(); i++) {
+        if (!model.isIndexed()) elements[i] = i;
+        else elements[i] = wide ? ((const uint32_t*)ibo)[i] : ((const uint16_t*)ibo)[i];
+    }
+    std::vector<build_ref> refs(triangle_count);
+    const size_t block = 1 << 16;
+    auto body = [&](size_t b) {
+        for (size_t t = b * block; t < std::min(triangle_count, (b + 1) * block); t++) {
+            glm::vec3 a = this -> vertex(elements[t * 3]), v1 = this -> vertex(elements[t * 3 + 1]), v2 = this -> vertex(elements[t * 3 + 2]);
+            refs[t].lo = glm::min(a, glm::min(v1, v2));
+            refs[t].hi = glm::max(a, glm::max(v1, v2));
+            refs[t].id = t;
+        }
+    };
+    size_t block_count = (triangle_count + block - 1) / block;
+    if (pool) pool -> parallel_for(block_count, body);
+    else for (size_t b = 0; b < block_count; b++) body(b);
+
+    this -> nodes.clear();
+    this -> corners.clear();
+    this -> triangle_ids.clear();
+    if (triangle_count == 0) return;
+    // a binary tree with one triangle per leaf is the largest possible
+    this -> nodes.resize(triangle_count * 2 - 1);
+    bvh_builder builder(this -> nodes, refs, pool);
+    bin_bounds root_bounds, root_centroids;
+    builder.rangeBounds(0, triangle_count, root_bounds, root_centroids);
+    builder.build(0, 0, triangle_count, 0, root_bounds, root_centroids);
+    this -> nodes.resize(builder.node_count.load());
+    this -> nodes.shrink_to_fit();
+
+    this -> corners.resize(triangle_count * 3);
+    this -> triangle_ids.resize(triangle_count);
+    for (size_t i = 0; i < triangle_count; i++) {
+        for (int k = 0; k < 3; k++) this -> corners[i * 3 + k] = elements[refs[i].id * 3 + k];
+        this -> triangle_ids[i] = refs[i].id;
+    }
+}
+
+void mesh_bvh::leafBounds(bvh_node &node) const {
+    bin_bounds bounds;
+    for (uint32_t i = node.first * 3; i < (node.first + node.count) * 3; i++) {
+        glm::vec3 p = this -> vertex(this -> corners[i]);
+        bounds.grow(p, p);
+    }
+    setBounds(node, bounds);
+}
+
+void mesh_bvh::refit(const objLoader &model) {
+    this -> usePositions(model);
+    // children always come after their parent
+    for (size_t i = this -> nodes.size(); i-- > 0;) {
+        bvh_node &node = this -> nodes[i];
+        if (node.count > 0) {
+            this -> leafBounds(node);
+            continue;
+        }
+        const bvh_node &left = this -> nodes[node.first], &right = this -> nodes[node.first + 1];
+        for (int k = 0; k < 3; k++) {
+            node.bounds_min[k] = std::min(left.bounds_min[k], right.bounds_min[k]);
+            node.bounds_max[k] = std::max(left.bounds_max[k], right.bounds_max[k]);
+        }
+    }
+}
+
+void mesh_bvh::refit(const objLoader &model, const std::vector<std::pair<size_t, size_t>> &vertex_ranges) {
+    if (model.hasGroupTransforms()) {
+        this -> refit(model);
+        return;
+    }
+    this -> usePositions(model);
+    if (vertex_ranges.empty()) return;
+    auto moved = [&vertex_ranges](uint32_t vertex) {
+        auto it = std::upper_bound(vertex_ranges.begin(), vertex_ranges.end(), std::make_pair((size_t)vertex, SIZE_MAX));
+        return it != vertex_ranges.begin() && vertex < (it - 1) -> first + (it - 1) -> second;
+    };
+    std::vector<char> changed(this -> nodes.size(), 0);
+    for (size_t i = this -> nodes.size(); i-- > 0;) {
+        bvh_node &node = this -> nodes[i];
+        if (node.count > 0) {
+            for (uint32_t c = node.first * 3; c < (node.first + node.count) * 3 && !changed[i]; c++) changed[i] = moved(this -> corners[c]);
+            if (changed[i]) this -> leafBounds(node);
+            continue;
+        }
+        if (!changed[node.first] && !changed[node.first + 1]) continue;
+        changed[i] = 1;
+        const bvh_node &left = this -> nodes[node.first], &right = this -> nodes[node.first + 1];
+        for (int k = 0; k < 3; k++) {
+            node.bounds_min[k] = std::min(left.bounds_min[k], right.bounds_min[k]);
+            node.bounds_max[k] = std::max(left.bounds_max[k], right.bounds_max[k]);
+        }
+    }
+}
+
+bool mesh_bvh::empty() {
+    return this -> nodes.empty();
+}
+
+size_t mesh_bvh::getNodeCount() {
+    return this -> nodes.size();
+}
+
+size_t mesh_bvh::getTriangleCount() {
+    return this -> triangle_ids.size();
+}
+
+size_t mesh_bvh::getGroup(size_t triangle) {
+    auto it = std::upper_bound(this -> group_first.begin(), this -> group_first.end(), triangle);
+    return it == this -> group_first.begin() ? 0 : it - this -> group_first.begin() - 1;
+}
+
+// entry distance of the ray into the box, false if it misses or enters beyond max_distance
+static inline bool rayBox(const bvh_node &node, const glm::vec3 &origin, const glm::vec3 &inv_dir, float max_distance, float &entry) {
+    float t_min = 0.0f, t_max = max_distance;
+    for (int k = 0; k < 3; k++) {
+        float t0 = (node.bounds_min[k] - origin[k]) * inv_dir[k];
+        float t1 = (node.bounds_max[k] - origin[k]) * inv_dir[k];
+        // written so a NaN from a ray in the slab plane keeps the previous bound
+        t_min = std::max(t_min, std::min(t0, t1));
+        t_max = std::min(t_max, std::max(t0, t1));
+    }
+    entry = t_min;
+    return t_min <= t_max;
+}
+
+// Moller-Trumbore, both sides count
+static inline bool rayTriangle(const glm::vec3 &origin, const glm::vec3 &dir, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, float &t, float &u, float &v) {
+    glm::vec3 e1 = b - a, e2 = c - a;
+    glm::vec3 p = glm::cross(dir, e2);
+    float det = glm::dot(e1, p);
+    if (std::fabs(det) < 1e-12f) return false;
+    float inv_det = 1.0f / det;
+    glm::vec3 s = origin - a;
+    u = glm::dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f) return false;
+    glm::vec3 q = glm::cross(s, e1);
+    v = glm::dot(dir, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    t = glm::dot(e2, q) * inv_det;
+    return t >= 0.0f;
+}
+
+bvh_hit mesh_bvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_distance) {
+    bvh_hit result = {false, max_distance, 0, 0, 0.0f, 0.0f};
+    if (this -> nodes.empty()) return result;
+    glm::vec3 inv_dir = glm::vec3(1.0f) / direction;
+    uint32_t stack[max_depth + 4];
+    size_t depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const bvh_node &node = this -> nodes[stack[--depth]];
+        float entry;
+        if (!rayBox(node, origin, inv_dir, result.distance, entry)) continue;
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                float t, u, v;
+                if (rayTriangle(origin, direction, this -> vertex(this -> corners[i * 3]), this -> vertex(this -> corners[i * 3 + 1]),
+                    this -> vertex(this -> corners[i * 3 + 2]), t, u, v) && t < result.distance) {
+                    result.hit = true;
+                    result.distance = t;
+                    result.triangle = this -> triangle_ids[i];
+                    result.u = u;
+                    result.v = v;
+                }
+            }
+            continue;
+        }
+        // the nearer child is visited first so the farther one is often culled
+        float left_entry, right_entry;
+        bool left = rayBox(this -> nodes[node.first], origin, inv_dir, result.distance, left_entry);
+        bool right = rayBox(this -> nodes[node.first + 1], origin, inv_dir, result.distance, right_entry);
+        if (left && right) {
+            bool left_first = left_entry <= right_entry;
+            stack[depth++] = left_first ? node.first + 1 : node.first;
+            stack[depth++] = left_first ? node.first : node.first + 1;
+        } else if (left) {
+            stack[depth++] = node.first;
+        } else if (right) {
+            stack[depth++] = node.first + 1;
+        }
+    }
+    if (result.hit) result.group = this -> getGroup(result.triangle);
+    return result;
+}
+
+static inline bool boxOverlap(const float *lo, const float *hi, const glm::vec3 &box_min, const glm::vec3 &box_max) {
+    return lo[0] <= box_max.x && hi[0] >= box_min.x && lo[1] <= box_max.y && hi[1] >= box_min.y && lo[2] <= box_max.z && hi[2] >= box_min.z;
+}
+
+void mesh_bvh::overlap(const glm::vec3 &box_min, const glm::vec3 &box_max, std::vector<size_t> &triangles) {
+    if (this -> nodes.empty()) return;
+    uint32_t stack[max_depth + 4];
+    size_t depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const bvh_node &node = this -> nodes[stack[--depth]];
+        if (!boxOverlap(node.bounds_min, node.bounds_max, box_min, box_max)) continue;
+        if (node.count == 0) {
+            stack[depth++] = node.first + 1;
+            stack[depth++] = node.first;
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            glm::vec3 a = this -> vertex(this -> corners[i * 3]), b = this -> vertex(this -> corners[i * 3 + 1]), c = this -> vertex(this -> corners[i * 3 + 2]);
+            glm::vec3 lo = glm::min(a, glm::min(b, c)), hi = glm::max(a, glm::max(b, c));
+            if (boxOverlap(&lo.x, &hi.x, box_min, box_max)) triangles.push_back(this -> triangle_ids[i]);
+        }
+    }
+}
+
+static inline float boxDistance2(const bvh_node &node, const glm::vec3 &p) {
+    float d2 = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        float d = std::max(std::max(node.bounds_min[k] - p[k], p[k] - node.bounds_max[k]), 0.0f);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+// closest point on triangle abc to p, from Ericson's Real-Time Collision Detection
+static glm::vec3 closestOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+bvh_nearest mesh_bvh::nearest(const glm::vec3 &point, float max_distance) {
+    bvh_nearest result = {false, glm::vec3(0.0f), max_distance, 0, 0};
+    if (this -> nodes.empty()) return result;
+    float best2 = max_distance * max_distance;
+    uint32_t stack[max_depth + 4];
+    size_t depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const bvh_node &node = this -> nodes[stack[--depth]];
+        if (boxDistance2(node, point) > best2) continue;
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                glm::vec3 q = closestOnTriangle(point, this -> vertex(this -> corners[i * 3]), this -> vertex(this -> corners[i * 3 + 1]), this -> vertex(this -> corners[i * 3 + 2]));
+                glm::vec3 d = q - point;
+                float d2 = glm::dot(d, d);
+                if (d2 <= best2) {
+                    best2 = d2;
+                    result.found = true;
+                    result.point = q;
+                    result.triangle = this -> triangle_ids[i];
+                }
+            }
+            continue;
+        }
+        float left = boxDistance2(this -> nodes[node.first], point);
+        float right = boxDistance2(this -> nodes[node.first + 1], point);
+        // nearer child on top of the stack
+        stack[depth++] = left <= right ? node.first + 1 : node.first;
+        stack[depth++] = left <= right ? node.first : node.first + 1;
+    }
+    if (result.found) {
+        result.distance = std::sqrt(best2);
+        result.group = this -> getGroup(result.triangle);
+    }
+    return result;
+}
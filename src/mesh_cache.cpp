@@ -0,0 +1,323 @@
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+static const char mesh_cache_magic[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+
+// options bits stored in the header
+#define MESH_CACHE_OPTION_INDEXED 0x1
+#define MESH_CACHE_OPTION_FLAT_NORMALS 0x2
+#define MESH_CACHE_OPTION_SMOOTH_NORMALS 0x4
+// flags bits stored in the header
+#define MESH_CACHE_FLAG_NORMAL 0x1
+#define MESH_CACHE_FLAG_TEXCOORD 0x2
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t hashBlock(const char *data, size_t size, uint64_t seed) {
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    // four independent lanes keep the multiplier busy
+    uint64_t lanes[4] = {seed + prime1, seed ^ prime2, seed, seed - prime1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * k, sizeof(word));
+            lanes[k] = rotl64(lanes[k] + word * prime2, 31) * prime1;
+        }
+    }
+    uint64_t hash = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+    for (; i < size; i++) hash = (hash ^ (unsigned char)data[i]) * prime1;
+    hash ^= size;
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t hashBytes(const char *data, size_t size, thread_pool *pool) {
+    // the block size is fixed so the result does not depend on the thread count
+    const size_t block_size = 1 << 22;
+    size_t block_count = (size + block_size - 1) / block_size;
+    if (block_count <= 1) return hashBlock(data, size, 0);
+    std::vector<uint64_t> partial(block_count);
+    auto body = [&](size_t i) {
+        size_t begin = i * block_size;
+        partial[i] = hashBlock(data + begin, std::min(block_size, size - begin), i);
+    };
+    if (pool) {
+        pool -> parallel_for(block_count, body);
+    } else {
+        for (size_t i = 0; i < block_count; i++) body(i);
+    }
+    return hashBlock(reinterpret_cast<const char *>(partial.data()), block_count * sizeof(uint64_t), size);
+}
+
+bool statMeshSource(const std::string& filename, mesh_cache_source& source) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) return false;
+    source.size = st.st_size;
+    source.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    source.hash = 0;
+    return true;
+}
+
+mesh_cache_source readMeshSource(const std::string& filename) {
+    mesh_cache_source source;
+    mapped_file file;
+    if (!statMeshSource(filename, source) || !file.open(filename)) return mesh_cache_source();
+    source.hash = hashBytes(file.data(), file.size());
+    return source;
+}
+
+static uint64_t alignCache(uint64_t offset) {
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+static void packMaterial(const material& mat, mesh_cache_material& out, std::string& strings) {
+    for (int i = 0; i < 3; i++) {
+        out.ambient[i] = mat.ambient[i];
+        out.diffuse[i] = mat.diffuse[i];
+        out.specular[i] = mat.specular[i];
+    }
+    out.shininess = mat.shininess;
+    out.bump_multiplier = mat.bump_multiplier;
+    out.reserved = 0;
+    const std::string *maps[3] = {&mat.diffuse_map, &mat.specular_map, &mat.bump_map};
+    for (int i = 0; i < 3; i++) {
+        out.map_offset[i] = strings.size();
+        out.map_size[i] = maps[i] -> size();
+        strings += *maps[i];
+    }
+}
+
+static material unpackMaterial(const mesh_cache_material& mat, const std::function<std::string(uint64_t, uint64_t)>& string_at) {
+    material result(
+        glm::vec3(mat.ambient[0], mat.ambient[1], mat.ambient[2]),
+        glm::vec3(mat.diffuse[0], mat.diffuse[1], mat.diffuse[2]),
+        glm::vec3(mat.specular[0], mat.specular[1], mat.specular[2]),
+        mat.shininess
+    );
+    result.bump_multiplier = mat.bump_multiplier;
+    result.diffuse_map = string_at(mat.map_offset[0], mat.map_size[0]);
+    result.specular_map = string_at(mat.map_offset[1], mat.map_size[1]);
+    result.bump_map = string_at(mat.map_offset[2], mat.map_size[2]);
+    return result;
+}
+
+void objLoader::setCacheEnabled(bool enable) {
+    this -> cache_enabled = enable;
+}
+
+void objLoader::setCacheDir(const std::string& dir) {
+    this -> cache_dir = dir;
+}
+
+bool objLoader::loadedFromCache() const {
+    return this -> from_cache;
+}
+
+const std::vector<std::string>& objLoader::getMaterialLibraries() const {
+    return this -> material_lib_paths;
+}
+
+void objLoader::setKnownSource(const mesh_cache_source& source) {
+    this -> known_source = source;
+}
+
+uint64_t objLoader::cacheOptions() const {
+    uint64_t options = 0;
+    if (this -> indexed) options |= MESH_CACHE_OPTION_INDEXED;
+    if (this -> flat_normals) options |= MESH_CACHE_OPTION_FLAT_NORMALS;
+    if (this -> smooth_normals) {
+        // the crease angle changes the normals too, its bits go in the high half
+        uint32_t crease_bits;
+        memcpy(&crease_bits, &this -> crease_angle, sizeof(crease_bits));
+        options |= MESH_CACHE_OPTION_SMOOTH_NORMALS | ((uint64_t)crease_bits << 32);
+    }
+    return options;
+}
+
+std::string objLoader::cachePath(const std::string& filename, const char *extension) {
+    if (this -> cache_dir.empty()) return filename + extension;
+    // files with the same name in different directories must not collide
+    char resolved[PATH_MAX];
+    std::string absolute = realpath(filename.c_str(), resolved) ? std::string(resolved) : filename;
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%016llx", (unsigned long long)hashBytes(absolute.data(), absolute.size()));
+    size_t last_slash_pos = filename.find_last_of("/");
+    std::string base = filename.substr(last_slash_pos == std::string::npos ? 0 : last_slash_pos + 1);
+    return this -> cache_dir + "/" + base + suffix + extension;
+}
+
+bool objLoader::readCache(const std::string& cache_path, const mesh_cache_source& source) {
+    // the vbo points straight into a private mapping, transforms only touch copied pages
+    mapped_file &cache = this -> vbo_mapping;
+    if (!cache.open(cache_path, true)) return false;
+    mesh_cache_header header;
+    if (cache.size() < sizeof(header)) {
+        cache.close();
+        return false;
+    }
+    memcpy(&header, cache.data(), sizeof(header));
+    // wrong byte order, old versions and stale sources fall back to the text path
+    if (memcmp(header.magic, mesh_cache_magic, sizeof(mesh_cache_magic)) != 0 ||
+        header.endian_tag != MESH_CACHE_ENDIAN_TAG || header.version != MESH_CACHE_VERSION ||
+        header.options != this -> cacheOptions() || header.source.size != source.size ||
+        header.source.mtime_ns != source.mtime_ns || header.source.hash != source.hash) {
+        cache.close();
+        return false;
+    }
+    auto section_ok = [&cache](uint64_t offset, uint64_t count, uint64_t element_size) {
+        return offset % 16 == 0 && offset <= cache.size() &&
+            (element_size == 0 || count <= (cache.size() - offset) / element_size);
+    };
+    if (!section_ok(header.vbo_offset, header.vbo_size, 1) || header.vbo_size % (VBO_FLOATS_PER_VERTEX * sizeof(float)) != 0 ||
+        (header.index_size != sizeof(uint16_t) && header.index_size != sizeof(uint32_t)) ||
+        !section_ok(header.ibo_offset, header.index_count, header.index_size) ||
+        !section_ok(header.group_offset, header.group_count, sizeof(mesh_cache_group)) ||
+        !section_ok(header.material_offset, header.material_count, sizeof(mesh_cache_named_material)) ||
+        !section_ok(header.string_offset, header.string_size, 1) ||
+        !section_ok(header.library_offset, header.library_count, sizeof(mesh_cache_library))) {
+        cache.close();
+        return false;
+    }
+    const char *strings = cache.data() + header.string_offset;
+    std::function<std::string(uint64_t, uint64_t)> string_at = [&](uint64_t offset, uint64_t size) {
+        if (offset > header.string_size || size > header.string_size - offset) return std::string();
+        return std::string(strings + offset, size);
+    };
+    // the materials are stale once a library changed, they are small enough to hash every time
+    const mesh_cache_library *libraries = reinterpret_cast<const mesh_cache_library *>(cache.data() + header.library_offset);
+    std::vector<std::string> library_paths;
+    for (size_t i = 0; i < header.library_count; i++) {
+        library_paths.push_back(string_at(libraries[i].path_offset, libraries[i].path_size));
+        mesh_cache_source current = readMeshSource(library_paths.back());
+        if (current.size != libraries[i].source.size || current.hash != libraries[i].source.hash) {
+            cache.close();
+            return false;
+        }
+    }
+    this -> material_lib_paths = library_paths;
+    const mesh_cache_group *groups = reinterpret_cast<const mesh_cache_group *>(cache.data() + header.group_offset);
+    for (size_t i = 0; i < header.group_count; i++) {
+        this -> group_index.push_back(std::make_tuple((int)groups[i].start, string_at(groups[i].name_offset, groups[i].name_size), unpackMaterial(groups[i].mat, string_at)));
+        this -> group_vertex_offset.push_back(groups[i].vertex_offset);
+    }
+    const mesh_cache_named_material *materials = reinterpret_cast<const mesh_cache_named_material *>(cache.data() + header.material_offset);
+    for (size_t i = 0; i < header.material_count; i++)
+        this -> material_lib.append(string_at(materials[i].name_offset, materials[i].name_size), unpackMaterial(materials[i].mat, string_at));
+    if (this -> indexed) {
+        const char *indices = cache.data() + header.ibo_offset;
+        this -> index_size = header.index_size;
+        if (header.index_size == sizeof(uint16_t)) {
+            const uint16_t *begin = reinterpret_cast<const uint16_t *>(indices);
+            this -> ibo16.assign(begin, begin + header.index_count);
+        } else {
+            const uint32_t *begin = reinterpret_cast<const uint32_t *>(indices);
+            this -> ibo32.assign(begin, begin + header.index_count);
+        }
+    }
+    this -> has_normal = (header.flags & MESH_CACHE_FLAG_NORMAL) != 0;
+    this -> has_texcoord = (header.flags & MESH_CACHE_FLAG_TEXCOORD) != 0;
+    this -> vbo = reinterpret_cast<float *>(cache.mutableData() + header.vbo_offset);
+    this -> vbo_size = header.vbo_size;
+    this -> from_cache = true;
+    return true;
+}
+
+bool objLoader::writeCache(const std::string& cache_path, const mesh_cache_source& source) {
+    std::string strings;
+    std::vector<mesh_cache_group> groups(this -> group_index.size());
+    for (size_t i = 0; i < this -> group_index.size(); i++) {
+        const std::string &name = std::get<1>(this -> group_index[i]);
+        groups[i].start = std::get<0>(this -> group_index[i]);
+        groups[i].vertex_offset = this -> group_vertex_offset[i];
+        groups[i].name_offset = strings.size();
+        groups[i].name_size = name.size();
+        strings += name;
+        packMaterial(std::get<2>(this -> group_index[i]), groups[i].mat, strings);
+    }
+    std::vector<mesh_cache_named_material> materials;
+    for (auto &entry : this -> material_lib.materials) {
+        mesh_cache_named_material named;
+        named.name_offset = strings.size();
+        named.name_size = entry.first.size();
+        strings += entry.first;
+        packMaterial(entry.second, named.mat, strings);
+        materials.push_back(named);
+    }
+    std::vector<mesh_cache_library> libraries;
+    for (const std::string &library : this -> material_lib_paths) {
+        // absolute, so the check does not depend on the working directory of the reader
+        char resolved[PATH_MAX];
+        std::string path = realpath(library.c_str(), resolved) ? std::string(resolved) : library;
+        mesh_cache_library entry;
+        entry.path_offset = strings.size();
+        entry.path_size = path.size();
+        entry.source = readMeshSource(path);
+        strings += path;
+        libraries.push_back(entry);
+    }
+    mesh_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, mesh_cache_magic, sizeof(mesh_cache_magic));
+    header.endian_tag = MESH_CACHE_ENDIAN_TAG;
+    header.version = MESH_CACHE_VERSION;
+    header.source = source;
+    header.options = this -> cacheOptions();
+    header.flags = (this -> has_normal ? MESH_CACHE_FLAG_NORMAL : 0) | (this -> has_texcoord ? MESH_CACHE_FLAG_TEXCOORD : 0);
+    header.vbo_offset = alignCache(sizeof(header));
+    header.vbo_size = this -> vbo_size;
+    header.ibo_offset = alignCache(header.vbo_offset + header.vbo_size);
+    header.index_count = this -> getIndexCount();
+    header.index_size = this -> index_size;
+    header.group_offset = alignCache(header.ibo_offset + header.index_count * header.index_size);
+    header.group_count = groups.size();
+    header.material_offset = alignCache(header.group_offset + groups.size() * sizeof(mesh_cache_group));
+    header.material_count = materials.size();
+    header.string_offset = alignCache(header.material_offset + materials.size() * sizeof(mesh_cache_named_material));
+    header.string_size = strings.size();
+    header.library_offset = alignCache(header.string_offset + strings.size());
+    header.library_count = libraries.size();
+    // write to a private name first so readers never see a half written cache
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d.%p", (int)getpid(), (void *)this);
+    std::string tmp_path = cache_path + suffix;
+    std::ofstream out(tmp_path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Cannot open file: " << tmp_path << std::endl;
+        return false;
+    }
+    uint64_t written = 0;
+    auto write_at = [&](uint64_t offset, const void *data, uint64_t size) {
+        static const char padding[16] = {0};
+        out.write(padding, offset - written);
+        out.write(static_cast<const char *>(data), size);
+        written = offset + size;
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(header.vbo_offset, this -> vbo, header.vbo_size);
+    write_at(header.ibo_offset, this -> getIBO(), header.index_count * header.index_size);
+    write_at(header.group_offset, groups.data(), groups.size() * sizeof(mesh_cache_group));
+    write_at(header.material_offset, materials.data(), materials.size() * sizeof(mesh_cache_named_material));
+    write_at(header.string_offset, strings.data(), strings.size());
+    write_at(header.library_offset, libraries.data(), libraries.size() * sizeof(mesh_cache_library));
+    out.close();
+    if (!out || rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+        std::cerr << "Cannot write mesh cache: " << cache_path << std::endl;
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,157 @@
+#include "mesh_cluster.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+static glm::vec3 positionAt(const float *vertices, size_t stride, size_t i) {
+    const float *p = vertices + i * stride;
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+// the sphere around the box center reaching the farthest vertex
+static void finishBounds(mesh_bounds &bounds, float radius2) {
+    bounds.sphere = glm::vec4((bounds.min + bounds.max) * 0.5f, std::sqrt(radius2));
+}
+
+mesh_bounds computeVertexBounds(const float *vertices, size_t count, size_t stride) {
+    mesh_bounds bounds;
+    bounds.min = glm::vec3(INFINITY);
+    bounds.max = glm::vec3(-INFINITY);
+    if (count == 0) {
+        bounds.min = bounds.max = glm::vec3(0.0f);
+        bounds.sphere = glm::vec4(0.0f);
+        return bounds;
+    }
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 p = positionAt(vertices, stride, i);
+        bounds.min = glm::min(bounds.min, p);
+        bounds.max = glm::max(bounds.max, p);
+    }
+    glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 d = positionAt(vertices, stride, i) - center;
+        radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    finishBounds(bounds, radius2);
+    return bounds;
+}
+
+mesh_bounds computeTriangleBounds(const uint32_t *indices, size_t index_count, const float *vertices, size_t stride) {
+    mesh_bounds bounds;
+    bounds.min = glm::vec3(INFINITY);
+    bounds.max = glm::vec3(-INFINITY);
+    if (index_count == 0) {
+        bounds.min = bounds.max = glm::vec3(0.0f);
+        bounds.sphere = glm::vec4(0.0f);
+        return bounds;
+    }
+    for (size_t i = 0; i < index_count; i++) {
+        glm::vec3 p = positionAt(vertices, stride, indices[i]);
+        bounds.min = glm::min(bounds.min, p);
+        bounds.max = glm::max(bounds.max, p);
+    }
+    glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < index_count; i++) {
+        glm::vec3 d = positionAt(vertices, stride, indices[i]) - center;
+        radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    finishBounds(bounds, radius2);
+    return bounds;
+}
+
+normal_cone computeNormalCone(const uint32_t *indices, size_t index_count, const float *vertices, size_t stride) {
+    std::vector<glm::vec3> normals;
+    normals.reserve(index_count / 3);
+    glm::vec3 sum(0.0f);
+    for (size_t i = 0; i + 2 < index_count; i += 3) {
+        glm::vec3 a = positionAt(vertices, stride, indices[i]);
+        glm::vec3 n = glm::cross(positionAt(vertices, stride, indices[i + 1]) - a, positionAt(vertices, stride, indices[i + 2]) - a);
+        float length = glm::length(n);
+        if (!(length > 0.0f)) continue;
+        normals.push_back(n / length);
+        sum += normals.back();
+    }
+    normal_cone cone = {glm::vec3(0.0f, 0.0f, 1.0f), 1.0f};
+    float sum_length = glm::length(sum);
+    if (normals.empty() || !(sum_length > 0.0f)) return cone;
+    cone.axis = sum / sum_length;
+    float min_dot = 1.0f;
+    for (const glm::vec3 &n : normals) min_dot = std::min(min_dot, glm::dot(n, cone.axis));
+    // the cone opens by acos(min_dot) around the axis, wider than a half sphere never culls
+    if (min_dot > 0.0f) cone.cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    return cone;
+}
+
+// spread the low 10 bits of v so two zero bits follow each
+mesh_bounds transformBounds(const mesh_bounds &bounds, const glm::mat4 &transform) {
+    // the box of the 8 transformed corners, per axis the extremes of each column times min or max
+    mesh_bounds result;
+    result.min = result.max = glm::vec3(transform[3]);
+    for (int column = 0; column < 3; column++) {
+        glm::vec3 a = glm::vec3(transform[column]) * bounds.min[column], b = glm::vec3(transform[column]) * bounds.max[column];
+        result.min += glm::min(a, b);
+        result.max += glm::max(a, b);
+    }
+    float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    result.sphere = glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(bounds.sphere), 1.0f)), bounds.sphere.w * scale);
+    return result;
+}
+
+normal_cone transformCone(const normal_cone &cone, const glm::mat4 &transform, const glm::mat3 &normal_matrix) {
+    normal_cone result = cone;
+    glm::vec3 axis = normal_matrix * cone.axis;
+    float x = glm::length(glm::vec3(transform[0])), y = glm::length(glm::vec3(transform[1])), z = glm::length(glm::vec3(transform[2]));
+    float largest = std::max(x, std::max(y, z));
+    // uniform scale and a rotation, or the angles between normals change
+    bool conformal = largest > 0.0f && std::fabs(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[1]))) <= 1e-4f * largest * largest &&
+        std::fabs(glm::dot(glm::vec3(transform[1]), glm::vec3(transform[2]))) <= 1e-4f * largest * largest &&
+        std::fabs(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[2]))) <= 1e-4f * largest * largest &&
+        std::min(x, std::min(y, z)) >= largest * (1.0f - 1e-4f) && glm::length(axis) > 0.0f;
+    if (!conformal) {
+        result.cutoff = 1.0f;
+        return result;
+    }
+    result.axis = glm::normalize(axis);
+    return result;
+}
+
+static uint32_t spreadBits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+void sortClusters(uint32_t *indices, size_t index_count, const float *vertices, size_t stride, size_t max_triangles) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count <= max_triangles || max_triangles == 0) return;
+    mesh_bounds bounds = computeTriangleBounds(indices, triangle_count * 3, vertices, stride);
+    glm::vec3 extent = bounds.max - bounds.min;
+    glm::vec3 scale;
+    for (int k = 0; k < 3; k++) scale[k] = extent[k] > 0.0f ? 1023.0f / extent[k] : 0.0f;
+    // morton code of the centroid in the high half, the triangle in the low one
+    std::vector<uint64_t> keys(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++) {
+        glm::vec3 centroid = (positionAt(vertices, stride, indices[t * 3]) + positionAt(vertices, stride, indices[t * 3 + 1]) +
+            positionAt(vertices, stride, indices[t * 3 + 2])) * (1.0f / 3.0f);
+        glm::vec3 q = glm::clamp((centroid - bounds.min) * scale, 0.0f, 1023.0f);
+        uint32_t code = spreadBits((uint32_t)q.x) | (spreadBits((uint32_t)q.y) << 1) | (spreadBits((uint32_t)q.z) << 2);
+        keys[t] = ((uint64_t)code << 32) | t;
+    }
+    std::sort(keys.begin(), keys.end());
+    // back to the previous order inside each run
+    for (size_t first = 0; first < triangle_count; first += max_triangles) {
+        size_t last = std::min(triangle_count, first + max_triangles);
+        for (size_t t = first; t < last; t++) keys[t] &= 0xffffffffu;
+        std::sort(keys.begin() + first, keys.begin() + last);
+    }
+    std::vector<uint32_t> sorted(triangle_count * 3);
+    for (size_t t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) sorted[t * 3 + k] = indices[keys[t] * 3 + k];
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
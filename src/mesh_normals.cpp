@@ -0,0 +1,122 @@
+#include "mesh_normals.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+// triangles or vertices per task
+static const size_t block_size = 4096;
+
+static void runBlocks(thread_pool *pool, size_t count, const std::function<void(size_t, size_t)> &body) {
+    size_t blocks = (count + block_size - 1) / block_size;
+    auto run = [&](size_t b) { body(b * block_size, std::min(count, (b + 1) * block_size)); };
+    if (pool && blocks > 1) pool -> parallel_for(blocks, run);
+    else for (size_t b = 0; b < blocks; b++) run(b);
+}
+
+// corners around every key in compressed rows: the corners of key k are items[first[k]] .. items[first[k+1] - 1],
+// in ascending order
+static void buildAdjacency(const uint32_t *keys, size_t corner_count, size_t key_count, std::vector<uint32_t> &first, std::vector<uint32_t> &items) {
+    first.assign(key_count + 1, 0);
+    for (size_t c = 0; c < corner_count; c++) first[keys ? keys[c] : c]++;
+    uint32_t sum = 0;
+    for (size_t k = 0; k <= key_count; k++) {
+        uint32_t count = first[k];
+        first[k] = sum;
+        sum += count;
+    }
+    items.resize(corner_count);
+    std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+    for (size_t c = 0; c < corner_count; c++) items[fill[keys ? keys[c] : c]++] = (uint32_t)c;
+}
+
+void generateSmoothNormals(const glm::vec3 *positions, size_t position_count, const uint32_t *corners, size_t corner_count,
+    const unsigned char *needed, float crease_angle, glm::vec3 *normals, thread_pool *pool) {
+    size_t triangle_count = corner_count / 3;
+    corner_count = triangle_count * 3;
+    // unit face normals for the crease test, and every corner's contribution: the face normal
+    // scaled by twice the area and by the angle at the corner
+    std::vector<glm::vec3> face_normals(triangle_count);
+    std::vector<glm::vec3> weighted(corner_count);
+    runBlocks(pool, triangle_count, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            glm::vec3 p[3] = {positions[corners[t * 3]], positions[corners[t * 3 + 1]], positions[corners[t * 3 + 2]]};
+            glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+            float length = glm::length(n);
+            face_normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+            for (int j = 0; j < 3; j++) {
+                glm::vec3 e1 = p[(j + 1) % 3] - p[j], e2 = p[(j + 2) % 3] - p[j];
+                float lengths = glm::length(e1) * glm::length(e2);
+                float angle = lengths > 0.0f ? std::acos(std::max(-1.0f, std::min(1.0f, glm::dot(e1, e2) / lengths))) : 0.0f;
+                weighted[t * 3 + j] = n * angle;
+            }
+        }
+    });
+    std::vector<uint32_t> first, around;
+    buildAdjacency(corners, corner_count, position_count, first, around);
+    float crease_cos = std::cos(crease_angle);
+    // every corner sums the same faces in the same order as the other corners of its smoothing
+    // group, so their normals come out bitwise equal and indexing merges them again
+    runBlocks(pool, triangle_count, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            if (needed && !needed[t]) continue;
+            for (int j = 0; j < 3; j++) {
+                uint32_t position = corners[t * 3 + j];
+                glm::vec3 sum(0.0f);
+                for (uint32_t k = first[position]; k < first[position + 1]; k++) {
+                    uint32_t other = around[k];
+                    if (glm::dot(face_normals[t], face_normals[other / 3]) >= crease_cos) sum += weighted[other];
+                }
+                float length = glm::length(sum);
+                normals[t * 3 + j] = length > 0.0f ? sum / length : face_normals[t];
+            }
+        }
+    });
+}
+
+void generateTangents(const float *vertices, size_t stride, size_t vertex_count, const uint32_t *indices, size_t index_count,
+    glm::vec4 *tangents, thread_pool *pool) {
+    size_t corner_count = indices ? index_count / 3 * 3 : vertex_count / 3 * 3;
+    size_t triangle_count = corner_count / 3;
+    auto vertexAt = [&](size_t corner) { return indices ? indices[corner] : (uint32_t)corner; };
+    // directions of increasing u and v over every triangle
+    std::vector<glm::vec3> u_directions(triangle_count), v_directions(triangle_count);
+    runBlocks(pool, triangle_count, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            const float *a = vertices + vertexAt(t * 3) * stride, *b = vertices + vertexAt(t * 3 + 1) * stride, *c = vertices + vertexAt(t * 3 + 2) * stride;
+            glm::vec3 e1(b[0] - a[0], b[1] - a[1], b[2] - a[2]), e2(c[0] - a[0], c[1] - a[1], c[2] - a[2]);
+            float s1 = b[6] - a[6], t1 = b[7] - a[7], s2 = c[6] - a[6], t2 = c[7] - a[7];
+            float det = s1 * t2 - s2 * t1;
+            if (det == 0.0f || !std::isfinite(det)) {
+                u_directions[t] = v_directions[t] = glm::vec3(0.0f);
+                continue;
+            }
+            float r = 1.0f / det;
+            u_directions[t] = (e1 * t2 - e2 * t1) * r;
+            v_directions[t] = (e2 * s1 - e1 * s2) * r;
+        }
+    });
+    std::vector<uint32_t> first, around;
+    buildAdjacency(indices, corner_count, vertex_count, first, around);
+    runBlocks(pool, vertex_count, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            glm::vec3 u_sum(0.0f), v_sum(0.0f);
+            for (uint32_t k = first[v]; k < first[v + 1]; k++) {
+                u_sum += u_directions[around[k] / 3];
+                v_sum += v_directions[around[k] / 3];
+            }
+            const float *vertex = vertices + v * stride;
+            glm::vec3 normal(vertex[3], vertex[4], vertex[5]);
+            // Gram-Schmidt against the normal, any perpendicular when the uv give no direction
+            glm::vec3 tangent = u_sum - normal * glm::dot(normal, u_sum);
+            float length = glm::length(tangent);
+            if (!(length > 1e-20f)) {
+                tangent = glm::cross(normal, std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+                length = glm::length(tangent);
+            }
+            if (length > 0.0f) tangent = tangent / length;
+            float sign = glm::dot(glm::cross(normal, tangent), v_sum) < 0.0f ? -1.0f : 1.0f;
+            tangents[v] = glm::vec4(tangent, sign);
+        }
+    });
+}
@@ -0,0 +1,218 @@
+#include "mesh_optimizer.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+vertex_cache_stats analyzeVertexCache(const uint32_t *indices, size_t index_count, size_t vertex_count, unsigned cache_size) {
+    vertex_cache_stats stats;
+    stats.triangles = index_count / 3;
+    stats.vertices = 0;
+    stats.transformed = 0;
+    // a vertex is cached while fewer than cache_size misses happened since it was loaded
+    std::vector<size_t> loaded_at(vertex_count, 0);
+    std::vector<bool> used(vertex_count, false);
+    size_t time = cache_size + 1;
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (!used[v]) {
+            used[v] = true;
+            stats.vertices++;
+        }
+        if (time - loaded_at[v] > cache_size) {
+            loaded_at[v] = time++;
+            stats.transformed++;
+        }
+    }
+    stats.acmr = stats.triangles ? (double)stats.transformed / stats.triangles : 0.0;
+    stats.atvr = stats.vertices ? (double)stats.transformed / stats.vertices : 0.0;
+    return stats;
+}
+
+vertex_cache_stats sumVertexCacheStats(const vertex_cache_stats *stats, size_t count) {
+    vertex_cache_stats total;
+    total.triangles = 0;
+    total.vertices = 0;
+    total.transformed = 0;
+    for (size_t i = 0; i < count; i++) {
+        total.triangles += stats[i].triangles;
+        total.vertices += stats[i].vertices;
+        total.transformed += stats[i].transformed;
+    }
+    total.acmr = total.triangles ? (double)total.transformed / total.triangles : 0.0;
+    total.atvr = total.vertices ? (double)total.transformed / total.vertices : 0.0;
+    return total;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t index_count, size_t vertex_count, unsigned cache_size) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) return;
+    // vertex -> triangles adjacency
+    std::vector<uint32_t> live(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; i++) live[indices[i]]++;
+    std::vector<size_t> adjacency_offset(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++) adjacency_offset[v+1] = adjacency_offset[v] + live[v];
+    std::vector<uint32_t> adjacency(adjacency_offset[vertex_count]);
+    std::vector<size_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++)
+        for (int k = 0; k < 3; k++) adjacency[fill[indices[t*3+k]]++] = t;
+
+    std::vector<size_t> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+    size_t time = cache_size + 1;
+    size_t cursor = 0;
+    auto skip_dead_end = [&]() -> long long {
+        while (!dead_end.empty()) {
+            uint32_t v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0) return v;
+        }
+        while (cursor < vertex_count) {
+            if (live[cursor] > 0) return cursor;
+            cursor++;
+        }
+        return -1;
+    };
+    long long fanning = skip_dead_end();
+    while (fanning >= 0) {
+        candidates.clear();
+        for (size_t a = adjacency_offset[fanning]; a < adjacency_offset[fanning+1]; a++) {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[t*3+k];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+            }
+        }
+        // prefer the candidate that stays in the cache longest and still has work left
+        long long best = -1;
+        long long best_priority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            long long priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+        fanning = (best >= 0) ? best : skip_dead_end();
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t index_count, const float *vertices, size_t stride, size_t vertex_count, unsigned cache_size, float threshold) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count < 2) return;
+    std::vector<size_t> cache_time(vertex_count, 0);
+    size_t time = cache_size + 1;
+    // moving the clock by more than the cache size empties the cache
+    auto count_misses = [&](size_t t) {
+        size_t misses = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[t*3+k];
+            if (time - cache_time[v] > cache_size) {
+                cache_time[v] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    };
+    // hard boundaries: triangles that miss the cache with all three vertices
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triangle_count; t++)
+        if (count_misses(t) == 3 || t == 0) hard.push_back(t);
+    hard.push_back(triangle_count);
+    // soft boundaries: split a hard cluster wherever its running miss ratio is already good enough
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t start = hard[h], end = hard[h+1];
+        time += cache_size + 1;
+        size_t misses = 0;
+        for (size_t t = start; t < end; t++) misses += count_misses(t);
+        double limit = (double)misses / (end - start) * threshold;
+        time += cache_size + 1;
+        misses = 0;
+        size_t cluster_start = start;
+        clusters.push_back(start);
+        for (size_t t = start; t < end; t++) {
+            misses += count_misses(t);
+            size_t done = t + 1 - cluster_start;
+            if (t + 1 < end && done >= 8 && (double)misses / done <= limit) {
+                clusters.push_back(t + 1);
+                cluster_start = t + 1;
+                misses = 0;
+                // the next cluster may be drawn after anything, assume a cold cache
+                time += cache_size + 1;
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+    // sort clusters by how much they face away from the mesh centre
+    size_t cluster_count = clusters.size() - 1;
+    std::vector<float> cluster_centroid(cluster_count * 3, 0.0f), cluster_normal(cluster_count * 3, 0.0f), cluster_area(cluster_count, 0.0f);
+    double mesh_centroid[3] = {0.0, 0.0, 0.0};
+    double mesh_area = 0.0;
+    for (size_t c = 0; c < cluster_count; c++) {
+        for (size_t t = clusters[c]; t < clusters[c+1]; t++) {
+            const float *p0 = vertices + (size_t)indices[t*3] * stride;
+            const float *p1 = vertices + (size_t)indices[t*3+1] * stride;
+            const float *p2 = vertices + (size_t)indices[t*3+2] * stride;
+            float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                float centre = (p0[k] + p1[k] + p2[k]) / 3.0f;
+                cluster_centroid[c*3+k] += centre * area;
+                cluster_normal[c*3+k] += n[k];
+                mesh_centroid[k] += centre * area;
+            }
+            cluster_area[c] += area;
+            mesh_area += area;
+        }
+    }
+    if (mesh_area > 0.0) for (int k = 0; k < 3; k++) mesh_centroid[k] /= mesh_area;
+    std::vector<float> sort_key(cluster_count, 0.0f);
+    for (size_t c = 0; c < cluster_count; c++) {
+        float inv_area = cluster_area[c] > 0.0f ? 1.0f / cluster_area[c] : 0.0f;
+        float length = std::sqrt(cluster_normal[c*3] * cluster_normal[c*3] + cluster_normal[c*3+1] * cluster_normal[c*3+1] + cluster_normal[c*3+2] * cluster_normal[c*3+2]);
+        float inv_length = length > 0.0f ? 1.0f / length : 0.0f;
+        for (int k = 0; k < 3; k++)
+            sort_key[c] += (cluster_centroid[c*3+k] * inv_area - (float)mesh_centroid[k]) * cluster_normal[c*3+k] * inv_length;
+    }
+    std::vector<size_t> order(cluster_count);
+    for (size_t c = 0; c < cluster_count; c++) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&sort_key](size_t a, size_t b) { return sort_key[a] > sort_key[b]; });
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+    for (size_t c : order)
+        output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c+1] * 3);
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeVertexFetch(uint32_t *indices, size_t index_count, float *vertices, size_t stride, size_t vertex_count) {
+    const uint32_t unused = UINT32_MAX;
+    std::vector<uint32_t> remap(vertex_count, unused);
+    uint32_t next = 0;
+    for (size_t i = 0; i < index_count; i++) {
+        if (remap[indices[i]] == unused) remap[indices[i]] = next++;
+        indices[i] = remap[indices[i]];
+    }
+    // unreferenced vertices keep their relative order at the end
+    for (size_t v = 0; v < vertex_count; v++)
+        if (remap[v] == unused) remap[v] = next++;
+    std::vector<float> reordered(vertex_count * stride);
+    for (size_t v = 0; v < vertex_count; v++)
+        memcpy(&reordered[(size_t)remap[v] * stride], vertices + v * stride, stride * sizeof(float));
+    std::copy(reordered.begin(), reordered.end(), vertices);
+}
@@ -0,0 +1,352 @@
+#include "mesh_simplifier.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// sum of squared distances to a set of weighted planes: p'Ap + 2b'p + c
+struct quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+// vertex classes, collapses of a vertex are restricted by its class
+enum vertex_kind {
+    KIND_INTERIOR,
+    KIND_BORDER,
+    KIND_SEAM,
+    KIND_LOCKED,
+};
+
+static void addPlane(quadric &q, const double n[3], double d, double weight) {
+    q.a00 += weight * n[0] * n[0];
+    q.a01 += weight * n[0] * n[1];
+    q.a02 += weight * n[0] * n[2];
+    q.a11 += weight * n[1] * n[1];
+    q.a12 += weight * n[1] * n[2];
+    q.a22 += weight * n[2] * n[2];
+    q.b0 += weight * n[0] * d;
+    q.b1 += weight * n[1] * d;
+    q.b2 += weight * n[2] * d;
+    q.c += weight * d * d;
+    q.weight += weight;
+}
+
+static void addQuadric(quadric &q, const quadric &other) {
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a22 += other.a22;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// weighted mean squared distance of p to the planes
+static double quadricError(const quadric &q, const float *p) {
+    double x = p[0], y = p[1], z = p[2];
+    double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+        2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return q.weight > 0.0 ? std::fabs(error) / q.weight : 0.0;
+}
+
+static void triangleNormal(const float *p0, const float *p1, const float *p2, double n[3]) {
+    double e1[3] = {(double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2]};
+    double e2[3] = {(double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2]};
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// wedges whose normals are further apart than this (60 degrees) are on a crease
+static const double crease_cos = 0.5;
+
+static uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+struct collapse {
+    uint32_t from;
+    uint32_t to;
+    float error;
+};
+
+size_t simplifyMesh(uint32_t *destination, const uint32_t *indices, size_t index_count, const float *vertices, size_t stride, size_t vertex_count,
+    size_t target_index_count, const unsigned char *locked, float *result_error) {
+    std::vector<uint32_t> result(indices, indices + index_count);
+    float max_error = 0.0f;
+    auto position = [&](uint32_t v) { return vertices + (size_t)v * stride; };
+
+    // vertices with equal positions are wedges of one position, named by the smallest of them,
+    // the wedges of a position form a ring through next_wedge
+    std::vector<unsigned char> used(vertex_count, 0);
+    for (size_t i = 0; i < index_count; i++) used[indices[i]] = 1;
+    std::vector<uint32_t> sorted;
+    for (size_t v = 0; v < vertex_count; v++)
+        if (used[v]) sorted.push_back(v);
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+        int order = memcmp(position(a), position(b), 3 * sizeof(float));
+        return order != 0 ? order < 0 : a < b;
+    });
+    std::vector<uint32_t> position_id(vertex_count), next_wedge(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) position_id[v] = next_wedge[v] = v;
+    for (size_t i = 0; i < sorted.size();) {
+        size_t j = i + 1;
+        while (j < sorted.size() && memcmp(position(sorted[i]), position(sorted[j]), 3 * sizeof(float)) == 0) j++;
+        for (size_t k = i; k < j; k++) {
+            position_id[sorted[k]] = sorted[i];
+            next_wedge[sorted[k]] = sorted[k + 1 < j ? k + 1 : i];
+        }
+        i = j;
+    }
+
+    // triangles already degenerate in position space have nothing to collapse
+    size_t kept = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+        uint32_t a = position_id[result[i]], b = position_id[result[i + 1]], c = position_id[result[i + 2]];
+        if (a == b || b == c || a == c) continue;
+        for (int k = 0; k < 3; k++) result[kept++] = result[i + k];
+    }
+    result.resize(kept);
+
+    // edges between positions with the corner they start at, used by one triangle on an
+    // open border and by more where non-manifold
+    std::vector<std::pair<uint64_t, uint32_t>> edges;
+    auto collectEdges = [&]() {
+        edges.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++) edges.push_back(std::make_pair(edgeKey(position_id[result[i + k]], position_id[result[i + (k + 1) % 3]]), i + k));
+        }
+        std::sort(edges.begin(), edges.end());
+    };
+    auto edgeUses = [&](uint32_t a, uint32_t b) {
+        uint64_t key = edgeKey(a, b);
+        auto first = std::lower_bound(edges.begin(), edges.end(), std::make_pair(key, (uint32_t)0));
+        auto last = std::lower_bound(first, edges.end(), std::make_pair(key + 1, (uint32_t)0));
+        return (size_t)(last - first);
+    };
+    collectEdges();
+
+    // wedges of a position meeting across an edge with the same texcoord and a normal within the
+    // crease angle form one attribute region, so flat shaded faces of a smooth surface are not seams
+    std::vector<uint32_t> region(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) region[v] = v;
+    auto findRegion = [&](uint32_t v) {
+        while (region[v] != v) v = region[v] = region[region[v]];
+        return v;
+    };
+    auto compatible = [&](uint32_t a, uint32_t b) {
+        if (stride < 8) return true;
+        const float *va = position(a), *vb = position(b);
+        if (va[6] != vb[6] || va[7] != vb[7]) return false;
+        double dot = (double)va[3] * vb[3] + (double)va[4] * vb[4] + (double)va[5] * vb[5];
+        double length_a = (double)va[3] * va[3] + (double)va[4] * va[4] + (double)va[5] * va[5];
+        double length_b = (double)vb[3] * vb[3] + (double)vb[4] * vb[4] + (double)vb[5] * vb[5];
+        if (length_a == 0.0 || length_b == 0.0) return length_a == length_b;
+        return dot >= crease_cos * std::sqrt(length_a * length_b);
+    };
+    auto cornerEnd = [&](uint32_t corner) { return corner - corner % 3 + (corner % 3 + 1) % 3; };
+    for (size_t i = 0; i + 1 < edges.size(); i++) {
+        bool pair = edges[i].first == edges[i + 1].first && (i == 0 || edges[i - 1].first != edges[i].first) &&
+            (i + 2 >= edges.size() || edges[i + 2].first != edges[i].first);
+        if (!pair) continue;
+        uint32_t a0 = result[edges[i].second], a1 = result[cornerEnd(edges[i].second)];
+        uint32_t b0 = result[edges[i + 1].second], b1 = result[cornerEnd(edges[i + 1].second)];
+        if (position_id[a0] != position_id[b0]) std::swap(b0, b1);
+        if (compatible(a0, b0)) region[findRegion(a0)] = findRegion(b0);
+        if (compatible(a1, b1)) region[findRegion(a1)] = findRegion(b1);
+    }
+
+    // one region is free to move, two are a seam that only moves along itself, more stay
+    std::vector<unsigned char> kind(vertex_count, KIND_INTERIOR);
+    for (uint32_t v : sorted) {
+        if (position_id[v] != v) continue;
+        uint32_t regions[3];
+        size_t region_count = 0;
+        uint32_t w = v;
+        do {
+            uint32_t r = findRegion(w);
+            if (std::find(regions, regions + region_count, r) == regions + region_count) {
+                if (region_count < 3) regions[region_count] = r;
+                region_count++;
+            }
+            if (locked && locked[w]) region_count = 3;
+            w = next_wedge[w];
+        } while (w != v && region_count < 3);
+        if (region_count == 2) kind[v] = KIND_SEAM;
+        if (region_count > 2) kind[v] = KIND_LOCKED;
+    }
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j].first == edges[i].first) j++;
+        uint32_t a = edges[i].first >> 32, b = (uint32_t)edges[i].first;
+        for (uint32_t p : {a, b}) {
+            if (j - i > 2 || (j - i == 1 && kind[p] == KIND_SEAM)) kind[p] = KIND_LOCKED;
+            else if (j - i == 1 && kind[p] == KIND_INTERIOR) kind[p] = KIND_BORDER;
+        }
+        i = j;
+    }
+
+    // plane quadrics of the triangles weighted by area, borders also keep a plane through
+    // the edge at a right angle to the triangle so they do not shrink
+    std::vector<quadric> quadrics(vertex_count, quadric());
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const float *p[3] = {position(result[i]), position(result[i + 1]), position(result[i + 2])};
+        double n[3];
+        triangleNormal(p[0], p[1], p[2], n);
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0) continue;
+        for (int k = 0; k < 3; k++) n[k] /= length;
+        double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+        for (int k = 0; k < 3; k++) addPlane(quadrics[position_id[result[i + k]]], n, d, length * 0.5);
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = position_id[result[i + k]], b = position_id[result[i + (k + 1) % 3]];
+            if (edgeUses(a, b) != 1) continue;
+            const float *pa = p[k], *pb = p[(k + 1) % 3];
+            double e[3] = {(double)pb[0] - pa[0], (double)pb[1] - pa[1], (double)pb[2] - pa[2]};
+            double edge_length = std::sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+            double m[3] = {e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0]};
+            double m_length = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+            if (m_length == 0.0) continue;
+            for (int c = 0; c < 3; c++) m[c] /= m_length;
+            double md = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+            addPlane(quadrics[a], m, md, edge_length * edge_length);
+            addPlane(quadrics[b], m, md, edge_length * edge_length);
+        }
+    }
+
+    std::vector<uint32_t> adjacency_offset, adjacency, remap(vertex_count);
+    std::vector<unsigned char> touched(vertex_count), live(vertex_count);
+    std::vector<collapse> candidates;
+    for (size_t v = 0; v < vertex_count; v++) remap[v] = v;
+    // each pass collapses independent edges, cheapest first, then rebuilds the triangle list
+    while (result.size() > target_index_count) {
+        size_t triangle_count = result.size() / 3;
+        // position -> triangles
+        adjacency_offset.assign(vertex_count + 1, 0);
+        for (uint32_t v : result) adjacency_offset[position_id[v] + 1]++;
+        for (size_t p = 0; p < vertex_count; p++) adjacency_offset[p + 1] += adjacency_offset[p];
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) adjacency[fill[position_id[result[i]]]++] = i / 3;
+        std::fill(live.begin(), live.end(), 0);
+        for (uint32_t v : result) live[v] = 1;
+
+        candidates.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = position_id[result[i + k]], b = position_id[result[i + (k + 1) % 3]];
+                for (int direction = 0; direction < 2; direction++) {
+                    uint32_t from = direction ? b : a, to = direction ? a : b;
+                    if (kind[from] == KIND_LOCKED) continue;
+                    candidates.push_back(collapse{from, to, (float)quadricError(quadrics[from], position(to))});
+                }
+            }
+        }
+        // the other triangle of an edge adds the same candidates, they sort next to each other
+        std::sort(candidates.begin(), candidates.end(), [](const collapse &x, const collapse &y) {
+            return x.error != y.error ? x.error < y.error : (x.from != y.from ? x.from < y.from : x.to < y.to);
+        });
+        candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const collapse &x, const collapse &y) {
+            return x.from == y.from && x.to == y.to;
+        }), candidates.end());
+
+        // a collapse removes about two triangles, costlier ones are left to later passes
+        size_t goal = (triangle_count - target_index_count / 3) / 2 + 1;
+        float error_goal = goal < candidates.size() ? candidates[goal].error * 1.5f : INFINITY;
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t collapsed = 0;
+        for (const collapse &c : candidates) {
+            if (collapsed >= goal || (c.error > error_goal && collapsed > 0)) break;
+            if (touched[c.from] || touched[c.to]) continue;
+            // borders only move along themselves
+            if (kind[c.from] == KIND_BORDER && edgeUses(c.from, c.to) != 1) continue;
+            // each region of from moves onto a wedge of to it shares a triangle with, a seam
+            // vertex thereby only moves along an edge both of its regions touch
+            uint32_t regions[2] = {UINT32_MAX, UINT32_MAX}, targets[2] = {UINT32_MAX, UINT32_MAX};
+            for (uint32_t a = adjacency_offset[c.from]; a < adjacency_offset[c.from + 1]; a++) {
+                const uint32_t *triangle = &result[(size_t)adjacency[a] * 3];
+                uint32_t w = UINT32_MAX, x = UINT32_MAX;
+                for (int k = 0; k < 3; k++) {
+                    if (position_id[triangle[k]] == c.from) w = triangle[k];
+                    if (position_id[triangle[k]] == c.to) x = triangle[k];
+                }
+                if (x == UINT32_MAX) continue;
+                uint32_t r = findRegion(w);
+                for (int slot = 0; slot < 2; slot++) {
+                    if (regions[slot] == r) break;
+                    if (regions[slot] != UINT32_MAX) continue;
+                    regions[slot] = r;
+                    targets[slot] = x;
+                    break;
+                }
+            }
+            bool valid = true;
+            uint32_t w = c.from;
+            do {
+                if (live[w]) {
+                    uint32_t r = findRegion(w);
+                    if (regions[0] == r) remap[w] = targets[0];
+                    else if (regions[1] == r) remap[w] = targets[1];
+                    else valid = false;
+                }
+                w = next_wedge[w];
+            } while (w != c.from && valid);
+            // triangles that stay must not flip when from moves onto to
+            for (uint32_t a = adjacency_offset[c.from]; a < adjacency_offset[c.from + 1] && valid; a++) {
+                const uint32_t *triangle = &result[(size_t)adjacency[a] * 3];
+                const float *p[3], *moved[3];
+                bool has_to = false;
+                for (int k = 0; k < 3; k++) {
+                    uint32_t p_id = position_id[triangle[k]];
+                    has_to = has_to || p_id == c.to;
+                    p[k] = position(triangle[k]);
+                    moved[k] = p_id == c.from ? position(c.to) : p[k];
+                }
+                if (has_to) continue;
+                double before[3], after[3];
+                triangleNormal(p[0], p[1], p[2], before);
+                triangleNormal(moved[0], moved[1], moved[2], after);
+                double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+                double after_length2 = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+                if (dot <= 0.0 || after_length2 == 0.0) valid = false;
+            }
+            if (!valid) {
+                w = c.from;
+                do {
+                    remap[w] = w;
+                    w = next_wedge[w];
+                } while (w != c.from);
+                continue;
+            }
+            addQuadric(quadrics[c.to], quadrics[c.from]);
+            touched[c.from] = touched[c.to] = 1;
+            max_error = std::max(max_error, c.error);
+            collapsed++;
+        }
+        if (collapsed == 0) break;
+
+        // drop the triangles that lost an edge, remapped wedges are not used anymore
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (position_id[a] == position_id[b] || position_id[b] == position_id[c] || position_id[a] == position_id[c]) continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+        for (size_t v = 0; v < vertex_count; v++) remap[v] = v;
+        collectEdges();
+    }
+
+    std::copy(result.begin(), result.end(), destination);
+    if (result_error) *result_error = std::sqrt(max_error);
+    return result.size();
+}
@@ -1,4 +1,65 @@
 #include "mtllib.h"
+#include "format_util.h"
+#include <filesystem>
+#include <climits>
+#include <cstdlib>
+
+// numbers following a texture map option, the word options (-clamp, -imfchan, ...) take one word instead
+static int mapOptionNumbers(const std::string& option) {
+    if (option == "-mm") return 2;
+    if (option == "-o" || option == "-s" || option == "-t") return 3;
+    if (option == "-bm" || option == "-boost" || option == "-texres") return 1;
+    return 0;
+}
+
+// the file name of a map statement after its options, resolved against the directory of the .mtl,
+// options other than -bm are skipped
+static std::string parseMap(std::istringstream& iss, const std::string& directory, float *bump_multiplier) {
+    std::string token;
+    while (iss >> token && token.size() > 1 && token[0] == '-') {
+        int numbers = mapOptionNumbers(token);
+        if (numbers == 0) {
+            iss >> token;
+            continue;
+        }
+        // trailing numbers are optional, the first word is the next option or the file name
+        for (int i = 0; i < numbers; i++) {
+            std::streampos before = iss.tellg();
+            std::string argument;
+            if (!(iss >> argument)) break;
+            char *end = NULL;
+            float value = strtof(argument.c_str(), &end);
+            if (end == argument.c_str() || *end != '\0') {
+                iss.clear();
+                iss.seekg(before);
+                break;
+            }
+            if (token == "-bm" && bump_multiplier) *bump_multiplier = value;
+        }
+    }
+    // the name may contain spaces and ends the line
+    std::string rest;
+    std::getline(iss, rest);
+    std::string name = token + rest;
+    while (!name.empty() && isspace((unsigned char)name.back())) name.pop_back();
+    if (name.empty() || name[0] == '-') return std::string();
+    for (char &c : name) if (c == '\\') c = '/';
+    std::string path = name[0] == '/' ? name : directory + name;
+    // absolute paths name the same image for every library and model, missing files keep the joined path
+    char resolved[PATH_MAX];
+    return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+}
+
+// path relative to the directory of filename, unchanged if there is no relative form
+static std::string relativeMapPath(const std::string& path, const std::string& filename) {
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(filename).parent_path();
+    std::filesystem::path directory = std::filesystem::absolute(parent.empty() ? "." : parent, error).lexically_normal();
+    std::filesystem::path absolute = std::filesystem::absolute(path, error).lexically_normal();
+    if (error) return path;
+    std::string relative = absolute.lexically_relative(directory).generic_string();
+    return relative.empty() ? path : relative;
+}
 
 bool mtl_file::load(const std::string& filename, bool append) {
     if (!append) this -> materials.clear();
@@ -12,6 +73,8 @@ bool mtl_file::load(const std::string& filename, bool append) {
     std::string matname;
     material mat;
     bool dirty = false;
+    size_t last_slash_pos = filename.find_last_of("/");
+    std::string directory = filename.substr(0, last_slash_pos + 1);
     while (std::getline(file, line)) {
         if (line.empty() || line[0] == '#') {
             if (dirty) {
@@ -46,6 +109,12 @@ bool mtl_file::load(const std::string& filename, bool append) {
             float ns;
             iss >> ns;
             mat.shininess = ns;
+        } else if (prefix == "map_Kd") {
+            mat.diffuse_map = parseMap(iss, directory, NULL);
+        } else if (prefix == "map_Ks") {
+            mat.specular_map = parseMap(iss, directory, NULL);
+        } else if (prefix == "map_Bump" || prefix == "map_bump" || prefix == "bump") {
+            mat.bump_map = parseMap(iss, directory, &mat.bump_multiplier);
         } else {
             // std::cerr << "Unsupported material property: " << prefix << std::endl;
         }
@@ -59,5 +128,43 @@ void mtl_file::append(const std::string& matname, const material &mat) {
 }
 
 bool mtl_file::save(const std::string& filename) {
-    return true;
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return false;
+    }
+    std::string out;
+    for (auto &entry : this -> materials) {
+        const material &mat = entry.second;
+        append_str(out, "newmtl ");
+        out += entry.first;
+        out.push_back('\n');
+        append_floats_line(out, "Ka", &mat.ambient.x, 3);
+        append_floats_line(out, "Kd", &mat.diffuse.x, 3);
+        append_floats_line(out, "Ks", &mat.specular.x, 3);
+        append_floats_line(out, "Ns", &mat.shininess, 1);
+        if (!mat.diffuse_map.empty()) {
+            append_str(out, "map_Kd ");
+            out += relativeMapPath(mat.diffuse_map, filename);
+            out.push_back('\n');
+        }
+        if (!mat.specular_map.empty()) {
+            append_str(out, "map_Ks ");
+            out += relativeMapPath(mat.specular_map, filename);
+            out.push_back('\n');
+        }
+        if (!mat.bump_map.empty()) {
+            append_str(out, "map_Bump ");
+            if (mat.bump_multiplier != 1.0f) {
+                append_str(out, "-bm ");
+                append_float(out, mat.bump_multiplier);
+                out.push_back(' ');
+            }
+            out += relativeMapPath(mat.bump_map, filename);
+            out.push_back('\n');
+        }
+        out.push_back('\n');
+    }
+    file.write(out.data(), out.size());
+    return (bool)file;
 }
\ No newline at end of file
@@ -0,0 +1,377 @@
+#include "obj_index.h"
+#include "mapped_file.h"
+#include "parse_util.h"
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+
+static const char obj_index_magic[8] = {'O', 'B', 'J', 'I', 'N', 'D', 'E', 'X'};
+
+// bytes between checkpoints, a record is found by parsing at most this much of the file
+static const uint64_t obj_index_checkpoint_step = 1 << 16;
+// slices smaller than this are not worth a thread
+static const size_t min_scan_size = 1 << 20;
+
+struct obj_index_header {
+    char magic[8];
+    uint32_t endian_tag;
+    uint32_t version;
+    mesh_cache_source source;
+    uint64_t vertices;
+    uint64_t texcoords;
+    uint64_t normals;
+    uint64_t faces;
+    uint64_t group_count;
+    uint64_t checkpoint_count;
+    uint64_t library_count;
+    uint64_t string_size;
+};
+
+// one obj_group_span, names in the string section
+struct obj_index_group {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t faces;
+    uint64_t vertices;
+    uint64_t texcoords;
+    uint64_t normals;
+    int64_t library;
+    uint64_t name_offset;
+    uint64_t name_size;
+    uint64_t material_offset;
+    uint64_t material_size;
+};
+
+struct obj_index_string {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// the first face line at or after some point of a slice, with the records before it in the slice
+struct face_mark {
+    uint64_t offset;
+    uint64_t counts[3];
+};
+
+// g, usemtl or mtllib line of a slice
+struct scan_event {
+    enum kind_t { GROUP, USEMTL, MTLLIB } kind;
+    // faces before the line in the slice
+    uint64_t face;
+    std::string name;
+    face_mark next;
+};
+
+struct scan_slice {
+    uint64_t counts[3];
+    uint64_t faces;
+    face_mark first;
+    std::vector<scan_event> events;
+    // counts relative to the slice
+    std::vector<obj_index_checkpoint> checkpoints;
+};
+
+// true for lines the loader looks at, with the first token and the rest; empty, comment
+// and indented lines are skipped exactly as parseChunk does
+static bool splitLine(const char *line, const char *line_end, const char *&prefix, const char *&args) {
+    if (line == line_end || line[0] == '#' || line[0] == ' ') return false;
+    prefix = skip_space(line, line_end);
+    args = skip_token(prefix, line_end);
+    return true;
+}
+
+static void scanSlice(const char *data, const char *cur, const char *end, scan_slice &slice) {
+    uint64_t counts[3] = {0, 0, 0};
+    uint64_t faces = 0;
+    // events before pending already know the face after them
+    size_t pending = 0;
+    uint64_t next_checkpoint = cur - data;
+    while (cur < end) {
+        const char *line = cur;
+        const char *line_end = find_line_end(line, end);
+        cur = (line_end == end) ? end : line_end + 1;
+        if ((uint64_t)(line - data) >= next_checkpoint) {
+            slice.checkpoints.push_back(obj_index_checkpoint{(uint64_t)(line - data), counts[0], counts[1], counts[2]});
+            next_checkpoint = line - data + obj_index_checkpoint_step;
+        }
+        const char *prefix, *args;
+        if (!splitLine(line, line_end, prefix, args)) continue;
+        if (token_is(prefix, args, "v")) {
+            counts[OBJ_RECORD_VERTEX]++;
+        } else if (token_is(prefix, args, "vt")) {
+            counts[OBJ_RECORD_TEXCOORD]++;
+        } else if (token_is(prefix, args, "vn")) {
+            counts[OBJ_RECORD_NORMAL]++;
+        } else if (token_is(prefix, args, "f")) {
+            // a face line without corners adds nothing
+            if (skip_space(args, line_end) == line_end) continue;
+            face_mark mark = {(uint64_t)(line - data), {counts[0], counts[1], counts[2]}};
+            if (faces == 0) slice.first = mark;
+            for (; pending < slice.events.size(); pending++) slice.events[pending].next = mark;
+            faces++;
+        } else if (token_is(prefix, args, "mtllib") || token_is(prefix, args, "usemtl") || token_is(prefix, args, "g")) {
+            scan_event event;
+            event.kind = (prefix[0] == 'm') ? scan_event::MTLLIB : ((prefix[0] == 'u') ? scan_event::USEMTL : scan_event::GROUP);
+            event.face = faces;
+            const char *name = skip_space(args, line_end);
+            event.name.assign(name, skip_token(name, line_end));
+            event.next = face_mark();
+            slice.events.push_back(std::move(event));
+        }
+    }
+    memcpy(slice.counts, counts, sizeof(counts));
+    slice.faces = faces;
+}
+
+void scanObjIndex(const char *data, size_t size, obj_index &index, thread_pool *pool) {
+    const char *data_end = data + size;
+    size_t thread_count = pool ? std::max<size_t>(1, pool -> size()) : 1;
+    size_t slice_count = std::max<size_t>(1, std::min(thread_count, size / min_scan_size));
+    std::vector<const char *> bounds(slice_count + 1);
+    bounds[0] = data;
+    bounds[slice_count] = data_end;
+    for (size_t i = 1; i < slice_count; i++) {
+        const char *split = std::max(bounds[i-1], data + size / slice_count * i);
+        const char *line_end = find_line_end(split, data_end);
+        bounds[i] = (line_end == data_end) ? data_end : line_end + 1;
+    }
+    std::vector<scan_slice> slices(slice_count);
+    auto body = [&](size_t i) { scanSlice(data, bounds[i], bounds[i+1], slices[i]); };
+    if (pool && slice_count > 1) {
+        pool -> parallel_for(slice_count, body);
+    } else {
+        for (size_t i = 0; i < slice_count; i++) body(i);
+    }
+
+    // replay the group and material state in file order, as objLoader::mergeChunks does
+    index.groups.clear();
+    index.checkpoints.clear();
+    index.libraries.clear();
+    uint64_t before[3] = {0, 0, 0};
+    uint64_t faces_before = 0;
+    std::string current_group = "default", current_material;
+    int64_t current_library = -1, material_library = -1;
+    // a group is activated if it has faces
+    bool group_activated = false;
+    // first face of every group, turned into face counts below
+    std::vector<uint64_t> group_first;
+    for (scan_slice &slice : slices) {
+        for (const obj_index_checkpoint &checkpoint : slice.checkpoints) {
+            index.checkpoints.push_back(obj_index_checkpoint{checkpoint.offset, before[0] + checkpoint.vertices,
+                before[1] + checkpoint.texcoords, before[2] + checkpoint.normals});
+        }
+        uint64_t run_begin = 0;
+        face_mark mark = slice.first;
+        auto activate = [&](uint64_t run_end) {
+            if (run_end > run_begin && !group_activated) {
+                group_activated = true;
+                obj_group_span span;
+                span.name = current_group;
+                span.material = current_material;
+                span.library = material_library;
+                span.begin = mark.offset;
+                span.end = size;
+                span.faces = 0;
+                span.vertices = before[0] + mark.counts[0];
+                span.texcoords = before[1] + mark.counts[1];
+                span.normals = before[2] + mark.counts[2];
+                index.groups.push_back(span);
+                group_first.push_back(faces_before + run_begin);
+            }
+            run_begin = run_end;
+        };
+        for (const scan_event &event : slice.events) {
+            activate(event.face);
+            if (event.kind == scan_event::MTLLIB) {
+                index.libraries.push_back(event.name);
+                current_library = index.libraries.size() - 1;
+            } else if (event.kind == scan_event::USEMTL) {
+                current_material = event.name;
+                material_library = current_library;
+            } else {
+                // an unnamed group keeps the current name
+                if (!event.name.empty()) current_group = event.name;
+                group_activated = false;
+            }
+            mark = event.next;
+        }
+        activate(slice.faces);
+        for (int k = 0; k < 3; k++) before[k] += slice.counts[k];
+        faces_before += slice.faces;
+    }
+    index.vertices = before[0];
+    index.texcoords = before[1];
+    index.normals = before[2];
+    index.faces = faces_before;
+    for (size_t i = 0; i < index.groups.size(); i++) {
+        bool last = i + 1 == index.groups.size();
+        index.groups[i].end = last ? size : index.groups[i + 1].begin;
+        index.groups[i].faces = (last ? faces_before : group_first[i + 1]) - group_first[i];
+    }
+}
+
+bool readObjIndex(const std::string &path, const mesh_cache_source &source, obj_index &index) {
+    mapped_file file;
+    if (!file.open(path)) return false;
+    obj_index_header header;
+    if (file.size() < sizeof(header)) return false;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, obj_index_magic, sizeof(obj_index_magic)) != 0 || header.endian_tag != MESH_CACHE_ENDIAN_TAG ||
+        header.version != OBJ_INDEX_VERSION || header.source.size != source.size || header.source.mtime_ns != source.mtime_ns) return false;
+    // sections follow each other, every size is checked before anything is read
+    uint64_t available = file.size() - sizeof(header);
+    if (header.group_count > available / sizeof(obj_index_group)) return false;
+    available -= header.group_count * sizeof(obj_index_group);
+    if (header.checkpoint_count > available / sizeof(obj_index_checkpoint)) return false;
+    available -= header.checkpoint_count * sizeof(obj_index_checkpoint);
+    if (header.library_count > available / sizeof(obj_index_string)) return false;
+    available -= header.library_count * sizeof(obj_index_string);
+    if (header.string_size > available) return false;
+    const char *cur = file.data() + sizeof(header);
+    const char *strings = cur + header.group_count * sizeof(obj_index_group) + header.checkpoint_count * sizeof(obj_index_checkpoint) +
+        header.library_count * sizeof(obj_index_string);
+    bool ok = true;
+    auto string_at = [&](uint64_t offset, uint64_t size) {
+        if (offset > header.string_size || size > header.string_size - offset) {
+            ok = false;
+            return std::string();
+        }
+        return std::string(strings + offset, size);
+    };
+    index.source = header.source;
+    index.vertices = header.vertices;
+    index.texcoords = header.texcoords;
+    index.normals = header.normals;
+    index.faces = header.faces;
+    index.groups.resize(header.group_count);
+    for (obj_group_span &span : index.groups) {
+        obj_index_group group;
+        memcpy(&group, cur, sizeof(group));
+        cur += sizeof(group);
+        span.name = string_at(group.name_offset, group.name_size);
+        span.material = string_at(group.material_offset, group.material_size);
+        span.library = group.library;
+        span.begin = group.begin;
+        span.end = group.end;
+        span.faces = group.faces;
+        span.vertices = group.vertices;
+        span.texcoords = group.texcoords;
+        span.normals = group.normals;
+        ok = ok && span.begin <= span.end && span.end <= source.size && span.library < (int64_t)header.library_count;
+    }
+    index.checkpoints.resize(header.checkpoint_count);
+    memcpy(index.checkpoints.data(), cur, header.checkpoint_count * sizeof(obj_index_checkpoint));
+    cur += header.checkpoint_count * sizeof(obj_index_checkpoint);
+    for (const obj_index_checkpoint &checkpoint : index.checkpoints) ok = ok && checkpoint.offset <= source.size;
+    index.libraries.resize(header.library_count);
+    for (std::string &library : index.libraries) {
+        obj_index_string name;
+        memcpy(&name, cur, sizeof(name));
+        cur += sizeof(name);
+        library = string_at(name.offset, name.size);
+    }
+    return ok;
+}
+
+bool writeObjIndex(const std::string &path, const obj_index &index) {
+    std::string strings;
+    auto add_string = [&strings](const std::string &value, uint64_t &offset, uint64_t &size) {
+        offset = strings.size();
+        size = value.size();
+        strings += value;
+    };
+    std::vector<obj_index_group> groups(index.groups.size());
+    for (size_t i = 0; i < groups.size(); i++) {
+        const obj_group_span &span = index.groups[i];
+        obj_index_group &group = groups[i];
+        group.begin = span.begin;
+        group.end = span.end;
+        group.faces = span.faces;
+        group.vertices = span.vertices;
+        group.texcoords = span.texcoords;
+        group.normals = span.normals;
+        group.library = span.library;
+        add_string(span.name, group.name_offset, group.name_size);
+        add_string(span.material, group.material_offset, group.material_size);
+    }
+    std::vector<obj_index_string> libraries(index.libraries.size());
+    for (size_t i = 0; i < libraries.size(); i++) add_string(index.libraries[i], libraries[i].offset, libraries[i].size);
+    obj_index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, obj_index_magic, sizeof(obj_index_magic));
+    header.endian_tag = MESH_CACHE_ENDIAN_TAG;
+    header.version = OBJ_INDEX_VERSION;
+    header.source = index.source;
+    header.vertices = index.vertices;
+    header.texcoords = index.texcoords;
+    header.normals = index.normals;
+    header.faces = index.faces;
+    header.group_count = groups.size();
+    header.checkpoint_count = index.checkpoints.size();
+    header.library_count = libraries.size();
+    header.string_size = strings.size();
+    // write to a private name first so readers never see a half written index; the address of the index
+    // tells apart loaders of one process writing the same sidecar
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d.%p", (int)getpid(), (const void *)&index);
+    std::string tmp_path = path + suffix;
+    std::ofstream out(tmp_path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Cannot open file: " << tmp_path << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(groups.data()), groups.size() * sizeof(obj_index_group));
+    out.write(reinterpret_cast<const char *>(index.checkpoints.data()), index.checkpoints.size() * sizeof(obj_index_checkpoint));
+    out.write(reinterpret_cast<const char *>(libraries.data()), libraries.size() * sizeof(obj_index_string));
+    out.write(strings.data(), strings.size());
+    out.close();
+    if (!out || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write group index: " << path << std::endl;
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static uint64_t checkpointCount(const obj_index_checkpoint &checkpoint, obj_record_kind kind) {
+    return kind == OBJ_RECORD_VERTEX ? checkpoint.vertices : (kind == OBJ_RECORD_TEXCOORD ? checkpoint.texcoords : checkpoint.normals);
+}
+
+void readObjRecords(const char *data, size_t size, const obj_index &index, obj_record_kind kind, const std::vector<uint32_t> &ids, float *out) {
+    const char *keyword = kind == OBJ_RECORD_VERTEX ? "v" : (kind == OBJ_RECORD_TEXCOORD ? "vt" : "vn");
+    int components = kind == OBJ_RECORD_TEXCOORD ? 2 : 3;
+    std::fill(out, out + ids.size() * components, 0.0f);
+    const char *end = data + size;
+    const char *cur = data;
+    // records of kind before cur
+    uint64_t count = 0;
+    size_t i = 0;
+    while (i < ids.size() && cur < end) {
+        // skip ahead to the last checkpoint before the record if that is further than cur
+        auto next = std::upper_bound(index.checkpoints.begin(), index.checkpoints.end(), (uint64_t)ids[i],
+            [kind](uint64_t id, const obj_index_checkpoint &checkpoint) { return id < checkpointCount(checkpoint, kind); });
+        if (next != index.checkpoints.begin()) {
+            const obj_index_checkpoint &checkpoint = *(next - 1);
+            if (checkpointCount(checkpoint, kind) > count && checkpoint.offset <= size) {
+                cur = data + checkpoint.offset;
+                count = checkpointCount(checkpoint, kind);
+            }
+        }
+        // parse forward while the wanted records follow each other, seek again at a gap
+        while (cur < end) {
+            const char *line = cur;
+            const char *line_end = find_line_end(line, end);
+            cur = (line_end == end) ? end : line_end + 1;
+            const char *prefix, *args;
+            if (!splitLine(line, line_end, prefix, args) || !token_is(prefix, args, keyword)) continue;
+            if (count++ != ids[i]) continue;
+            parse_floats(args, line_end, out + i * components, components);
+            i++;
+            if (i == ids.size() || ids[i] != count) break;
+        }
+    }
+}
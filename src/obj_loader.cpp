@@ -1,163 +1,1306 @@
 #include "obj_loader.h"
+#include "mapped_file.h"
+#include "parse_util.h"
+#include <algorithm>
+#include <unordered_map>
+#include <climits>
+#include <cstring>
+#include <cstdint>
 
-#define push_vec3(src, tar) \
-    tar.push_back(src.x); \
-    tar.push_back(src.y); \
-    tar.push_back(src.z);
+static size_t hashVertex(const float *vertex) {
+    uint32_t bits[VBO_FLOATS_PER_VERTEX];
+    memcpy(bits, vertex, sizeof(bits));
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < VBO_FLOATS_PER_VERTEX; i++) {
+        hash ^= bits[i];
+        hash *= 1099511628211ULL;
+    }
+    // the table masks off the low bits, which fnv alone leaves poorly mixed for grid-like data
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
 
-#define push_vec2(src, tar) \
-    tar.push_back(src.x); \
-    tar.push_back(src.y);
+// open addressing set of vertex indices keyed by the vertex contents in a vbo,
+// each slot keeps the hash so probing and growing rarely have to touch the vbo
+class vertex_table {
+public:
+    vertex_table(): count(0) {}
+    // forget every entry and size the table for up to expected vertices
+    void reset(size_t expected) {
+        size_t size = 16;
+        // larger groups grow on demand instead of reserving for the worst case
+        while (size < expected * 2 && size < (1u << 20)) size <<= 1;
+        this -> slots.assign(size, slot_entry{0, empty});
+        this -> count = 0;
+    }
+    // index of an identical vertex already in the table, or index itself after adding it
+    uint32_t insert(const float *vbo, uint32_t index) {
+        if ((this -> count + 1) * 2 > this -> slots.size()) this -> grow();
+        size_t mask = this -> slots.size() - 1;
+        const float *vertex = vbo + (size_t)index * VBO_FLOATS_PER_VERTEX;
+        size_t hash = hashVertex(vertex);
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            slot_entry &entry = this -> slots[slot];
+            if (entry.index == empty) {
+                entry.hash = (uint32_t)hash;
+                entry.index = index;
+                this -> count++;
+                return index;
+            }
+            if (entry.hash == (uint32_t)hash &&
+                memcmp(vbo + (size_t)entry.index * VBO_FLOATS_PER_VERTEX, vertex, VBO_FLOATS_PER_VERTEX * sizeof(float)) == 0) return entry.index;
+        }
+    }
+private:
+    static constexpr uint32_t empty = 0xffffffffu;
+    struct slot_entry {
+        uint32_t hash;
+        uint32_t index;
+    };
+    std::vector<slot_entry> slots;
+    size_t count;
+    void grow() {
+        std::vector<slot_entry> old(this -> slots.size() * 2, slot_entry{0, empty});
+        old.swap(this -> slots);
+        size_t mask = this -> slots.size() - 1;
+        for (const slot_entry &entry : old) {
+            if (entry.index == empty) continue;
+            size_t slot = entry.hash & mask;
+            while (this -> slots[slot].index != empty) slot = (slot + 1) & mask;
+            this -> slots[slot] = entry;
+        }
+    }
+};
 
 objLoader::~objLoader() {
-    if (this -> vbo) delete[] this -> vbo;
+    this -> releaseVBO();
 }
 
-bool objLoader::hasNormal() {
-    return !(std::get<2>(this -> faces[0][0]) == -1);
+void objLoader::releaseVBO() {
+    if (this -> vbo_mapping.isOpen()) this -> vbo_mapping.close();
+    else if (this -> vbo) delete[] this -> vbo;
+    this -> vbo = nullptr;
+    this -> vbo_size = 0;
 }
 
-bool objLoader::hasTexcoord() {
-    return !(std::get<1>(this -> faces[0][0]) == -1);
+bool objLoader::hasNormal() const {
+    return this -> has_normal;
 }
 
-bool objLoader::load(const std::string& filename) {
-    if (this -> vbo) delete[] this -> vbo;
-    this -> vbo_size = 0;
-    vertices.clear();
-    normals.clear();
-    texcoord.clear();
-    faces.clear();
-    material_lib.materials.clear();
-    group_index.clear();
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Cannot open file: " << filename << std::endl;
-        this -> vbo = nullptr;
-        return false;
+bool objLoader::hasTexcoord() const {
+    return this -> has_texcoord;
+}
+
+// state changing line seen while parsing a chunk, replayed in file order on merge
+struct obj_event {
+    enum kind_t { GROUP, USEMTL, MTLLIB } kind;
+    // faces parsed in the chunk before this line
+    size_t face;
+    std::string name;
+};
+
+// records parsed from one newline aligned slice of the file
+struct obj_chunk {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoord;
+    face_list faces;
+    std::vector<obj_event> events;
+    // (corner, component) of relative indices, resolved against this chunk's lists only
+    std::vector<std::pair<size_t, int>> relative;
+    // line counts, only filled with OBJ_LOADER_STATS
+    load_stats stats = load_stats();
+};
+
+#ifdef OBJ_LOADER_STATS
+static void addLineCounts(load_stats &total, const load_stats &chunk) {
+    total.vertex_lines += chunk.vertex_lines;
+    total.normal_lines += chunk.normal_lines;
+    total.texcoord_lines += chunk.texcoord_lines;
+    total.face_lines += chunk.face_lines;
+    total.group_lines += chunk.group_lines;
+    total.usemtl_lines += chunk.usemtl_lines;
+    total.mtllib_lines += chunk.mtllib_lines;
+    total.comment_lines += chunk.comment_lines;
+    total.empty_lines += chunk.empty_lines;
+    total.skipped_lines += chunk.skipped_lines;
+}
+#endif
+
+// chunks smaller than this are not worth a thread
+static const size_t min_chunk_size = 1 << 20;
+// exporters write mtllib at the top, only this much of a file is searched for it before parsing
+static const size_t material_scan_bytes = 1 << 16;
+
+// parsed_bytes is advanced about every progress_step bytes
+static const size_t progress_step = 1 << 20;
+
+static void parseChunk(const char *cur, const char *end, obj_chunk &chunk, std::atomic<size_t> &parsed_bytes) {
+    const char *reported = cur;
+    while (cur < end) {
+        if ((size_t)(cur - reported) >= progress_step) {
+            parsed_bytes.fetch_add(cur - reported, std::memory_order_relaxed);
+            reported = cur;
+        }
+        const char *line = cur;
+        const char *line_end = find_line_end(line, end);
+        cur = (line_end == end) ? end : line_end + 1;
+        // a line of only whitespace, such as the "\r" of a blank crlf line, is empty
+        const char *prefix = skip_space(line, line_end);
+        if (prefix == line_end || line[0] == '#' || line[0] == ' ') {
+            LOAD_STATS(if (prefix == line_end) chunk.stats.empty_lines++; else if (line[0] == '#') chunk.stats.comment_lines++; else chunk.stats.skipped_lines++;)
+            continue;
+        }
+        const char *args = skip_token(prefix, line_end);
+        if (token_is(prefix, args, "v")) {
+            glm::vec3 vertex(0.0f);
+            parse_floats(args, line_end, &vertex.x, 3);
+            chunk.vertices.push_back(vertex);
+            LOAD_STATS(chunk.stats.vertex_lines++);
+        } else if (token_is(prefix, args, "vn")) {
+            glm::vec3 norm(0.0f);
+            parse_floats(args, line_end, &norm.x, 3);
+            chunk.normals.push_back(norm);
+            LOAD_STATS(chunk.stats.normal_lines++);
+        } else if (token_is(prefix, args, "vt")) {
+            glm::vec2 tex(0.0f);
+            parse_floats(args, line_end, &tex.x, 2);
+            chunk.texcoord.push_back(tex);
+            LOAD_STATS(chunk.stats.texcoord_lines++);
+        } else if (token_is(prefix, args, "f")) {
+            int *component[3];
+            const int counts[3] = {(int)chunk.vertices.size(), (int)chunk.texcoord.size(), (int)chunk.normals.size()};
+            const char *corner = skip_space(args, line_end);
+            while (corner < line_end) {
+                // corner is v, v/vt, v//vn or v/vt/vn
+                const char *corner_end = skip_token(corner, line_end);
+                int raw[3];
+                parse_face_corner(corner, corner_end, raw);
+                size_t corner_index = chunk.faces.v.size();
+                chunk.faces.v.push_back(-1);
+                chunk.faces.vt.push_back(-1);
+                chunk.faces.vn.push_back(-1);
+                component[0] = &chunk.faces.v.back();
+                component[1] = &chunk.faces.vt.back();
+                component[2] = &chunk.faces.vn.back();
+                for (int k = 0; k < 3; k++) {
+                    if (raw[k] > 0) {
+                        *component[k] = raw[k] - 1;
+                    } else if (raw[k] < 0) {
+                        // relative to the end of the list, shifted by the earlier chunks on merge
+                        *component[k] = counts[k] + raw[k];
+                        chunk.relative.push_back(std::make_pair(corner_index, k));
+                    }
+                }
+                corner = skip_space(corner_end, line_end);
+            }
+            // a face line without corners adds nothing
+            if (chunk.faces.v.size() > chunk.faces.first.back()) chunk.faces.first.push_back(chunk.faces.v.size());
+            LOAD_STATS(chunk.stats.face_lines++);
+        } else if (token_is(prefix, args, "mtllib") || token_is(prefix, args, "usemtl") || token_is(prefix, args, "g")) {
+            obj_event event;
+            event.kind = (prefix[0] == 'm') ? obj_event::MTLLIB : ((prefix[0] == 'u') ? obj_event::USEMTL : obj_event::GROUP);
+            event.face = chunk.faces.size();
+            const char *name = skip_space(args, line_end);
+            event.name.assign(name, skip_token(name, line_end));
+            LOAD_STATS(if (event.kind == obj_event::MTLLIB) chunk.stats.mtllib_lines++; else if (event.kind == obj_event::USEMTL) chunk.stats.usemtl_lines++; else chunk.stats.group_lines++;)
+            chunk.events.push_back(std::move(event));
+        } else {
+            // unsupported records are only counted
+            LOAD_STATS(chunk.stats.skipped_lines++);
+        }
     }
-    std::string line;
+    parsed_bytes.fetch_add(end - reported, std::memory_order_relaxed);
+}
+
+void objLoader::setThreadCount(size_t count) {
+    if (count != this -> thread_count) this -> pool.reset();
+    this -> thread_count = count;
+}
+
+size_t objLoader::getThreadCount() const {
+    if (this -> shared_pool) return std::max<size_t>(1, this -> shared_pool -> size());
+    return this -> thread_count == 0 ? thread_pool::hardwareThreads() : this -> thread_count;
+}
+
+void objLoader::setThreadPool(thread_pool *pool) {
+    this -> shared_pool = pool;
+}
+
+void objLoader::setMaterialSource(const std::function<std::shared_ptr<const mtl_file>(const std::string&)>& source) {
+    this -> material_source = source;
+}
+
+void objLoader::setTextureCache(texture_cache *cache) {
+    this -> textures = cache;
+}
+
+void objLoader::requestTextures(const material& mat) {
+    if (!this -> textures) return;
+    this -> textures -> request(mat.diffuse_map);
+    this -> textures -> request(mat.specular_map);
+    this -> textures -> request(mat.bump_map);
+}
+
+void objLoader::prefetchMaterials(const std::string& filename, const char *data, size_t size) {
+    const char *end = data + std::min(size, material_scan_bytes);
+    for (const char *line = data; line < end; ) {
+        const char *line_end = find_line_end(line, end);
+        const char *prefix = skip_space(line, line_end);
+        const char *args = skip_token(prefix, line_end);
+        if (token_is(prefix, args, "mtllib") && line_end < end) {
+            const char *name = skip_space(args, line_end);
+            this -> loadMaterialLibrary(filename, std::string(name, skip_token(name, line_end)));
+        }
+        line = line_end + 1;
+    }
+}
+
+thread_pool& objLoader::getPool() {
+    if (this -> shared_pool) return *(this -> shared_pool);
+    if (!this -> pool) this -> pool.reset(new thread_pool(this -> getThreadCount()));
+    return *(this -> pool);
+}
+
+void objLoader::mergeChunks(std::vector<obj_chunk>& chunks, const std::string& filename) {
+    size_t chunk_count = chunks.size();
+    // prefix sums of the per chunk record counts
+    std::vector<size_t> v_offset(chunk_count + 1, 0), vt_offset(chunk_count + 1, 0), vn_offset(chunk_count + 1, 0), f_offset(chunk_count + 1, 0), c_offset(chunk_count + 1, 0);
+    for (size_t i = 0; i < chunk_count; i++) {
+        v_offset[i+1] = v_offset[i] + chunks[i].vertices.size();
+        vt_offset[i+1] = vt_offset[i] + chunks[i].texcoord.size();
+        vn_offset[i+1] = vn_offset[i] + chunks[i].normals.size();
+        f_offset[i+1] = f_offset[i] + chunks[i].faces.size();
+        c_offset[i+1] = c_offset[i] + chunks[i].faces.v.size();
+    }
+    if (chunk_count == 1) {
+        // relative indices of a single chunk are already absolute
+        this -> vertices.swap(chunks[0].vertices);
+        this -> texcoord.swap(chunks[0].texcoord);
+        this -> normals.swap(chunks[0].normals);
+        this -> faces.swap(chunks[0].faces);
+    } else {
+        this -> vertices.resize(v_offset[chunk_count]);
+        this -> texcoord.resize(vt_offset[chunk_count]);
+        this -> normals.resize(vn_offset[chunk_count]);
+        this -> faces.first.resize(f_offset[chunk_count] + 1);
+        this -> faces.v.resize(c_offset[chunk_count]);
+        this -> faces.vt.resize(c_offset[chunk_count]);
+        this -> faces.vn.resize(c_offset[chunk_count]);
+        this -> getPool().parallel_for(chunk_count, [&](size_t i) {
+            obj_chunk &chunk = chunks[i];
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), this -> vertices.begin() + v_offset[i]);
+            std::copy(chunk.texcoord.begin(), chunk.texcoord.end(), this -> texcoord.begin() + vt_offset[i]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), this -> normals.begin() + vn_offset[i]);
+            const int offsets[3] = {(int)v_offset[i], (int)vt_offset[i], (int)vn_offset[i]};
+            for (auto &fixup : chunk.relative) {
+                std::vector<int> &component = fixup.second == 0 ? chunk.faces.v : (fixup.second == 1 ? chunk.faces.vt : chunk.faces.vn);
+                component[fixup.first] += offsets[fixup.second];
+            }
+            // corner offsets become global, the shared end offset is written by the next chunk or below
+            for (size_t f = 0; f < chunk.faces.size(); f++) this -> faces.first[f_offset[i] + f] = chunk.faces.first[f] + c_offset[i];
+            std::copy(chunk.faces.v.begin(), chunk.faces.v.end(), this -> faces.v.begin() + c_offset[i]);
+            std::copy(chunk.faces.vt.begin(), chunk.faces.vt.end(), this -> faces.vt.begin() + c_offset[i]);
+            std::copy(chunk.faces.vn.begin(), chunk.faces.vn.end(), this -> faces.vn.begin() + c_offset[i]);
+        });
+        this -> faces.first[f_offset[chunk_count]] = c_offset[chunk_count];
+    }
+    // replay group and material state in file order
     std::string current_group = "default";
     material current_material;
     // a group is activated if it has faces
     bool group_activated = false;
-    while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#' || line[0] == ' ') continue;
-        std::istringstream iss(line);
-        std::string prefix;
-        iss >> prefix;
-        if (prefix == "v") {
-            glm::vec3 vertex;
-            iss >> vertex.x >> vertex.y >> vertex.z;
-            vertices.push_back(vertex);
-        } else if (prefix == "vn") {
-            glm::vec3 norm;
-            iss >> norm.x >> norm.y >> norm.z;
-            normals.push_back(norm);
-        } else if (prefix == "vt") {
-            glm::vec2 tex;
-            iss >> tex.x >> tex.y;
-            texcoord.push_back(tex);
-        } else if (prefix == "f") {
-            if (!group_activated) {
+    for (size_t i = 0; i < chunk_count; i++) {
+        size_t run_begin = 0;
+        auto activate = [&](size_t run_end) {
+            if (run_end > run_begin && !group_activated) {
                 group_activated = true;
-                group_index.push_back(std::make_tuple(faces.size(), current_group, current_material));
+                this -> group_index.push_back(std::make_tuple(f_offset[i] + run_begin, current_group, current_material));
             }
-            faces.resize(faces.size() + 1);
-            std::string vertexInfo;
-            while (iss >> vertexInfo) {
-                vertexInfo += "/";
-                std::vector<int> v_n_t_index;
-                while (vertexInfo.size() > 0) {
-                    size_t next_idx = vertexInfo.find("/");
-                    if (next_idx == std::string::npos) next_idx = vertexInfo.size();
-                    if (next_idx == 0) v_n_t_index.push_back(-1);
-                    else v_n_t_index.push_back(std::stoi(vertexInfo.substr(0, next_idx)) - 1);
-                    vertexInfo = vertexInfo.substr(next_idx + 1);
+            run_begin = run_end;
+        };
+        for (auto &event : chunks[i].events) {
+            activate(event.face);
+            if (event.kind == obj_event::MTLLIB) {
+                LOAD_STATS(auto material_start = std::chrono::steady_clock::now());
+                this -> loadMaterialLibrary(filename, event.name);
+                LOAD_STATS(this -> stats.material_ms += elapsedMs(material_start));
+            } else if (event.kind == obj_event::USEMTL) {
+                if ((this -> material_lib.materials).find(event.name) == (this -> material_lib.materials).end()) {
+                    std::cerr << "Material not found: " << event.name << std::endl;
+                    current_material = material();
+                } else {
+                    current_material = this -> material_lib.materials[event.name];
                 }
-                while (v_n_t_index.size() < 3) v_n_t_index.push_back(-1);
-                faces[faces.size()-1].push_back(std::make_tuple(v_n_t_index[0], v_n_t_index[1], v_n_t_index[2]));
-            }
-        } else if (prefix == "mtllib") {
-            std::string mtl_filename;
-            iss >> mtl_filename;
-            // construct mtl file path
-            size_t last_slash_pos = filename.find_last_of("/");
-            std::string mtl_path = filename.substr(0, last_slash_pos + 1) + mtl_filename;
-            std::cout << "Loading material library: " << mtl_path << std::endl;
-            // load mtl file
-            this -> material_lib.load(mtl_path);
-        } else if (prefix == "usemtl") {
-            std::string material_name;
-            iss >> material_name;
-            if ((this -> material_lib.materials).find(material_name) == (this -> material_lib.materials).end()) {
-                std::cerr << "Material not found: " << material_name << std::endl;
-                current_material = material();
             } else {
-                current_material = this -> material_lib.materials[material_name];
+                // an unnamed group keeps the current name
+                if (!event.name.empty()) current_group = event.name;
+                group_activated = false;
             }
-        } else if (prefix == "g") {
-            iss >> current_group;
-            group_activated = false;
-        } else {
-            // std::cerr << "Unsupported format:" << prefix << std::endl;
         }
+        activate(f_offset[i+1] - f_offset[i]);
     }
+}
+
+void objLoader::loadMaterialLibrary(const std::string& filename, const std::string& name) {
+    // construct mtl file path
+    size_t last_slash_pos = filename.find_last_of("/");
+    std::string mtl_path = filename.substr(0, last_slash_pos + 1) + name;
+    // already read before parsing
+    if (mtl_path == this -> material_lib_path) return;
+    this -> material_lib_path = mtl_path;
+    if (std::find(this -> material_lib_paths.begin(), this -> material_lib_paths.end(), mtl_path) == this -> material_lib_paths.end())
+        this -> material_lib_paths.push_back(mtl_path);
+    std::cout << "Loading material library: " << mtl_path << std::endl;
+    // load mtl file
+    if (this -> material_source) {
+        std::shared_ptr<const mtl_file> library = this -> material_source(mtl_path);
+        if (library) this -> material_lib.materials = library -> materials;
+        else this -> material_lib.materials.clear();
+    } else {
+        this -> material_lib.load(mtl_path);
+    }
+    for (auto &entry : this -> material_lib.materials) this -> requestTextures(entry.second);
+}
+
+void objLoader::resetModel() {
+    this -> releaseVBO();
+    this -> packed_dirty = true;
+    this -> tangents_dirty = true;
+    this -> stale_groups.clear();
+    // a new model is uploaded as a whole
+    this -> dirty_ranges.clear();
+    this -> from_cache = false;
+    this -> has_normal = false;
+    this -> has_texcoord = false;
+    vertices.clear();
+    normals.clear();
+    texcoord.clear();
+    faces.clear();
+    material_lib.materials.clear();
+    material_lib_path.clear();
+    material_lib_paths.clear();
+    group_index.clear();
+    group_vertex_offset.clear();
+    group_lods.clear();
+    lod_first = 0;
+    group_bounds.clear();
+    clusters.clear();
+    group_cluster_first.clear();
+    group_transforms.clear();
+    group_normal_matrices.clear();
+    ibo16.clear();
+    ibo32.clear();
+    lazy_filename.clear();
+    lazy_faces.clear();
+    group_loaded.clear();
+    for (int k = 0; k < 3; k++) {
+        lazy_ids[k].clear();
+        lazy_local[k].clear();
+    }
+}
+
+bool objLoader::load(const std::string& filename) {
+    this -> progress_bytes = 0;
+    this -> progress_bytes_total = 0;
+    this -> progress_faces = 0;
+    this -> progress_faces_total = 0;
+    this -> stats = load_stats();
+    LOAD_STATS(auto load_start = std::chrono::steady_clock::now());
+    LOAD_STATS(auto phase_start = load_start);
+    this -> resetModel();
+    mapped_file file;
+    if (!file.open(filename)) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return false;
+    }
+    this -> progress_bytes_total = file.size();
+    mesh_cache_source source, known = this -> known_source;
+    this -> known_source = mesh_cache_source();
+    std::string cache_path;
+    if (this -> cache_enabled && statMeshSource(filename, source)) {
+        bool unchanged = known.size == source.size && known.mtime_ns == source.mtime_ns;
+        source.hash = unchanged ? known.hash : hashBytes(file.data(), file.size(), &this -> getPool());
+        cache_path = this -> cachePath(filename);
+        LOAD_STATS(this -> stats.open_ms = elapsedMs(phase_start); phase_start = std::chrono::steady_clock::now());
+        bool cached = this -> readCache(cache_path, source);
+        LOAD_STATS(this -> stats.cache_ms = elapsedMs(phase_start); phase_start = std::chrono::steady_clock::now());
+        if (cached) {
+            for (auto &entry : this -> material_lib.materials) this -> requestTextures(entry.second);
+            this -> computeBounds();
+            this -> finishProgress();
+            LOAD_STATS(this -> collectLoadStats(file.size(), 0); this -> stats.total_ms = elapsedMs(load_start));
+            return true;
+        }
+    } else {
+        LOAD_STATS(this -> stats.open_ms = elapsedMs(phase_start); phase_start = std::chrono::steady_clock::now());
+    }
+    // libraries named at the head are read now, so their images decode on the texture pool while the geometry parses
+    if (this -> textures) this -> prefetchMaterials(filename, file.data(), file.size());
+    // split into newline aligned chunks, small files stay on the calling thread
+    const char *data = file.data();
+    const char *data_end = data + file.size();
+    size_t chunk_count = std::max<size_t>(1, std::min(this -> getThreadCount(), file.size() / min_chunk_size));
+    std::vector<const char *> bounds(chunk_count + 1);
+    bounds[0] = data;
+    bounds[chunk_count] = data_end;
+    for (size_t i = 1; i < chunk_count; i++) {
+        const char *split = std::max(bounds[i-1], data + file.size() / chunk_count * i);
+        const char *line_end = find_line_end(split, data_end);
+        bounds[i] = (line_end == data_end) ? data_end : line_end + 1;
+    }
+    std::vector<obj_chunk> chunks(chunk_count);
+    if (chunk_count == 1) {
+        // parse straight into the storage of the previous load, merge swaps it back
+        chunks[0].vertices.swap(this -> vertices);
+        chunks[0].normals.swap(this -> normals);
+        chunks[0].texcoord.swap(this -> texcoord);
+        chunks[0].faces.swap(this -> faces);
+        parseChunk(bounds[0], bounds[1], chunks[0], this -> progress_bytes);
+    } else {
+        this -> getPool().parallel_for(chunk_count, [&](size_t i) {
+            parseChunk(bounds[i], bounds[i+1], chunks[i], this -> progress_bytes);
+        });
+    }
+    LOAD_STATS(this -> stats.parse_ms = elapsedMs(phase_start); phase_start = std::chrono::steady_clock::now());
+    LOAD_STATS(for (auto &chunk : chunks) addLineCounts(this -> stats, chunk.stats));
+    LOAD_STATS(size_t file_size = file.size());
     file.close();
-    // construct vbo
-    std::vector<float> tmp_vbo(0);
+    this -> mergeChunks(chunks, filename);
+    LOAD_STATS(this -> stats.merge_ms = elapsedMs(phase_start) - this -> stats.material_ms);
+    [[maybe_unused]] size_t tmp_vbo_bytes = this -> buildBuffers();
+    LOAD_STATS(phase_start = std::chrono::steady_clock::now());
+    if (!cache_path.empty()) this -> writeCache(cache_path, source);
+    LOAD_STATS(this -> stats.cache_ms += elapsedMs(phase_start));
+    this -> computeBounds();
+    this -> finishProgress();
+    LOAD_STATS(this -> collectLoadStats(file_size, tmp_vbo_bytes); this -> stats.total_ms = elapsedMs(load_start));
+    if (this -> release_source) {
+        std::vector<glm::vec3>().swap(this -> vertices);
+        std::vector<glm::vec3>().swap(this -> normals);
+        std::vector<glm::vec2>().swap(this -> texcoord);
+        face_list().swap(this -> faces);
+    }
+    return true;
+}
+
+size_t objLoader::buildBuffers() {
+    LOAD_STATS(auto phase_start = std::chrono::steady_clock::now());
+    // normals and texcoords are decided per face, so files where only some faces have them index correctly;
+    // a face keeps its file normals only if every corner has one
+    size_t face_count = this -> faces.size();
+    std::vector<unsigned char> file_normals(face_count, 0);
+    bool any_file_normals = false, any_generated = false;
+    for (size_t i = 0; i < face_count; i++) {
+        bool complete = !this -> flat_normals;
+        for (uint32_t c = this -> faces.first[i]; c < this -> faces.first[i+1] && complete; c++) complete = this -> faces.vn[c] != -1;
+        file_normals[i] = complete;
+        any_file_normals = any_file_normals || complete;
+        any_generated = any_generated || !complete;
+    }
+    this -> has_texcoord = std::find_if(this -> faces.vt.begin(), this -> faces.vt.end(), [](int vt) { return vt != -1; }) != this -> faces.vt.end();
+    bool generate_smooth = this -> smooth_normals && !this -> flat_normals && any_generated;
+    this -> has_normal = this -> flat_normals || any_file_normals || generate_smooth;
+    // fan triangulation of every face, counted first so each buffer is allocated once
+    size_t triangle_count = 0;
+    for (size_t i = 0; i < face_count; i++) {
+        size_t corners = this -> faces.first[i+1] - this -> faces.first[i];
+        if (corners > 2) triangle_count += corners - 2;
+    }
+    LOAD_STATS(this -> stats.triangulate_ms = elapsedMs(phase_start); phase_start = std::chrono::steady_clock::now());
+    // smooth normals of every triangle corner without file normals, in emission order
+    std::vector<glm::vec3> smooth;
+    if (generate_smooth) {
+        std::vector<uint32_t> corners(triangle_count * 3);
+        std::vector<unsigned char> needed(triangle_count);
+        size_t t = 0;
+        for (size_t i = 0; i < face_count; i++) {
+            const uint32_t first = this -> faces.first[i];
+            const uint32_t count = this -> faces.first[i+1] - first;
+            for (uint32_t k = 1; k + 1 < count; k++, t++) {
+                corners[t * 3] = this -> faces.v[first];
+                corners[t * 3 + 1] = this -> faces.v[first + k];
+                corners[t * 3 + 2] = this -> faces.v[first + k + 1];
+                needed[t] = !file_normals[i];
+            }
+        }
+        smooth.resize(triangle_count * 3);
+        generateSmoothNormals(this -> vertices.data(), this -> vertices.size(), corners.data(), corners.size(), needed.data(),
+            glm::radians(this -> crease_angle), smooth.data(), &this -> getPool());
+    }
+    LOAD_STATS(this -> stats.normals_ms = elapsedMs(phase_start); phase_start = std::chrono::steady_clock::now());
+    // non-indexed vertices go straight into the vbo, indexed ones shrink by dedup and are copied once
+    float *out = new float[triangle_count * 3 * VBO_FLOATS_PER_VERTEX];
+    size_t vertex_count = 0;
+    std::vector<uint32_t> tmp_ibo;
+    if (this -> indexed) tmp_ibo.reserve(triangle_count * 3);
+    // vertices already emitted in the current group, keyed by their contents
+    vertex_table vertex_lookup;
     size_t group_idx = 0;
-    for (size_t i = 0; i < faces.size(); i++) {
-        auto face = faces[i];
-        // convert group index to vbo offset
-        if (group_idx < group_index.size() && std::get<0>(group_index[group_idx]) == (int)i) {
-            group_index[group_idx] = std::make_tuple(tmp_vbo.size() / 8, std::get<1>(group_index[group_idx]), std::get<2>(group_index[group_idx]));
+    size_t triangle = 0;
+    this -> progress_faces_total = face_count;
+    for (size_t i = 0; i < face_count; i++) {
+        if ((i & 0xffff) == 0) this -> progress_faces = i;
+        // convert group index to vbo offset, placeholders without faces start where the next group does
+        while (group_idx < group_index.size() && std::get<0>(group_index[group_idx]) == (int)i) {
+            size_t offset = this -> indexed ? tmp_ibo.size() : vertex_count;
+            group_index[group_idx] = std::make_tuple(offset, std::get<1>(group_index[group_idx]), std::get<2>(group_index[group_idx]));
+            group_vertex_offset.push_back(vertex_count);
+            // vertices are not shared between groups, so every group owns a contiguous vertex range
+            size_t group_end = group_idx + 1 < group_index.size() ? std::get<0>(group_index[group_idx + 1]) : face_count;
+            if (this -> indexed) vertex_lookup.reset(this -> faces.first[group_end] - this -> faces.first[i]);
             group_idx++;
         }
-        std::vector<std::tuple<int, int, int>> face_vertices(3);
-        face_vertices[0] = face[0];
-        for (size_t i = 1; i + 1 < face.size(); i++) {
-            face_vertices[1] = face[i];
-            face_vertices[2] = face[i+1];
+        const uint32_t first = this -> faces.first[i];
+        const uint32_t corners = this -> faces.first[i+1] - first;
+        const bool use_file_normals = file_normals[i];
+        for (uint32_t k = 1; k + 1 < corners; k++, triangle++) {
             // construct triangle
-            glm::vec3 default_normal = glm::normalize(
-                glm::cross(
-                    vertices[std::get<0>(face_vertices[1])] - vertices[std::get<0>(face_vertices[0])],
-                    vertices[std::get<0>(face_vertices[2])] - vertices[std::get<0>(face_vertices[1])]
-                )
-            );
+            const uint32_t corner[3] = {first, first + k, first + k + 1};
+            glm::vec3 default_normal(0.0f);
+            if (!use_file_normals && !generate_smooth) {
+                default_normal = glm::normalize(
+                    glm::cross(
+                        vertices[this -> faces.v[corner[1]]] - vertices[this -> faces.v[corner[0]]],
+                        vertices[this -> faces.v[corner[2]]] - vertices[this -> faces.v[corner[1]]]
+                    )
+                );
+            }
             for (int j = 0; j < 3; j++) {
-                push_vec3(vertices[std::get<0>(face_vertices[j])], tmp_vbo);
-                if (hasNormal()) {
-                    push_vec3(normals[std::get<2>(face_vertices[j])], tmp_vbo);
-                } else {
-                    push_vec3(default_normal, tmp_vbo);
-                }
-                if (hasTexcoord()) {
-                    push_vec2(texcoord[std::get<1>(face_vertices[j])], tmp_vbo);
+                float *vertex = out + vertex_count * VBO_FLOATS_PER_VERTEX;
+                const glm::vec3 &position = vertices[this -> faces.v[corner[j]]];
+                const glm::vec3 &normal = use_file_normals ? normals[this -> faces.vn[corner[j]]] :
+                    generate_smooth ? smooth[triangle * 3 + j] : default_normal;
+                const int vt = this -> faces.vt[corner[j]];
+                const glm::vec2 tex = vt != -1 ? texcoord[vt] : glm::vec2(0.0f, 0.0f);
+                vertex[0] = position.x; vertex[1] = position.y; vertex[2] = position.z;
+                vertex[3] = normal.x; vertex[4] = normal.y; vertex[5] = normal.z;
+                vertex[6] = tex.x; vertex[7] = tex.y;
+                if (this -> indexed) {
+                    // the vertex just written is dropped again if an identical one exists
+                    uint32_t found = vertex_lookup.insert(out, vertex_count);
+                    if (found == vertex_count) vertex_count++;
+                    tmp_ibo.push_back(found);
                 } else {
-                    push_vec2(glm::vec2(0.0f, 0.0f), tmp_vbo);
+                    vertex_count++;
                 }
             }
         }
     }
-    // copy to vbo
-    this -> vbo_size = tmp_vbo.size() * sizeof(float);
-    this -> vbo = new float[tmp_vbo.size()];
-    for (size_t i = 0; i < tmp_vbo.size(); i++)
-        this -> vbo[i] = tmp_vbo[i];
+    // groups without faces left at the end, unloaded placeholders of openGroups
+    for (; group_idx < group_index.size(); group_idx++) {
+        size_t offset = this -> indexed ? tmp_ibo.size() : vertex_count;
+        group_index[group_idx] = std::make_tuple(offset, std::get<1>(group_index[group_idx]), std::get<2>(group_index[group_idx]));
+        group_vertex_offset.push_back(vertex_count);
+    }
+    LOAD_STATS(this -> stats.triangulate_ms += elapsedMs(phase_start); phase_start = std::chrono::steady_clock::now());
+    size_t tmp_vbo_bytes = this -> indexed ? triangle_count * 3 * VBO_FLOATS_PER_VERTEX * sizeof(float) : 0;
+    this -> vbo_size = vertex_count * VBO_FLOATS_PER_VERTEX * sizeof(float);
+    if (this -> indexed) {
+        this -> vbo = new float[vertex_count * VBO_FLOATS_PER_VERTEX];
+        memcpy(this -> vbo, out, this -> vbo_size);
+        delete[] out;
+        this -> packIndices(tmp_ibo);
+    } else {
+        this -> vbo = out;
+    }
+    LOAD_STATS(this -> stats.copy_ms = elapsedMs(phase_start));
+    return tmp_vbo_bytes;
+}
+
+bool objLoader::openGroups(const std::string& filename) {
+    this -> stats = load_stats();
+    LOAD_STATS(auto load_start = std::chrono::steady_clock::now());
+    mapped_file file;
+    mesh_cache_source source;
+    if (!file.open(filename) || !statMeshSource(filename, source)) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return false;
+    }
+    this -> resetModel();
+    std::string index_path = this -> cachePath(filename, ".objindex");
+    if (!readObjIndex(index_path, source, this -> lazy_index)) {
+        scanObjIndex(file.data(), file.size(), this -> lazy_index, &this -> getPool());
+        this -> lazy_index.source = source;
+        writeObjIndex(index_path, this -> lazy_index);
+    }
+    this -> lazy_filename = filename;
+    // every library is read once, material_lib ends up holding the last one as after load
+    std::vector<std::map<std::string, material>> libraries;
+    for (const std::string &library : this -> lazy_index.libraries) {
+        this -> loadMaterialLibrary(filename, library);
+        libraries.push_back(this -> material_lib.materials);
+    }
+    for (const obj_group_span &span : this -> lazy_index.groups) {
+        material mat;
+        // groups before any usemtl keep the default material
+        if (!span.material.empty()) {
+            if (span.library >= 0 && libraries[span.library].count(span.material)) mat = libraries[span.library][span.material];
+            else std::cerr << "Material not found: " << span.material << std::endl;
+        }
+        this -> group_index.push_back(std::make_tuple(0, span.name, mat));
+    }
+    this -> lazy_faces.assign(this -> group_index.size(), face_list());
+    this -> group_loaded.assign(this -> group_index.size(), 0);
+    this -> rebuildLazyGroups();
+    this -> finishProgress();
+    LOAD_STATS(this -> collectLoadStats(0, 0); this -> stats.total_ms = elapsedMs(load_start));
+    return true;
+}
+
+bool objLoader::loadGroups(const std::vector<size_t>& groups) {
+    // a model read by load has all of its groups
+    if (this -> lazy_filename.empty()) return true;
+    std::vector<size_t> wanted;
+    for (size_t group : groups) {
+        if (group < this -> group_loaded.size() && !this -> group_loaded[group]) wanted.push_back(group);
+    }
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+    if (wanted.empty()) return true;
+    mapped_file file;
+    mesh_cache_source source;
+    if (!file.open(this -> lazy_filename) || !statMeshSource(this -> lazy_filename, source)) {
+        std::cerr << "Cannot open file: " << this -> lazy_filename << std::endl;
+        return false;
+    }
+    // the byte ranges only fit the file the index was built from
+    if (source.size != this -> lazy_index.source.size || source.mtime_ns != this -> lazy_index.source.mtime_ns) {
+        std::cerr << "Group index out of date: " << this -> lazy_filename << std::endl;
+        return false;
+    }
+    std::vector<obj_chunk> chunks(wanted.size());
+    std::atomic<size_t> parsed_bytes(0);
+    this -> getPool().parallel_for(wanted.size(), [&](size_t i) {
+        const obj_group_span &span = this -> lazy_index.groups[wanted[i]];
+        obj_chunk &chunk = chunks[i];
+        parseChunk(file.data() + span.begin, file.data() + span.end, chunk, parsed_bytes);
+        // relative indices count back from the records before the span plus the ones in it
+        const int offsets[3] = {(int)span.vertices, (int)span.texcoords, (int)span.normals};
+        for (auto &fixup : chunk.relative) {
+            std::vector<int> &component = fixup.second == 0 ? chunk.faces.v : (fixup.second == 1 ? chunk.faces.vt : chunk.faces.vn);
+            component[fixup.first] += offsets[fixup.second];
+        }
+    });
+    // fetch the records the new groups use that are not held yet, each file record is held once so
+    // smooth normals weld the same positions as after load
+    const uint32_t not_held = UINT32_MAX, needed = UINT32_MAX - 1;
+    for (int kind = 0; kind < 3; kind++) {
+        auto component = [&](obj_chunk &chunk) -> std::vector<int>& { return kind == 0 ? chunk.faces.v : (kind == 1 ? chunk.faces.vt : chunk.faces.vn); };
+        int lo = INT_MAX, hi = -1;
+        for (obj_chunk &chunk : chunks) {
+            for (int id : component(chunk)) {
+                if (id < 0) continue;
+                lo = std::min(lo, id);
+                hi = std::max(hi, id);
+            }
+        }
+        if (hi < 0) continue;
+        // where each file record in the range the groups use is held, a table instead of sorting every corner
+        std::vector<uint32_t> local(hi - lo + 1, not_held);
+        for (obj_chunk &chunk : chunks) {
+            for (int id : component(chunk)) if (id >= 0) local[id - lo] = needed;
+        }
+        std::vector<uint32_t> &held_ids = this -> lazy_ids[kind], &held_local = this -> lazy_local[kind];
+        size_t first_held = std::lower_bound(held_ids.begin(), held_ids.end(), (uint32_t)lo) - held_ids.begin();
+        for (size_t i = first_held; i < held_ids.size() && held_ids[i] <= (uint32_t)hi; i++) local[held_ids[i] - lo] = held_local[i];
+        std::vector<uint32_t> missing;
+        for (size_t i = 0; i < local.size(); i++) if (local[i] == needed) missing.push_back(lo + i);
+        int components = kind == 1 ? 2 : 3;
+        std::vector<float> values(missing.size() * components);
+        readObjRecords(file.data(), file.size(), this -> lazy_index, (obj_record_kind)kind, missing, values.data());
+        size_t held = kind == 0 ? this -> vertices.size() : (kind == 1 ? this -> texcoord.size() : this -> normals.size());
+        for (size_t i = 0; i < missing.size(); i++) {
+            const float *value = values.data() + i * components;
+            if (kind == 0) this -> vertices.push_back(glm::vec3(value[0], value[1], value[2]));
+            else if (kind == 1) this -> texcoord.push_back(glm::vec2(value[0], value[1]));
+            else this -> normals.push_back(glm::vec3(value[0], value[1], value[2]));
+            local[missing[i] - lo] = held + i;
+        }
+        // merge the new records into the sorted file indices
+        std::vector<uint32_t> merged_ids, merged_local;
+        merged_ids.reserve(held_ids.size() + missing.size());
+        merged_local.reserve(held_ids.size() + missing.size());
+        size_t a = 0, b = 0;
+        while (a < held_ids.size() || b < missing.size()) {
+            if (b == missing.size() || (a < held_ids.size() && held_ids[a] < missing[b])) {
+                merged_ids.push_back(held_ids[a]);
+                merged_local.push_back(held_local[a++]);
+            } else {
+                merged_ids.push_back(missing[b]);
+                merged_local.push_back(held + b++);
+            }
+        }
+        held_ids.swap(merged_ids);
+        held_local.swap(merged_local);
+        this -> getPool().parallel_for(chunks.size(), [&](size_t i) {
+            for (int &id : component(chunks[i])) if (id >= 0) id = local[id - lo];
+        });
+    }
+    for (size_t i = 0; i < wanted.size(); i++) {
+        this -> lazy_faces[wanted[i]].swap(chunks[i].faces);
+        this -> group_loaded[wanted[i]] = 1;
+    }
+    this -> rebuildLazyGroups();
     return true;
 }
 
-const float* objLoader::getVBO() {
+void objLoader::rebuildLazyGroups() {
+    // faces of the loaded groups in group order, placeholders get an empty face range
+    this -> faces.clear();
+    for (size_t i = 0; i < this -> group_index.size(); i++) {
+        const face_list &group = this -> lazy_faces[i];
+        uint32_t base = this -> faces.v.size();
+        this -> group_index[i] = std::make_tuple((int)this -> faces.size(), std::get<1>(this -> group_index[i]), std::get<2>(this -> group_index[i]));
+        for (size_t f = 1; f < group.first.size(); f++) this -> faces.first.push_back(group.first[f] + base);
+        this -> faces.v.insert(this -> faces.v.end(), group.v.begin(), group.v.end());
+        this -> faces.vt.insert(this -> faces.vt.end(), group.vt.begin(), group.vt.end());
+        this -> faces.vn.insert(this -> faces.vn.end(), group.vn.begin(), group.vn.end());
+    }
+    this -> releaseVBO();
+    this -> packed_dirty = true;
+    this -> tangents_dirty = true;
+    this -> stale_groups.clear();
+    this -> dirty_ranges.clear();
+    this -> group_vertex_offset.clear();
+    this -> group_lods.clear();
+    this -> lod_first = 0;
+    this -> ibo16.clear();
+    this -> ibo32.clear();
+    this -> buildBuffers();
+    this -> computeBounds();
+}
+
+bool objLoader::isGroupLoaded(size_t idx) const {
+    return this -> group_loaded.empty() || this -> group_loaded[idx];
+}
+
+void objLoader::setReleaseSource(bool enable) {
+    this -> release_source = enable;
+}
+
+void objLoader::setFlatNormals(bool enable) {
+    this -> flat_normals = enable;
+}
+
+void objLoader::setSmoothNormals(bool enable) {
+    this -> smooth_normals = enable;
+}
+
+void objLoader::setCreaseAngle(float degrees) {
+    this -> crease_angle = degrees;
+}
+
+const std::vector<glm::vec4>& objLoader::getTangents() {
+    if (this -> tangents_dirty) {
+        // the groups only, appended levels of detail use the same vertices
+        size_t index_count = 0;
+        for (size_t i = 0; i < this -> group_index.size(); i++) index_count = std::max(index_count, this -> getGroupRange(i).first + this -> getGroupRange(i).second);
+        std::vector<uint32_t> indices;
+        if (this -> indexed) {
+            indices = this -> unpackIndices();
+            indices.resize(index_count);
+        }
+        this -> tangents.resize(this -> getVertexCount());
+        generateTangents(this -> vbo, VBO_FLOATS_PER_VERTEX, this -> getVertexCount(), this -> indexed ? indices.data() : NULL, index_count,
+            this -> tangents.data(), &this -> getPool());
+        this -> tangents_dirty = false;
+    }
+    return this -> tangents;
+}
+
+float objLoader::getLoadProgress() const {
+    size_t bytes_total = this -> progress_bytes_total.load();
+    size_t faces_total = this -> progress_faces_total.load();
+    float parsed = bytes_total ? std::min(1.0f, (float)this -> progress_bytes.load() / bytes_total) : 0.0f;
+    float built = faces_total ? (float)this -> progress_faces.load() / faces_total : 0.0f;
+    // parsing dominates a load, building the vbo takes the rest
+    return 0.8f * parsed + 0.2f * built;
+}
+
+void objLoader::finishProgress() {
+    this -> progress_bytes = this -> progress_bytes_total.load();
+    this -> progress_faces_total = 1;
+    this -> progress_faces = 1;
+}
+
+void objLoader::swap(objLoader& other) {
+    std::swap(this -> vbo, other.vbo);
+    std::swap(this -> vbo_size, other.vbo_size);
+    this -> vertices.swap(other.vertices);
+    this -> normals.swap(other.normals);
+    this -> texcoord.swap(other.texcoord);
+    this -> faces.swap(other.faces);
+    std::swap(this -> material_lib, other.material_lib);
+    this -> material_lib_path.swap(other.material_lib_path);
+    this -> material_lib_paths.swap(other.material_lib_paths);
+    this -> material_source.swap(other.material_source);
+    std::swap(this -> textures, other.textures);
+    this -> group_index.swap(other.group_index);
+    this -> group_vertex_offset.swap(other.group_vertex_offset);
+    this -> group_lods.swap(other.group_lods);
+    std::swap(this -> lod_first, other.lod_first);
+    this -> group_bounds.swap(other.group_bounds);
+    this -> clusters.swap(other.clusters);
+    this -> group_cluster_first.swap(other.group_cluster_first);
+    this -> group_transforms.swap(other.group_transforms);
+    this -> group_normal_matrices.swap(other.group_normal_matrices);
+    std::swap(this -> indexed, other.indexed);
+    std::swap(this -> index_size, other.index_size);
+    this -> ibo16.swap(other.ibo16);
+    this -> ibo32.swap(other.ibo32);
+    std::swap(this -> has_normal, other.has_normal);
+    std::swap(this -> has_texcoord, other.has_texcoord);
+    std::swap(this -> flat_normals, other.flat_normals);
+    std::swap(this -> smooth_normals, other.smooth_normals);
+    std::swap(this -> crease_angle, other.crease_angle);
+    this -> tangents.swap(other.tangents);
+    std::swap(this -> tangents_dirty, other.tangents_dirty);
+    std::swap(this -> requested_format, other.requested_format);
+    this -> packed_vbo.swap(other.packed_vbo);
+    this -> group_dequant.swap(other.group_dequant);
+    std::swap(this -> packed_dirty, other.packed_dirty);
+    this -> stale_groups.swap(other.stale_groups);
+    this -> dirty_ranges.swap(other.dirty_ranges);
+    this -> vbo_mapping.swap(other.vbo_mapping);
+    std::swap(this -> release_source, other.release_source);
+    std::swap(this -> cache_enabled, other.cache_enabled);
+    std::swap(this -> from_cache, other.from_cache);
+    this -> cache_dir.swap(other.cache_dir);
+    std::swap(this -> stats, other.stats);
+    std::swap(this -> thread_count, other.thread_count);
+    this -> pool.swap(other.pool);
+    std::swap(this -> shared_pool, other.shared_pool);
+    this -> lazy_filename.swap(other.lazy_filename);
+    std::swap(this -> lazy_index, other.lazy_index);
+    this -> lazy_faces.swap(other.lazy_faces);
+    this -> group_loaded.swap(other.group_loaded);
+    for (int k = 0; k < 3; k++) {
+        this -> lazy_ids[k].swap(other.lazy_ids[k]);
+        this -> lazy_local[k].swap(other.lazy_local[k]);
+    }
+    // progress counters describe a running load and stay with their object
+}
+
+void objLoader::copyFrom(const objLoader& other) {
+    if (&other == this) return;
+    // a vbo mapped from the cache becomes a heap copy
+    this -> releaseVBO();
+    if (other.vbo) {
+        this -> vbo = new float[other.vbo_size / sizeof(float)];
+        memcpy(this -> vbo, other.vbo, other.vbo_size);
+        this -> vbo_size = other.vbo_size;
+    }
+    this -> vertices = other.vertices;
+    this -> normals = other.normals;
+    this -> texcoord = other.texcoord;
+    this -> faces = other.faces;
+    this -> material_lib = other.material_lib;
+    this -> material_lib_path = other.material_lib_path;
+    this -> material_lib_paths = other.material_lib_paths;
+    this -> group_index = other.group_index;
+    this -> group_vertex_offset = other.group_vertex_offset;
+    this -> group_lods = other.group_lods;
+    this -> lod_first = other.lod_first;
+    this -> group_bounds = other.group_bounds;
+    this -> clusters = other.clusters;
+    this -> group_cluster_first = other.group_cluster_first;
+    this -> group_transforms = other.group_transforms;
+    this -> group_normal_matrices = other.group_normal_matrices;
+    this -> indexed = other.indexed;
+    this -> index_size = other.index_size;
+    this -> ibo16 = other.ibo16;
+    this -> ibo32 = other.ibo32;
+    this -> has_normal = other.has_normal;
+    this -> has_texcoord = other.has_texcoord;
+    this -> flat_normals = other.flat_normals;
+    this -> smooth_normals = other.smooth_normals;
+    this -> crease_angle = other.crease_angle;
+    this -> tangents = other.tangents;
+    this -> tangents_dirty = other.tangents_dirty;
+    this -> requested_format = other.requested_format;
+    this -> packed_vbo = other.packed_vbo;
+    this -> group_dequant = other.group_dequant;
+    this -> packed_dirty = other.packed_dirty;
+    this -> stale_groups = other.stale_groups;
+    this -> dirty_ranges = other.dirty_ranges;
+    this -> release_source = other.release_source;
+    this -> cache_enabled = other.cache_enabled;
+    this -> from_cache = other.from_cache;
+    this -> cache_dir = other.cache_dir;
+    this -> stats = other.stats;
+    this -> lazy_filename = other.lazy_filename;
+    this -> lazy_index = other.lazy_index;
+    this -> lazy_faces = other.lazy_faces;
+    this -> group_loaded = other.group_loaded;
+    for (int k = 0; k < 3; k++) {
+        this -> lazy_ids[k] = other.lazy_ids[k];
+        this -> lazy_local[k] = other.lazy_local[k];
+    }
+}
+
+size_t objLoader::getMemoryUsage() const {
+    size_t bytes = this -> vbo_size + this -> packed_vbo.capacity() +
+        this -> ibo16.capacity() * sizeof(uint16_t) + this -> ibo32.capacity() * sizeof(uint32_t);
+    bytes += this -> vertices.capacity() * sizeof(glm::vec3) + this -> normals.capacity() * sizeof(glm::vec3) +
+        this -> texcoord.capacity() * sizeof(glm::vec2) + this -> tangents.capacity() * sizeof(glm::vec4);
+    bytes += this -> faces.first.capacity() * sizeof(uint32_t) +
+        (this -> faces.v.capacity() + this -> faces.vt.capacity() + this -> faces.vn.capacity()) * sizeof(int);
+    bytes += this -> group_bounds.capacity() * sizeof(mesh_bounds) + this -> clusters.capacity() * sizeof(group_cluster);
+    bytes += this -> group_transforms.capacity() * sizeof(glm::mat4) + this -> group_normal_matrices.capacity() * sizeof(glm::mat3);
+    for (const face_list &group : this -> lazy_faces) {
+        bytes += group.first.capacity() * sizeof(uint32_t) + (group.v.capacity() + group.vt.capacity() + group.vn.capacity()) * sizeof(int);
+    }
+    for (int k = 0; k < 3; k++) bytes += (this -> lazy_ids[k].capacity() + this -> lazy_local[k].capacity()) * sizeof(uint32_t);
+    return bytes;
+}
+
+const load_stats& objLoader::getLoadStats() const {
+    return this -> stats;
+}
+
+void objLoader::collectLoadStats(size_t bytes_read, size_t tmp_vbo_bytes) {
+    this -> stats.bytes_read = bytes_read;
+    this -> stats.vertices = this -> getVertexCount();
+    this -> stats.indices = this -> indexed ? this -> getIndexCount() : 0;
+    this -> stats.triangles = (this -> indexed ? this -> getIndexCount() : this -> getVertexCount()) / 3;
+    this -> stats.positions_bytes = this -> vertices.capacity() * sizeof(glm::vec3);
+    this -> stats.normals_bytes = this -> normals.capacity() * sizeof(glm::vec3);
+    this -> stats.texcoords_bytes = this -> texcoord.capacity() * sizeof(glm::vec2);
+    this -> stats.faces_bytes = this -> faces.first.capacity() * sizeof(uint32_t) +
+        (this -> faces.v.capacity() + this -> faces.vt.capacity() + this -> faces.vn.capacity()) * sizeof(int);
+    this -> stats.tmp_vbo_bytes = tmp_vbo_bytes;
+    this -> stats.vbo_bytes = this -> vbo_mapping.isOpen() ? 0 : this -> vbo_size;
+    this -> stats.ibo_bytes = this -> ibo16.capacity() * sizeof(uint16_t) + this -> ibo32.capacity() * sizeof(uint32_t);
+}
+
+void objLoader::setIndexed(bool enable) {
+    this -> indexed = enable;
+}
+
+bool objLoader::isIndexed() const {
+    return this -> indexed;
+}
+
+void objLoader::packIndices(const std::vector<uint32_t>& indices) {
+    this -> ibo16.clear();
+    this -> ibo32.clear();
+    // 16 bit indices are enough when every vertex fits
+    if (this -> getVertexCount() <= 65536) {
+        this -> index_size = sizeof(uint16_t);
+        this -> ibo16.assign(indices.begin(), indices.end());
+    } else {
+        this -> index_size = sizeof(uint32_t);
+        this -> ibo32 = indices;
+    }
+}
+
+bool objLoader::optimizeMesh(bool reduce_overdraw, vertex_cache_stats& before, vertex_cache_stats& after) {
+    if (!this -> indexed) return false;
+    this -> clearLODs();
+    this -> clearClusters();
+    std::vector<uint32_t> indices = this -> unpackIndices();
+    size_t group_count = this -> group_index.size();
+    std::vector<vertex_cache_stats> group_before(group_count), group_after(group_count);
+    // groups own disjoint index and vertex ranges, so they are optimized independently
+    this -> getPool().parallel_for(group_count, [&](size_t i) {
+        auto range = this -> getGroupRange(i);
+        auto vertex_range = this -> getGroupVertexRange(i);
+        uint32_t *group = indices.data() + range.first;
+        float *group_vertices = this -> vbo + vertex_range.first * VBO_FLOATS_PER_VERTEX;
+        for (size_t j = 0; j < range.second; j++) group[j] -= vertex_range.first;
+        group_before[i] = analyzeVertexCache(group, range.second, vertex_range.second);
+        optimizeVertexCache(group, range.second, vertex_range.second);
+        if (reduce_overdraw) optimizeOverdraw(group, range.second, group_vertices, VBO_FLOATS_PER_VERTEX, vertex_range.second);
+        optimizeVertexFetch(group, range.second, group_vertices, VBO_FLOATS_PER_VERTEX, vertex_range.second);
+        group_after[i] = analyzeVertexCache(group, range.second, vertex_range.second);
+        for (size_t j = 0; j < range.second; j++) group[j] += vertex_range.first;
+    });
+    before = sumVertexCacheStats(group_before.data(), group_count);
+    after = sumVertexCacheStats(group_after.data(), group_count);
+    this -> packIndices(indices);
+    this -> packed_dirty = true;
+    this -> tangents_dirty = true;
+    this -> addDirtyRange(0, this -> getVertexCount());
+    return true;
+}
+
+bool objLoader::generateLODs(const std::vector<float>& ratios) {
+    if (!this -> indexed) return false;
+    this -> clearLODs();
+    size_t vertex_count = this -> getVertexCount();
+    size_t group_count = this -> group_index.size();
+    // positions shared with another group stay in place, so neighbouring groups keep meeting without cracks
+    std::vector<unsigned char> locked(vertex_count, 0);
+    std::vector<uint32_t> vertex_group(vertex_count), order(vertex_count);
+    for (size_t i = 0; i < group_count; i++) {
+        auto range = this -> getGroupVertexRange(i);
+        std::fill(vertex_group.begin() + range.first, vertex_group.begin() + range.first + range.second, i);
+    }
+    for (size_t v = 0; v < vertex_count; v++) order[v] = v;
+    const float *vbo = this -> vbo;
+    std::sort(order.begin(), order.end(), [vbo](uint32_t a, uint32_t b) {
+        return memcmp(vbo + (size_t)a * VBO_FLOATS_PER_VERTEX, vbo + (size_t)b * VBO_FLOATS_PER_VERTEX, 3 * sizeof(float)) < 0;
+    });
+    for (size_t i = 0; i < vertex_count;) {
+        size_t j = i + 1;
+        bool shared = false;
+        while (j < vertex_count && memcmp(vbo + (size_t)order[i] * VBO_FLOATS_PER_VERTEX, vbo + (size_t)order[j] * VBO_FLOATS_PER_VERTEX, 3 * sizeof(float)) == 0) {
+            shared = shared || vertex_group[order[j]] != vertex_group[order[i]];
+            j++;
+        }
+        if (shared) for (size_t k = i; k < j; k++) locked[order[k]] = 1;
+        i = j;
+    }
+
+    std::vector<uint32_t> indices = this -> unpackIndices();
+    // levels of every group with group relative first indices, appended in group order afterwards
+    std::vector<std::vector<uint32_t>> level_indices(group_count);
+    std::vector<std::vector<group_lod>> lods(group_count);
+    this -> getPool().parallel_for(group_count, [&](size_t i) {
+        auto range = this -> getGroupRange(i);
+        auto vertex_range = this -> getGroupVertexRange(i);
+        const float *group_vertices = this -> vbo + vertex_range.first * VBO_FLOATS_PER_VERTEX;
+        std::vector<uint32_t> source(indices.begin() + range.first, indices.begin() + range.first + range.second);
+        for (uint32_t &index : source) index -= vertex_range.first;
+        std::vector<uint32_t> level(source.size());
+        lods[i].push_back(group_lod{range.first, range.second, 0.0f});
+        for (float ratio : ratios) {
+            size_t target = (size_t)(range.second / 3 * ratio) * 3;
+            if (target >= source.size()) continue;
+            float error = 0.0f;
+            size_t count = simplifyMesh(level.data(), source.data(), source.size(), group_vertices, VBO_FLOATS_PER_VERTEX, vertex_range.second,
+                target, locked.data() + vertex_range.first, &error);
+            // locked borders and seams can stop the collapses, a level equal to the last one is not kept
+            if (count == source.size()) break;
+            // the errors of the levels in between add up at most
+            lods[i].push_back(group_lod{level_indices[i].size(), count, error + lods[i].back().error});
+            for (size_t j = 0; j < count; j++) level_indices[i].push_back(level[j] + vertex_range.first);
+            source.assign(level.begin(), level.begin() + count);
+        }
+    });
+    this -> lod_first = indices.size();
+    for (size_t i = 0; i < group_count; i++) {
+        for (size_t level = 1; level < lods[i].size(); level++) lods[i][level].first += indices.size();
+        indices.insert(indices.end(), level_indices[i].begin(), level_indices[i].end());
+    }
+    this -> group_lods.swap(lods);
+    this -> packIndices(indices);
+    return true;
+}
+
+void objLoader::clearLODs() {
+    if (this -> lod_first > 0) {
+        if (this -> index_size == sizeof(uint16_t)) this -> ibo16.resize(this -> lod_first);
+        else this -> ibo32.resize(this -> lod_first);
+    }
+    this -> lod_first = 0;
+    // until generateLODs runs every group has only itself, kept up to date so a const model has its levels
+    this -> group_lods.assign(this -> group_index.size(), std::vector<group_lod>());
+    for (size_t i = 0; i < this -> group_index.size(); i++) {
+        auto range = this -> getGroupRange(i);
+        this -> group_lods[i].push_back(group_lod{range.first, range.second, 0.0f});
+    }
+}
+
+const std::vector<group_lod>& objLoader::getGroupLODs(size_t idx) const {
+    return this -> group_lods[idx];
+}
+
+const mesh_bounds& objLoader::getGroupBounds(size_t idx) const {
+    return this -> group_bounds[idx];
+}
+
+const std::vector<group_cluster>& objLoader::getClusters() const {
+    return this -> clusters;
+}
+
+std::pair<size_t, size_t> objLoader::getGroupClusters(size_t idx) const {
+    if (this -> clusters.empty()) return std::make_pair(0, 0);
+    return std::make_pair(this -> group_cluster_first[idx], this -> group_cluster_first[idx + 1] - this -> group_cluster_first[idx]);
+}
+
+bool objLoader::buildClusters(size_t max_triangles) {
+    if (!this -> indexed || max_triangles == 0) return false;
+    std::vector<uint32_t> indices = this -> unpackIndices();
+    size_t group_count = this -> group_index.size();
+    size_t cluster_size = max_triangles * 3;
+    this -> group_cluster_first.assign(group_count + 1, 0);
+    for (size_t i = 0; i < group_count; i++) {
+        size_t count = this -> getGroupRange(i).second;
+        this -> group_cluster_first[i + 1] = this -> group_cluster_first[i] + (count + cluster_size - 1) / cluster_size;
+    }
+    this -> clusters.assign(this -> group_cluster_first[group_count], group_cluster());
+    this -> getPool().parallel_for(group_count, [&](size_t i) {
+        auto range = this -> getGroupRange(i);
+        sortClusters(indices.data() + range.first, range.second, this -> vbo, VBO_FLOATS_PER_VERTEX, max_triangles);
+        for (size_t c = this -> group_cluster_first[i]; c < this -> group_cluster_first[i + 1]; c++) {
+            group_cluster &cluster = this -> clusters[c];
+            cluster.group = i;
+            cluster.first = range.first + (c - this -> group_cluster_first[i]) * cluster_size;
+            cluster.count = std::min(cluster_size, range.first + range.second - cluster.first);
+            cluster.bounds = computeTriangleBounds(indices.data() + cluster.first, cluster.count, this -> vbo, VBO_FLOATS_PER_VERTEX);
+            cluster.cone = computeNormalCone(indices.data() + cluster.first, cluster.count, this -> vbo, VBO_FLOATS_PER_VERTEX);
+        }
+    });
+    this -> packIndices(indices);
+    return true;
+}
+
+void objLoader::clearClusters() {
+    this -> clusters.clear();
+    this -> group_cluster_first.clear();
+}
+
+void objLoader::computeBounds() {
+    this -> group_bounds.assign(this -> group_index.size(), mesh_bounds());
+    this -> clearClusters();
+    this -> clearLODs();
+    std::vector<size_t> groups(this -> group_index.size());
+    for (size_t i = 0; i < groups.size(); i++) groups[i] = i;
+    this -> updateBounds(groups);
+}
+
+void objLoader::updateBounds(const std::vector<size_t>& groups) {
+    this -> getPool().parallel_for(groups.size(), [&](size_t i) {
+        size_t group = groups[i];
+        auto vertex_range = this -> getGroupVertexRange(group);
+        this -> group_bounds[group] = computeVertexBounds(this -> vbo + vertex_range.first * VBO_FLOATS_PER_VERTEX, vertex_range.second, VBO_FLOATS_PER_VERTEX);
+        auto cluster_range = this -> getGroupClusters(group);
+        std::vector<uint32_t> cluster_indices;
+        for (size_t c = cluster_range.first; c < cluster_range.first + cluster_range.second; c++) {
+            group_cluster &cluster = this -> clusters[c];
+            cluster_indices.resize(cluster.count);
+            for (size_t j = 0; j < cluster.count; j++) {
+                size_t k = cluster.first + j;
+                cluster_indices[j] = this -> index_size == sizeof(uint16_t) ? this -> ibo16[k] : this -> ibo32[k];
+            }
+            cluster.bounds = computeTriangleBounds(cluster_indices.data(), cluster.count, this -> vbo, VBO_FLOATS_PER_VERTEX);
+            cluster.cone = computeNormalCone(cluster_indices.data(), cluster.count, this -> vbo, VBO_FLOATS_PER_VERTEX);
+        }
+    });
+}
+
+void objLoader::setVertexFormat(const vertex_format& format) {
+    this -> requested_format = format;
+    this -> packed_dirty = true;
+    this -> addDirtyRange(0, this -> getVertexCount());
+}
+
+vertex_format objLoader::getVertexFormat() const {
+    vertex_format format = this -> requested_format;
+    // zero texcoords are not worth uploading
+    if (!this -> has_texcoord) format.texcoord = VERTEX_NONE;
+    return format;
+}
+
+vertex_format objLoader::getRequestedFormat() const {
+    return this -> requested_format;
+}
+
+void objLoader::packVBO() {
+    vertex_format format = this -> getVertexFormat();
+    size_t stride = format.stride();
+    std::vector<size_t> groups;
+    if (this -> packed_dirty) {
+        size_t group_count = this -> group_index.size();
+        this -> packed_vbo.resize(this -> getVertexCount() * stride);
+        this -> group_dequant.assign(group_count, position_dequant());
+        for (size_t i = 0; i < group_count; i++) groups.push_back(i);
+    } else {
+        groups.swap(this -> stale_groups);
+        std::sort(groups.begin(), groups.end());
+        groups.erase(std::unique(groups.begin(), groups.end()), groups.end());
+    }
+    this -> getPool().parallel_for(groups.size(), [&](size_t i) {
+        auto range = this -> getGroupVertexRange(groups[i]);
+        const float *group_vertices = this -> vbo + range.first * VBO_FLOATS_PER_VERTEX;
+        this -> group_dequant[groups[i]] = computeDequant(group_vertices, range.second, format);
+        packVertices(group_vertices, range.second, format, this -> group_dequant[groups[i]], this -> packed_vbo.data() + range.first * stride);
+    });
+    this -> packed_dirty = false;
+    this -> stale_groups.clear();
+}
+
+const unsigned char* objLoader::getPackedVBO() {
+    if (this -> packed_dirty || !this -> stale_groups.empty()) this -> packVBO();
+    return this -> packed_vbo.data();
+}
+
+size_t objLoader::getPackedVBOSize() {
+    if (this -> packed_dirty || !this -> stale_groups.empty()) this -> packVBO();
+    return this -> packed_vbo.size();
+}
+
+const position_dequant& objLoader::getGroupDequant(size_t idx) {
+    if (this -> packed_dirty || !this -> stale_groups.empty()) this -> packVBO();
+    return this -> group_dequant[idx];
+}
+
+const unsigned char* objLoader::getPackedVBO() const {
+    return this -> packed_vbo.data();
+}
+
+size_t objLoader::getPackedVBOSize() const {
+    return this -> packed_vbo.size();
+}
+
+const position_dequant& objLoader::getGroupDequant(size_t idx) const {
+    return this -> group_dequant[idx];
+}
+
+std::vector<uint32_t> objLoader::unpackIndices() {
+    if (this -> index_size == sizeof(uint16_t))
+        return std::vector<uint32_t>(this -> ibo16.begin(), this -> ibo16.end());
+    return this -> ibo32;
+}
+
+const void* objLoader::getIBO() const {
+    if (this -> index_size == sizeof(uint16_t)) return this -> ibo16.data();
+    return this -> ibo32.data();
+}
+
+size_t objLoader::getIBOSize() const {
+    return this -> getIndexCount() * this -> index_size;
+}
+
+size_t objLoader::getIndexSize() const {
+    return this -> index_size;
+}
+
+size_t objLoader::getIndexCount() const {
+    return this -> ibo16.size() + this -> ibo32.size();
+}
+
+size_t objLoader::getVertexCount() const {
+    return this -> vbo_size / sizeof(float) / VBO_FLOATS_PER_VERTEX;
+}
+
+std::pair<size_t, size_t> objLoader::getGroupRange(size_t idx) const {
+    // appended levels of detail are not part of the last group
+    size_t total = this -> indexed ? (this -> lod_first > 0 ? this -> lod_first : this -> getIndexCount()) : this -> getVertexCount();
+    size_t start = std::get<0>(this -> group_index[idx]);
+    size_t end = (idx == this -> group_index.size() - 1) ? total : std::get<0>(this -> group_index[idx + 1]);
+    return std::make_pair(start, end - start);
+}
+
+std::pair<size_t, size_t> objLoader::getGroupVertexRange(size_t idx) const {
+    size_t start = this -> group_vertex_offset[idx];
+    size_t end = (idx == this -> group_vertex_offset.size() - 1) ? this -> getVertexCount() : this -> group_vertex_offset[idx + 1];
+    return std::make_pair(start, end - start);
+}
+
+const float* objLoader::getVBO() const {
     return this -> vbo;
 }
 
-size_t objLoader::getVBOSize() {
+size_t objLoader::getVBOSize() const {
     return this -> vbo_size;
 }
 
-const std::vector<std::tuple<int, std::string, material>>& objLoader::getGroupIndices() {
+const std::vector<std::tuple<int, std::string, material>>& objLoader::getGroupIndices() const {
     return this -> group_index;
 }
 
@@ -165,75 +1308,115 @@ void objLoader::applyMaterial(size_t idx, const material& mat) {
     this -> group_index[idx] = std::make_tuple(std::get<0>(this -> group_index[idx]), std::get<1>(this -> group_index[idx]), mat);
 }
 
-bool objLoader::save(const std::string& filename) {
-    // obj file
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Cannot open file: " << filename << std::endl;
-        return false;
+void objLoader::applyTransform(size_t idx, const glm::mat4& transform) {
+    this -> applyTransforms(std::vector<std::pair<size_t, glm::mat4>>(1, std::make_pair(idx, transform)));
+}
+
+void objLoader::applyTransforms(const std::vector<std::pair<size_t, glm::mat4>>& requested) {
+    // repeated groups are composed first, each group is transformed by one task set
+    std::vector<std::pair<size_t, glm::mat4>> transforms;
+    std::unordered_map<size_t, size_t> position;
+    for (auto &transform : requested) {
+        auto found = position.find(transform.first);
+        if (found == position.end()) {
+            position[transform.first] = transforms.size();
+            transforms.push_back(transform);
+        } else {
+            transforms[found -> second].second = transform.second * transforms[found -> second].second;
+        }
     }
-    // mtl file
-    size_t last_slash_pos = filename.find_last_of("/");
-    std::string mtl_filename = filename.substr(0, last_slash_pos + 1) + this -> material_lib.name + ".mtl";
-    std::ofstream mtl_file(mtl_filename);
-    if (!mtl_file.is_open()) {
-        std::cerr << "Cannot open file: " << mtl_filename << std::endl;
-        file.close();
-        return false;
+    bool moved = false;
+    for (auto &transform : transforms) {
+        auto range = this -> getGroupVertexRange(transform.first);
+        if (range.second == 0) continue;
+        moved = true;
+        this -> stale_groups.push_back(transform.first);
+        this -> addDirtyRange(range.first, range.second);
     }
-    // write vertices
-    file << "mtllib " << this -> material_lib.name << ".mtl" << std::endl;
-    for (size_t i = 0; i < this -> getVBOSize() / sizeof(float); i += 8)
-        file << "v " << vbo[i] << " " << vbo[i+1] << " " << vbo[i+2] << std::endl;
-    // write normals
-    // not implemented
-    // write texcoords
-    // not implemented
-    // write faces
-    for (size_t i = 0; i < this -> group_index.size(); i++) {
-        auto group = this -> group_index[i];
-        file << "g " << std::get<1>(group) << std::endl;
-        file << "usemtl " << std::get<1>(group)+"-material" << std::endl;
-        size_t start_index = std::get<0>(this -> group_index[i]); // count of vertex
-            size_t end_index = (i == this -> group_index.size() - 1) ? (this -> getVBOSize()) / sizeof(float) / 8 : std::get<0>(this -> group_index[i + 1]); // count of vertex
-        for (size_t j = start_index; j < end_index; j += 3) {
-            file << "f " << (j+1) << " " << (j+2) << " " << (j+3) << std::endl;
+    if (!moved) return;
+    this -> tangents_dirty = true;
+    this -> transformGroups(this -> vbo, transforms);
+    std::vector<size_t> groups;
+    for (auto &transform : transforms) groups.push_back(transform.first);
+    std::sort(groups.begin(), groups.end());
+    groups.erase(std::unique(groups.begin(), groups.end()), groups.end());
+    this -> updateBounds(groups);
+}
+
+void objLoader::transformGroups(float *target, const std::vector<std::pair<size_t, glm::mat4>>& transforms) {
+    // vertices per task, big enough that scheduling stays cheap next to the kernel
+    const size_t slice_size = 16384;
+    struct transform_slice {
+        float *first;
+        size_t count;
+        size_t transform;
+    };
+    std::vector<vertex_transform> prepared;
+    std::vector<transform_slice> slices;
+    for (size_t i = 0; i < transforms.size(); i++) {
+        prepared.push_back(makeVertexTransform(transforms[i].second));
+        auto range = this -> getGroupVertexRange(transforms[i].first);
+        for (size_t begin = 0; begin < range.second; begin += slice_size) {
+            transform_slice slice;
+            slice.first = target + (range.first + begin) * VBO_FLOATS_PER_VERTEX;
+            slice.count = std::min(slice_size, range.second - begin);
+            slice.transform = i;
+            slices.push_back(slice);
         }
     }
-    file.close();
-    // write mtl file
-    for (size_t i = 0; i < this -> group_index.size(); i++) {
-        auto group = this -> group_index[i];
-        auto name = std::get<1>(group)+"-material";
-        auto mat = std::get<2>(group);
-        mtl_file << "newmtl " << name << std::endl;
-        mtl_file << "Ka " << mat.ambient.x << " " << mat.ambient.y << " " << mat.ambient.z << std::endl;
-        mtl_file << "Kd " << mat.diffuse.x << " " << mat.diffuse.y << " " << mat.diffuse.z << std::endl;
-        mtl_file << "Ks " << mat.specular.x << " " << mat.specular.y << " " << mat.specular.z << std::endl;
-        mtl_file << "Ns " << mat.shininess << std::endl;
-        mtl_file << std::endl;
-    }
-    mtl_file.close();
-    return true;
+    this -> getPool().parallel_for(slices.size(), [&](size_t i) {
+        transformVertices(slices[i].first, slices[i].count, VBO_FLOATS_PER_VERTEX, prepared[slices[i].transform]);
+    });
 }
 
-void objLoader::applyTransform(size_t idx, const glm::mat4& transform) {
-    auto group = this -> group_index[idx];
-    size_t start_index = std::get<0>(group) * 8; // count of vertex
-    size_t end_index = (idx == this -> group_index.size() - 1) ? (this -> getVBOSize()) / sizeof(float) : (std::get<0>(this -> group_index[idx + 1]) * 8); // count of vertex
-    for (size_t i = start_index; i < end_index; i += 8) {
-        glm::vec3 vertex(vbo[i], vbo[i+1], vbo[i+2]);
-        glm::vec3 normal(vbo[i+3], vbo[i+4], vbo[i+5]);
-        glm::vec2 texcoord(vbo[i+6], vbo[i+7]);
-        vertex = transform * glm::vec4(vertex, 1.0f);
-        normal = glm::normalize(glm::transpose(glm::inverse(glm::mat3(transform))) * normal);
-        vbo[i] = vertex.x;
-        vbo[i+1] = vertex.y;
-        vbo[i+2] = vertex.z;
-        vbo[i+3] = normal.x;
-        vbo[i+4] = normal.y;
-        vbo[i+5] = normal.z;
-        vbo[i+6] = texcoord.x;
-        vbo[i+7] = texcoord.y;
+void objLoader::setGroupTransform(size_t idx, const glm::mat4& transform) {
+    if (this -> group_transforms.empty()) {
+        this -> group_transforms.assign(this -> group_index.size(), glm::mat4(1.0f));
+        this -> group_normal_matrices.assign(this -> group_index.size(), glm::mat3(1.0f));
     }
+    this -> group_transforms[idx] = transform;
+    this -> group_normal_matrices[idx] = glm::transpose(glm::inverse(glm::mat3(transform)));
+}
+
+const glm::mat4& objLoader::getGroupTransform(size_t idx) const {
+    static const glm::mat4 identity(1.0f);
+    return this -> group_transforms.empty() ? identity : this -> group_transforms[idx];
+}
+
+const glm::mat3& objLoader::getGroupNormalMatrix(size_t idx) const {
+    static const glm::mat3 identity(1.0f);
+    return this -> group_normal_matrices.empty() ? identity : this -> group_normal_matrices[idx];
+}
+
+bool objLoader::hasGroupTransforms() const {
+    for (const glm::mat4 &transform : this -> group_transforms) {
+        if (transform != glm::mat4(1.0f)) return true;
+    }
+    return false;
+}
+
+void objLoader::addDirtyRange(size_t first, size_t count) {
+    if (count == 0) return;
+    this -> dirty_ranges.push_back(std::make_pair(first, count));
+    std::sort(this -> dirty_ranges.begin(), this -> dirty_ranges.end());
+    // merge overlapping and touching spans
+    size_t merged = 0;
+    for (size_t i = 1; i < this -> dirty_ranges.size(); i++) {
+        auto &last = this -> dirty_ranges[merged];
+        auto &range = this -> dirty_ranges[i];
+        if (range.first <= last.first + last.second) {
+            last.second = std::max(last.first + last.second, range.first + range.second) - last.first;
+        } else {
+            this -> dirty_ranges[++merged] = range;
+        }
+    }
+    this -> dirty_ranges.resize(merged + 1);
+}
+
+const std::vector<std::pair<size_t, size_t>>& objLoader::getDirtyRanges() {
+    return this -> dirty_ranges;
+}
+
+void objLoader::clearDirtyRanges() {
+    this -> dirty_ranges.clear();
 }
\ No newline at end of file
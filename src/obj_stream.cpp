@@ -0,0 +1,152 @@
+#include "obj_stream.h"
+#include "mapped_file.h"
+#include "parse_util.h"
+
+// resident file pages are dropped in steps of this many bytes
+static const size_t release_interval = 64 << 20;
+
+const std::vector<std::tuple<size_t, std::string, material>>& objStream::getGroupIndices() {
+    return this -> group_index;
+}
+
+size_t objStream::getSkippedFaces() {
+    return this -> skipped_faces;
+}
+
+bool objStream::run(const std::string& filename, const std::function<bool(const obj_stream_block&)>& callback) {
+    this -> group_index.clear();
+    this -> material_lib.materials.clear();
+    this -> skipped_faces = 0;
+    mapped_file file;
+    if (!file.open(filename)) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return false;
+    }
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoord;
+    std::vector<float> block;
+    const size_t block_floats = this -> block_triangles * 3 * VBO_FLOATS_PER_VERTEX;
+    block.reserve(block_floats);
+    // resolved (v, vt, vn) of the current face
+    std::vector<int> corners;
+    std::string current_group = "default";
+    material current_material;
+    // a group is activated if it has faces
+    bool group_activated = false;
+    size_t emitted = 0;
+    bool stopped = false;
+    auto flush = [&]() {
+        if (block.empty()) return;
+        obj_stream_block out;
+        out.group = this -> group_index.size() - 1;
+        out.vertices = block.data();
+        out.vertex_count = block.size() / VBO_FLOATS_PER_VERTEX;
+        emitted += out.vertex_count;
+        if (!callback(out)) stopped = true;
+        block.clear();
+    };
+    const char *data = file.data();
+    const char *cur = data;
+    const char *file_end = data + file.size();
+    size_t released = 0;
+    while (cur < file_end && !stopped) {
+        const char *line = cur;
+        const char *line_end = find_line_end(line, file_end);
+        cur = (line_end == file_end) ? file_end : line_end + 1;
+        if ((size_t)(line - data) - released >= release_interval) {
+            released = line - data;
+            file.releaseBefore(released);
+        }
+        if (line == line_end || line[0] == '#' || line[0] == ' ') continue;
+        const char *prefix = skip_space(line, line_end);
+        const char *args = skip_token(prefix, line_end);
+        if (token_is(prefix, args, "v")) {
+            glm::vec3 vertex(0.0f);
+            parse_floats(args, line_end, &vertex.x, 3);
+            vertices.push_back(vertex);
+        } else if (token_is(prefix, args, "vn")) {
+            glm::vec3 norm(0.0f);
+            parse_floats(args, line_end, &norm.x, 3);
+            normals.push_back(norm);
+        } else if (token_is(prefix, args, "vt")) {
+            glm::vec2 tex(0.0f);
+            parse_floats(args, line_end, &tex.x, 2);
+            texcoord.push_back(tex);
+        } else if (token_is(prefix, args, "f")) {
+            const int counts[3] = {(int)vertices.size(), (int)texcoord.size(), (int)normals.size()};
+            bool valid = true;
+            bool face_normal = true;
+            bool face_texcoord = true;
+            corners.clear();
+            const char *corner = skip_space(args, line_end);
+            while (corner < line_end) {
+                const char *corner_end = skip_token(corner, line_end);
+                int raw[3];
+                parse_face_corner(corner, corner_end, raw);
+                for (int k = 0; k < 3; k++) {
+                    int idx = raw[k] > 0 ? raw[k] - 1 : (raw[k] < 0 ? counts[k] + raw[k] : -1);
+                    if (idx >= counts[k] || (k == 0 && idx < 0) || idx < -1) valid = false;
+                    corners.push_back(idx);
+                }
+                face_texcoord = face_texcoord && corners[corners.size() - 2] >= 0;
+                face_normal = face_normal && corners[corners.size() - 1] >= 0;
+                corner = skip_space(corner_end, line_end);
+            }
+            if (corners.empty()) continue;
+            if (!valid) {
+                this -> skipped_faces++;
+                continue;
+            }
+            if (!group_activated) {
+                // blocks never span groups
+                flush();
+                if (stopped) break;
+                group_activated = true;
+                this -> group_index.push_back(std::make_tuple(emitted, current_group, current_material));
+            }
+            size_t corner_count = corners.size() / 3;
+            for (size_t i = 1; i + 1 < corner_count; i++) {
+                const int *tri[3] = {&corners[0], &corners[i * 3], &corners[(i + 1) * 3]};
+                glm::vec3 default_normal(0.0f);
+                if (!face_normal) {
+                    default_normal = glm::normalize(glm::cross(
+                        vertices[tri[1][0]] - vertices[tri[0][0]],
+                        vertices[tri[2][0]] - vertices[tri[1][0]]
+                    ));
+                }
+                for (int j = 0; j < 3; j++) {
+                    const glm::vec3 &pos = vertices[tri[j][0]];
+                    const glm::vec3 &norm = face_normal ? normals[tri[j][2]] : default_normal;
+                    glm::vec2 tex = face_texcoord ? texcoord[tri[j][1]] : glm::vec2(0.0f, 0.0f);
+                    const float vertex[VBO_FLOATS_PER_VERTEX] = {pos.x, pos.y, pos.z, norm.x, norm.y, norm.z, tex.x, tex.y};
+                    block.insert(block.end(), vertex, vertex + VBO_FLOATS_PER_VERTEX);
+                }
+                if (block.size() >= block_floats) flush();
+            }
+        } else if (token_is(prefix, args, "mtllib")) {
+            const char *name = skip_space(args, line_end);
+            // construct mtl file path
+            size_t last_slash_pos = filename.find_last_of("/");
+            std::string mtl_path = filename.substr(0, last_slash_pos + 1) + std::string(name, skip_token(name, line_end));
+            std::cout << "Loading material library: " << mtl_path << std::endl;
+            this -> material_lib.load(mtl_path);
+        } else if (token_is(prefix, args, "usemtl")) {
+            const char *name = skip_space(args, line_end);
+            std::string material_name(name, skip_token(name, line_end));
+            if ((this -> material_lib.materials).find(material_name) == (this -> material_lib.materials).end()) {
+                std::cerr << "Material not found: " << material_name << std::endl;
+                current_material = material();
+            } else {
+                current_material = this -> material_lib.materials[material_name];
+            }
+        } else if (token_is(prefix, args, "g")) {
+            const char *name = skip_space(args, line_end);
+            // an unnamed group keeps the current name
+            if (name < line_end) current_group.assign(name, skip_token(name, line_end));
+            group_activated = false;
+        }
+    }
+    if (!stopped) flush();
+    return true;
+}
@@ -0,0 +1,182 @@
+#include "obj_loader.h"
+#include "format_util.h"
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdio>
+
+// fnv-1a over the bit patterns of n floats, so -0 and 0 stay apart and nan is harmless,
+// mixed at the end because the table masks off the low bits
+static uint64_t hashAttribute(const float *value, int n) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (int i = 0; i < n; i++) {
+        uint32_t bits;
+        memcpy(&bits, value + i, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// number the distinct values of an n float attribute in order of first use,
+// index maps each vertex to its number and first_use each number to a vertex
+static void dedupAttribute(const float *vbo, size_t vertex_count, size_t offset, int n, std::vector<uint32_t> &index, std::vector<uint32_t> &first_use) {
+    // open addressing table of numbers, sized for every value being distinct so it never grows
+    const uint32_t empty = 0xffffffffu;
+    struct slot_entry {
+        uint32_t hash;
+        uint32_t number;
+    };
+    size_t size = 16;
+    while (size < vertex_count * 2) size <<= 1;
+    std::vector<slot_entry> slots(size, slot_entry{0, empty});
+    size_t mask = size - 1;
+    index.resize(vertex_count);
+    first_use.clear();
+    for (size_t i = 0; i < vertex_count; i++) {
+        const float *value = vbo + i * VBO_FLOATS_PER_VERTEX + offset;
+        uint64_t hash = hashAttribute(value, n);
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            slot_entry &entry = slots[slot];
+            if (entry.number == empty) {
+                entry.hash = (uint32_t)hash;
+                entry.number = (uint32_t)first_use.size();
+                first_use.push_back((uint32_t)i);
+                index[i] = entry.number;
+                break;
+            }
+            if (entry.hash == (uint32_t)hash &&
+                memcmp(vbo + (size_t)first_use[entry.number] * VBO_FLOATS_PER_VERTEX + offset, value, n * sizeof(float)) == 0) {
+                index[i] = entry.number;
+                break;
+            }
+        }
+    }
+}
+
+// format count lines in parallel blocks and write them in file order,
+// only a few blocks per thread are held in memory at a time
+static bool writeLines(FILE *file, size_t count, thread_pool &pool, const std::function<void(std::string&, size_t)> &line) {
+    const size_t block_lines = 16384;
+    size_t block_count = (count + block_lines - 1) / block_lines;
+    size_t wave = std::max<size_t>(1, pool.size()) * 2;
+    std::vector<std::string> blocks(wave);
+    for (size_t first = 0; first < block_count; first += wave) {
+        size_t n = std::min(wave, block_count - first);
+        pool.parallel_for(n, [&](size_t i) {
+            std::string &out = blocks[i];
+            out.clear();
+            size_t begin = (first + i) * block_lines;
+            size_t end = std::min(count, begin + block_lines);
+            for (size_t k = begin; k < end; k++) line(out, k);
+        });
+        for (size_t i = 0; i < n; i++)
+            if (fwrite(blocks[i].data(), 1, blocks[i].size(), file) != blocks[i].size()) return false;
+    }
+    return true;
+}
+
+bool objLoader::save(const std::string& filename) {
+    // placeholders of openGroups have no faces, writing them would drop their geometry
+    for (size_t i = 0; i < this -> group_index.size(); i++) {
+        if (!this -> isGroupLoaded(i)) {
+            std::cerr << "Cannot save a model with unloaded groups: " << filename << std::endl;
+            return false;
+        }
+    }
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return false;
+    }
+    std::vector<char> file_buffer(1 << 20);
+    setvbuf(file, file_buffer.data(), _IOFBF, file_buffer.size());
+    thread_pool &pool = this -> getPool();
+    size_t vertex_count = this -> getVertexCount();
+    // bake the group transforms into a copy, the model keeps its vertices and transforms
+    const float *vbo = this -> vbo;
+    std::vector<float> baked;
+    if (this -> hasGroupTransforms()) {
+        baked.assign(this -> vbo, this -> vbo + vertex_count * VBO_FLOATS_PER_VERTEX);
+        std::vector<std::pair<size_t, glm::mat4>> transforms;
+        for (size_t i = 0; i < this -> group_transforms.size(); i++) {
+            if (this -> group_transforms[i] != glm::mat4(1.0f)) transforms.push_back(std::make_pair(i, this -> group_transforms[i]));
+        }
+        this -> transformGroups(baked.data(), transforms);
+        vbo = baked.data();
+    }
+    // every attribute is written once, faces refer to them with v/vt/vn triplets
+    std::vector<uint32_t> position_index, normal_index, texcoord_index;
+    std::vector<uint32_t> positions, normals, texcoords;
+    bool write_normal = this -> has_normal;
+    bool write_texcoord = this -> has_texcoord;
+    pool.parallel_for(3, [&](size_t i) {
+        if (i == 0) dedupAttribute(vbo, vertex_count, 0, 3, position_index, positions);
+        if (i == 1 && write_normal) dedupAttribute(vbo, vertex_count, 3, 3, normal_index, normals);
+        if (i == 2 && write_texcoord) dedupAttribute(vbo, vertex_count, 6, 2, texcoord_index, texcoords);
+    });
+
+    // the mtl file is named after the obj, so several models can be saved to one directory
+    size_t last_slash_pos = filename.find_last_of("/");
+    std::string mtl_name = filename.substr(last_slash_pos + 1);
+    if (mtl_name.size() > 4 && mtl_name.compare(mtl_name.size() - 4, 4, ".obj") == 0) mtl_name.resize(mtl_name.size() - 4);
+    std::string header;
+    append_str(header, "mtllib ");
+    header += mtl_name;
+    append_str(header, ".mtl\n");
+    bool ok = fwrite(header.data(), 1, header.size(), file) == header.size();
+    ok = ok && writeLines(file, positions.size(), pool, [&](std::string &out, size_t i) {
+        append_floats_line(out, "v", vbo + positions[i] * VBO_FLOATS_PER_VERTEX, 3);
+    });
+    ok = ok && writeLines(file, texcoords.size(), pool, [&](std::string &out, size_t i) {
+        append_floats_line(out, "vt", vbo + texcoords[i] * VBO_FLOATS_PER_VERTEX + 6, 2);
+    });
+    ok = ok && writeLines(file, normals.size(), pool, [&](std::string &out, size_t i) {
+        append_floats_line(out, "vn", vbo + normals[i] * VBO_FLOATS_PER_VERTEX + 3, 3);
+    });
+
+    std::vector<uint32_t> indices;
+    if (this -> indexed) indices = this -> unpackIndices();
+    for (size_t i = 0; ok && i < this -> group_index.size(); i++) {
+        const std::string &name = std::get<1>(this -> group_index[i]);
+        std::string group_header;
+        append_str(group_header, "g ");
+        group_header += name;
+        append_str(group_header, "\nusemtl ");
+        group_header += name;
+        append_str(group_header, "-material\n");
+        ok = fwrite(group_header.data(), 1, group_header.size(), file) == group_header.size();
+        auto range = this -> getGroupRange(i);
+        ok = ok && writeLines(file, range.second / 3, pool, [&](std::string &out, size_t t) {
+            out.push_back('f');
+            for (size_t k = 0; k < 3; k++) {
+                size_t corner = range.first + t * 3 + k;
+                size_t vertex = this -> indexed ? indices[corner] : corner;
+                out.push_back(' ');
+                append_uint(out, position_index[vertex] + 1);
+                if (write_texcoord || write_normal) {
+                    out.push_back('/');
+                    if (write_texcoord) append_uint(out, texcoord_index[vertex] + 1);
+                }
+                if (write_normal) {
+                    out.push_back('/');
+                    append_uint(out, normal_index[vertex] + 1);
+                }
+            }
+            out.push_back('\n');
+        });
+    }
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        std::cerr << "Cannot write file: " << filename << std::endl;
+        return false;
+    }
+
+    // mtl file next to the obj, one material per group
+    mtl_file group_materials(mtl_name);
+    for (size_t i = 0; i < this -> group_index.size(); i++)
+        group_materials.append(std::get<1>(this -> group_index[i]) + "-material", std::get<2>(this -> group_index[i]));
+    return group_materials.save(filename.substr(0, last_slash_pos + 1) + mtl_name + ".mtl");
+}
@@ -0,0 +1,192 @@
+#include "texture_cache.h"
+#include "load_stats.h"
+#include <stb/stb_image.h>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define TEXTURE_CACHE_SSE2
+#include <emmintrin.h>
+#endif
+
+static std::string textureKey(const std::string &path) {
+    char resolved[PATH_MAX];
+    return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+}
+
+// output pixels first .. target_width - 1 of row y
+static void downsampleRow(const unsigned char *source, int width, int height, unsigned char *target, int y, int first) {
+    int target_width = std::max(1, width / 2);
+    const unsigned char *row0 = source + (size_t)std::min(2 * y, height - 1) * width * 4;
+    const unsigned char *row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+    unsigned char *out = target + (size_t)y * target_width * 4;
+    for (int x = first; x < target_width; x++) {
+        int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+        for (int c = 0; c < 4; c++) out[x * 4 + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+    }
+}
+
+void downsampleRGBA8Scalar(const unsigned char *source, int width, int height, unsigned char *target) {
+    int target_height = std::max(1, height / 2);
+    for (int y = 0; y < target_height; y++) downsampleRow(source, width, height, target, y, 0);
+}
+
+void downsampleRGBA8(const unsigned char *source, int width, int height, unsigned char *target) {
+#ifdef TEXTURE_CACHE_SSE2
+    int target_width = std::max(1, width / 2), target_height = std::max(1, height / 2);
+    // 4 output pixels from 8 pixels of two rows, widened to 16 bits so the sum of 4 cannot overflow
+    int simd_width = width >= 2 ? target_width / 4 * 4 : 0;
+    const __m128i zero = _mm_setzero_si128(), rounding = _mm_set1_epi16(2);
+    for (int y = 0; y < target_height; y++) {
+        const unsigned char *row0 = source + (size_t)std::min(2 * y, height - 1) * width * 4;
+        const unsigned char *row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+        unsigned char *out = target + (size_t)y * target_width * 4;
+        for (int x = 0; x < simd_width; x += 4) {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8)), a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8)), b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+            // pixels 0 1 | 2 3 | 4 5 | 6 7 of both rows summed per channel
+            __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+            // horizontal pairs: the low and high pixel of every register
+            __m128i p0 = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+            __m128i p1 = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+            p0 = _mm_srli_epi16(_mm_add_epi16(p0, rounding), 2);
+            p1 = _mm_srli_epi16(_mm_add_epi16(p1, rounding), 2);
+            _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(p0, p1));
+        }
+        downsampleRow(source, width, height, target, y, simd_width);
+    }
+#else
+    downsampleRGBA8Scalar(source, width, height, target);
+#endif
+}
+
+void generateMipmaps(texture_image &image) {
+    if (image.levels.empty()) return;
+    image.levels.resize(1);
+    // the whole chain is allocated first, it adds a third of level 0
+    size_t total = (size_t)image.levels[0].width * image.levels[0].height * 4;
+    for (int width = image.levels[0].width, height = image.levels[0].height; width > 1 || height > 1; ) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        image.levels.push_back(texture_level{width, height, total});
+        total += (size_t)width * height * 4;
+    }
+    image.pixels.resize(total);
+    for (size_t i = 1; i < image.levels.size(); i++) {
+        const texture_level &previous = image.levels[i - 1];
+        downsampleRGBA8(image.pixels.data() + previous.offset, previous.width, previous.height, image.pixels.data() + image.levels[i].offset);
+    }
+}
+
+bool decodeTexture(const std::string &path, texture_image &image) {
+    int width, height, channels;
+    unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!pixels) {
+        std::cerr << "Cannot open file: " << path << " (" << stbi_failure_reason() << ")" << std::endl;
+        return false;
+    }
+    image.path = path;
+    image.levels.assign(1, texture_level{width, height, 0});
+    image.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+    generateMipmaps(image);
+    return true;
+}
+
+texture_cache::texture_cache(size_t thread_count): stats(), pool(thread_count) {}
+
+bool texture_cache::claim(const std::string &key) {
+    if (this -> images.count(key) || this -> decoding.count(key)) return false;
+    this -> decoding.insert(key);
+    return true;
+}
+
+void texture_cache::decode(const std::string &key) {
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<texture_image> image = std::make_shared<texture_image>();
+    bool ok = decodeTexture(key, *image);
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    this -> decoding.erase(key);
+    this -> images[key] = ok ? image : nullptr;
+    this -> stats.decode_ms += elapsedMs(start);
+    if (ok) this -> stats.bytes += image -> pixels.size();
+    else this -> stats.failures++;
+    this -> decoded.notify_all();
+}
+
+void texture_cache::request(const std::string &path) {
+    if (path.empty()) return;
+    std::string key = textureKey(path);
+    {
+        std::lock_guard<std::mutex> lock(this -> mutex);
+        if (!this -> claim(key)) {
+            this -> stats.hits++;
+            return;
+        }
+        this -> stats.misses++;
+    }
+    this -> pool.submit([this, key]() { this -> decode(key); });
+}
+
+texture_handle texture_cache::get(const std::string &path) {
+    if (path.empty()) return nullptr;
+    std::string key = textureKey(path);
+    {
+        std::unique_lock<std::mutex> lock(this -> mutex);
+        bool decode_here = this -> claim(key);
+        if (!decode_here) {
+            // cached or on the pool, the request counted the miss
+            this -> decoded.wait(lock, [&] { return this -> decoding.count(key) == 0; });
+            auto found = this -> images.find(key);
+            if (found != this -> images.end()) {
+                this -> stats.hits++;
+                return found -> second;
+            }
+            // cleared while decoding
+            if (!this -> claim(key)) return nullptr;
+        }
+        this -> stats.misses++;
+    }
+    this -> decode(key);
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    auto found = this -> images.find(key);
+    return found != this -> images.end() ? found -> second : nullptr;
+}
+
+void texture_cache::wait() {
+    std::unique_lock<std::mutex> lock(this -> mutex);
+    this -> decoded.wait(lock, [this] { return this -> decoding.empty(); });
+}
+
+void texture_cache::clearUnused() {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    for (auto entry = this -> images.begin(); entry != this -> images.end(); ) {
+        // the map holds the only reference, failures are tried again
+        if (entry -> second.use_count() <= 1) {
+            if (entry -> second) this -> stats.bytes -= entry -> second -> pixels.size();
+            entry = this -> images.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
+}
+
+void texture_cache::clear() {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    this -> images.clear();
+    this -> stats.bytes = 0;
+}
+
+texture_stats texture_cache::getStats() {
+    std::lock_guard<std::mutex> lock(this -> mutex);
+    texture_stats current = this -> stats;
+    current.images = this -> images.size();
+    return current;
+}
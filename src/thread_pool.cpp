@@ -0,0 +1,79 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+thread_pool::thread_pool(size_t thread_count): stopping(false) {
+    if (thread_count == 0) thread_count = hardwareThreads();
+    for (size_t i = 0; i < thread_count; i++)
+        this -> workers.emplace_back(&thread_pool::workerLoop, this);
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(this -> mutex);
+        this -> stopping = true;
+    }
+    this -> cond.notify_all();
+    for (auto &worker : this -> workers) worker.join();
+}
+
+size_t thread_pool::hardwareThreads() {
+    size_t count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+void thread_pool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(this -> mutex);
+        this -> tasks.push_back(std::move(task));
+    }
+    this -> cond.notify_one();
+}
+
+void thread_pool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(this -> mutex);
+            this -> cond.wait(lock, [this] { return this -> stopping || !this -> tasks.empty(); });
+            if (this -> stopping && this -> tasks.empty()) return;
+            task = std::move(this -> tasks.front());
+            this -> tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void thread_pool::parallel_for(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) return;
+    if (count == 1 || this -> workers.empty()) {
+        for (size_t i = 0; i < count; i++) body(i);
+        return;
+    }
+    // helpers that start after all items are taken return immediately,
+    // so the state has to outlive this call
+    struct shared_state {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable cond;
+    };
+    auto state = std::make_shared<shared_state>();
+    const std::function<void(size_t)> *fn = &body;
+    auto run = [state, fn, count]() {
+        size_t i;
+        while ((i = state -> next.fetch_add(1)) < count) {
+            (*fn)(i);
+            if (state -> done.fetch_add(1) + 1 == count) {
+                std::lock_guard<std::mutex> lock(state -> mutex);
+                state -> cond.notify_all();
+            }
+        }
+    };
+    size_t helpers = std::min(count - 1, this -> workers.size());
+    for (size_t i = 0; i < helpers; i++) this -> submit(run);
+    run();
+    std::unique_lock<std::mutex> lock(state -> mutex);
+    state -> cond.wait(lock, [&state, count] { return state -> done.load() == count; });
+}
@@ -0,0 +1,174 @@
+#include "transform_kernel.h"
+#include "vertex_format.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+vertex_transform makeVertexTransform(const glm::mat4 &transform) {
+    vertex_transform result;
+    // glm is column major, m[column][row]
+    glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) result.position[r][c] = transform[c][r];
+        for (int c = 0; c < 3; c++) result.normal[r][c] = normal_matrix[c][r];
+    }
+    return result;
+}
+
+void transformVerticesScalar(float *vertices, size_t count, size_t stride, const vertex_transform &t) {
+    for (size_t i = 0; i < count; i++, vertices += stride) {
+        float x = vertices[0], y = vertices[1], z = vertices[2];
+        float nx = vertices[3], ny = vertices[4], nz = vertices[5];
+        vertices[0] = t.position[0][0] * x + t.position[0][1] * y + t.position[0][2] * z + t.position[0][3];
+        vertices[1] = t.position[1][0] * x + t.position[1][1] * y + t.position[1][2] * z + t.position[1][3];
+        vertices[2] = t.position[2][0] * x + t.position[2][1] * y + t.position[2][2] * z + t.position[2][3];
+        float tx = t.normal[0][0] * nx + t.normal[0][1] * ny + t.normal[0][2] * nz;
+        float ty = t.normal[1][0] * nx + t.normal[1][1] * ny + t.normal[1][2] * nz;
+        float tz = t.normal[2][0] * nx + t.normal[2][1] * ny + t.normal[2][2] * nz;
+        float length2 = tx * tx + ty * ty + tz * tz;
+        float inv = length2 > 0.0f ? 1.0f / std::sqrt(length2) : 0.0f;
+        vertices[3] = tx * inv;
+        vertices[4] = ty * inv;
+        vertices[5] = tz * inv;
+    }
+}
+
+#ifdef TRANSFORM_KERNEL_X86
+
+// the simd kernels work on the canonical 8 float record: x y z nx ny nz u v,
+// a block of records is transposed so every register holds one component
+
+// 4 records per step, each split into two halves of 4 floats
+static void transformVerticesSSE(float *vertices, size_t count, const vertex_transform &t) {
+    const __m128 p00 = _mm_set1_ps(t.position[0][0]), p01 = _mm_set1_ps(t.position[0][1]), p02 = _mm_set1_ps(t.position[0][2]), p03 = _mm_set1_ps(t.position[0][3]);
+    const __m128 p10 = _mm_set1_ps(t.position[1][0]), p11 = _mm_set1_ps(t.position[1][1]), p12 = _mm_set1_ps(t.position[1][2]), p13 = _mm_set1_ps(t.position[1][3]);
+    const __m128 p20 = _mm_set1_ps(t.position[2][0]), p21 = _mm_set1_ps(t.position[2][1]), p22 = _mm_set1_ps(t.position[2][2]), p23 = _mm_set1_ps(t.position[2][3]);
+    const __m128 n00 = _mm_set1_ps(t.normal[0][0]), n01 = _mm_set1_ps(t.normal[0][1]), n02 = _mm_set1_ps(t.normal[0][2]);
+    const __m128 n10 = _mm_set1_ps(t.normal[1][0]), n11 = _mm_set1_ps(t.normal[1][1]), n12 = _mm_set1_ps(t.normal[1][2]);
+    const __m128 n20 = _mm_set1_ps(t.normal[2][0]), n21 = _mm_set1_ps(t.normal[2][1]), n22 = _mm_set1_ps(t.normal[2][2]);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    size_t blocks = count / 4;
+    for (size_t b = 0; b < blocks; b++, vertices += 32) {
+        // x y z nx
+        __m128 a0 = _mm_loadu_ps(vertices), a1 = _mm_loadu_ps(vertices + 8), a2 = _mm_loadu_ps(vertices + 16), a3 = _mm_loadu_ps(vertices + 24);
+        // ny nz u v
+        __m128 b0 = _mm_loadu_ps(vertices + 4), b1 = _mm_loadu_ps(vertices + 12), b2 = _mm_loadu_ps(vertices + 20), b3 = _mm_loadu_ps(vertices + 28);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p00, a0), _mm_mul_ps(p01, a1)), _mm_add_ps(_mm_mul_ps(p02, a2), p03));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p10, a0), _mm_mul_ps(p11, a1)), _mm_add_ps(_mm_mul_ps(p12, a2), p13));
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p20, a0), _mm_mul_ps(p21, a1)), _mm_add_ps(_mm_mul_ps(p22, a2), p23));
+        __m128 nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n00, a3), _mm_mul_ps(n01, b0)), _mm_mul_ps(n02, b1));
+        __m128 ny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n10, a3), _mm_mul_ps(n11, b0)), _mm_mul_ps(n12, b1));
+        __m128 nz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n20, a3), _mm_mul_ps(n21, b0)), _mm_mul_ps(n22, b1));
+        __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+        __m128 inv = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(length2)), _mm_cmpgt_ps(length2, zero));
+        a0 = x; a1 = y; a2 = z; a3 = _mm_mul_ps(nx, inv);
+        b0 = _mm_mul_ps(ny, inv); b1 = _mm_mul_ps(nz, inv);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        _mm_storeu_ps(vertices, a0); _mm_storeu_ps(vertices + 8, a1); _mm_storeu_ps(vertices + 16, a2); _mm_storeu_ps(vertices + 24, a3);
+        _mm_storeu_ps(vertices + 4, b0); _mm_storeu_ps(vertices + 12, b1); _mm_storeu_ps(vertices + 20, b2); _mm_storeu_ps(vertices + 28, b3);
+    }
+    transformVerticesScalar(vertices, count - blocks * 4, VBO_FLOATS_PER_VERTEX, t);
+}
+
+__attribute__((target("avx2,fma")))
+static inline void transpose8(__m256 &r0, __m256 &r1, __m256 &r2, __m256 &r3, __m256 &r4, __m256 &r5, __m256 &r6, __m256 &r7) {
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)), s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)), s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    r0 = _mm256_permute2f128_ps(s0, s4, 0x20); r4 = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r1 = _mm256_permute2f128_ps(s1, s5, 0x20); r5 = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r2 = _mm256_permute2f128_ps(s2, s6, 0x20); r6 = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r3 = _mm256_permute2f128_ps(s3, s7, 0x20); r7 = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+// 8 records per step, one record per register before the transpose
+__attribute__((target("avx2,fma")))
+static void transformVerticesAVX2(float *vertices, size_t count, const vertex_transform &t) {
+    const __m256 p00 = _mm256_set1_ps(t.position[0][0]), p01 = _mm256_set1_ps(t.position[0][1]), p02 = _mm256_set1_ps(t.position[0][2]), p03 = _mm256_set1_ps(t.position[0][3]);
+    const __m256 p10 = _mm256_set1_ps(t.position[1][0]), p11 = _mm256_set1_ps(t.position[1][1]), p12 = _mm256_set1_ps(t.position[1][2]), p13 = _mm256_set1_ps(t.position[1][3]);
+    const __m256 p20 = _mm256_set1_ps(t.position[2][0]), p21 = _mm256_set1_ps(t.position[2][1]), p22 = _mm256_set1_ps(t.position[2][2]), p23 = _mm256_set1_ps(t.position[2][3]);
+    const __m256 n00 = _mm256_set1_ps(t.normal[0][0]), n01 = _mm256_set1_ps(t.normal[0][1]), n02 = _mm256_set1_ps(t.normal[0][2]);
+    const __m256 n10 = _mm256_set1_ps(t.normal[1][0]), n11 = _mm256_set1_ps(t.normal[1][1]), n12 = _mm256_set1_ps(t.normal[1][2]);
+    const __m256 n20 = _mm256_set1_ps(t.normal[2][0]), n21 = _mm256_set1_ps(t.normal[2][1]), n22 = _mm256_set1_ps(t.normal[2][2]);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    size_t blocks = count / 8;
+    for (size_t b = 0; b < blocks; b++, vertices += 64) {
+        __m256 r0 = _mm256_loadu_ps(vertices), r1 = _mm256_loadu_ps(vertices + 8);
+        __m256 r2 = _mm256_loadu_ps(vertices + 16), r3 = _mm256_loadu_ps(vertices + 24);
+        __m256 r4 = _mm256_loadu_ps(vertices + 32), r5 = _mm256_loadu_ps(vertices + 40);
+        __m256 r6 = _mm256_loadu_ps(vertices + 48), r7 = _mm256_loadu_ps(vertices + 56);
+        transpose8(r0, r1, r2, r3, r4, r5, r6, r7);
+        __m256 x = _mm256_fmadd_ps(p00, r0, _mm256_fmadd_ps(p01, r1, _mm256_fmadd_ps(p02, r2, p03)));
+        __m256 y = _mm256_fmadd_ps(p10, r0, _mm256_fmadd_ps(p11, r1, _mm256_fmadd_ps(p12, r2, p13)));
+        __m256 z = _mm256_fmadd_ps(p20, r0, _mm256_fmadd_ps(p21, r1, _mm256_fmadd_ps(p22, r2, p23)));
+        __m256 nx = _mm256_fmadd_ps(n00, r3, _mm256_fmadd_ps(n01, r4, _mm256_mul_ps(n02, r5)));
+        __m256 ny = _mm256_fmadd_ps(n10, r3, _mm256_fmadd_ps(n11, r4, _mm256_mul_ps(n12, r5)));
+        __m256 nz = _mm256_fmadd_ps(n20, r3, _mm256_fmadd_ps(n21, r4, _mm256_mul_ps(n22, r5)));
+        __m256 length2 = _mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz)));
+        __m256 inv = _mm256_and_ps(_mm256_div_ps(one, _mm256_sqrt_ps(length2)), _mm256_cmp_ps(length2, zero, _CMP_GT_OQ));
+        r0 = x; r1 = y; r2 = z;
+        r3 = _mm256_mul_ps(nx, inv); r4 = _mm256_mul_ps(ny, inv); r5 = _mm256_mul_ps(nz, inv);
+        transpose8(r0, r1, r2, r3, r4, r5, r6, r7);
+        _mm256_storeu_ps(vertices, r0); _mm256_storeu_ps(vertices + 8, r1);
+        _mm256_storeu_ps(vertices + 16, r2); _mm256_storeu_ps(vertices + 24, r3);
+        _mm256_storeu_ps(vertices + 32, r4); _mm256_storeu_ps(vertices + 40, r5);
+        _mm256_storeu_ps(vertices + 48, r6); _mm256_storeu_ps(vertices + 56, r7);
+    }
+    transformVerticesScalar(vertices, count - blocks * 8, VBO_FLOATS_PER_VERTEX, t);
+}
+
+enum transform_kernel_kind { KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2 };
+
+static transform_kernel_kind detectKernel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse2")) return KERNEL_SSE;
+    return KERNEL_SCALAR;
+}
+
+static transform_kernel_kind selectedKernel() {
+    static const transform_kernel_kind kind = detectKernel();
+    return kind;
+}
+
+void transformVertices(float *vertices, size_t count, size_t stride, const vertex_transform &transform) {
+    if (stride == VBO_FLOATS_PER_VERTEX) {
+        switch (selectedKernel()) {
+            case KERNEL_AVX2: transformVerticesAVX2(vertices, count, transform); return;
+            case KERNEL_SSE: transformVerticesSSE(vertices, count, transform); return;
+            default: break;
+        }
+    }
+    transformVerticesScalar(vertices, count, stride, transform);
+}
+
+const char *transformKernelName() {
+    switch (selectedKernel()) {
+        case KERNEL_AVX2: return "avx2";
+        case KERNEL_SSE: return "sse";
+        default: return "scalar";
+    }
+}
+
+#else
+
+void transformVertices(float *vertices, size_t count, size_t stride, const vertex_transform &transform) {
+    transformVerticesScalar(vertices, count, stride, transform);
+}
+
+const char *transformKernelName() {
+    return "scalar";
+}
+
+#endif
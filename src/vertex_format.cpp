@@ -0,0 +1,146 @@
+#include "vertex_format.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+static size_t encodingSize(vertex_encoding encoding, size_t float_components) {
+    switch (encoding) {
+        case VERTEX_FLOAT32: return float_components * sizeof(float);
+        // xyz plus padding to keep attributes 4 byte aligned
+        case VERTEX_QUANT16: return 4 * sizeof(int16_t);
+        case VERTEX_OCT16: return 2 * sizeof(int16_t);
+        case VERTEX_OCT8: return 4 * sizeof(int8_t);
+        case VERTEX_HALF: return 2 * sizeof(uint16_t);
+        default: return 0;
+    }
+}
+
+size_t vertex_format::stride() const {
+    return encodingSize(this -> position, 3) + encodingSize(this -> normal, 3) + encodingSize(this -> texcoord, 2);
+}
+
+std::vector<vertex_attribute> vertex_format::attributes() const {
+    std::vector<vertex_attribute> result;
+    size_t offset = 0;
+    const vertex_encoding encodings[3] = {this -> position, this -> normal, this -> texcoord};
+    const unsigned float_components[3] = {3, 3, 2};
+    for (unsigned i = 0; i < 3; i++) {
+        if (encodings[i] == VERTEX_NONE) continue;
+        vertex_attribute attr;
+        attr.location = i;
+        attr.offset = offset;
+        switch (encodings[i]) {
+            case VERTEX_QUANT16: attr.components = 3; attr.type = COMPONENT_SHORT; break;
+            case VERTEX_OCT16: attr.components = 2; attr.type = COMPONENT_SHORT; break;
+            case VERTEX_OCT8: attr.components = 2; attr.type = COMPONENT_BYTE; break;
+            case VERTEX_HALF: attr.components = 2; attr.type = COMPONENT_HALF; break;
+            default: attr.components = float_components[i]; attr.type = COMPONENT_FLOAT; break;
+        }
+        result.push_back(attr);
+        offset += encodingSize(encodings[i], float_components[i]);
+    }
+    return result;
+}
+
+float vertex_format::normalScale() const {
+    if (this -> normal == VERTEX_OCT16) return 1.0f / 32767.0f;
+    if (this -> normal == VERTEX_OCT8) return 1.0f / 127.0f;
+    return 0.0f;
+}
+
+position_dequant computeDequant(const float *vertices, size_t count, const vertex_format& format) {
+    position_dequant dequant;
+    if (format.position != VERTEX_QUANT16 || count == 0) return dequant;
+    glm::vec3 lo(vertices[0], vertices[1], vertices[2]), hi = lo;
+    for (size_t i = 1; i < count; i++) {
+        const float *p = vertices + i * VBO_FLOATS_PER_VERTEX;
+        lo = glm::min(lo, glm::vec3(p[0], p[1], p[2]));
+        hi = glm::max(hi, glm::vec3(p[0], p[1], p[2]));
+    }
+    dequant.offset = (lo + hi) * 0.5f;
+    dequant.scale = (hi - lo) * (0.5f / 32767.0f);
+    return dequant;
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (((bits >> 23) & 0xff) == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31) return sign | 0x7c00;
+    if (exponent <= 0) {
+        // subnormal half or zero
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return sign | half;
+    }
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    // round to nearest even, a carry into the exponent is still correct
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return sign | half;
+}
+
+static int16_t quantizeSigned16(float value) {
+    return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+static int8_t quantizeSigned8(float value) {
+    return (int8_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 127.0f);
+}
+
+void packVertices(const float *vertices, size_t count, const vertex_format& format, const position_dequant& dequant, unsigned char *out) {
+    size_t stride = format.stride();
+    glm::vec3 inv_scale(0.0f);
+    for (int k = 0; k < 3; k++) inv_scale[k] = dequant.scale[k] > 0.0f ? 1.0f / (dequant.scale[k] * 32767.0f) : 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        const float *v = vertices + i * VBO_FLOATS_PER_VERTEX;
+        unsigned char *dst = out + i * stride;
+        if (format.position == VERTEX_FLOAT32) {
+            memcpy(dst, v, 3 * sizeof(float));
+            dst += 3 * sizeof(float);
+        } else if (format.position == VERTEX_QUANT16) {
+            int16_t q[4] = {0, 0, 0, 0};
+            for (int k = 0; k < 3; k++) q[k] = quantizeSigned16((v[k] - dequant.offset[k]) * inv_scale[k]);
+            memcpy(dst, q, sizeof(q));
+            dst += sizeof(q);
+        }
+        if (format.normal == VERTEX_FLOAT32) {
+            memcpy(dst, v + 3, 3 * sizeof(float));
+            dst += 3 * sizeof(float);
+        } else if (format.normal == VERTEX_OCT16 || format.normal == VERTEX_OCT8) {
+            // project onto the octahedron and fold the lower half over the diagonals
+            float len = std::fabs(v[3]) + std::fabs(v[4]) + std::fabs(v[5]);
+            float x = len > 0.0f ? v[3] / len : 0.0f;
+            float y = len > 0.0f ? v[4] / len : 0.0f;
+            if (v[5] < 0.0f) {
+                float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = fx;
+                y = fy;
+            }
+            if (format.normal == VERTEX_OCT16) {
+                int16_t q[2] = {quantizeSigned16(x), quantizeSigned16(y)};
+                memcpy(dst, q, sizeof(q));
+                dst += sizeof(q);
+            } else {
+                int8_t q[4] = {quantizeSigned8(x), quantizeSigned8(y), 0, 0};
+                memcpy(dst, q, sizeof(q));
+                dst += sizeof(q);
+            }
+        }
+        if (format.texcoord == VERTEX_FLOAT32) {
+            memcpy(dst, v + 6, 2 * sizeof(float));
+        } else if (format.texcoord == VERTEX_HALF) {
+            uint16_t h[2] = {floatToHalf(v[6]), floatToHalf(v[7])};
+            memcpy(dst, h, sizeof(h));
+        }
+    }
+}
@@ -0,0 +1,248 @@
+// headless batch converter: loads .obj files on a shared thread pool and writes
+// them back as triangulated .obj/.mtl or as binary mesh caches
+#include "obj_loader.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum output_format {
+    OUTPUT_NONE,
+    OUTPUT_OBJ,
+    OUTPUT_CACHE,
+};
+
+struct convert_options {
+    std::string output_dir;
+    output_format format = OUTPUT_NONE;
+    bool indexed = false;
+    bool flat_normals = false;
+    bool smooth_normals = false;
+    float crease_angle = 60.0f;
+    size_t threads = 0;
+    size_t max_memory = size_t(2048) << 20;
+};
+
+struct convert_job {
+    std::string input;
+    // output path relative to the output directory, without extension
+    std::string relative;
+    size_t file_size = 0;
+    // false if the size could not be read, the job is reported failed without a load
+    bool readable = true;
+    bool ok = false;
+    size_t triangles = 0;
+    size_t vertices = 0;
+    double load_ms = 0.0;
+    double write_ms = 0.0;
+    double wait_ms = 0.0;
+};
+
+// rough peak memory of a load per byte of .obj text: parsed arrays, the vbo and the dedup table
+const size_t memory_per_file_byte = 8;
+
+// caps the estimated memory of the meshes being converted at once,
+// a mesh larger than the whole budget still runs, but alone
+class memory_gate {
+public:
+    explicit memory_gate(size_t limit): limit(limit), in_flight(0) {}
+    void acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(this -> mutex);
+        this -> cond.wait(lock, [&] { return this -> in_flight == 0 || this -> in_flight + bytes <= this -> limit; });
+        this -> in_flight += bytes;
+    }
+    void release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(this -> mutex);
+            this -> in_flight -= bytes;
+        }
+        this -> cond.notify_all();
+    }
+private:
+    size_t limit;
+    size_t in_flight;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+static double elapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void printUsage(const char *name) {
+    std::cerr << "usage: " << name << " [options] <file.obj | directory>...\n"
+        << "  -o <dir>             output directory, required with --format\n"
+        << "  --format obj|cache   write triangulated .obj/.mtl files or binary mesh caches\n"
+        << "  --indexed            deduplicate vertices and build index buffers\n"
+        << "  --flat-normals       replace the normals with face normals\n"
+        << "  --smooth-normals     give faces without normals smooth ones instead of face normals\n"
+        << "  --crease <degrees>   sharpest edge still smoothed by --smooth-normals (default 60)\n"
+        << "  -j <threads>         threads including the main one, 0 = all (default)\n"
+        << "  --max-memory <MB>    estimated memory of the meshes in flight (default 2048)\n"
+        << "without --format the files are only loaded and timed" << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, convert_options &options, std::vector<std::string> &inputs) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            options.output_dir = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "obj") options.format = OUTPUT_OBJ;
+            else if (format == "cache") options.format = OUTPUT_CACHE;
+            else return false;
+        } else if (arg == "--indexed") {
+            options.indexed = true;
+        } else if (arg == "--flat-normals") {
+            options.flat_normals = true;
+        } else if (arg == "--smooth-normals") {
+            options.smooth_normals = true;
+        } else if (arg == "--crease" && i + 1 < argc) {
+            options.crease_angle = std::strtof(argv[++i], NULL);
+        } else if (arg == "-j" && i + 1 < argc) {
+            options.threads = std::strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--max-memory" && i + 1 < argc) {
+            options.max_memory = std::strtoull(argv[++i], NULL, 10) << 20;
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    return !inputs.empty() && (options.format == OUTPUT_NONE || !options.output_dir.empty());
+}
+
+// files are taken as given, directories are searched for .obj files recursively
+// and keep their layout below the output directory
+static void addJob(const fs::path &input, const std::string &relative, std::vector<convert_job> &jobs) {
+    convert_job job;
+    job.input = input.string();
+    job.relative = relative;
+    std::error_code error;
+    uintmax_t size = fs::file_size(input, error);
+    if (error) {
+        std::cerr << "Cannot open file: " << job.input << std::endl;
+        job.readable = false;
+    } else {
+        job.file_size = size;
+    }
+    jobs.push_back(job);
+}
+
+static void collectJobs(const std::vector<std::string> &inputs, std::vector<convert_job> &jobs) {
+    for (const std::string &input : inputs) {
+        std::error_code error;
+        if (fs::is_directory(input, error)) {
+            for (auto it = fs::recursive_directory_iterator(input, error); !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+                if (!it -> is_regular_file(error) || it -> path().extension() != ".obj") continue;
+                addJob(it -> path(), fs::relative(it -> path(), input).replace_extension().string(), jobs);
+            }
+        } else {
+            addJob(input, fs::path(input).stem().string(), jobs);
+        }
+    }
+}
+
+static void convert(convert_job &job, const convert_options &options, thread_pool &pool, memory_gate &gate) {
+    size_t estimate = job.file_size * memory_per_file_byte;
+    auto start = std::chrono::steady_clock::now();
+    gate.acquire(estimate);
+    job.wait_ms = elapsedSince(start);
+
+    fs::path output = fs::path(options.output_dir) / job.relative;
+    std::error_code error;
+    if (options.format != OUTPUT_NONE) fs::create_directories(output.parent_path(), error);
+
+    {
+        // the loader is gone before its memory is handed to the next mesh
+        objLoader loader;
+        loader.setThreadPool(&pool);
+        loader.setIndexed(options.indexed);
+        loader.setFlatNormals(options.flat_normals);
+        loader.setSmoothNormals(options.smooth_normals);
+        loader.setCreaseAngle(options.crease_angle);
+        loader.setReleaseSource(true);
+        if (options.format == OUTPUT_CACHE) {
+            // the cache is written by the load itself, under the name a loader with this cache dir looks for
+            loader.setCacheEnabled(true);
+            loader.setCacheDir(output.parent_path().string());
+        }
+        start = std::chrono::steady_clock::now();
+        job.ok = loader.load(job.input);
+        job.load_ms = elapsedSince(start);
+        if (job.ok) {
+            job.triangles = loader.isIndexed() ? loader.getIndexCount() / 3 : loader.getVertexCount() / 3;
+            job.vertices = loader.getVertexCount();
+            if (options.format == OUTPUT_OBJ) {
+                start = std::chrono::steady_clock::now();
+                job.ok = loader.save(output.string() + ".obj");
+                job.write_ms = elapsedSince(start);
+            }
+        }
+    }
+    gate.release(estimate);
+}
+
+int main(int argc, char **argv) {
+    convert_options options;
+    std::vector<std::string> inputs;
+    if (!parseOptions(argc, argv, options, inputs)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    std::vector<convert_job> jobs;
+    collectJobs(inputs, jobs);
+    if (jobs.empty()) {
+        std::cerr << "No .obj files found" << std::endl;
+        return 1;
+    }
+
+    // the caller of parallel_for works too, so the pool gets one thread less,
+    // a single thread converts the files in turn (a pool of 0 would mean all threads)
+    size_t threads = options.threads == 0 ? thread_pool::hardwareThreads() : options.threads;
+    thread_pool pool(std::max<size_t>(1, threads - 1));
+    memory_gate gate(options.max_memory);
+    // largest files first so a big one does not start last, loaders share the pool
+    // and idle threads pick up the chunks of the files still being parsed
+    std::vector<size_t> order;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i].readable) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].file_size > jobs[b].file_size; });
+    auto start = std::chrono::steady_clock::now();
+    auto body = [&](size_t i) {
+        convert(jobs[order[i]], options, pool, gate);
+    };
+    if (threads == 1) {
+        for (size_t i = 0; i < order.size(); i++) body(i);
+    } else {
+        pool.parallel_for(order.size(), body);
+    }
+    double wall_ms = elapsedSince(start);
+
+    size_t failed = 0, bytes = 0, triangles = 0;
+    double busy_ms = 0.0;
+    printf("%10s %10s %10s %10s %10s %10s %10s  %s\n", "MB", "triangles", "vertices", "wait ms", "load ms", "write ms", "total ms", "file");
+    for (const convert_job &job : jobs) {
+        double total_ms = job.load_ms + job.write_ms;
+        printf("%10.2f %10zu %10zu %10.2f %10.2f %10.2f %10.2f  %s%s\n", job.file_size / 1e6, job.triangles, job.vertices,
+            job.wait_ms, job.load_ms, job.write_ms, total_ms, job.input.c_str(), job.ok ? "" : "  FAILED");
+        if (!job.ok) failed++;
+        bytes += job.file_size;
+        triangles += job.triangles;
+        busy_ms += total_ms;
+    }
+    printf("%zu files, %zu failed, %.2f MB, %zu triangles, %.2f ms on %zu threads (%.2f ms of work, %.1f MB/s)\n",
+        jobs.size(), failed, bytes / 1e6, triangles, wall_ms, threads, busy_ms, wall_ms > 0.0 ? bytes / 1e3 / wall_ms : 0.0);
+    return failed == 0 ? 0 : 1;
+}